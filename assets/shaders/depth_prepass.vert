@@ -0,0 +1,19 @@
+#version 450
+
+// Position only stream of the geometry pool, snorm16 like the position of CompactVertex3d
+layout(location = 0) in vec4 in_position;
+// Per instance, locations 1 to 4. The material at location 5 isn't needed for depth.
+layout(location = 1) in mat4 in_model;
+
+layout(set = 0, binding = 0) uniform global_uniform_object {
+    mat4 projection;
+    mat4 view;
+} global_ubo;
+
+// The shading pass tests for equal depth, so both have to compute the position identically
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = global_ubo.projection * global_ubo.view * in_model * vec4(in_position.xyz, 1.0);
+}
@@ -2,9 +2,17 @@
 
 layout(location = 0) out vec4 out_color;
 
-layout(set = 1, binding = 0) uniform local_uniform_object {
+struct LocalUniformObject {
     vec4 diffuse_color;
-} object_ubo;
+    vec4 _reserved0;
+    vec4 _reserved1;
+    vec4 _reserved2;
+};
+
+// Uniforms of every object, indexed by the material of the instance
+layout(std430, set = 1, binding = 0) readonly buffer local_uniform_objects {
+    LocalUniformObject objects[];
+} object_buffer;
 
 layout(set = 1, binding = 1) uniform sampler2D diffuse_sampler;
 
@@ -12,7 +20,9 @@ layout(location = 1) in struct dto {
     vec2 tex_coord;
 } in_dto;
 
+layout(location = 2) flat in uint in_material;
+
 void main()
 {
-    out_color = object_ubo.diffuse_color * texture(diffuse_sampler, in_dto.tex_coord);
+    out_color = object_buffer.objects[in_material].diffuse_color * texture(diffuse_sampler, in_dto.tex_coord);
 }
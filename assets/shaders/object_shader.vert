@@ -1,25 +1,47 @@
 #version 450
 
-layout(location = 0) in vec3 in_position;
+// CompactVertex3d. The position is normalized to the mesh's bounds, the model matrix includes the dequantization.
+layout(location = 0) in vec4 in_position;
 layout(location = 1) in vec2 in_texcoord;
+// Octahedral encoded
+layout(location = 2) in vec2 in_normal;
+// Per instance, locations 3 to 6, then the material with its index in x
+layout(location = 3) in mat4 in_model;
+layout(location = 7) in uvec4 in_material;
 
 layout(set = 0, binding = 0) uniform global_uniform_object {
     mat4 projection;
     mat4 view;
 } global_ubo;
 
-layout(push_constant) uniform push_constants {
-    mat4 model;
-} u_push_constants;
-
 layout(location = 0) out int out_mode;
 
 layout(location = 1) out struct dto {
     vec2 tex_coord;
 } out_dto;
 
+layout(location = 2) flat out uint out_material;
+// World space
+layout(location = 3) out vec3 out_normal;
+
+// Must match the depth pre-pass, which is tested against with equal depth
+invariant gl_Position;
+
+// Mirrors octahedral_decode in vertex.hpp
+vec3 octahedral_decode(vec2 encoded)
+{
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float t = max(-normal.z, 0.0);
+    normal.x += normal.x >= 0.0 ? -t : t;
+    normal.y += normal.y >= 0.0 ? -t : t;
+    return normalize(normal);
+}
+
 void main()
 {
     out_dto.tex_coord = in_texcoord;
-    gl_Position = global_ubo.projection * global_ubo.view * u_push_constants.model * vec4(in_position, 1.0);
-}
\ No newline at end of file
+    out_material = in_material.x;
+    // The dequantization only scales uniformly, so the model matrix keeps the normal's direction
+    out_normal = normalize(mat3(in_model) * octahedral_decode(in_normal));
+    gl_Position = global_ubo.projection * global_ubo.view * in_model * vec4(in_position.xyz, 1.0);
+}
@@ -0,0 +1,38 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform sampler2D source;
+
+layout(location = 0) in vec2 in_uv;
+layout(location = 1) flat in vec2 in_uv_min;
+layout(location = 2) flat in vec2 in_uv_max;
+layout(location = 3) flat in vec2 in_texel_size;
+layout(location = 4) flat in float in_sharpness;
+
+layout(location = 0) out vec4 out_color;
+
+vec3 tap(vec2 uv)
+{
+    return texture(source, clamp(uv, in_uv_min, in_uv_max)).rgb;
+}
+
+void main()
+{
+    vec3 center = tap(in_uv);
+    if (in_sharpness <= 0.0)
+    {
+        out_color = vec4(center, 1.0);
+        return;
+    }
+
+    vec3 north = tap(in_uv - vec2(0.0, in_texel_size.y));
+    vec3 south = tap(in_uv + vec2(0.0, in_texel_size.y));
+    vec3 west = tap(in_uv - vec2(in_texel_size.x, 0.0));
+    vec3 east = tap(in_uv + vec2(in_texel_size.x, 0.0));
+
+    // Unsharp mask of the bilinear result, kept within the neighbourhood so edges don't ring
+    vec3 sharpened = center + in_sharpness * (4.0 * center - (north + south + west + east)) * 0.25;
+    vec3 low = min(center, min(min(north, south), min(west, east)));
+    vec3 high = max(center, max(max(north, south), max(west, east)));
+
+    out_color = vec4(clamp(sharpened, low, high), 1.0);
+}
@@ -0,0 +1,29 @@
+#version 450
+
+// Matches VulkanUpscaler::UpscaleConstants
+layout(push_constant) uniform upscale_constants {
+    // Rendered part of the source, in uv coordinates
+    vec2 uv_scale;
+    vec2 texel_size;
+    float sharpness;
+} u_upscale;
+
+layout(location = 0) out vec2 out_uv;
+layout(location = 1) flat out vec2 out_uv_min;
+layout(location = 2) flat out vec2 out_uv_max;
+layout(location = 3) flat out vec2 out_texel_size;
+layout(location = 4) flat out float out_sharpness;
+
+void main()
+{
+    // One triangle that covers the target, the parts outside of it are clipped
+    vec2 position = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+
+    out_uv = position * u_upscale.uv_scale;
+    // Bilinear taps stay half a texel inside the rendered part, the rest of the source is stale
+    out_uv_min = 0.5 * u_upscale.texel_size;
+    out_uv_max = u_upscale.uv_scale - 0.5 * u_upscale.texel_size;
+    out_texel_size = u_upscale.texel_size;
+    out_sharpness = u_upscale.sharpness;
+}
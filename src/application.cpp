@@ -2,12 +2,35 @@
 
 #include "application.hpp"
 
+#include "core/allocation_tracker.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
 namespace flwfrg
 {
 
+///// Local helper functions
+
+namespace
+{
+
+glm::mat4 interpolated_view(const Application::SimulationState &previous, const Application::SimulationState &current, float alpha)
+{
+	const glm::vec3 position = glm::mix(previous.camera_position, current.camera_position, alpha);
+	const glm::quat orientation = glm::slerp(previous.camera_orientation, current.camera_orientation, alpha);
+
+	// The view is the inverse of the camera's transform
+	return glm::mat4_cast(glm::conjugate(orientation)) * glm::translate(glm::mat4(1.0f), -position);
+}
+
+}// namespace
+
+///// Method implementations
+
 Application::Application()
 {
-	
+	renderer_.set_job_system(&job_system_);
+	renderer_.set_render_thread(true);
 }
 
 
@@ -19,14 +42,87 @@ void Application::run()
 {
 	while (!renderer_.should_close())
 	{
-		if (!renderer_.begin_frame(0.01f))
-			continue;
+		frame();
+	}
+
+	if constexpr (AllocationTracker::enabled)
+		AllocationTracker::write_report("allocation_report.json");
+}
+
+bool Application::run_allocation_check(uint32_t warmup_frames, uint32_t checked_frames)
+{
+	if constexpr (!AllocationTracker::enabled)
+	{
+		FLOWFORGE_ERROR("The allocation check needs a build configured with FLOWFORGE_ALLOCATION_TRACKING");
+		return false;
+	}
+
+	// Frames are closed by the render thread, count them there instead of counting submitted frames
+	AllocationTracker::set_steady_state_check(true, warmup_frames);
+	const uint64_t first_frame = AllocationTracker::last_frame().frame;
+	const uint64_t frame_count = static_cast<uint64_t>(warmup_frames) + checked_frames;
+	while (!renderer_.should_close() && AllocationTracker::last_frame().frame - first_frame <= frame_count)
+	{
+		frame();
+	}
+	const bool completed = AllocationTracker::last_frame().frame - first_frame > frame_count;
+	AllocationTracker::set_steady_state_check(false);
+
+	const uint64_t violations = AllocationTracker::steady_state_violations();
+	AllocationTracker::write_report("allocation_report.json");
+	if (!completed)
+	{
+		FLOWFORGE_ERROR("Allocation check stopped before {} frames were rendered", frame_count);
+		return false;
+	}
+
+	FLOWFORGE_INFO("Allocation check: {} of {} steady state frames allocated", violations, checked_frames);
+	return violations == 0;
+}
 
-		renderer_.update_global_state(glm::mat4(1.0f), glm::mat4(1.0f));
+void Application::set_fixed_step(bool enabled, double step_seconds)
+{
+	fixed_step_enabled_ = enabled;
+	fixed_step_ = FixedTimestep{step_seconds};
+	previous_state_ = current_state_;
+}
+
+///// Private methods
+
+void Application::frame()
+{
+	// Jobs that touch GLFW or other main thread only state
+	job_system_.run_main_thread_jobs();
 
-		
-		renderer_.end_frame();
+	const double delta_time = clock_.tick();
+	if (!renderer_.begin_frame(static_cast<float>(delta_time)))
+		return;
+
+	float alpha = 1.0f;
+	if (fixed_step_enabled_)
+	{
+		for (uint32_t steps = fixed_step_.advance(delta_time); steps > 0; steps--)
+		{
+			previous_state_ = current_state_;
+			simulate(fixed_step_.step());
+		}
+		alpha = fixed_step_.alpha();
 	}
+	else
+	{
+		previous_state_ = current_state_;
+		simulate(delta_time);
+	}
+
+	renderer_.update_global_state(glm::mat4(1.0f), interpolated_view(previous_state_, current_state_, alpha));
+
+	
+	renderer_.end_frame();
+}
+
+void Application::simulate([[maybe_unused]] double delta_seconds)
+{
+	// Game logic advances current_state_ here
 }
 
 }// namespace flwfrg
@@ -1,20 +1,51 @@
 #pragma once
 
+#include "core/clock.hpp"
+#include "core/job_system.hpp"
 #include "renderer/vulkan/renderer.hpp"
 
+#include <glm/gtc/quaternion.hpp>
+
 namespace flwfrg
 {
 
 class Application
 {
+public:
+	// State advanced by the fixed simulation step, rendered between the last two steps
+	struct SimulationState
+	{
+		glm::vec3 camera_position{0.0f};
+		glm::quat camera_orientation{1.0f, 0.0f, 0.0f, 0.0f};
+	};
+
 public:
 	Application();
 	~Application();
 
 	void run();
+	// Runs warmup_frames and then checked_frames more with the steady state allocation check on, and writes the
+	// allocation report. Returns false if a checked frame allocated or the window closed first. Only builds with
+	// allocation tracking can pass it.
+	bool run_allocation_check(uint32_t warmup_frames, uint32_t checked_frames);
+
+	// Simulates in steps of fixed length and interpolates what is rendered, otherwise steps by the frame time
+	void set_fixed_step(bool enabled, double step_seconds = 1.0 / 60.0);
 
 private:
+	// Declared first so it outlives everything that submits jobs to it
+	JobSystem job_system_{};
 	VulkanRenderer renderer_{1280, 800, "TestName"};
+
+	FrameClock clock_{};
+	FixedTimestep fixed_step_{};
+	bool fixed_step_enabled_ = false;
+	SimulationState previous_state_{};
+	SimulationState current_state_{};
+
+	// Simulates and renders one frame
+	void frame();
+	void simulate(double delta_seconds);
 };
 
-}// namespace flwfrg
\ No newline at end of file
+}// namespace flwfrg
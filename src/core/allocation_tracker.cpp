@@ -0,0 +1,555 @@
+#include "pch.hpp"
+
+#include "allocation_tracker.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <dbghelp.h>
+#include <malloc.h>
+#pragma comment(lib, "dbghelp.lib")
+#elif __has_include(<execinfo.h>)
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#define FLOWFORGE_HAS_EXECINFO 1
+#endif
+
+namespace flwfrg
+{
+
+///// Local helper functions
+
+namespace
+{
+
+// Open addressed table of call stacks, a slot is claimed by swapping the hash of its stack in and never moves within a frame.
+// Everything here is constant initialized, operator new may run before any constructor.
+constexpr size_t site_table_bits = 12;
+constexpr size_t site_table_size = size_t{1} << site_table_bits;
+constexpr size_t site_probe_limit = 16;
+
+struct SiteSlot
+{
+	std::atomic<uint64_t> key;
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> bytes;
+	// Written by the thread that claimed the slot
+	std::atomic<uint32_t> frame_count;
+	std::atomic<uintptr_t> frames[AllocationSite::max_frames];
+};
+
+SiteSlot sites_s[site_table_size]{};
+
+std::atomic<uint64_t> allocations_s = 0;
+std::atomic<uint64_t> frees_s = 0;
+std::atomic<uint64_t> bytes_s = 0;
+std::atomic<uint64_t> vulkan_allocations_s = 0;
+std::atomic<uint64_t> vulkan_bytes_s = 0;
+std::atomic<uint64_t> unattributed_s = 0;
+
+// Set while a thread walks its stack, the walk may allocate the first time it runs
+thread_local bool capturing_s = false;
+
+// Guards everything below, only taken once per frame and by readers
+std::mutex mutex_s{};
+AllocationStatistics last_frame_s{};
+AllocationStatistics totals_s{};
+uint64_t frame_s = 0;
+bool check_s = false;
+uint32_t warmup_frames_s = 0;
+uint32_t frames_since_warmup_s = 0;
+uint64_t violations_s = 0;
+
+uint32_t capture_stack(uintptr_t (&frames)[AllocationSite::max_frames])
+{
+#if defined(_WIN32)
+	void *addresses[AllocationSite::max_frames];
+	const auto count = static_cast<uint32_t>(CaptureStackBackTrace(0, AllocationSite::max_frames, addresses, nullptr));
+#elif defined(FLOWFORGE_HAS_EXECINFO)
+	void *addresses[AllocationSite::max_frames];
+	const auto count = static_cast<uint32_t>(std::max(backtrace(addresses, AllocationSite::max_frames), 0));
+#else
+	void *addresses[1];
+	const uint32_t count = 0;
+#endif
+	for (uint32_t i = 0; i < count; i++)
+	{
+		frames[i] = reinterpret_cast<uintptr_t>(addresses[i]);
+	}
+	return count;
+}
+
+uint64_t hash_stack(const uintptr_t *frames, uint32_t count)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		hash = (hash ^ static_cast<uint64_t>(frames[i])) * 0x100000001B3ull;
+	}
+	// Zero marks a free slot
+	return hash == 0 ? 1 : hash;
+}
+
+// Name of the function the return address is in with the offset into it, or the module and the offset into it
+std::string symbol_name(uintptr_t address)
+{
+	char buffer[32];
+#if defined(_WIN32)
+	static const bool initialized = SymInitialize(GetCurrentProcess(), nullptr, TRUE) != FALSE;
+
+	alignas(SYMBOL_INFO) char storage[sizeof(SYMBOL_INFO) + 256];
+	auto *symbol = reinterpret_cast<SYMBOL_INFO *>(storage);
+	symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+	symbol->MaxNameLen = 256;
+	DWORD64 displacement = 0;
+	if (initialized && SymFromAddr(GetCurrentProcess(), address, &displacement, symbol))
+	{
+		std::snprintf(buffer, sizeof(buffer), "+0x%llx", static_cast<unsigned long long>(displacement));
+		return std::string{symbol->Name} + buffer;
+	}
+#elif defined(FLOWFORGE_HAS_EXECINFO)
+	Dl_info info{};
+	if (dladdr(reinterpret_cast<void *>(address), &info) != 0)
+	{
+		if (info.dli_sname != nullptr)
+		{
+			int status = 0;
+			char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+			std::string name = status == 0 ? demangled : info.dli_sname;
+			std::free(demangled);
+
+			std::snprintf(buffer, sizeof(buffer), "+0x%llx", static_cast<unsigned long long>(address - reinterpret_cast<uintptr_t>(info.dli_saddr)));
+			return name + buffer;
+		}
+		if (info.dli_fname != nullptr)
+		{
+			std::snprintf(buffer, sizeof(buffer), "+0x%llx", static_cast<unsigned long long>(address - reinterpret_cast<uintptr_t>(info.dli_fbase)));
+			return std::string{info.dli_fname} + buffer;
+		}
+	}
+#endif
+	std::snprintf(buffer, sizeof(buffer), "0x%llx", static_cast<unsigned long long>(address));
+	return buffer;
+}
+
+// Frames of the tracker and operator new, everything before them in the stack is recording the allocation
+bool is_tracker_frame(std::string_view name)
+{
+	return name.starts_with("operator new") || name.starts_with("flwfrg::AllocationTracker::record_allocation");
+}
+
+// Frames of the standard library containers and allocators that called operator new
+bool is_allocator_frame(std::string_view name)
+{
+	// Template instances are named with their return type first, it ends at the first space outside of angle brackets
+	int32_t depth = 0;
+	for (size_t i = 0; i < name.size() && name[i] != '('; i++)
+	{
+		if (name[i] == '<')
+		{
+			depth++;
+		} else if (name[i] == '>')
+		{
+			depth--;
+		} else if (name[i] == ' ' && depth == 0)
+		{
+			name.remove_prefix(i + 1);
+			break;
+		}
+	}
+
+	return name.starts_with("std::") || name.starts_with("__gnu_cxx::");
+}
+
+// Takes the sites out of the table, keeping the ones that allocated the most often.
+// Allocations racing with this may land in either frame, attribution around the frame boundary is approximate.
+void collect_sites(AllocationStatistics &statistics)
+{
+	for (SiteSlot &slot: sites_s)
+	{
+		if (slot.key.load(std::memory_order_relaxed) == 0)
+			continue;
+
+		AllocationSite site{};
+		site.frame_count = std::min<uint32_t>(slot.frame_count.load(std::memory_order_relaxed), AllocationSite::max_frames);
+		for (uint32_t i = 0; i < site.frame_count; i++)
+		{
+			site.frames[i] = slot.frames[i].load(std::memory_order_relaxed);
+		}
+		site.count = slot.count.exchange(0, std::memory_order_relaxed);
+		site.bytes = slot.bytes.exchange(0, std::memory_order_relaxed);
+		slot.key.store(0, std::memory_order_relaxed);
+
+		if (statistics.site_count < AllocationStatistics::max_sites)
+		{
+			statistics.sites[statistics.site_count++] = site;
+		}
+		else if (site.count > statistics.sites.back().count)
+		{
+			statistics.sites.back() = site;
+		}
+		else
+		{
+			continue;
+		}
+		std::sort(statistics.sites.begin(), statistics.sites.begin() + statistics.site_count,
+				  [](const AllocationSite &a, const AllocationSite &b) { return a.count > b.count; });
+	}
+}
+
+std::string json_escaped(std::string_view text)
+{
+	std::string escaped;
+	for (const char c: text)
+	{
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		escaped += c;
+	}
+	return escaped;
+}
+
+void write_statistics(std::ofstream &file, const AllocationStatistics &statistics)
+{
+	file << "{\"frame\": " << statistics.frame
+		 << ", \"allocations\": " << statistics.allocations
+		 << ", \"frees\": " << statistics.frees
+		 << ", \"bytes\": " << statistics.bytes
+		 << ", \"vulkan_allocations\": " << statistics.vulkan_allocations
+		 << ", \"vulkan_bytes\": " << statistics.vulkan_bytes
+		 << ", \"unattributed\": " << statistics.unattributed
+		 << ", \"sites\": [";
+	for (uint32_t i = 0; i < statistics.site_count; i++)
+	{
+		const AllocationSite &site = statistics.sites[i];
+		file << (i == 0 ? "" : ", ")
+			 << "{\"site\": \"" << json_escaped(AllocationTracker::describe_site(site))
+			 << "\", \"count\": " << site.count
+			 << ", \"bytes\": " << site.bytes << "}";
+	}
+	file << "]}";
+}
+
+}// namespace
+
+///// Method implementations
+
+void AllocationTracker::begin_frame()
+{
+	AllocationStatistics frame{};
+	frame.allocations = allocations_s.exchange(0, std::memory_order_relaxed);
+	frame.frees = frees_s.exchange(0, std::memory_order_relaxed);
+	frame.bytes = bytes_s.exchange(0, std::memory_order_relaxed);
+	frame.vulkan_allocations = vulkan_allocations_s.exchange(0, std::memory_order_relaxed);
+	frame.vulkan_bytes = vulkan_bytes_s.exchange(0, std::memory_order_relaxed);
+	frame.unattributed = unattributed_s.exchange(0, std::memory_order_relaxed);
+	collect_sites(frame);
+
+	bool report = false;
+	{
+		std::lock_guard lock{mutex_s};
+		frame.frame = frame_s++;
+		last_frame_s = frame;
+
+		totals_s.frame = frame.frame;
+		totals_s.allocations += frame.allocations;
+		totals_s.frees += frame.frees;
+		totals_s.bytes += frame.bytes;
+		totals_s.vulkan_allocations += frame.vulkan_allocations;
+		totals_s.vulkan_bytes += frame.vulkan_bytes;
+		totals_s.unattributed += frame.unattributed;
+
+		if (check_s && frames_since_warmup_s >= warmup_frames_s && frame.allocations > 0)
+		{
+			// Only the first one is logged, the log line allocates and would fail the next frame as well
+			report = violations_s++ == 0;
+		}
+		frames_since_warmup_s++;
+	}
+
+	if (report)
+	{
+		FLOWFORGE_ERROR("Steady state frame {} allocated {} times ({} bytes), most often at {}",
+						frame.frame, frame.allocations, frame.bytes,
+						frame.site_count > 0 ? describe_site(frame.sites[0]) : std::string_view{"an unknown site"});
+	}
+}
+
+void AllocationTracker::record_allocation(size_t bytes)
+{
+	allocations_s.fetch_add(1, std::memory_order_relaxed);
+	bytes_s.fetch_add(bytes, std::memory_order_relaxed);
+
+	if (capturing_s)
+	{
+		unattributed_s.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	uintptr_t frames[AllocationSite::max_frames];
+	capturing_s = true;
+	const uint32_t frame_count = capture_stack(frames);
+	capturing_s = false;
+	if (frame_count == 0)
+	{
+		unattributed_s.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	const uint64_t key = hash_stack(frames, frame_count);
+	const auto start = static_cast<size_t>(key >> (64 - site_table_bits));
+	for (size_t probe = 0; probe < site_probe_limit; probe++)
+	{
+		SiteSlot &slot = sites_s[(start + probe) & (site_table_size - 1)];
+
+		uint64_t current = slot.key.load(std::memory_order_relaxed);
+		if (current == 0 && slot.key.compare_exchange_strong(current, key, std::memory_order_relaxed))
+		{
+			for (uint32_t i = 0; i < frame_count; i++)
+			{
+				slot.frames[i].store(frames[i], std::memory_order_relaxed);
+			}
+			slot.frame_count.store(frame_count, std::memory_order_relaxed);
+			current = key;
+		}
+
+		if (current == key)
+		{
+			slot.count.fetch_add(1, std::memory_order_relaxed);
+			slot.bytes.fetch_add(bytes, std::memory_order_relaxed);
+			return;
+		}
+	}
+	unattributed_s.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AllocationTracker::record_free()
+{
+	frees_s.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AllocationTracker::record_vulkan_allocation(size_t bytes)
+{
+	vulkan_allocations_s.fetch_add(1, std::memory_order_relaxed);
+	vulkan_bytes_s.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void AllocationTracker::set_steady_state_check(bool check, uint32_t warmup_frames)
+{
+	std::lock_guard lock{mutex_s};
+	check_s = check;
+	warmup_frames_s = warmup_frames;
+	frames_since_warmup_s = 0;
+}
+
+void AllocationTracker::restart_warmup()
+{
+	std::lock_guard lock{mutex_s};
+	frames_since_warmup_s = 0;
+}
+
+AllocationStatistics AllocationTracker::last_frame()
+{
+	std::lock_guard lock{mutex_s};
+	return last_frame_s;
+}
+
+AllocationStatistics AllocationTracker::totals()
+{
+	std::lock_guard lock{mutex_s};
+	AllocationStatistics totals = totals_s;
+	totals.sites = last_frame_s.sites;
+	totals.site_count = last_frame_s.site_count;
+	return totals;
+}
+
+uint64_t AllocationTracker::steady_state_violations()
+{
+	std::lock_guard lock{mutex_s};
+	return violations_s;
+}
+
+std::string_view AllocationTracker::describe_site(const AllocationSite &site)
+{
+	static std::mutex names_mutex;
+	static std::unordered_map<uint64_t, std::string> names;
+
+	std::lock_guard lock{names_mutex};
+	auto [it, inserted] = names.try_emplace(hash_stack(site.frames.data(), site.frame_count));
+	if (!inserted)
+		return it->second;
+
+	// The frames up to operator new belong to the tracker, the ones after it to containers and allocators
+	uint32_t first = 0;
+	std::string names_of_frames[AllocationSite::max_frames];
+	for (uint32_t i = 0; i < site.frame_count; i++)
+	{
+		names_of_frames[i] = symbol_name(site.frames[i]);
+		if (is_tracker_frame(names_of_frames[i]))
+			first = i + 1;
+	}
+	while (first < site.frame_count && is_allocator_frame(names_of_frames[first]))
+	{
+		first++;
+	}
+
+	std::string &name = it->second;
+	for (uint32_t i = first; i < std::min(first + 2, site.frame_count); i++)
+	{
+		name += i == first ? "" : " <- ";
+		name += names_of_frames[i];
+	}
+	if (name.empty())
+		name = site.frame_count > 0 ? symbol_name(site.frames[site.frame_count - 1]) : "unknown";
+	return name;
+}
+
+bool AllocationTracker::write_report(std::string_view path)
+{
+	const AllocationStatistics totals = AllocationTracker::totals();
+	const AllocationStatistics frame = last_frame();
+	const uint64_t violations = steady_state_violations();
+
+	std::ofstream file{std::string{path}};
+	if (!file)
+	{
+		FLOWFORGE_ERROR("Failed to write allocation report to {}", path);
+		return false;
+	}
+
+	file << "{\n\t\"tracking\": " << (enabled ? "true" : "false")
+		 << ",\n\t\"steady_state_violations\": " << violations
+		 << ",\n\t\"totals\": ";
+	write_statistics(file, totals);
+	file << ",\n\t\"last_frame\": ";
+	write_statistics(file, frame);
+	file << "\n}\n";
+	return static_cast<bool>(file);
+}
+
+}// namespace flwfrg
+
+///// Global allocation functions
+
+#if FLOWFORGE_ALLOCATION_TRACKING_ENABLED
+
+namespace
+{
+
+void *tracked_allocate(std::size_t size) noexcept
+{
+	void *pointer = std::malloc(size == 0 ? 1 : size);
+	if (pointer != nullptr)
+		flwfrg::AllocationTracker::record_allocation(size);
+	return pointer;
+}
+
+void *tracked_allocate_aligned(std::size_t size, std::align_val_t alignment) noexcept
+{
+	const auto align = static_cast<std::size_t>(alignment);
+#if defined(_MSC_VER)
+	void *pointer = _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+	// aligned_alloc wants the size to be a multiple of the alignment
+	void *pointer = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) & ~(align - 1));
+#endif
+	if (pointer != nullptr)
+		flwfrg::AllocationTracker::record_allocation(size);
+	return pointer;
+}
+
+void tracked_free(void *pointer) noexcept
+{
+	if (pointer == nullptr)
+		return;
+	flwfrg::AllocationTracker::record_free();
+	std::free(pointer);
+}
+
+void tracked_free_aligned(void *pointer) noexcept
+{
+	if (pointer == nullptr)
+		return;
+	flwfrg::AllocationTracker::record_free();
+#if defined(_MSC_VER)
+	_aligned_free(pointer);
+#else
+	std::free(pointer);
+#endif
+}
+
+}// namespace
+
+void *operator new(std::size_t size)
+{
+	if (void *pointer = tracked_allocate(size))
+		return pointer;
+	throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+	if (void *pointer = tracked_allocate(size))
+		return pointer;
+	throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+	return tracked_allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+	return tracked_allocate(size);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+	if (void *pointer = tracked_allocate_aligned(size, alignment))
+		return pointer;
+	throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+	if (void *pointer = tracked_allocate_aligned(size, alignment))
+		return pointer;
+	throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+	return tracked_allocate_aligned(size, alignment);
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+	return tracked_allocate_aligned(size, alignment);
+}
+
+void operator delete(void *pointer) noexcept { tracked_free(pointer); }
+void operator delete[](void *pointer) noexcept { tracked_free(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept { tracked_free(pointer); }
+void operator delete[](void *pointer, std::size_t) noexcept { tracked_free(pointer); }
+void operator delete(void *pointer, const std::nothrow_t &) noexcept { tracked_free(pointer); }
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept { tracked_free(pointer); }
+
+void operator delete(void *pointer, std::align_val_t) noexcept { tracked_free_aligned(pointer); }
+void operator delete[](void *pointer, std::align_val_t) noexcept { tracked_free_aligned(pointer); }
+void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept { tracked_free_aligned(pointer); }
+void operator delete[](void *pointer, std::size_t, std::align_val_t) noexcept { tracked_free_aligned(pointer); }
+void operator delete(void *pointer, std::align_val_t, const std::nothrow_t &) noexcept { tracked_free_aligned(pointer); }
+void operator delete[](void *pointer, std::align_val_t, const std::nothrow_t &) noexcept { tracked_free_aligned(pointer); }
+
+#endif
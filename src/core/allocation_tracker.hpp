@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Configure with -DFLOWFORGE_ALLOCATION_TRACKING=ON to replace the global operator new and delete and hand the
+// tracking callbacks to Vulkan. Without it nothing is recorded and the tracker reports empty frames.
+#ifdef FLOWFORGE_ALLOCATION_TRACKING
+#define FLOWFORGE_ALLOCATION_TRACKING_ENABLED 1
+#else
+#define FLOWFORGE_ALLOCATION_TRACKING_ENABLED 0
+#endif
+
+namespace flwfrg
+{
+
+struct AllocationSite
+{
+	static constexpr size_t max_frames = 16;
+
+	// Return addresses from inside operator new outwards, describe_site names the first one outside the allocator
+	std::array<uintptr_t, max_frames> frames{};
+	uint32_t frame_count = 0;
+	uint64_t count = 0;
+	uint64_t bytes = 0;
+};
+
+struct AllocationStatistics
+{
+	static constexpr size_t max_sites = 8;
+
+	uint64_t frame = 0;
+	uint64_t allocations = 0;
+	uint64_t frees = 0;
+	uint64_t bytes = 0;
+	// Host memory the Vulkan implementation asked for through the allocation callbacks
+	uint64_t vulkan_allocations = 0;
+	uint64_t vulkan_bytes = 0;
+
+	// Call sites that allocated the most often, sorted by count
+	std::array<AllocationSite, max_sites> sites{};
+	uint32_t site_count = 0;
+	// Allocations made after the site table filled up or without a stack, counted but not attributed
+	uint64_t unattributed = 0;
+};
+
+/// <summary>
+/// Counts every heap allocation and attributes it to its call stack, frame by frame. Recording takes no lock and
+/// never allocates itself, so it may be called from inside operator new on any thread. Walking the stack on every
+/// allocation is slow, which is why it is only done in instrumented builds.
+/// The steady state check treats any heap allocation after the warm up frames as an error, structural changes like
+/// a swapchain recreation restart the warm up. Host memory the Vulkan implementation asks for is reported, but isn't
+/// an error, the driver decides when it allocates.
+/// </summary>
+class AllocationTracker
+{
+public:
+	static constexpr bool enabled = FLOWFORGE_ALLOCATION_TRACKING_ENABLED;
+
+	// Methods
+
+	// Closes the frame that was being recorded and starts the next one
+	static void begin_frame();
+
+	static void record_allocation(size_t bytes);
+	static void record_free();
+	static void record_vulkan_allocation(size_t bytes);
+
+	static void set_steady_state_check(bool check, uint32_t warmup_frames = 120);
+	static void restart_warmup();
+
+	// The last frame begin_frame closed
+	[[nodiscard]] static AllocationStatistics last_frame();
+	// Everything recorded since the start, sites are those of the last frame
+	[[nodiscard]] static AllocationStatistics totals();
+	[[nodiscard]] static uint64_t steady_state_violations();
+
+	// Names the first frame outside of operator new and the standard library, and its caller. The names are cached,
+	// so this only allocates for sites it didn't describe before.
+	[[nodiscard]] static std::string_view describe_site(const AllocationSite &site);
+
+	// Writes the totals, the last frame and the violations as JSON, returns false if the file can't be written
+	static bool write_report(std::string_view path);
+};
+
+}// namespace flwfrg
@@ -0,0 +1,63 @@
+#include "pch.hpp"
+
+#include "clock.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace flwfrg
+{
+
+FrameClock::FrameClock()
+	: start_{Clock::now()},
+	  last_tick_{start_}
+{
+}
+
+double FrameClock::tick()
+{
+	const Clock::time_point now = Clock::now();
+	delta_ = std::min(std::chrono::duration<double>(now - last_tick_).count(), max_delta_);
+	last_tick_ = now;
+	return delta_;
+}
+
+void FrameClock::set_max_delta(double seconds)
+{
+	max_delta_ = std::max(seconds, 0.0);
+}
+
+double FrameClock::elapsed() const
+{
+	return std::chrono::duration<double>(Clock::now() - start_).count();
+}
+
+FixedTimestep::FixedTimestep(double step_seconds, uint32_t max_steps)
+	: step_{step_seconds},
+	  max_steps_{std::max(max_steps, 1u)}
+{
+	assert(step_seconds > 0.0);
+}
+
+uint32_t FixedTimestep::advance(double delta_seconds)
+{
+	accumulator_ += std::max(delta_seconds, 0.0);
+
+	const auto steps = static_cast<uint64_t>(std::floor(accumulator_ / step_));
+	accumulator_ = std::max(accumulator_ - static_cast<double>(steps) * step_, 0.0);
+
+	if (steps > max_steps_)
+	{
+		dropped_steps_ += steps - max_steps_;
+		return max_steps_;
+	}
+	return static_cast<uint32_t>(steps);
+}
+
+void FixedTimestep::reset()
+{
+	accumulator_ = 0.0;
+	dropped_steps_ = 0;
+}
+
+}// namespace flwfrg
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace flwfrg
+{
+
+/// <summary>
+/// Measures the time between frames with the steady high resolution clock.
+/// A long stall, like a breakpoint or a window being dragged, is clamped instead of being simulated as one huge step.
+/// </summary>
+class FrameClock
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+public:
+	FrameClock();
+
+	// Methods
+
+	// Seconds since the last tick, or since the clock was created
+	double tick();
+	void set_max_delta(double seconds);
+
+	// Seconds since the clock was created
+	[[nodiscard]] double elapsed() const;
+	[[nodiscard]] inline double delta() const { return delta_; };
+
+private:
+	Clock::time_point start_;
+	Clock::time_point last_tick_;
+	double delta_ = 0.0;
+	double max_delta_ = 0.25;
+};
+
+/// <summary>
+/// Turns variable frame times into a whole number of fixed simulation steps. The time left over is carried to the next
+/// frame, alpha says how far it is into the next step, to interpolate between the last two simulated states.
+/// At most max_steps are taken per frame, time beyond that is dropped so a slow simulation falls behind instead of spiraling.
+/// </summary>
+class FixedTimestep
+{
+public:
+	explicit FixedTimestep(double step_seconds = 1.0 / 60.0, uint32_t max_steps = 8);
+
+	// Methods
+
+	// Adds the frame time and returns the number of steps to simulate
+	uint32_t advance(double delta_seconds);
+	void reset();
+
+	[[nodiscard]] inline double step() const { return step_; };
+	// In [0, 1), the fraction of a step between the last simulated state and the time of the frame
+	[[nodiscard]] inline float alpha() const { return static_cast<float>(accumulator_ / step_); };
+	// Steps dropped since the last reset because the simulation fell behind
+	[[nodiscard]] inline uint64_t dropped_steps() const { return dropped_steps_; };
+
+private:
+	double step_;
+	uint32_t max_steps_;
+	double accumulator_ = 0.0;
+	uint64_t dropped_steps_ = 0;
+};
+
+}// namespace flwfrg
@@ -0,0 +1,39 @@
+#include "pch.hpp"
+
+#include "cpu_features.hpp"
+
+namespace flwfrg
+{
+
+InstructionSet supported_instruction_set()
+{
+#if FLOWFORGE_X86
+#if defined(_MSC_VER)
+	int registers[4];
+	__cpuid(registers, 0);
+	const int max_leaf = registers[0];
+
+	__cpuid(registers, 1);
+	const bool has_sse2 = (registers[3] & (1 << 26)) != 0;
+	// AVX also needs the OS to save the upper register halves
+	const bool has_avx = (registers[2] & (1 << 27)) != 0 && (registers[2] & (1 << 28)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+
+	bool has_avx2 = false;
+	if (has_avx && max_leaf >= 7)
+	{
+		__cpuidex(registers, 7, 0);
+		has_avx2 = (registers[1] & (1 << 5)) != 0;
+	}
+#else
+	const bool has_sse2 = __builtin_cpu_supports("sse2");
+	const bool has_avx2 = __builtin_cpu_supports("avx2");
+#endif
+	if (has_avx2)
+		return InstructionSet::AVX2;
+	if (has_sse2)
+		return InstructionSet::SSE;
+#endif
+	return InstructionSet::SCALAR;
+}
+
+}// namespace flwfrg
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define FLOWFORGE_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define FLOWFORGE_X86 0
+#endif
+
+// GCC and Clang need the instruction set enabled per function, MSVC accepts the intrinsics as is
+#if FLOWFORGE_X86 && (defined(__GNUC__) || defined(__clang__))
+#define FLOWFORGE_TARGET_SSE __attribute__((target("sse2")))
+#define FLOWFORGE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define FLOWFORGE_TARGET_SSE
+#define FLOWFORGE_TARGET_AVX2
+#endif
+
+namespace flwfrg
+{
+
+// SIMD code paths, each one includes the ones before it
+enum class InstructionSet : uint8_t
+{
+	SCALAR = 0,
+	SSE = 1,
+	AVX2 = 2
+};
+
+// Best instruction set of the running CPU
+[[nodiscard]] InstructionSet supported_instruction_set();
+
+}// namespace flwfrg
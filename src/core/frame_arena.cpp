@@ -0,0 +1,189 @@
+#include "pch.hpp"
+
+#include "frame_arena.hpp"
+
+#include <algorithm>
+
+namespace flwfrg
+{
+
+///// Local helper functions
+
+namespace
+{
+
+// Arenas the calling thread used last, saves the lookup under the lock. Allocators are told apart by id,
+// a new one may live where a destroyed one was.
+std::atomic<uint64_t> next_allocator_id_s = 1;
+thread_local uint64_t current_allocator_s = 0;
+thread_local void *current_arenas_s = nullptr;
+
+uintptr_t align_up(uintptr_t value, size_t alignment)
+{
+	return (value + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+}
+
+}// namespace
+
+///// Method implementations
+
+FrameArena::FrameArena(size_t block_size)
+	: block_size_{block_size}
+{
+	assert(block_size_ > 0);
+}
+
+void FrameArena::reset()
+{
+	current_ = 0;
+	offset_ = 0;
+	used_bytes_.store(0, std::memory_order_relaxed);
+}
+
+FrameArenaStatistics FrameArena::statistics() const
+{
+	FrameArenaStatistics statistics{};
+	statistics.used_bytes = used_bytes_.load(std::memory_order_relaxed);
+	statistics.peak_bytes = peak_bytes_.load(std::memory_order_relaxed);
+	statistics.capacity_bytes = capacity_bytes_.load(std::memory_order_relaxed);
+	statistics.block_allocations = block_allocations_.load(std::memory_order_relaxed);
+	return statistics;
+}
+
+void *FrameArena::do_allocate(size_t bytes, size_t alignment)
+{
+	assert((alignment & (alignment - 1)) == 0);
+
+	auto aligned_offset = [this, alignment]() {
+		const auto base = reinterpret_cast<uintptr_t>(blocks_[current_].memory.get());
+		return static_cast<size_t>(align_up(base + offset_, alignment) - base);
+	};
+
+	size_t start = blocks_.empty() ? 0 : aligned_offset();
+	if (blocks_.empty() || start + bytes > blocks_[current_].size)
+	{
+		next_block(bytes, alignment);
+		start = aligned_offset();
+	}
+
+	void *pointer = blocks_[current_].memory.get() + start;
+	const size_t used = used_bytes_.load(std::memory_order_relaxed) + (start + bytes - offset_);
+	offset_ = start + bytes;
+
+	used_bytes_.store(used, std::memory_order_relaxed);
+	if (used > peak_bytes_.load(std::memory_order_relaxed))
+		peak_bytes_.store(used, std::memory_order_relaxed);
+
+	return pointer;
+}
+
+void FrameArena::do_deallocate(void *, size_t, size_t)
+{
+	// Freed all at once by reset
+}
+
+bool FrameArena::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+	return this == &other;
+}
+
+FrameAllocator::FrameAllocator(uint32_t frame_count, size_t block_size)
+	: id_{next_allocator_id_s.fetch_add(1, std::memory_order_relaxed)},
+	  frame_count_{std::max(frame_count, 1u)},
+	  block_size_{block_size}
+{
+}
+
+void FrameAllocator::begin_frame()
+{
+	frame_.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::pmr::memory_resource *FrameAllocator::resource()
+{
+	ThreadArenas &arenas = thread_arenas();
+
+	const uint64_t frame = frame_.load(std::memory_order_relaxed);
+	const size_t slot = frame % frame_count_;
+	if (arenas.frames[slot] != frame)
+	{
+		arenas.arenas[slot]->reset();
+		arenas.frames[slot] = frame;
+	}
+	return arenas.arenas[slot].get();
+}
+
+FrameArenaStatistics FrameAllocator::statistics() const
+{
+	std::lock_guard lock{mutex_};
+
+	FrameArenaStatistics statistics{};
+	for (const std::unique_ptr<ThreadArenas> &thread: threads_)
+	{
+		for (const std::unique_ptr<FrameArena> &arena: thread->arenas)
+		{
+			const FrameArenaStatistics arena_statistics = arena->statistics();
+			statistics.used_bytes += arena_statistics.used_bytes;
+			statistics.peak_bytes = std::max(statistics.peak_bytes, arena_statistics.peak_bytes);
+			statistics.capacity_bytes += arena_statistics.capacity_bytes;
+			statistics.block_allocations += arena_statistics.block_allocations;
+		}
+	}
+	return statistics;
+}
+
+///// Private methods
+
+void FrameArena::next_block(size_t bytes, size_t alignment)
+{
+	// new[] aligns blocks for any fundamental type, larger alignments are padded inside the block
+	const size_t padded = bytes + (alignment > alignof(std::max_align_t) ? alignment : 0);
+
+	const size_t first = blocks_.empty() ? 0 : current_ + 1;
+	for (size_t i = first; i < blocks_.size(); i++)
+	{
+		if (blocks_[i].size >= padded)
+		{
+			// Skipped blocks stay unused until the next reset
+			std::swap(blocks_[i], blocks_[first]);
+			current_ = first;
+			offset_ = 0;
+			return;
+		}
+	}
+
+	const size_t size = std::max(block_size_, padded);
+	blocks_.insert(blocks_.begin() + static_cast<std::ptrdiff_t>(first), Block{std::make_unique<std::byte[]>(size), size});
+	current_ = first;
+	offset_ = 0;
+
+	capacity_bytes_.fetch_add(size, std::memory_order_relaxed);
+	block_allocations_.fetch_add(1, std::memory_order_relaxed);
+}
+
+FrameAllocator::ThreadArenas &FrameAllocator::thread_arenas()
+{
+	if (current_allocator_s == id_)
+		return *static_cast<ThreadArenas *>(current_arenas_s);
+
+	const std::thread::id id = std::this_thread::get_id();
+
+	std::lock_guard lock{mutex_};
+	auto found = std::find_if(threads_.begin(), threads_.end(), [id](const std::unique_ptr<ThreadArenas> &thread) { return thread->thread == id; });
+	if (found == threads_.end())
+	{
+		auto arenas = std::make_unique<ThreadArenas>();
+		arenas->thread = id;
+		arenas->frames.assign(frame_count_, UINT64_MAX);
+		for (uint32_t i = 0; i < frame_count_; i++)
+			arenas->arenas.push_back(std::make_unique<FrameArena>(block_size_));
+		threads_.push_back(std::move(arenas));
+		found = threads_.end() - 1;
+	}
+
+	current_allocator_s = id_;
+	current_arenas_s = found->get();
+	return **found;
+}
+
+}// namespace flwfrg
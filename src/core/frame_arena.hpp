@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace flwfrg
+{
+
+struct FrameArenaStatistics
+{
+	// Bytes handed out since the last reset, and the most any frame used
+	uint64_t used_bytes = 0;
+	uint64_t peak_bytes = 0;
+	uint64_t capacity_bytes = 0;
+	// Blocks taken from the heap since the arena was created, stays put once the arena saw its largest frame
+	uint64_t block_allocations = 0;
+};
+
+/// <summary>
+/// Bump allocator for data that only lives for a frame. Allocating moves a pointer, deallocating does nothing and
+/// reset rewinds everything at once. Blocks are kept across resets, so after the first frames it stops touching the heap.
+/// Only the thread that owns it allocates and resets, statistics may be read by any thread.
+/// </summary>
+class FrameArena : public std::pmr::memory_resource
+{
+public:
+	explicit FrameArena(size_t block_size = 256 * 1024);
+	~FrameArena() override = default;
+
+	// Not copyable or movable
+	FrameArena(const FrameArena &) = delete;
+	FrameArena &operator=(const FrameArena &) = delete;
+	FrameArena(FrameArena &&) = delete;
+	FrameArena &operator=(FrameArena &&) = delete;
+
+	// Methods
+
+	// Everything allocated so far becomes invalid
+	void reset();
+
+	[[nodiscard]] FrameArenaStatistics statistics() const;
+
+protected:
+	void *do_allocate(size_t bytes, size_t alignment) override;
+	void do_deallocate(void *pointer, size_t bytes, size_t alignment) override;
+	[[nodiscard]] bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+private:
+	struct Block
+	{
+		std::unique_ptr<std::byte[]> memory;
+		size_t size;
+	};
+
+	size_t block_size_;
+	std::vector<Block> blocks_{};
+	// Block allocations come from and the offset into it
+	size_t current_ = 0;
+	size_t offset_ = 0;
+
+	std::atomic<uint64_t> used_bytes_ = 0;
+	std::atomic<uint64_t> peak_bytes_ = 0;
+	std::atomic<uint64_t> capacity_bytes_ = 0;
+	std::atomic<uint64_t> block_allocations_ = 0;
+
+	///// Private methods
+
+	// Moves to the first kept block with room for the allocation, or adds one
+	void next_block(size_t bytes, size_t alignment);
+};
+
+/// <summary>
+/// Gives every thread its own ring of frame arenas, one per frame that may still use its allocations.
+/// begin_frame moves every thread to the next arena of its ring, which is reset the next time the thread allocates,
+/// so allocations stay valid until frame_count more frames began. Threads never share an arena and take no lock
+/// after their first allocation.
+/// </summary>
+class FrameAllocator
+{
+public:
+	explicit FrameAllocator(uint32_t frame_count, size_t block_size = 256 * 1024);
+
+	// Not copyable or movable
+	FrameAllocator(const FrameAllocator &) = delete;
+	FrameAllocator &operator=(const FrameAllocator &) = delete;
+	FrameAllocator(FrameAllocator &&) = delete;
+	FrameAllocator &operator=(FrameAllocator &&) = delete;
+
+	// Methods
+
+	// Any thread may call this, once the oldest frame's allocations are no longer used
+	void begin_frame();
+	// Arena of the calling thread for the current frame, for std::pmr containers that don't outlive the frame
+	[[nodiscard]] std::pmr::memory_resource *resource();
+
+	// Summed over the arenas of every thread, the peak is that of the largest arena
+	[[nodiscard]] FrameArenaStatistics statistics() const;
+	[[nodiscard]] inline uint32_t frame_count() const { return frame_count_; };
+
+private:
+	struct ThreadArenas
+	{
+		std::thread::id thread;
+		std::vector<std::unique_ptr<FrameArena>> arenas;
+		// Frame every arena was last reset for
+		std::vector<uint64_t> frames;
+	};
+
+	uint64_t id_;
+	uint32_t frame_count_;
+	size_t block_size_;
+	std::atomic<uint64_t> frame_ = 0;
+
+	mutable std::mutex mutex_{};
+	std::vector<std::unique_ptr<ThreadArenas>> threads_{};
+
+	///// Private methods
+
+	ThreadArenas &thread_arenas();
+};
+
+}// namespace flwfrg
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace flwfrg
+{
+
+template<typename Signature>
+class FunctionRef;
+
+/// <summary>
+/// Non owning reference to a callable, two pointers that are cheap to copy and never allocate.
+/// The callable has to outlive the reference, so it is meant for parameters that are only called before returning.
+/// </summary>
+template<typename Result, typename... Arguments>
+class FunctionRef<Result(Arguments...)>
+{
+public:
+	template<typename Function>
+		requires(!std::is_same_v<std::remove_cvref_t<Function>, FunctionRef> && std::is_invocable_r_v<Result, Function &, Arguments...>)
+	FunctionRef(Function &&function)
+		: object_{const_cast<void *>(static_cast<const void *>(std::addressof(function)))},
+		  invoke_{[](void *object, Arguments... arguments) -> Result {
+			  return std::invoke(*static_cast<std::add_pointer_t<Function>>(object), std::forward<Arguments>(arguments)...);
+		  }}
+	{
+	}
+
+	// Methods
+
+	inline Result operator()(Arguments... arguments) const { return invoke_(object_, std::forward<Arguments>(arguments)...); };
+
+private:
+	void *object_;
+	Result (*invoke_)(void *, Arguments...);
+};
+
+}// namespace flwfrg
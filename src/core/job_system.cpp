@@ -0,0 +1,616 @@
+#include "pch.hpp"
+
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace flwfrg
+{
+
+///// Local helper functions
+
+namespace
+{
+
+// Which system and thread the calling thread belongs to
+thread_local const JobSystem *current_system_s = nullptr;
+thread_local uint32_t current_thread_s = 0;
+
+void pin_current_thread(uint32_t hardware_thread)
+{
+#ifdef _WIN32
+	if (hardware_thread < 64 && SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR{1} << hardware_thread) == 0)
+		FLOWFORGE_WARN("Failed to pin thread to hardware thread {}", hardware_thread);
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(hardware_thread, &set);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+		FLOWFORGE_WARN("Failed to pin thread to hardware thread {}", hardware_thread);
+#else
+	(void) hardware_thread;
+#endif
+}
+
+// Xorshift, picks the first thread to steal from
+uint32_t next_random(uint32_t &state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+}// namespace
+
+
+///// Method implementations
+
+JobGraph::Node JobGraph::add(JobFunction work)
+{
+	nodes_.push_back({std::move(work), {}, 0});
+	return static_cast<Node>(nodes_.size() - 1);
+}
+
+void JobGraph::precede(Node before, Node after)
+{
+	assert(before < nodes_.size() && after < nodes_.size() && before != after);
+
+	nodes_[before].successors.push_back(after);
+	nodes_[after].dependency_count++;
+}
+
+void JobGraph::clear()
+{
+	nodes_.clear();
+}
+
+bool JobSystem::WorkDeque::push(Job *job)
+{
+	const int64_t bottom = bottom_.load(std::memory_order_relaxed);
+	const int64_t top = top_.load(std::memory_order_acquire);
+	if (bottom - top >= capacity)
+		return false;
+
+	jobs_[bottom & (capacity - 1)].store(job, std::memory_order_relaxed);
+	// Publishes the job to thieves, who load the bottom with acquire
+	bottom_.store(bottom + 1, std::memory_order_release);
+	return true;
+}
+
+JobSystem::Job *JobSystem::WorkDeque::pop()
+{
+	const int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+	bottom_.store(bottom, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t top = top_.load(std::memory_order_relaxed);
+
+	if (top > bottom)
+	{
+		// Empty
+		bottom_.store(bottom + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job *job = jobs_[bottom & (capacity - 1)].load(std::memory_order_relaxed);
+	if (top == bottom)
+	{
+		// The last job, a thief may be taking it at the same time
+		if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = nullptr;
+		bottom_.store(bottom + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+JobSystem::Job *JobSystem::WorkDeque::steal()
+{
+	int64_t top = top_.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	const int64_t bottom = bottom_.load(std::memory_order_acquire);
+	if (top >= bottom)
+		return nullptr;
+
+	Job *job = jobs_[top & (capacity - 1)].load(std::memory_order_relaxed);
+	// Lost the race against the owner or another thief
+	if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr;
+	return job;
+}
+
+bool JobSystem::WorkDeque::empty() const
+{
+	return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+}
+
+JobSystem::JobSystem(JobSystemSettings settings)
+	: main_thread_id_{std::this_thread::get_id()}
+{
+	const uint32_t hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+	const uint32_t worker_count = settings.worker_count > 0 ? settings.worker_count : hardware_threads - 1;
+
+	for (uint32_t i = 0; i <= worker_count; i++)
+	{
+		threads_.push_back(std::make_unique<ThreadState>());
+		threads_.back()->steal_seed = 0x9E3779B9u * (i + 1);
+	}
+
+	{
+		std::lock_guard lock{job_pool_mutex_};
+		add_job_block(std::max(settings.reserved_jobs, job_batch_size));
+	}
+
+	current_system_s = this;
+	current_thread_s = 0;
+	if (settings.pin_threads)
+		pin_current_thread(0);
+
+	workers_.reserve(worker_count);
+	for (uint32_t i = 1; i <= worker_count; i++)
+	{
+		workers_.emplace_back([this, i, pin = settings.pin_threads, hardware_threads]() {
+			current_system_s = this;
+			current_thread_s = i;
+			if (pin)
+				pin_current_thread(i % hardware_threads);
+
+			worker_loop(i);
+		});
+	}
+
+	FLOWFORGE_INFO("Job system started with {} worker threads", worker_count);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard lock{sleep_mutex_};
+		stopping_ = true;
+	}
+	sleep_condition_.notify_all();
+
+	for (std::thread &worker: workers_)
+	{
+		worker.join();
+	}
+
+	// Jobs nobody waited for are dropped with the blocks they live in
+
+	if (current_system_s == this)
+		current_system_s = nullptr;
+}
+
+void JobSystem::submit(JobFunction work, JobGroup &group)
+{
+	group.pending_.fetch_add(1, std::memory_order_relaxed);
+	push(allocate_job(std::move(work), &group));
+}
+
+void JobSystem::wait(JobGroup &group)
+{
+	const uint32_t index = thread_index();
+	while (!group.done())
+	{
+		if (Job *job = find_job(index))
+		{
+			execute(job, index);
+		} else if (index != 0 || run_main_thread_jobs() == 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::run(JobGraph &graph)
+{
+	if (graph.nodes_.empty())
+		return;
+
+	if (graph.remaining_capacity_ < graph.nodes_.size())
+	{
+		graph.remaining_ = std::make_unique<std::atomic<uint32_t>[]>(graph.nodes_.size());
+		graph.remaining_capacity_ = graph.nodes_.size();
+	}
+	for (size_t i = 0; i < graph.nodes_.size(); i++)
+	{
+		graph.remaining_[i].store(graph.nodes_[i].dependency_count, std::memory_order_relaxed);
+	}
+
+	JobGroup group;
+	bool has_root = false;
+	for (JobGraph::Node node = 0; node < graph.nodes_.size(); node++)
+	{
+		if (graph.nodes_[node].dependency_count == 0)
+		{
+			submit_graph_node(graph, node, group);
+			has_root = true;
+		}
+	}
+	assert(has_root && "Job graph has a cycle");
+
+	// Successors are submitted before their predecessor finishes, so the group only empties at the end
+	wait(group);
+}
+
+void JobSystem::parallel_for(uint32_t begin, uint32_t end, uint32_t grain, const RangeFunction &function)
+{
+	if (end <= begin)
+		return;
+
+	grain = std::max(grain, 1u);
+	if (end - begin <= grain || workers_.empty())
+	{
+		function(begin, end);
+		return;
+	}
+
+	JobGroup group;
+	split_range(begin, end, grain, function, group);
+	wait(group);
+}
+
+void JobSystem::submit_main_thread(JobFunction work, JobGroup *group)
+{
+	if (group != nullptr)
+		group->pending_.fetch_add(1, std::memory_order_relaxed);
+
+	Job *job = allocate_job(std::move(work), group);
+
+	std::lock_guard lock{main_thread_mutex_};
+	if (last_main_thread_job_ != nullptr)
+	{
+		last_main_thread_job_->next = job;
+	} else
+	{
+		main_thread_jobs_ = job;
+	}
+	last_main_thread_job_ = job;
+}
+
+uint32_t JobSystem::run_main_thread_jobs()
+{
+	assert(is_main_thread());
+
+	Job *job;
+	{
+		std::lock_guard lock{main_thread_mutex_};
+		job = std::exchange(main_thread_jobs_, nullptr);
+		last_main_thread_job_ = nullptr;
+	}
+
+	uint32_t count = 0;
+	while (job != nullptr)
+	{
+		Job *next = std::exchange(job->next, nullptr);
+		execute(job, 0);
+		job = next;
+		count++;
+	}
+	main_thread_executed_.fetch_add(count, std::memory_order_relaxed);
+	return count;
+}
+
+bool JobSystem::is_main_thread() const
+{
+	return std::this_thread::get_id() == main_thread_id_;
+}
+
+JobSystemStatistics JobSystem::statistics() const
+{
+	JobSystemStatistics statistics{};
+	statistics.workers = worker_count();
+	for (const std::unique_ptr<ThreadState> &thread: threads_)
+	{
+		statistics.executed_jobs += thread->executed_jobs.load(std::memory_order_relaxed);
+		statistics.stolen_jobs += thread->stolen_jobs.load(std::memory_order_relaxed);
+	}
+	statistics.main_thread_jobs = main_thread_executed_.load(std::memory_order_relaxed);
+	return statistics;
+}
+
+void parallel_for(JobSystem *job_system, uint32_t begin, uint32_t end, uint32_t grain, const RangeFunction &function)
+{
+	if (job_system != nullptr)
+	{
+		job_system->parallel_for(begin, end, grain, function);
+	} else if (begin < end)
+	{
+		function(begin, end);
+	}
+}
+
+uint32_t parallel_compact(JobSystem *job_system, uint32_t begin, uint32_t end, uint32_t grain, const CompactFunction &kernel, std::vector<uint32_t> &out)
+{
+	if (end <= begin)
+		return 0;
+
+	grain = std::max(grain, 1u);
+	const uint32_t count = end - begin;
+	const uint32_t block_count = (count + grain - 1) / grain;
+
+	// Chunks start a multiple of grain from begin. Each writes to the start of its own range and its count to its first
+	// block, the counts follow the elements and are zero for blocks in the middle of a chunk.
+	const size_t first = out.size();
+	out.resize(first + count + block_count);
+	uint32_t *elements = out.data() + first;
+	uint32_t *block_counts = elements + count;
+	std::fill(block_counts, block_counts + block_count, 0);
+
+	std::atomic<uint32_t> chunk_count = 0;
+	parallel_for(job_system, begin, end, grain, [&](uint32_t chunk_begin, uint32_t chunk_end) {
+		block_counts[(chunk_begin - begin) / grain] = kernel(chunk_begin, chunk_end, elements + (chunk_begin - begin));
+		chunk_count.fetch_add(1, std::memory_order_relaxed);
+	});
+
+	// Move the chunks together in order, each one only moves toward the front
+	uint32_t kept = 0;
+	for (uint32_t block = 0; block < block_count; block++)
+	{
+		std::memmove(elements + kept, elements + block * grain, block_counts[block] * sizeof(uint32_t));
+		kept += block_counts[block];
+	}
+	out.resize(first + kept);
+
+	return chunk_count.load(std::memory_order_relaxed);
+}
+
+///// Private methods
+
+void JobSystem::add_job_block(uint32_t count)
+{
+	job_blocks_.push_back(std::make_unique<Job[]>(count));
+	Job *block = job_blocks_.back().get();
+	for (uint32_t i = 0; i + 1 < count; i++)
+	{
+		block[i].next = &block[i + 1];
+	}
+	block[count - 1].next = shared_free_jobs_;
+	shared_free_jobs_ = block;
+}
+
+JobSystem::Job *JobSystem::allocate_job(JobFunction work, JobGroup *group)
+{
+	const uint32_t index = thread_index();
+	ThreadState *thread = index != no_thread ? threads_[index].get() : nullptr;
+
+	if (thread == nullptr || thread->free_jobs == nullptr)
+	{
+		std::lock_guard lock{job_pool_mutex_};
+		if (shared_free_jobs_ == nullptr)
+		{
+			// More jobs are in flight than were reserved
+			add_job_block(job_batch_size);
+		}
+
+		if (thread == nullptr)
+		{
+			Job *job = std::exchange(shared_free_jobs_, shared_free_jobs_->next);
+			job->next = nullptr;
+			job->work = std::move(work);
+			job->group = group;
+			return job;
+		}
+
+		// Take up to a batch
+		thread->free_jobs = shared_free_jobs_;
+		thread->free_job_count = 1;
+		Job *last = shared_free_jobs_;
+		while (last->next != nullptr && thread->free_job_count < job_batch_size)
+		{
+			last = last->next;
+			thread->free_job_count++;
+		}
+		shared_free_jobs_ = std::exchange(last->next, nullptr);
+	}
+
+	Job *job = std::exchange(thread->free_jobs, thread->free_jobs->next);
+	thread->free_job_count--;
+	job->next = nullptr;
+	job->work = std::move(work);
+	job->group = group;
+	return job;
+}
+
+void JobSystem::free_job(Job *job, uint32_t thread_index)
+{
+	job->work.reset();
+	job->group = nullptr;
+
+	if (thread_index == no_thread)
+	{
+		std::lock_guard lock{job_pool_mutex_};
+		job->next = shared_free_jobs_;
+		shared_free_jobs_ = job;
+		return;
+	}
+
+	ThreadState &thread = *threads_[thread_index];
+	job->next = thread.free_jobs;
+	thread.free_jobs = job;
+	if (++thread.free_job_count < 2 * job_batch_size)
+		return;
+
+	// Threads that mostly run stolen jobs collect them, hand a batch back to the threads that submit
+	Job *first = thread.free_jobs;
+	Job *last = first;
+	for (uint32_t i = 1; i < job_batch_size; i++)
+	{
+		last = last->next;
+	}
+	thread.free_jobs = std::exchange(last->next, nullptr);
+	thread.free_job_count -= job_batch_size;
+
+	std::lock_guard lock{job_pool_mutex_};
+	last->next = shared_free_jobs_;
+	shared_free_jobs_ = first;
+}
+
+void JobSystem::submit_graph_node(JobGraph &graph, JobGraph::Node node, JobGroup &group)
+{
+	submit([this, &graph, node, &group]() {
+		graph.nodes_[node].work();
+		for (JobGraph::Node successor: graph.nodes_[node].successors)
+		{
+			if (graph.remaining_[successor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+				submit_graph_node(graph, successor, group);
+		}
+	}, group);
+}
+
+void JobSystem::worker_loop(uint32_t thread_index)
+{
+	// Spins a while before sleeping, jobs tend to come in bursts
+	constexpr uint32_t idle_spins = 64;
+
+	uint32_t spins = 0;
+	while (!stopping_.load(std::memory_order_relaxed))
+	{
+		const uint64_t submitted = submitted_jobs_.load(std::memory_order_seq_cst);
+		if (Job *job = find_job(thread_index))
+		{
+			execute(job, thread_index);
+			spins = 0;
+			continue;
+		}
+
+		if (++spins < idle_spins)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		// Sleep until something was submitted after the last look at the queues
+		sleeping_workers_.fetch_add(1, std::memory_order_seq_cst);
+		{
+			std::unique_lock lock{sleep_mutex_};
+			sleep_condition_.wait(lock, [&]() {
+				return stopping_.load(std::memory_order_relaxed) || submitted_jobs_.load(std::memory_order_seq_cst) != submitted;
+			});
+		}
+		sleeping_workers_.fetch_sub(1, std::memory_order_relaxed);
+		spins = 0;
+	}
+}
+
+void JobSystem::push(Job *job)
+{
+	const uint32_t index = thread_index();
+	if (index == no_thread)
+	{
+		std::lock_guard lock{shared_mutex_};
+		shared_jobs_.push_back(job);
+		shared_job_count_.fetch_add(1, std::memory_order_release);
+	} else if (!threads_[index]->deque.push(job))
+	{
+		// The deque is full, run the job right away instead
+		execute(job, index);
+		return;
+	}
+
+	wake_workers();
+}
+
+void JobSystem::wake_workers()
+{
+	submitted_jobs_.fetch_add(1, std::memory_order_seq_cst);
+	if (sleeping_workers_.load(std::memory_order_seq_cst) == 0)
+		return;
+
+	std::lock_guard lock{sleep_mutex_};
+	sleep_condition_.notify_one();
+}
+
+JobSystem::Job *JobSystem::find_job(uint32_t thread_index)
+{
+	if (thread_index != no_thread)
+	{
+		if (Job *job = threads_[thread_index]->deque.pop())
+			return job;
+	}
+
+	if (shared_job_count_.load(std::memory_order_acquire) > 0)
+	{
+		std::lock_guard lock{shared_mutex_};
+		if (!shared_jobs_.empty())
+		{
+			Job *job = shared_jobs_.back();
+			shared_jobs_.pop_back();
+			shared_job_count_.fetch_sub(1, std::memory_order_relaxed);
+			return job;
+		}
+	}
+
+	// Threads outside the system only help with the shared jobs
+	if (thread_index == no_thread)
+		return nullptr;
+
+	const auto thread_count = static_cast<uint32_t>(threads_.size());
+	const uint32_t first = next_random(threads_[thread_index]->steal_seed) % thread_count;
+	for (uint32_t i = 0; i < thread_count; i++)
+	{
+		const uint32_t victim = (first + i) % thread_count;
+		if (victim == thread_index)
+			continue;
+
+		if (Job *job = threads_[victim]->deque.steal())
+		{
+			threads_[thread_index]->stolen_jobs.fetch_add(1, std::memory_order_relaxed);
+			return job;
+		}
+	}
+	return nullptr;
+}
+
+void JobSystem::execute(Job *job, uint32_t thread_index)
+{
+	job->work();
+
+	if (job->group != nullptr)
+		job->group->pending_.fetch_sub(1, std::memory_order_acq_rel);
+	if (thread_index != no_thread)
+		threads_[thread_index]->executed_jobs.fetch_add(1, std::memory_order_relaxed);
+
+	free_job(job, thread_index);
+}
+
+void JobSystem::split_range(uint32_t begin, uint32_t end, uint32_t grain, const RangeFunction &function, JobGroup &group)
+{
+	const uint32_t index = thread_index();
+
+	// Lazy binary splitting. Half of the range is offered to other threads whenever the own deque ran dry,
+	// which only happens when someone stole from it. Otherwise it is worked through a grain at a time.
+	while (end - begin > grain)
+	{
+		if (index != no_thread && !threads_[index]->deque.empty())
+		{
+			function(begin, begin + grain);
+			begin += grain;
+			continue;
+		}
+
+		const uint32_t grains = (end - begin + grain - 1) / grain;
+		const uint32_t middle = begin + grains / 2 * grain;
+		submit([this, middle, end, grain, &function, &group]() {
+			split_range(middle, end, grain, function, group);
+		}, group);
+		end = middle;
+	}
+
+	function(begin, end);
+}
+
+uint32_t JobSystem::thread_index() const
+{
+	return current_system_s == this ? current_thread_s : no_thread;
+}
+
+}// namespace flwfrg
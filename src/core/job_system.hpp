@@ -0,0 +1,317 @@
+#pragma once
+
+#include "function_ref.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace flwfrg
+{
+
+class JobSystem;
+
+// Called with a chunk of the range, begin inclusive and end exclusive. Only referenced, parallel_for returns once
+// every chunk finished.
+using RangeFunction = FunctionRef<void(uint32_t, uint32_t)>;
+// Called with a chunk of the range and where to write the elements it keeps, returns how many it wrote
+using CompactFunction = FunctionRef<uint32_t(uint32_t, uint32_t, uint32_t *)>;
+
+/// <summary>
+/// Move only callable that keeps its captures inside itself, so submitting a job never allocates.
+/// Captures that don't fit are rejected at compile time, capture references to bigger state instead.
+/// </summary>
+class JobFunction
+{
+public:
+	static constexpr size_t capacity = 48;
+
+	JobFunction() = default;
+	template<typename Function>
+		requires(!std::is_same_v<std::remove_cvref_t<Function>, JobFunction> && std::is_invocable_r_v<void, std::decay_t<Function> &>)
+	JobFunction(Function &&function)
+	{
+		using Stored = std::decay_t<Function>;
+		static_assert(sizeof(Stored) <= capacity && alignof(Stored) <= alignof(std::max_align_t), "Job captures too large");
+		static_assert(std::is_nothrow_move_constructible_v<Stored>);
+
+		new (storage_) Stored{std::forward<Function>(function)};
+		invoke_ = [](void *storage) { (*std::launder(static_cast<Stored *>(storage)))(); };
+		relocate_ = [](void *destination, void *source) {
+			Stored *stored = std::launder(static_cast<Stored *>(source));
+			if (destination != nullptr)
+				new (destination) Stored{std::move(*stored)};
+			stored->~Stored();
+		};
+	}
+	~JobFunction() { reset(); };
+
+	// Not copyable but movable
+	JobFunction(const JobFunction &) = delete;
+	JobFunction &operator=(const JobFunction &) = delete;
+	JobFunction(JobFunction &&other) noexcept { take(other); };
+	JobFunction &operator=(JobFunction &&other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			take(other);
+		}
+		return *this;
+	};
+
+	// Methods
+
+	inline void operator()() { invoke_(storage_); };
+	inline explicit operator bool() const { return invoke_ != nullptr; };
+
+	// Destroys the callable
+	inline void reset()
+	{
+		if (relocate_ != nullptr)
+			relocate_(nullptr, storage_);
+		invoke_ = nullptr;
+		relocate_ = nullptr;
+	};
+
+private:
+	alignas(std::max_align_t) std::byte storage_[capacity];
+	void (*invoke_)(void *) = nullptr;
+	// Moves the callable in source to destination and destroys it, or only destroys it when destination is null
+	void (*relocate_)(void *, void *) = nullptr;
+
+	///// Private methods
+
+	inline void take(JobFunction &other)
+	{
+		if (other.relocate_ != nullptr)
+			other.relocate_(storage_, other.storage_);
+		invoke_ = std::exchange(other.invoke_, nullptr);
+		relocate_ = std::exchange(other.relocate_, nullptr);
+	};
+};
+
+struct JobSystemSettings
+{
+	// Worker threads next to the main thread, zero for one per remaining hardware thread
+	uint32_t worker_count = 0;
+	// Pins the main thread to the first hardware thread and every worker to one of the following ones
+	bool pin_threads = false;
+	// Jobs allocated up front. More are allocated when this many are queued or running at once.
+	uint32_t reserved_jobs = 4096;
+};
+
+struct JobSystemStatistics
+{
+	uint32_t workers = 0;
+	uint64_t executed_jobs = 0;
+	// Jobs taken from the queue of another thread
+	uint64_t stolen_jobs = 0;
+	uint64_t main_thread_jobs = 0;
+};
+
+/// <summary>
+/// Counts the jobs submitted with it that haven't finished yet.
+/// </summary>
+class JobGroup
+{
+public:
+	JobGroup() = default;
+
+	// Not copyable or movable
+	JobGroup(const JobGroup &) = delete;
+	JobGroup &operator=(const JobGroup &) = delete;
+	JobGroup(JobGroup &&) = delete;
+	JobGroup &operator=(JobGroup &&) = delete;
+
+	[[nodiscard]] inline bool done() const { return pending_.load(std::memory_order_acquire) == 0; };
+
+private:
+	std::atomic<uint32_t> pending_ = 0;
+
+	friend JobSystem;
+};
+
+/// <summary>
+/// Jobs and the order they have to run in. A job only starts once every job that precedes it finished.
+/// The graph can be run any number of times, it has to be acyclic.
+/// </summary>
+class JobGraph
+{
+public:
+	using Node = uint32_t;
+
+	// Methods
+
+	Node add(JobFunction work);
+	// after starts once before finished
+	void precede(Node before, Node after);
+	void clear();
+
+	[[nodiscard]] inline size_t size() const { return nodes_.size(); };
+
+private:
+	struct GraphNode
+	{
+		JobFunction work;
+		std::vector<Node> successors;
+		uint32_t dependency_count;
+	};
+
+	std::vector<GraphNode> nodes_{};
+	// Dependencies left for every node in the current run, only reallocated when the graph grew since the last run
+	std::unique_ptr<std::atomic<uint32_t>[]> remaining_{};
+	size_t remaining_capacity_ = 0;
+
+	friend JobSystem;
+};
+
+/// <summary>
+/// Work stealing scheduler. Every thread owns a Chase-Lev deque, it pushes and pops jobs at the bottom while idle threads
+/// steal from the top of the others. Threads that wait for jobs run other jobs in the meantime, so jobs may wait on the jobs
+/// they submit. The thread that creates the system is the main thread, jobs that have to run on it, like GLFW calls,
+/// are queued separately and run when it calls run_main_thread_jobs or waits.
+/// </summary>
+class JobSystem
+{
+public:
+	explicit JobSystem(JobSystemSettings settings = {});
+	~JobSystem();
+
+	// Not copyable or movable
+	JobSystem(const JobSystem &) = delete;
+	JobSystem &operator=(const JobSystem &) = delete;
+	JobSystem(JobSystem &&) = delete;
+	JobSystem &operator=(JobSystem &&) = delete;
+
+	// Methods
+
+	void submit(JobFunction work, JobGroup &group);
+	// Runs jobs until every job of the group finished
+	void wait(JobGroup &group);
+	// Runs the graph and waits for it
+	void run(JobGraph &graph);
+
+	// Calls function on chunks of at least grain elements that together cover the range, in parallel.
+	// Ranges are only split where other threads are out of work, and always grain elements from begin apart,
+	// so the chunks start at begin plus a multiple of grain. Returns once every chunk finished.
+	void parallel_for(uint32_t begin, uint32_t end, uint32_t grain, const RangeFunction &function);
+
+	// Queues a job for the main thread. Any thread may call this.
+	void submit_main_thread(JobFunction work, JobGroup *group = nullptr);
+	// Returns the number of main thread jobs that ran. Only called by the main thread.
+	uint32_t run_main_thread_jobs();
+
+	[[nodiscard]] bool is_main_thread() const;
+	[[nodiscard]] inline uint32_t worker_count() const { return static_cast<uint32_t>(workers_.size()); };
+	[[nodiscard]] JobSystemStatistics statistics() const;
+
+private:
+	struct Job
+	{
+		JobFunction work;
+		JobGroup *group = nullptr;
+		// Next job in a free list or in the main thread queue
+		Job *next = nullptr;
+	};
+
+	// Jobs are allocated this many at a time and moved between the free lists in batches of this size
+	static constexpr uint32_t job_batch_size = 64;
+
+	// Chase-Lev deque of fixed capacity. Correct and Efficient Work-Stealing for Weak Memory Models. Lê et al. 2013
+	class WorkDeque
+	{
+	public:
+		// Only called by the owner, fails when the deque is full
+		bool push(Job *job);
+		Job *pop();
+		// Called by any thread
+		Job *steal();
+		[[nodiscard]] bool empty() const;
+
+	private:
+		static constexpr int64_t capacity = 4096;
+
+		alignas(64) std::atomic<int64_t> top_ = 0;
+		alignas(64) std::atomic<int64_t> bottom_ = 0;
+		std::unique_ptr<std::atomic<Job *>[]> jobs_ = std::make_unique<std::atomic<Job *>[]>(capacity);
+	};
+
+	// Queue and counters of one thread, index zero is the main thread
+	struct alignas(64) ThreadState
+	{
+		WorkDeque deque;
+		std::atomic<uint64_t> executed_jobs = 0;
+		std::atomic<uint64_t> stolen_jobs = 0;
+		uint32_t steal_seed;
+
+		// Only touched by the owning thread
+		Job *free_jobs = nullptr;
+		uint32_t free_job_count = 0;
+	};
+
+	std::vector<std::unique_ptr<ThreadState>> threads_{};
+	std::vector<std::thread> workers_{};
+	std::thread::id main_thread_id_;
+
+	// Jobs submitted from threads that don't belong to the system
+	std::mutex shared_mutex_{};
+	std::vector<Job *> shared_jobs_{};
+	std::atomic<uint32_t> shared_job_count_ = 0;
+
+	// Jobs are never freed before the system is destroyed. Executed jobs go to the free list of the thread that ran
+	// them, threads with too many hand a batch to the shared list and threads without any take one from it.
+	std::mutex job_pool_mutex_{};
+	std::vector<std::unique_ptr<Job[]>> job_blocks_{};
+	Job *shared_free_jobs_ = nullptr;
+
+	std::mutex main_thread_mutex_{};
+	Job *main_thread_jobs_ = nullptr;
+	Job *last_main_thread_job_ = nullptr;
+	std::atomic<uint64_t> main_thread_executed_ = 0;
+
+	// Idle workers sleep until the submitted job count changes
+	std::mutex sleep_mutex_{};
+	std::condition_variable sleep_condition_{};
+	std::atomic<uint64_t> submitted_jobs_ = 0;
+	std::atomic<uint32_t> sleeping_workers_ = 0;
+	std::atomic<bool> stopping_ = false;
+
+	///// Private methods
+
+	void worker_loop(uint32_t thread_index);
+	// Links count new jobs into the shared free list, job_pool_mutex_ has to be held
+	void add_job_block(uint32_t count);
+	Job *allocate_job(JobFunction work, JobGroup *group);
+	void free_job(Job *job, uint32_t thread_index);
+	void submit_graph_node(JobGraph &graph, JobGraph::Node node, JobGroup &group);
+	void push(Job *job);
+	void wake_workers();
+	// Own deque first, then the shared jobs, then the other threads
+	Job *find_job(uint32_t thread_index);
+	void execute(Job *job, uint32_t thread_index);
+	void split_range(uint32_t begin, uint32_t end, uint32_t grain, const RangeFunction &function, JobGroup &group);
+
+	// Index of the calling thread in threads_, or no_thread for threads that don't belong to this system
+	[[nodiscard]] uint32_t thread_index() const;
+
+	static constexpr uint32_t no_thread = UINT32_MAX;
+};
+
+// Runs function over the whole range on the calling thread when there is no job system
+void parallel_for(JobSystem *job_system, uint32_t begin, uint32_t end, uint32_t grain, const RangeFunction &function);
+
+// Runs kernel over the range like parallel_for and appends the elements the chunks kept to out, in range order.
+// Every chunk writes into its own part of out, which is compacted afterwards, so out needs room for the whole range
+// but only reallocates while its capacity grows. Returns the number of chunks.
+uint32_t parallel_compact(JobSystem *job_system, uint32_t begin, uint32_t end, uint32_t grain, const CompactFunction &kernel, std::vector<uint32_t> &out);
+
+}// namespace flwfrg
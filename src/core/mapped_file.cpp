@@ -0,0 +1,149 @@
+#include "pch.hpp"
+
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace flwfrg
+{
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+	: data_{other.data_},
+	  size_{other.size_}
+#ifdef _WIN32
+	  ,
+	  file_handle_{other.file_handle_},
+	  mapping_handle_{other.mapping_handle_}
+#endif
+{
+	other.data_ = nullptr;
+	other.size_ = 0;
+#ifdef _WIN32
+	other.file_handle_ = nullptr;
+	other.mapping_handle_ = nullptr;
+#endif
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+
+		data_ = other.data_;
+		size_ = other.size_;
+		other.data_ = nullptr;
+		other.size_ = 0;
+#ifdef _WIN32
+		file_handle_ = other.file_handle_;
+		mapping_handle_ = other.mapping_handle_;
+		other.file_handle_ = nullptr;
+		other.mapping_handle_ = nullptr;
+#endif
+	}
+	return *this;
+}
+
+std::optional<MappedFile> MappedFile::open(const std::string &path)
+{
+	MappedFile result{};
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		FLOWFORGE_ERROR("Failed to open file: {}", path);
+		return std::nullopt;
+	}
+	result.file_handle_ = file;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+	{
+		FLOWFORGE_ERROR("Failed to get size of file: {}", path);
+		return std::nullopt;
+	}
+	result.size_ = static_cast<size_t>(file_size.QuadPart);
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		FLOWFORGE_ERROR("Failed to create file mapping: {}", path);
+		return std::nullopt;
+	}
+	result.mapping_handle_ = mapping;
+
+	result.data_ = static_cast<const std::byte *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (result.data_ == nullptr)
+	{
+		FLOWFORGE_ERROR("Failed to map file: {}", path);
+		return std::nullopt;
+	}
+#else
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file == -1)
+	{
+		FLOWFORGE_ERROR("Failed to open file: {}", path);
+		return std::nullopt;
+	}
+
+	struct stat file_stat{};
+	if (fstat(file, &file_stat) != 0 || file_stat.st_size == 0)
+	{
+		FLOWFORGE_ERROR("Failed to get size of file: {}", path);
+		::close(file);
+		return std::nullopt;
+	}
+	result.size_ = static_cast<size_t>(file_stat.st_size);
+
+	void *data = mmap(nullptr, result.size_, PROT_READ, MAP_PRIVATE, file, 0);
+	// The mapping keeps its own reference to the file
+	::close(file);
+	if (data == MAP_FAILED)
+	{
+		FLOWFORGE_ERROR("Failed to map file: {}", path);
+		result.size_ = 0;
+		return std::nullopt;
+	}
+
+	// Start reading ahead, the whole payload is consumed right after opening
+	madvise(data, result.size_, MADV_WILLNEED);
+	result.data_ = static_cast<const std::byte *>(data);
+#endif
+
+	return result;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (data_ != nullptr)
+		UnmapViewOfFile(data_);
+	if (mapping_handle_ != nullptr)
+		CloseHandle(mapping_handle_);
+	if (file_handle_ != nullptr)
+		CloseHandle(file_handle_);
+	file_handle_ = nullptr;
+	mapping_handle_ = nullptr;
+#else
+	if (data_ != nullptr)
+		munmap(const_cast<std::byte *>(data_), size_);
+#endif
+	data_ = nullptr;
+	size_ = 0;
+}
+
+}// namespace flwfrg
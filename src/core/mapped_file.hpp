@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+
+namespace flwfrg
+{
+
+/// <summary>
+/// Read only memory mapping of a whole file.
+/// </summary>
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	// Not copyable but movable
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+	MappedFile(MappedFile &&other) noexcept;
+	MappedFile &operator=(MappedFile &&other) noexcept;
+
+	static std::optional<MappedFile> open(const std::string &path);
+
+	[[nodiscard]] inline const std::byte *data() const { return data_; }
+	[[nodiscard]] inline size_t size() const { return size_; }
+	[[nodiscard]] inline std::span<const std::byte> bytes() const { return {data_, size_}; }
+
+private:
+	const std::byte *data_ = nullptr;
+	size_t size_ = 0;
+
+#ifdef _WIN32
+	void *file_handle_ = nullptr;
+	void *mapping_handle_ = nullptr;
+#endif
+
+	void close();
+};
+
+}// namespace flwfrg
@@ -531,18 +531,30 @@ int main(int, char **)
 
 #include "application.hpp"
 
-int main()
+#include <cstdlib>
+#include <string_view>
+
+// FlowForge --check-allocations [frames] renders a warm up and then the frames, 600 by default, and fails when
+// any of them allocated. Needs a build configured with FLOWFORGE_ALLOCATION_TRACKING.
+int main(int argc, char **argv)
 {
 	flwfrg::Logger::init();
 
+	const bool check_allocations = argc > 1 && std::string_view{argv[1]} == "--check-allocations";
+	const uint32_t checked_frames = check_allocations && argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)) : 600;
+
 	try
 	{
 		flwfrg::Application application{};
 
+		if (check_allocations)
+			return application.run_allocation_check(120, checked_frames) ? 0 : 1;
+
 		application.run();
 	} catch (const std::exception &e)
 	{
 		FLOWFORGE_FATAL(e.what());
+		return 1;
 	}
 
 	return 0;
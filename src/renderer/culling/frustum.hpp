@@ -0,0 +1,65 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+
+#include <glm/glm.hpp>
+
+#include <array>
+
+namespace flwfrg
+{
+
+/// <summary>
+/// View frustum as six inward facing planes (xyz normal, w distance), normalized so
+/// plane distances are in world units.
+/// </summary>
+struct Frustum
+{
+	enum Plane
+	{
+		PLANE_LEFT = 0,
+		PLANE_RIGHT,
+		PLANE_BOTTOM,
+		PLANE_TOP,
+		PLANE_NEAR,
+		PLANE_FAR
+	};
+
+	std::array<glm::vec4, 6> planes{};
+
+	// Extracts the planes from a projection * view matrix with a [0, 1] depth range
+	static Frustum from_view_projection(const glm::mat4 &view_projection)
+	{
+		const glm::vec4 row0{view_projection[0][0], view_projection[1][0], view_projection[2][0], view_projection[3][0]};
+		const glm::vec4 row1{view_projection[0][1], view_projection[1][1], view_projection[2][1], view_projection[3][1]};
+		const glm::vec4 row2{view_projection[0][2], view_projection[1][2], view_projection[2][2], view_projection[3][2]};
+		const glm::vec4 row3{view_projection[0][3], view_projection[1][3], view_projection[2][3], view_projection[3][3]};
+
+		Frustum frustum;
+		frustum.planes[PLANE_LEFT] = row3 + row0;
+		frustum.planes[PLANE_RIGHT] = row3 - row0;
+		frustum.planes[PLANE_BOTTOM] = row3 + row1;
+		frustum.planes[PLANE_TOP] = row3 - row1;
+		frustum.planes[PLANE_NEAR] = row2;
+		frustum.planes[PLANE_FAR] = row3 - row2;
+
+		for (glm::vec4 &plane: frustum.planes)
+		{
+			plane /= glm::length(glm::vec3(plane));
+		}
+		return frustum;
+	}
+
+	[[nodiscard]] bool intersects_sphere(const glm::vec3 &center, float radius) const
+	{
+		for (const glm::vec4 &plane: planes)
+		{
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+				return false;
+		}
+		return true;
+	}
+};
+
+}// namespace flwfrg
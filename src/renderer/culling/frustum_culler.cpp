@@ -0,0 +1,284 @@
+#include "pch.hpp"
+
+#include "frustum_culler.hpp"
+
+#include "core/cpu_features.hpp"
+#include "core/job_system.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <chrono>
+
+namespace flwfrg
+{
+
+///// Local helper functions
+
+namespace
+{
+
+// Smallest range culled by one job, a multiple of 8 so only the last chunk has a scalar tail
+constexpr uint32_t objects_per_chunk = 4 * 1024;
+
+/// <summary>
+/// Frustum planes split into components, with the AABB corner furthest along each plane normal.
+/// </summary>
+struct CullPlanes
+{
+	float normal_x[6];
+	float normal_y[6];
+	float normal_z[6];
+	float distance[6];
+
+	// Corner arrays of the positive vertex per plane
+	const float *positive_x[6];
+	const float *positive_y[6];
+	const float *positive_z[6];
+};
+
+struct CullArrays
+{
+	const float *center_x;
+	const float *center_y;
+	const float *center_z;
+	const float *radius;
+};
+
+uint32_t cull_scalar(const CullPlanes &planes, const CullArrays &arrays, uint32_t begin, uint32_t end, CullObjectHandle *out)
+{
+	uint32_t count = 0;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		bool visible = true;
+		for (int p = 0; p < 6; p++)
+		{
+			const float sphere_distance = planes.normal_x[p] * arrays.center_x[i] + planes.normal_y[p] * arrays.center_y[i] + planes.normal_z[p] * arrays.center_z[i] + planes.distance[p];
+			const float box_distance = planes.normal_x[p] * planes.positive_x[p][i] + planes.normal_y[p] * planes.positive_y[p][i] + planes.normal_z[p] * planes.positive_z[p][i] + planes.distance[p];
+			visible &= (sphere_distance >= -arrays.radius[i]) & (box_distance >= 0.0f);
+		}
+
+		// Write unconditionally, only the count decides what is kept
+		out[count] = i;
+		count += visible ? 1 : 0;
+	}
+	return count;
+}
+
+#if FLOWFORGE_X86
+
+FLOWFORGE_TARGET_SSE uint32_t cull_sse(const CullPlanes &planes, const CullArrays &arrays, uint32_t begin, uint32_t end, CullObjectHandle *out)
+{
+	__m128 normal_x[6], normal_y[6], normal_z[6], distance[6];
+	for (int p = 0; p < 6; p++)
+	{
+		normal_x[p] = _mm_set1_ps(planes.normal_x[p]);
+		normal_y[p] = _mm_set1_ps(planes.normal_y[p]);
+		normal_z[p] = _mm_set1_ps(planes.normal_z[p]);
+		distance[p] = _mm_set1_ps(planes.distance[p]);
+	}
+	const __m128 zero = _mm_setzero_ps();
+
+	uint32_t count = 0;
+	uint32_t i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		const __m128 center_x = _mm_loadu_ps(arrays.center_x + i);
+		const __m128 center_y = _mm_loadu_ps(arrays.center_y + i);
+		const __m128 center_z = _mm_loadu_ps(arrays.center_z + i);
+		const __m128 negative_radius = _mm_sub_ps(zero, _mm_loadu_ps(arrays.radius + i));
+
+		__m128 visible = _mm_cmpeq_ps(zero, zero);
+		for (int p = 0; p < 6; p++)
+		{
+			__m128 sphere_distance = _mm_add_ps(_mm_mul_ps(normal_x[p], center_x), distance[p]);
+			sphere_distance = _mm_add_ps(_mm_mul_ps(normal_y[p], center_y), sphere_distance);
+			sphere_distance = _mm_add_ps(_mm_mul_ps(normal_z[p], center_z), sphere_distance);
+
+			__m128 box_distance = _mm_add_ps(_mm_mul_ps(normal_x[p], _mm_loadu_ps(planes.positive_x[p] + i)), distance[p]);
+			box_distance = _mm_add_ps(_mm_mul_ps(normal_y[p], _mm_loadu_ps(planes.positive_y[p] + i)), box_distance);
+			box_distance = _mm_add_ps(_mm_mul_ps(normal_z[p], _mm_loadu_ps(planes.positive_z[p] + i)), box_distance);
+
+			visible = _mm_and_ps(visible, _mm_and_ps(_mm_cmpge_ps(sphere_distance, negative_radius), _mm_cmpge_ps(box_distance, zero)));
+		}
+
+		for (uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(visible)); mask != 0; mask &= mask - 1)
+		{
+			out[count++] = i + std::countr_zero(mask);
+		}
+	}
+
+	return count + cull_scalar(planes, arrays, i, end, out + count);
+}
+
+FLOWFORGE_TARGET_AVX2 uint32_t cull_avx2(const CullPlanes &planes, const CullArrays &arrays, uint32_t begin, uint32_t end, CullObjectHandle *out)
+{
+	__m256 normal_x[6], normal_y[6], normal_z[6], distance[6];
+	for (int p = 0; p < 6; p++)
+	{
+		normal_x[p] = _mm256_set1_ps(planes.normal_x[p]);
+		normal_y[p] = _mm256_set1_ps(planes.normal_y[p]);
+		normal_z[p] = _mm256_set1_ps(planes.normal_z[p]);
+		distance[p] = _mm256_set1_ps(planes.distance[p]);
+	}
+	const __m256 zero = _mm256_setzero_ps();
+
+	uint32_t count = 0;
+	uint32_t i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		const __m256 center_x = _mm256_loadu_ps(arrays.center_x + i);
+		const __m256 center_y = _mm256_loadu_ps(arrays.center_y + i);
+		const __m256 center_z = _mm256_loadu_ps(arrays.center_z + i);
+		const __m256 negative_radius = _mm256_sub_ps(zero, _mm256_loadu_ps(arrays.radius + i));
+
+		__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			__m256 sphere_distance = _mm256_add_ps(_mm256_mul_ps(normal_x[p], center_x), distance[p]);
+			sphere_distance = _mm256_add_ps(_mm256_mul_ps(normal_y[p], center_y), sphere_distance);
+			sphere_distance = _mm256_add_ps(_mm256_mul_ps(normal_z[p], center_z), sphere_distance);
+
+			__m256 box_distance = _mm256_add_ps(_mm256_mul_ps(normal_x[p], _mm256_loadu_ps(planes.positive_x[p] + i)), distance[p]);
+			box_distance = _mm256_add_ps(_mm256_mul_ps(normal_y[p], _mm256_loadu_ps(planes.positive_y[p] + i)), box_distance);
+			box_distance = _mm256_add_ps(_mm256_mul_ps(normal_z[p], _mm256_loadu_ps(planes.positive_z[p] + i)), box_distance);
+
+			const __m256 inside = _mm256_and_ps(_mm256_cmp_ps(sphere_distance, negative_radius, _CMP_GE_OQ),
+												_mm256_cmp_ps(box_distance, zero, _CMP_GE_OQ));
+			visible = _mm256_and_ps(visible, inside);
+		}
+
+		for (uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(visible)); mask != 0; mask &= mask - 1)
+		{
+			out[count++] = i + std::countr_zero(mask);
+		}
+	}
+
+	return count + cull_scalar(planes, arrays, i, end, out + count);
+}
+
+#endif
+
+}// namespace
+
+
+///// Method implementations
+
+FrustumCuller::FrustumCuller()
+	: instruction_set_{supported_instruction_set()}
+{
+}
+
+CullObjectHandle FrustumCuller::add(const glm::vec3 &center, float radius, const glm::vec3 &aabb_min, const glm::vec3 &aabb_max)
+{
+	center_x_.push_back(center.x);
+	center_y_.push_back(center.y);
+	center_z_.push_back(center.z);
+	radius_.push_back(radius);
+	min_x_.push_back(aabb_min.x);
+	min_y_.push_back(aabb_min.y);
+	min_z_.push_back(aabb_min.z);
+	max_x_.push_back(aabb_max.x);
+	max_y_.push_back(aabb_max.y);
+	max_z_.push_back(aabb_max.z);
+
+	return static_cast<CullObjectHandle>(radius_.size() - 1);
+}
+
+void FrustumCuller::set_bounds(CullObjectHandle object, const glm::vec3 &center, float radius, const glm::vec3 &aabb_min, const glm::vec3 &aabb_max)
+{
+	assert(object < radius_.size());
+
+	center_x_[object] = center.x;
+	center_y_[object] = center.y;
+	center_z_[object] = center.z;
+	radius_[object] = radius;
+	min_x_[object] = aabb_min.x;
+	min_y_[object] = aabb_min.y;
+	min_z_[object] = aabb_min.z;
+	max_x_[object] = aabb_max.x;
+	max_y_[object] = aabb_max.y;
+	max_z_[object] = aabb_max.z;
+}
+
+void FrustumCuller::clear()
+{
+	for (std::vector<float> *array: {&center_x_, &center_y_, &center_z_, &radius_, &min_x_, &min_y_, &min_z_, &max_x_, &max_y_, &max_z_})
+	{
+		array->clear();
+	}
+}
+
+void FrustumCuller::reserve(size_t count)
+{
+	for (std::vector<float> *array: {&center_x_, &center_y_, &center_z_, &radius_, &min_x_, &min_y_, &min_z_, &max_x_, &max_y_, &max_z_})
+	{
+		array->reserve(count);
+	}
+}
+
+void FrustumCuller::cull(const Frustum &frustum, std::vector<CullObjectHandle> &out_visible)
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	const uint32_t object_count = static_cast<uint32_t>(size());
+
+	// The chunks are gathered in order, so the output stays sorted
+	out_visible.clear();
+	const uint32_t chunk_count = parallel_compact(job_system_, 0, object_count, objects_per_chunk, [&](uint32_t begin, uint32_t end, CullObjectHandle *out) {
+		return cull_range(frustum, begin, end, out);
+	}, out_visible);
+
+	statistics_.objects = object_count;
+	statistics_.visible = static_cast<uint32_t>(out_visible.size());
+	statistics_.partitions = chunk_count;
+	statistics_.microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+void FrustumCuller::set_instruction_set(InstructionSet instruction_set)
+{
+	if (static_cast<uint8_t>(instruction_set) > static_cast<uint8_t>(supported_instruction_set()))
+	{
+		FLOWFORGE_WARN("Requested culling instruction set is not supported by this CPU");
+		return;
+	}
+	instruction_set_ = instruction_set;
+}
+
+void FrustumCuller::set_job_system(JobSystem *job_system)
+{
+	job_system_ = job_system;
+}
+
+uint32_t FrustumCuller::cull_range(const Frustum &frustum, uint32_t begin, uint32_t end, CullObjectHandle *out) const
+{
+	CullPlanes planes{};
+	for (int p = 0; p < 6; p++)
+	{
+		const glm::vec4 &plane = frustum.planes[p];
+		planes.normal_x[p] = plane.x;
+		planes.normal_y[p] = plane.y;
+		planes.normal_z[p] = plane.z;
+		planes.distance[p] = plane.w;
+
+		planes.positive_x[p] = plane.x >= 0.0f ? max_x_.data() : min_x_.data();
+		planes.positive_y[p] = plane.y >= 0.0f ? max_y_.data() : min_y_.data();
+		planes.positive_z[p] = plane.z >= 0.0f ? max_z_.data() : min_z_.data();
+	}
+
+	const CullArrays arrays{center_x_.data(), center_y_.data(), center_z_.data(), radius_.data()};
+
+	switch (instruction_set_)
+	{
+#if FLOWFORGE_X86
+		case InstructionSet::AVX2:
+			return cull_avx2(planes, arrays, begin, end, out);
+		case InstructionSet::SSE:
+			return cull_sse(planes, arrays, begin, end, out);
+#endif
+		default:
+			return cull_scalar(planes, arrays, begin, end, out);
+	}
+}
+
+}// namespace flwfrg
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "core/cpu_features.hpp"
+#include "frustum.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace flwfrg
+{
+
+class JobSystem;
+
+using CullObjectHandle = uint32_t;
+
+struct FrustumCullerStatistics
+{
+	uint32_t objects = 0;
+	uint32_t visible = 0;
+	// Chunks culled by separate jobs
+	uint32_t partitions = 0;
+	double microseconds = 0.0;
+
+	[[nodiscard]] inline double objects_per_microsecond() const { return microseconds > 0.0 ? objects / microseconds : 0.0; };
+};
+
+/// <summary>
+/// World space bounding spheres and AABBs in structure of arrays form, tested against a frustum
+/// 8 objects at a time. An object is visible when both its sphere and its AABB intersect the frustum.
+/// Large sets are split into chunks that are culled by the jobs of a job system, when one is set.
+/// </summary>
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+
+	// Methods
+
+	CullObjectHandle add(const glm::vec3 &center, float radius, const glm::vec3 &aabb_min, const glm::vec3 &aabb_max);
+	void set_bounds(CullObjectHandle object, const glm::vec3 &center, float radius, const glm::vec3 &aabb_min, const glm::vec3 &aabb_max);
+	void clear();
+	void reserve(size_t count);
+
+	// Writes the handles of the visible objects in ascending order
+	void cull(const Frustum &frustum, std::vector<CullObjectHandle> &out_visible);
+
+	// Forces an instruction set, the best supported one is used by default
+	void set_instruction_set(InstructionSet instruction_set);
+	// Culls on the calling thread alone without one
+	void set_job_system(JobSystem *job_system);
+
+	[[nodiscard]] inline size_t size() const { return radius_.size(); };
+	[[nodiscard]] inline InstructionSet instruction_set() const { return instruction_set_; };
+	[[nodiscard]] inline const FrustumCullerStatistics &statistics() const { return statistics_; };
+
+private:
+	std::vector<float> center_x_{};
+	std::vector<float> center_y_{};
+	std::vector<float> center_z_{};
+	std::vector<float> radius_{};
+	std::vector<float> min_x_{};
+	std::vector<float> min_y_{};
+	std::vector<float> min_z_{};
+	std::vector<float> max_x_{};
+	std::vector<float> max_y_{};
+	std::vector<float> max_z_{};
+
+	InstructionSet instruction_set_;
+	JobSystem *job_system_ = nullptr;
+
+	FrustumCullerStatistics statistics_{};
+
+	// Returns the number of visible handles written to out
+	uint32_t cull_range(const Frustum &frustum, uint32_t begin, uint32_t end, CullObjectHandle *out) const;
+};
+
+}// namespace flwfrg
@@ -0,0 +1,55 @@
+#include "pch.hpp"
+
+#include "lod_selector.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace flwfrg
+{
+
+///// Method implementations
+
+LodSelector::LodSelector(Settings settings)
+	: settings_{settings}
+{
+}
+
+void LodSelector::update(const glm::mat4 &projection, float viewport_height, float near_clip, float far_clip)
+{
+	// The vertical focal length in pixels, the projection may flip y
+	pixels_per_unit_ = std::abs(projection[1][1]) * viewport_height * 0.5f;
+	near_clip_ = near_clip;
+	far_clip_ = std::max(far_clip, near_clip);
+}
+
+float LodSelector::distance(const glm::vec3 &view_center, float radius) const
+{
+	return std::clamp(glm::length(view_center) - radius, near_clip_, far_clip_);
+}
+
+uint32_t LodSelector::select(std::span<const MeshLod> lods, float distance, float scale, uint32_t previous) const
+{
+	if (lods.size() <= 1)
+		return 0;
+
+	// Projected error relative to the allowed one
+	const float factor = scale * error_scale() / std::max(distance, near_clip_);
+
+	// Levels get coarser and their errors only grow, so stop at the first one over the limit
+	auto coarsest_under = [&](float limit) {
+		uint32_t level = 0;
+		while (level + 1 < lods.size() && lods[level + 1].error * factor <= limit)
+			level++;
+		return level;
+	};
+
+	// Without a previous level, or when it became too coarse, go straight to the right level
+	if (previous >= lods.size() || lods[previous].error * factor > 1.0f)
+		return coarsest_under(1.0f);
+
+	// Only get coarser once the level is comfortably under the limit
+	return std::max(previous, coarsest_under(1.0f - settings_.hysteresis));
+}
+
+}// namespace flwfrg
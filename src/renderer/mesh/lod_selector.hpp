@@ -0,0 +1,58 @@
+#pragma once
+
+#include "mesh_data.hpp"
+
+#include <span>
+
+namespace flwfrg
+{
+
+/// <summary>
+/// Picks detail levels by the screen space size of their error. A level is allowed while its error,
+/// projected at the distance of the closest point of the bounds, stays under max_pixel_error.
+/// With a previous level, coarser levels must stay under the threshold scaled by (1 - hysteresis),
+/// so objects near the switching distance don't flicker between two levels.
+/// </summary>
+class LodSelector
+{
+public:
+	struct Settings
+	{
+		float max_pixel_error = 1.0f;
+		float hysteresis = 0.25f;
+	};
+
+	// Previous level of an object that has none yet
+	static constexpr uint32_t no_level = ~0u;
+
+public:
+	LodSelector() = default;
+	explicit LodSelector(Settings settings);
+
+	// Methods
+
+	// Call once per frame with the projection the frame is drawn with
+	void update(const glm::mat4 &projection, float viewport_height, float near_clip, float far_clip);
+
+	// Distance from the camera to the closest point of a view space bounding sphere, clamped to the clip range
+	[[nodiscard]] float distance(const glm::vec3 &view_center, float radius) const;
+
+	// Scale is the largest axis scale of the model matrix
+	[[nodiscard]] uint32_t select(std::span<const MeshLod> lods, float distance, float scale, uint32_t previous = no_level) const;
+
+	// Pixels covered by one object space unit at distance one, divided by the allowed error
+	[[nodiscard]] inline float error_scale() const { return pixels_per_unit_ / settings_.max_pixel_error; };
+	[[nodiscard]] inline float hysteresis() const { return settings_.hysteresis; };
+	[[nodiscard]] inline float near_clip() const { return near_clip_; };
+	[[nodiscard]] inline float far_clip() const { return far_clip_; };
+	[[nodiscard]] inline const Settings &settings() const { return settings_; };
+
+private:
+	Settings settings_{};
+
+	float pixels_per_unit_ = 0.0f;
+	float near_clip_ = 0.1f;
+	float far_clip_ = 1000.0f;
+};
+
+}// namespace flwfrg
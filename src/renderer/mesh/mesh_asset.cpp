@@ -0,0 +1,292 @@
+#include "pch.hpp"
+
+#include "mesh_asset.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace flwfrg
+{
+
+///// Local helper functions
+
+namespace
+{
+
+constexpr uint64_t align_up(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+uint32_t index_size(IndexType type)
+{
+	return type == IndexType::UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+bool section_valid(uint64_t offset, uint64_t size, size_t file_size)
+{
+	return offset % mesh_asset_alignment == 0 && offset <= file_size && size <= file_size - offset;
+}
+
+template<typename T>
+std::span<const T> section(const std::byte *data, uint64_t offset, uint32_t count)
+{
+	return {reinterpret_cast<const T *>(data + offset), count};
+}
+
+}// namespace
+
+
+///// Cooking
+
+bool write_mesh_asset(const std::string &path, std::span<const MeshAssetSource> meshes, std::span<const std::string> materials)
+{
+	MeshAssetHeader header{};
+	header.magic = mesh_asset_magic;
+	header.version = mesh_asset_version;
+	header.vertex_stride = sizeof(CompactVertex3d);
+	header.mesh_count = static_cast<uint32_t>(meshes.size());
+	header.material_count = static_cast<uint32_t>(materials.size());
+
+	// Build the tables and compute the payload sizes
+	std::vector<MeshAssetMesh> mesh_table;
+	std::vector<MeshAssetSubmesh> submesh_table;
+	std::vector<MeshAssetLod> lod_table;
+	uint64_t vertex_count = 0;
+	uint64_t index_bytes = 0;
+
+	for (const MeshAssetSource &source: meshes)
+	{
+		assert(source.mesh != nullptr);
+		const MeshData &mesh = *source.mesh;
+
+		// Texture coordinates are stored as unorm16
+		const bool wrapping = std::any_of(mesh.vertices.begin(), mesh.vertices.end(), [](const Vertex3d &vertex) {
+			const glm::vec2 uv = vertex.texture_coordiante;
+			return uv.x < 0.0f || uv.y < 0.0f || uv.x > 1.0f || uv.y > 1.0f;
+		});
+		if (wrapping)
+		{
+			FLOWFORGE_WARN("Mesh {} of '{}' has texture coordinates outside of [0, 1], they are clamped", mesh_table.size(), path);
+		}
+
+		MeshAssetMesh entry{};
+		entry.bounds = mesh.compute_bounds();
+		entry.vertex_offset = static_cast<uint32_t>(vertex_count);
+		entry.vertex_count = static_cast<uint32_t>(mesh.vertices.size());
+		entry.index_byte_offset = index_bytes;
+		entry.index_count = static_cast<uint32_t>(mesh.indices.size());
+		entry.index_type = mesh.index_type();
+		entry.first_submesh = static_cast<uint32_t>(submesh_table.size());
+
+		if (source.submeshes.empty())
+		{
+			// Without LODs the whole mesh is the full detail range, with them only the indices before the first level
+			const uint32_t index_count = source.lods.empty() || source.lods[0].empty() ? entry.index_count : source.lods[0][0].first_index;
+			submesh_table.push_back({0, index_count, 0, 0, 0, 0});
+		} else
+		{
+			submesh_table.insert(submesh_table.end(), source.submeshes.begin(), source.submeshes.end());
+		}
+		entry.submesh_count = static_cast<uint32_t>(submesh_table.size()) - entry.first_submesh;
+		assert(source.lods.size() <= entry.submesh_count);
+
+		for (uint32_t i = 0; i < entry.submesh_count; i++)
+		{
+			MeshAssetSubmesh &submesh = submesh_table[entry.first_submesh + i];
+			submesh.first_lod = static_cast<uint32_t>(lod_table.size());
+			submesh.lod_count = 0;
+			if (i >= source.lods.size())
+				continue;
+
+			for (const MeshLod &lod: source.lods[i])
+			{
+				assert(uint64_t{lod.first_index} + lod.index_count <= mesh.indices.size());
+				lod_table.push_back({lod.first_index, lod.index_count, lod.error, 0});
+			}
+			submesh.lod_count = static_cast<uint32_t>(lod_table.size()) - submesh.first_lod;
+		}
+
+		vertex_count += entry.vertex_count;
+		// Keep every mesh's indices 4 byte aligned, so they can be addressed by either index type
+		index_bytes = align_up(index_bytes + uint64_t{entry.index_count} * index_size(entry.index_type), 4);
+
+		mesh_table.push_back(entry);
+	}
+	header.submesh_count = static_cast<uint32_t>(submesh_table.size());
+	header.lod_count = static_cast<uint32_t>(lod_table.size());
+
+	std::vector<MeshAssetMaterial> material_table(materials.size());
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		std::strncpy(material_table[i].name, materials[i].c_str(), sizeof(MeshAssetMaterial::name) - 1);
+	}
+
+	// Section layout
+	uint64_t offset = align_up(sizeof(MeshAssetHeader), mesh_asset_alignment);
+	header.meshes_offset = offset;
+	offset = align_up(offset + mesh_table.size() * sizeof(MeshAssetMesh), mesh_asset_alignment);
+	header.submeshes_offset = offset;
+	offset = align_up(offset + submesh_table.size() * sizeof(MeshAssetSubmesh), mesh_asset_alignment);
+	header.lods_offset = offset;
+	offset = align_up(offset + lod_table.size() * sizeof(MeshAssetLod), mesh_asset_alignment);
+	header.materials_offset = offset;
+	offset = align_up(offset + material_table.size() * sizeof(MeshAssetMaterial), mesh_asset_alignment);
+	header.vertex_data_offset = offset;
+	header.vertex_data_size = vertex_count * sizeof(CompactVertex3d);
+	offset = align_up(offset + header.vertex_data_size, mesh_asset_alignment);
+	header.index_data_offset = offset;
+	header.index_data_size = index_bytes;
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		FLOWFORGE_ERROR("Failed to open file for writing: {}", path);
+		return false;
+	}
+
+	auto write_at = [&file](uint64_t position, const void *data, uint64_t size) {
+		// Pad up to the section start
+		static constexpr char zeros[mesh_asset_alignment]{};
+		for (uint64_t current = file.tellp(); current < position; current = file.tellp())
+		{
+			file.write(zeros, static_cast<std::streamsize>(std::min<uint64_t>(position - current, sizeof(zeros))));
+		}
+		file.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(size));
+	};
+
+	write_at(0, &header, sizeof(header));
+	write_at(header.meshes_offset, mesh_table.data(), mesh_table.size() * sizeof(MeshAssetMesh));
+	write_at(header.submeshes_offset, submesh_table.data(), submesh_table.size() * sizeof(MeshAssetSubmesh));
+	write_at(header.lods_offset, lod_table.data(), lod_table.size() * sizeof(MeshAssetLod));
+	write_at(header.materials_offset, material_table.data(), material_table.size() * sizeof(MeshAssetMaterial));
+
+	write_at(header.vertex_data_offset, nullptr, 0);
+	for (const MeshAssetSource &source: meshes)
+	{
+		const std::vector<CompactVertex3d> vertices = source.mesh->compact_vertices();
+		file.write(reinterpret_cast<const char *>(vertices.data()), static_cast<std::streamsize>(vertices.size() * sizeof(CompactVertex3d)));
+	}
+
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		const MeshData &mesh = *meshes[i].mesh;
+		write_at(header.index_data_offset + mesh_table[i].index_byte_offset, nullptr, 0);
+		if (mesh_table[i].index_type == IndexType::UINT16)
+		{
+			std::vector<uint16_t> indices = mesh.indices_16();
+			file.write(reinterpret_cast<const char *>(indices.data()), static_cast<std::streamsize>(indices.size() * sizeof(uint16_t)));
+		} else
+		{
+			file.write(reinterpret_cast<const char *>(mesh.indices.data()), static_cast<std::streamsize>(mesh.indices.size() * sizeof(uint32_t)));
+		}
+	}
+	write_at(header.index_data_offset + header.index_data_size, nullptr, 0);
+
+	if (!file.good())
+	{
+		FLOWFORGE_ERROR("Failed to write mesh asset: {}", path);
+		return false;
+	}
+
+	FLOWFORGE_INFO("Wrote mesh asset '{}' ({} meshes, {} vertices, {} detail levels)", path, header.mesh_count, vertex_count, header.lod_count);
+	return true;
+}
+
+
+///// Loading
+
+std::optional<MeshAsset> MeshAsset::open(const std::string &path)
+{
+	std::optional<MappedFile> file = MappedFile::open(path);
+	if (!file.has_value())
+	{
+		return std::nullopt;
+	}
+
+	const std::byte *data = file->data();
+	const size_t size = file->size();
+
+	if (size < sizeof(MeshAssetHeader))
+	{
+		FLOWFORGE_ERROR("Mesh asset '{}' is too small", path);
+		return std::nullopt;
+	}
+
+	const auto *header = reinterpret_cast<const MeshAssetHeader *>(data);
+	if (header->magic != mesh_asset_magic || header->version != mesh_asset_version)
+	{
+		FLOWFORGE_ERROR("Mesh asset '{}' has an invalid header (magic {:#x}, version {})", path, header->magic, header->version);
+		return std::nullopt;
+	}
+	if (header->vertex_stride != sizeof(CompactVertex3d))
+	{
+		FLOWFORGE_ERROR("Mesh asset '{}' has vertex stride {}, expected {}", path, header->vertex_stride, sizeof(CompactVertex3d));
+		return std::nullopt;
+	}
+
+	// Validate every section before handing out views into the mapping
+	if (!section_valid(header->meshes_offset, uint64_t{header->mesh_count} * sizeof(MeshAssetMesh), size) ||
+		!section_valid(header->submeshes_offset, uint64_t{header->submesh_count} * sizeof(MeshAssetSubmesh), size) ||
+		!section_valid(header->lods_offset, uint64_t{header->lod_count} * sizeof(MeshAssetLod), size) ||
+		!section_valid(header->materials_offset, uint64_t{header->material_count} * sizeof(MeshAssetMaterial), size) ||
+		!section_valid(header->vertex_data_offset, header->vertex_data_size, size) ||
+		!section_valid(header->index_data_offset, header->index_data_size, size))
+	{
+		FLOWFORGE_ERROR("Mesh asset '{}' is truncated or corrupt", path);
+		return std::nullopt;
+	}
+
+	MeshAsset asset{};
+	asset.header_ = header;
+	asset.meshes_ = section<MeshAssetMesh>(data, header->meshes_offset, header->mesh_count);
+	asset.submeshes_ = section<MeshAssetSubmesh>(data, header->submeshes_offset, header->submesh_count);
+	asset.materials_ = section<MeshAssetMaterial>(data, header->materials_offset, header->material_count);
+	asset.lods_ = section<MeshAssetLod>(data, header->lods_offset, header->lod_count);
+	asset.vertex_data_ = {data + header->vertex_data_offset, header->vertex_data_size};
+	asset.index_data_ = {data + header->index_data_offset, header->index_data_size};
+
+	for (const MeshAssetMesh &mesh: asset.meshes_)
+	{
+		if ((uint64_t{mesh.vertex_offset} + mesh.vertex_count) * sizeof(CompactVertex3d) > header->vertex_data_size ||
+			mesh.index_byte_offset % 4 != 0 ||
+			mesh.index_byte_offset + uint64_t{mesh.index_count} * index_size(mesh.index_type) > header->index_data_size ||
+			uint64_t{mesh.first_submesh} + mesh.submesh_count > header->submesh_count)
+		{
+			FLOWFORGE_ERROR("Mesh asset '{}' has a mesh entry out of range", path);
+			return std::nullopt;
+		}
+
+		for (const MeshAssetSubmesh &submesh: asset.submeshes(mesh))
+		{
+			if (uint64_t{submesh.first_index} + submesh.index_count > mesh.index_count ||
+				uint64_t{submesh.first_lod} + submesh.lod_count > header->lod_count ||
+				submesh.lod_count >= max_mesh_lods)
+			{
+				FLOWFORGE_ERROR("Mesh asset '{}' has a submesh entry out of range", path);
+				return std::nullopt;
+			}
+			if (submesh.material_index >= header->material_count)
+			{
+				FLOWFORGE_ERROR("Mesh asset '{}' has a submesh with material {}, but only {} materials", path, submesh.material_index, header->material_count);
+				return std::nullopt;
+			}
+
+			for (const MeshAssetLod &lod: asset.lods(submesh))
+			{
+				if (uint64_t{lod.first_index} + lod.index_count > mesh.index_count)
+				{
+					FLOWFORGE_ERROR("Mesh asset '{}' has a detail level out of range", path);
+					return std::nullopt;
+				}
+			}
+		}
+	}
+
+	// Moving the mapping doesn't move the mapped memory, so the views stay valid
+	asset.file_ = std::move(file.value());
+	return asset;
+}
+
+}// namespace flwfrg
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "core/mapped_file.hpp"
+#include "mesh_data.hpp"
+
+#include <optional>
+#include <span>
+#include <string>
+#include <type_traits>
+
+namespace flwfrg
+{
+
+///// On disk layout
+// All sections start at a multiple of mesh_asset_alignment from the beginning of the file,
+// so every struct and payload can be used in place from the mapping.
+
+constexpr uint32_t mesh_asset_magic = 0x414D4646;// "FFMA"
+constexpr uint32_t mesh_asset_version = 3;
+constexpr uint64_t mesh_asset_alignment = 16;
+
+struct MeshAssetHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertex_stride;
+	uint32_t mesh_count;
+	uint32_t submesh_count;
+	uint32_t material_count;
+	uint32_t lod_count;
+	uint32_t _reserved0;
+
+	uint64_t meshes_offset;
+	uint64_t submeshes_offset;
+	uint64_t materials_offset;
+	uint64_t vertex_data_offset;
+	uint64_t vertex_data_size;
+	uint64_t index_data_offset;
+	uint64_t index_data_size;
+	uint64_t lods_offset;
+};
+
+struct MeshAssetMesh
+{
+	// The vertices are CompactVertex3d, quantized to bounds.quantization()
+	MeshBounds bounds;
+	// First vertex, relative to the vertex payload
+	uint32_t vertex_offset;
+	uint32_t vertex_count;
+	// Relative to the index payload. Always 4 byte aligned.
+	uint64_t index_byte_offset;
+	uint32_t index_count;
+	IndexType index_type;
+	uint8_t _reserved[3];
+	uint32_t first_submesh;
+	uint32_t submesh_count;
+};
+
+struct MeshAssetSubmesh
+{
+	// Relative to the first index of the owning mesh
+	uint32_t first_index;
+	uint32_t index_count;
+	uint32_t material_index;
+	// Simplified levels after the full detail range above
+	uint32_t first_lod;
+	uint32_t lod_count;
+	uint32_t _reserved;
+};
+
+struct MeshAssetLod
+{
+	// Relative to the first index of the owning mesh
+	uint32_t first_index;
+	uint32_t index_count;
+	// Object space error against the full detail range
+	float error;
+	uint32_t _reserved;
+};
+
+struct MeshAssetMaterial
+{
+	char name[64];
+};
+
+static_assert(sizeof(MeshAssetHeader) == 96);
+static_assert(sizeof(MeshAssetMesh) == 56);
+static_assert(sizeof(MeshAssetSubmesh) == 24);
+static_assert(sizeof(MeshAssetLod) == 16);
+static_assert(std::is_trivially_copyable_v<MeshAssetMesh> && std::is_trivially_copyable_v<MeshAssetHeader>);
+
+
+///// Cooking
+
+struct MeshAssetSource
+{
+	const MeshData *mesh = nullptr;
+	// If empty, a single submesh using material 0 covers the whole mesh. Their LOD fields are filled in when writing.
+	std::vector<MeshAssetSubmesh> submeshes{};
+	// Simplified levels of every submesh, as returned by MeshSimplifier::generate_lods. May be empty.
+	std::vector<std::vector<MeshLod>> lods{};
+};
+
+bool write_mesh_asset(const std::string &path, std::span<const MeshAssetSource> meshes, std::span<const std::string> materials);
+
+
+///// Loading
+
+/// <summary>
+/// Cooked mesh file mapped into memory. All accessors point straight into the mapping,
+/// nothing is parsed or copied when opening.
+/// </summary>
+class MeshAsset
+{
+public:
+	static std::optional<MeshAsset> open(const std::string &path);
+
+	[[nodiscard]] inline const MeshAssetHeader &header() const { return *header_; }
+	[[nodiscard]] inline std::span<const MeshAssetMesh> meshes() const { return meshes_; }
+	[[nodiscard]] inline std::span<const MeshAssetSubmesh> submeshes() const { return submeshes_; }
+	[[nodiscard]] inline std::span<const MeshAssetMaterial> materials() const { return materials_; }
+	[[nodiscard]] inline std::span<const MeshAssetLod> lods() const { return lods_; }
+
+	// Whole payloads, laid out exactly as they should be in the geometry buffers. Vertices are CompactVertex3d.
+	[[nodiscard]] inline std::span<const std::byte> vertex_data() const { return vertex_data_; }
+	[[nodiscard]] inline std::span<const std::byte> index_data() const { return index_data_; }
+
+	[[nodiscard]] std::span<const MeshAssetSubmesh> submeshes(const MeshAssetMesh &mesh) const
+	{
+		return submeshes_.subspan(mesh.first_submesh, mesh.submesh_count);
+	}
+
+	[[nodiscard]] std::span<const MeshAssetLod> lods(const MeshAssetSubmesh &submesh) const
+	{
+		return lods_.subspan(submesh.first_lod, submesh.lod_count);
+	}
+
+private:
+	MeshAsset() = default;
+
+	MappedFile file_{};
+
+	const MeshAssetHeader *header_ = nullptr;
+	std::span<const MeshAssetMesh> meshes_{};
+	std::span<const MeshAssetSubmesh> submeshes_{};
+	std::span<const MeshAssetMaterial> materials_{};
+	std::span<const MeshAssetLod> lods_{};
+	std::span<const std::byte> vertex_data_{};
+	std::span<const std::byte> index_data_{};
+};
+
+}// namespace flwfrg
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "renderer/vulkan/shaders/vertex.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace flwfrg
+{
+
+enum class IndexType : uint8_t
+{
+	UINT16,
+	UINT32
+};
+
+struct MeshBounds
+{
+	glm::vec3 min{0};
+	glm::vec3 max{0};
+
+	[[nodiscard]] inline glm::vec3 center() const { return (min + max) * 0.5f; }
+	[[nodiscard]] inline glm::vec3 extent() const { return (max - min) * 0.5f; }
+	[[nodiscard]] inline float radius() const { return glm::length(extent()); }
+	// Quantization the vertices of the mesh are stored with
+	[[nodiscard]] inline VertexQuantization quantization() const { return VertexQuantization::from_bounds(min, max); }
+
+	// Axis aligned box around the transformed box
+	[[nodiscard]] inline MeshBounds transformed(const glm::mat4 &model) const
+	{
+		const glm::vec3 world_center = glm::vec3(model * glm::vec4(center(), 1.0f));
+		const glm::vec3 local_extent = extent();
+		const glm::vec3 world_extent = glm::abs(glm::vec3(model[0])) * local_extent.x +
+									   glm::abs(glm::vec3(model[1])) * local_extent.y +
+									   glm::abs(glm::vec3(model[2])) * local_extent.z;
+		return {world_center - world_extent, world_center + world_extent};
+	}
+};
+
+// Detail levels per mesh, the full detail one included
+constexpr uint32_t max_mesh_lods = 8;
+
+/// <summary>
+/// Index range of one detail level. Every level of a mesh indexes the same vertices.
+/// </summary>
+struct MeshLod
+{
+	uint32_t first_index = 0;
+	uint32_t index_count = 0;
+	// Largest object space distance between the level and the full detail surface
+	float error = 0.0f;
+};
+
+/// <summary>
+/// Full precision, CPU side mesh used while importing and cooking.
+/// </summary>
+struct MeshData
+{
+	std::vector<Vertex3d> vertices;
+	std::vector<uint32_t> indices;
+
+	[[nodiscard]] inline size_t triangle_count() const { return indices.size() / 3; }
+
+	// 16 bit indices are used whenever every vertex can be addressed by them
+	[[nodiscard]] inline IndexType index_type() const
+	{
+		return vertices.size() <= std::numeric_limits<uint16_t>::max() ? IndexType::UINT16 : IndexType::UINT32;
+	}
+
+	[[nodiscard]] std::vector<uint16_t> indices_16() const
+	{
+		return {indices.begin(), indices.end()};
+	}
+
+	[[nodiscard]] MeshBounds compute_bounds() const
+	{
+		if (vertices.empty())
+			return {};
+
+		MeshBounds bounds{vertices[0].position, vertices[0].position};
+		for (const Vertex3d &vertex: vertices)
+		{
+			bounds.min = glm::min(bounds.min, vertex.position);
+			bounds.max = glm::max(bounds.max, vertex.position);
+		}
+		return bounds;
+	}
+
+	// Area weighted average of the normals of the triangles using each vertex
+	[[nodiscard]] std::vector<glm::vec3> compute_normals() const
+	{
+		std::vector<glm::vec3> normals(vertices.size(), glm::vec3(0.0f));
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			const glm::vec3 a = vertices[indices[i]].position;
+			const glm::vec3 face = glm::cross(vertices[indices[i + 1]].position - a, vertices[indices[i + 2]].position - a);
+			for (size_t corner = 0; corner < 3; corner++)
+			{
+				normals[indices[i + corner]] += face;
+			}
+		}
+		for (glm::vec3 &normal: normals)
+		{
+			const float length = glm::length(normal);
+			normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+		}
+		return normals;
+	}
+
+	// The vertices as the geometry pool stores them, quantized to the bounds of the mesh
+	[[nodiscard]] std::vector<CompactVertex3d> compact_vertices() const
+	{
+		const VertexQuantization quantization = compute_bounds().quantization();
+		const std::vector<glm::vec3> normals = compute_normals();
+
+		std::vector<CompactVertex3d> result;
+		result.reserve(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			result.push_back(CompactVertex3d::pack(vertices[i], normals[i], quantization));
+		}
+		return result;
+	}
+};
+
+}// namespace flwfrg
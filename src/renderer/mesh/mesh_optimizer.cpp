@@ -0,0 +1,449 @@
+#include "pch.hpp"
+
+#include "mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+namespace flwfrg
+{
+
+///// Local helper functions
+
+namespace
+{
+
+constexpr uint32_t invalid_index = std::numeric_limits<uint32_t>::max();
+
+// Forsyth's scoring parameters (https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html)
+constexpr uint32_t forsyth_cache_size = 32;
+constexpr float forsyth_cache_decay_power = 1.5f;
+constexpr float forsyth_last_triangle_score = 0.75f;
+constexpr float forsyth_valence_boost_scale = 2.0f;
+constexpr float forsyth_valence_boost_power = 0.5f;
+
+float forsyth_vertex_score(int32_t cache_position, uint32_t remaining_valence)
+{
+	// Vertices without remaining triangles never influence the choice
+	if (remaining_valence == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+	if (cache_position >= 0)
+	{
+		if (cache_position < 3)
+		{
+			// The vertices of the last triangle get a fixed score so the next triangle doesn't just reuse the same edge
+			score = forsyth_last_triangle_score;
+		} else
+		{
+			const float scaler = 1.0f / static_cast<float>(forsyth_cache_size - 3);
+			score = std::pow(1.0f - static_cast<float>(cache_position - 3) * scaler, forsyth_cache_decay_power);
+		}
+	}
+
+	// Boost vertices with few triangles left, so lone triangles don't get stranded
+	score += forsyth_valence_boost_scale * std::pow(static_cast<float>(remaining_valence), -forsyth_valence_boost_power);
+	return score;
+}
+
+struct WeldKey
+{
+	std::array<uint32_t, 5> bits;
+
+	bool operator==(const WeldKey &other) const { return bits == other.bits; }
+};
+
+struct WeldKeyHash
+{
+	size_t operator()(const WeldKey &key) const
+	{
+		// FNV-1a over the bit patterns
+		uint64_t hash = 14695981039346656037ull;
+		for (uint32_t value: key.bits)
+		{
+			hash ^= value;
+			hash *= 1099511628211ull;
+		}
+		return static_cast<size_t>(hash);
+	}
+};
+
+uint32_t float_bits(float value)
+{
+	// Treat -0 and +0 as the same vertex
+	if (value == 0.0f)
+		value = 0.0f;
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+}// namespace
+
+
+///// Method implementations
+
+MeshOptimizer::MeshOptimizer(Settings settings)
+	: settings_{settings}
+{
+}
+
+MeshOptimizationReport MeshOptimizer::optimize(MeshData &mesh) const
+{
+	MeshOptimizationReport report{};
+	report.vertex_count_before = mesh.vertices.size();
+	report.before = analyze_vertex_cache(mesh.indices, mesh.vertices.size());
+
+	weld_vertices(mesh);
+	optimize_vertex_cache(mesh.indices, mesh.vertices.size());
+	optimize_overdraw(mesh.indices, mesh.vertices);
+	optimize_vertex_fetch(mesh);
+
+	report.vertex_count_after = mesh.vertices.size();
+	report.after = analyze_vertex_cache(mesh.indices, mesh.vertices.size());
+	report.index_type = mesh.index_type();
+
+	FLOWFORGE_INFO("Mesh optimized: {} -> {} vertices, {} triangles, {} bit indices",
+				   report.vertex_count_before,
+				   report.vertex_count_after,
+				   mesh.triangle_count(),
+				   report.index_type == IndexType::UINT16 ? 16 : 32);
+	FLOWFORGE_INFO("\tACMR {:.3f} -> {:.3f}, ATVR {:.3f} -> {:.3f}",
+				   report.before.acmr,
+				   report.after.acmr,
+				   report.before.atvr,
+				   report.after.atvr);
+
+	return report;
+}
+
+size_t MeshOptimizer::weld_vertices(MeshData &mesh) const
+{
+	const float inverse_epsilon = settings_.weld_epsilon > 0.0f ? 1.0f / settings_.weld_epsilon : 0.0f;
+
+	std::unordered_map<WeldKey, uint32_t, WeldKeyHash> unique_vertices;
+	unique_vertices.reserve(mesh.vertices.size());
+
+	std::vector<uint32_t> remap(mesh.vertices.size());
+	std::vector<Vertex3d> welded;
+	welded.reserve(mesh.vertices.size());
+
+	for (size_t i = 0; i < mesh.vertices.size(); i++)
+	{
+		const Vertex3d &vertex = mesh.vertices[i];
+
+		WeldKey key{};
+		for (int axis = 0; axis < 3; axis++)
+		{
+			// Snap to the epsilon grid when welding nearby vertices
+			float value = inverse_epsilon > 0.0f ? std::round(vertex.position[axis] * inverse_epsilon) : vertex.position[axis];
+			key.bits[axis] = float_bits(value);
+		}
+		key.bits[3] = float_bits(vertex.texture_coordiante.x);
+		key.bits[4] = float_bits(vertex.texture_coordiante.y);
+
+		auto [it, inserted] = unique_vertices.try_emplace(key, static_cast<uint32_t>(welded.size()));
+		if (inserted)
+		{
+			welded.push_back(vertex);
+		}
+		remap[i] = it->second;
+	}
+
+	for (uint32_t &index: mesh.indices)
+	{
+		index = remap[index];
+	}
+
+	size_t removed = mesh.vertices.size() - welded.size();
+	mesh.vertices = std::move(welded);
+	return removed;
+}
+
+void MeshOptimizer::optimize_vertex_cache(std::span<uint32_t> indices, size_t vertex_count)
+{
+	const size_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0)
+		return;
+
+	// Build vertex to triangle adjacency
+	std::vector<uint32_t> valence(vertex_count, 0);
+	for (uint32_t index: indices)
+	{
+		valence[index]++;
+	}
+
+	std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+	for (size_t i = 0; i < vertex_count; i++)
+	{
+		adjacency_offsets[i + 1] = adjacency_offsets[i] + valence[i];
+	}
+
+	std::vector<uint32_t> adjacency(indices.size());
+	{
+		std::vector<uint32_t> cursor(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	// Initial scores
+	std::vector<int32_t> cache_position(vertex_count, -1);
+	std::vector<float> vertex_score(vertex_count);
+	for (size_t i = 0; i < vertex_count; i++)
+	{
+		vertex_score[i] = forsyth_vertex_score(-1, valence[i]);
+	}
+
+	std::vector<float> triangle_score(triangle_count);
+	std::vector<bool> emitted(triangle_count, false);
+	for (size_t t = 0; t < triangle_count; t++)
+	{
+		triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+	}
+
+	std::vector<uint32_t> output;
+	output.reserve(indices.size());
+
+	std::array<uint32_t, forsyth_cache_size + 3> cache{};
+	std::array<uint32_t, forsyth_cache_size + 3> new_cache{};
+	size_t cache_count = 0;
+
+	uint32_t best_triangle = static_cast<uint32_t>(std::max_element(triangle_score.begin(), triangle_score.end()) - triangle_score.begin());
+	size_t scan_cursor = 0;
+
+	for (size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++)
+	{
+		if (best_triangle == invalid_index)
+		{
+			// Nothing in the cache has triangles left, continue with the next unemitted triangle
+			while (emitted[scan_cursor])
+				scan_cursor++;
+			best_triangle = static_cast<uint32_t>(scan_cursor);
+		}
+
+		const uint32_t *triangle = &indices[best_triangle * 3];
+		output.insert(output.end(), triangle, triangle + 3);
+		emitted[best_triangle] = true;
+
+		// Remove the triangle from the adjacency of its vertices
+		for (int i = 0; i < 3; i++)
+		{
+			uint32_t vertex = triangle[i];
+			uint32_t *begin = &adjacency[adjacency_offsets[vertex]];
+			uint32_t *end = begin + valence[vertex];
+			uint32_t *found = std::find(begin, end, best_triangle);
+			if (found != end)
+			{
+				std::swap(*found, *(end - 1));
+				valence[vertex]--;
+			}
+		}
+
+		// The emitted triangle goes to the front of the cache
+		size_t new_cache_count = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			new_cache[new_cache_count++] = triangle[i];
+		}
+		for (size_t i = 0; i < cache_count; i++)
+		{
+			uint32_t vertex = cache[i];
+			if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+			{
+				new_cache[new_cache_count++] = vertex;
+			}
+		}
+
+		// Rescore everything that moved, including vertices that just fell out of the cache
+		for (size_t i = 0; i < new_cache_count; i++)
+		{
+			uint32_t vertex = new_cache[i];
+			cache_position[vertex] = i < forsyth_cache_size ? static_cast<int32_t>(i) : -1;
+			vertex_score[vertex] = forsyth_vertex_score(cache_position[vertex], valence[vertex]);
+		}
+
+		// Pick the best triangle touching the cache
+		best_triangle = invalid_index;
+		float best_score = -1.0f;
+		for (size_t i = 0; i < new_cache_count; i++)
+		{
+			uint32_t vertex = new_cache[i];
+			for (uint32_t a = 0; a < valence[vertex]; a++)
+			{
+				uint32_t t = adjacency[adjacency_offsets[vertex] + a];
+				float score = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+				triangle_score[t] = score;
+				if (score > best_score)
+				{
+					best_score = score;
+					best_triangle = t;
+				}
+			}
+		}
+
+		cache_count = std::min<size_t>(new_cache_count, forsyth_cache_size);
+		std::copy_n(new_cache.begin(), cache_count, cache.begin());
+	}
+
+	std::copy(output.begin(), output.end(), indices.begin());
+}
+
+void MeshOptimizer::optimize_overdraw(std::span<uint32_t> indices, std::span<const Vertex3d> vertices) const
+{
+	const size_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0)
+		return;
+
+	const VertexCacheStatistics cache_order_statistics = analyze_vertex_cache(indices, vertices.size());
+
+	// Split into clusters wherever the cache had to restart, i.e. a triangle misses on all three vertices
+	std::vector<uint32_t> cluster_starts;
+	{
+		std::vector<uint32_t> timestamps(vertices.size(), 0);
+		uint32_t time = settings_.cache_size + 1;
+
+		for (size_t t = 0; t < triangle_count; t++)
+		{
+			uint32_t misses = 0;
+			for (int i = 0; i < 3; i++)
+			{
+				uint32_t vertex = indices[t * 3 + i];
+				if (time - timestamps[vertex] > settings_.cache_size)
+				{
+					timestamps[vertex] = time++;
+					misses++;
+				}
+			}
+
+			if (t == 0 || misses == 3)
+			{
+				cluster_starts.push_back(static_cast<uint32_t>(t));
+			}
+		}
+	}
+
+	if (cluster_starts.size() < 2)
+		return;
+
+	// Mesh centroid
+	glm::vec3 mesh_centroid{0.0f};
+	for (const Vertex3d &vertex: vertices)
+	{
+		mesh_centroid += vertex.position;
+	}
+	mesh_centroid /= static_cast<float>(vertices.size());
+
+	// Sort clusters so the ones facing away from the mesh center (likely occluders) are drawn first
+	struct Cluster
+	{
+		uint32_t first_triangle;
+		uint32_t triangle_count;
+		float sort_key;
+	};
+	std::vector<Cluster> clusters(cluster_starts.size());
+
+	for (size_t c = 0; c < cluster_starts.size(); c++)
+	{
+		uint32_t begin = cluster_starts[c];
+		uint32_t end = c + 1 < cluster_starts.size() ? cluster_starts[c + 1] : static_cast<uint32_t>(triangle_count);
+
+		glm::vec3 centroid{0.0f};
+		glm::vec3 normal{0.0f};
+		float area = 0.0f;
+
+		for (uint32_t t = begin; t < end; t++)
+		{
+			const glm::vec3 &p0 = vertices[indices[t * 3]].position;
+			const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].position;
+			const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].position;
+
+			// Area weighted normal and centroid
+			glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+			float triangle_area = glm::length(cross);
+			centroid += (p0 + p1 + p2) * (triangle_area / 3.0f);
+			normal += cross;
+			area += triangle_area;
+		}
+
+		if (area > 0.0f)
+			centroid /= area;
+		float normal_length = glm::length(normal);
+		if (normal_length > 0.0f)
+			normal /= normal_length;
+
+		clusters[c] = {begin, end - begin, glm::dot(centroid - mesh_centroid, normal)};
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) { return a.sort_key > b.sort_key; });
+
+	std::vector<uint32_t> reordered;
+	reordered.reserve(indices.size());
+	for (const Cluster &cluster: clusters)
+	{
+		auto begin = indices.begin() + cluster.first_triangle * 3;
+		reordered.insert(reordered.end(), begin, begin + cluster.triangle_count * 3);
+	}
+
+	// Only keep the new order if the cache efficiency stays within the threshold
+	VertexCacheStatistics reordered_statistics = analyze_vertex_cache(reordered, vertices.size());
+	if (reordered_statistics.acmr <= cache_order_statistics.acmr * settings_.overdraw_threshold)
+	{
+		std::copy(reordered.begin(), reordered.end(), indices.begin());
+	}
+}
+
+void MeshOptimizer::optimize_vertex_fetch(MeshData &mesh)
+{
+	std::vector<uint32_t> remap(mesh.vertices.size(), invalid_index);
+	std::vector<Vertex3d> reordered;
+	reordered.reserve(mesh.vertices.size());
+
+	for (uint32_t &index: mesh.indices)
+	{
+		if (remap[index] == invalid_index)
+		{
+			remap[index] = static_cast<uint32_t>(reordered.size());
+			reordered.push_back(mesh.vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	mesh.vertices = std::move(reordered);
+}
+
+VertexCacheStatistics MeshOptimizer::analyze_vertex_cache(std::span<const uint32_t> indices, size_t vertex_count) const
+{
+	VertexCacheStatistics statistics{};
+	if (indices.empty() || vertex_count == 0)
+		return statistics;
+
+	// FIFO cache simulation. A vertex is cached if it was inserted within the last cache_size insertions.
+	std::vector<uint32_t> timestamps(vertex_count, 0);
+	uint32_t time = settings_.cache_size + 1;
+	size_t unique_vertices = 0;
+
+	for (uint32_t index: indices)
+	{
+		if (timestamps[index] == 0)
+			unique_vertices++;
+
+		if (time - timestamps[index] > settings_.cache_size)
+		{
+			timestamps[index] = time++;
+			statistics.vertices_transformed++;
+		}
+	}
+
+	statistics.acmr = static_cast<float>(statistics.vertices_transformed) / static_cast<float>(indices.size() / 3);
+	statistics.atvr = static_cast<float>(statistics.vertices_transformed) / static_cast<float>(unique_vertices);
+	return statistics;
+}
+
+}// namespace flwfrg
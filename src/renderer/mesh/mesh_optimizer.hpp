@@ -0,0 +1,70 @@
+#pragma once
+
+#include "mesh_data.hpp"
+
+#include <span>
+
+namespace flwfrg
+{
+
+struct VertexCacheStatistics
+{
+	uint32_t vertices_transformed = 0;
+	// Average cache miss ratio (transformed vertices per triangle). 0.5 is the optimum for regular grids.
+	float acmr = 0.0f;
+	// Average transform to vertex ratio (transformed vertices per unique vertex). 1.0 is the optimum.
+	float atvr = 0.0f;
+};
+
+struct MeshOptimizationReport
+{
+	VertexCacheStatistics before{};
+	VertexCacheStatistics after{};
+	size_t vertex_count_before = 0;
+	size_t vertex_count_after = 0;
+	IndexType index_type = IndexType::UINT32;
+};
+
+/// <summary>
+/// Offline mesh processing run at import/cook time.
+/// Reorders indices for the post transform vertex cache and for overdraw, and vertices for fetch locality.
+/// </summary>
+class MeshOptimizer
+{
+public:
+	struct Settings
+	{
+		// Vertices closer than this are merged when welding. 0 only merges bitwise identical vertices.
+		float weld_epsilon = 0.0f;
+		// Size of the FIFO cache used when reporting statistics and forming overdraw clusters
+		uint32_t cache_size = 16;
+		// Allowed ACMR increase when reordering clusters for overdraw
+		float overdraw_threshold = 1.05f;
+	};
+
+public:
+	MeshOptimizer() = default;
+	explicit MeshOptimizer(Settings settings);
+
+	// Runs welding, vertex cache, overdraw and vertex fetch optimization in order and logs the results.
+	MeshOptimizationReport optimize(MeshData &mesh) const;
+
+	// Merges duplicate vertices and remaps the indices. Returns the number of vertices removed.
+	size_t weld_vertices(MeshData &mesh) const;
+
+	// Forsyth style greedy triangle reordering for the post transform cache.
+	static void optimize_vertex_cache(std::span<uint32_t> indices, size_t vertex_count);
+
+	// Tipsify style cluster ordering, drawing outward facing clusters first. Expects cache optimized input.
+	void optimize_overdraw(std::span<uint32_t> indices, std::span<const Vertex3d> vertices) const;
+
+	// Reorders vertices in first use order and drops unreferenced ones.
+	static void optimize_vertex_fetch(MeshData &mesh);
+
+	[[nodiscard]] VertexCacheStatistics analyze_vertex_cache(std::span<const uint32_t> indices, size_t vertex_count) const;
+
+private:
+	Settings settings_{};
+};
+
+}// namespace flwfrg
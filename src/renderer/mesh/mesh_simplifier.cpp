@@ -0,0 +1,457 @@
+#include "pch.hpp"
+
+#include "mesh_simplifier.hpp"
+
+#include "mesh_optimizer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace flwfrg
+{
+
+///// Local helper functions
+
+namespace
+{
+
+/// <summary>
+/// Sum of squared distances to a set of area weighted planes, as a symmetric 4x4 matrix.
+/// Surface Simplification Using Quadric Error Metrics. Michael Garland, Paul S. Heckbert. 1997
+/// </summary>
+struct Quadric
+{
+	double a00 = 0.0, a01 = 0.0, a02 = 0.0, a03 = 0.0;
+	double a11 = 0.0, a12 = 0.0, a13 = 0.0;
+	double a22 = 0.0, a23 = 0.0;
+	double a33 = 0.0;
+	double weight = 0.0;
+
+	static Quadric from_plane(const glm::vec3 &normal, double distance, double weight)
+	{
+		const double x = normal.x, y = normal.y, z = normal.z;
+
+		Quadric quadric{};
+		quadric.a00 = x * x * weight;
+		quadric.a01 = x * y * weight;
+		quadric.a02 = x * z * weight;
+		quadric.a03 = x * distance * weight;
+		quadric.a11 = y * y * weight;
+		quadric.a12 = y * z * weight;
+		quadric.a13 = y * distance * weight;
+		quadric.a22 = z * z * weight;
+		quadric.a23 = z * distance * weight;
+		quadric.a33 = distance * distance * weight;
+		quadric.weight = weight;
+		return quadric;
+	}
+
+	void add(const Quadric &other)
+	{
+		a00 += other.a00;
+		a01 += other.a01;
+		a02 += other.a02;
+		a03 += other.a03;
+		a11 += other.a11;
+		a12 += other.a12;
+		a13 += other.a13;
+		a22 += other.a22;
+		a23 += other.a23;
+		a33 += other.a33;
+		weight += other.weight;
+	}
+
+	// Weighted average of the squared plane distances of the point
+	[[nodiscard]] double error(const glm::vec3 &point) const
+	{
+		const double x = point.x, y = point.y, z = point.z;
+		const double sum = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x +
+						   a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y +
+						   a22 * z * z + 2.0 * a23 * z +
+						   a33;
+		return weight > 0.0 ? std::max(sum / weight, 0.0) : 0.0;
+	}
+};
+
+// Collapse of one position onto another, both given by their position group
+struct Collapse
+{
+	uint32_t from;
+	uint32_t to;
+	double cost;
+};
+
+// Vertex that the copies of the moved position with the given attributes collapse onto
+struct WedgeTarget
+{
+	uint32_t attribute_group;
+	uint32_t vertex;
+};
+
+// Bit patterns of a vertex, the texture coordinate only when comparing attributes
+struct VertexKey
+{
+	std::array<uint32_t, 5> bits;
+
+	bool operator==(const VertexKey &other) const { return bits == other.bits; }
+};
+
+struct VertexKeyHash
+{
+	size_t operator()(const VertexKey &key) const
+	{
+		// FNV-1a over the bit patterns
+		uint64_t hash = 14695981039346656037ull;
+		for (uint32_t value: key.bits)
+		{
+			hash ^= value;
+			hash *= 1099511628211ull;
+		}
+		return static_cast<size_t>(hash);
+	}
+};
+
+VertexKey vertex_key(const Vertex3d &vertex, bool attributes)
+{
+	const std::array<float, 5> values = {vertex.position.x,
+										 vertex.position.y,
+										 vertex.position.z,
+										 vertex.texture_coordiante.x,
+										 vertex.texture_coordiante.y};
+
+	VertexKey key{};
+	for (size_t i = 0; i < (attributes ? values.size() : 3); i++)
+	{
+		// Treat -0 and +0 as the same value
+		const float value = values[i] == 0.0f ? 0.0f : values[i];
+		std::memcpy(&key.bits[i], &value, sizeof(uint32_t));
+	}
+	return key;
+}
+
+// Maps every vertex to the first one with the same position, or with the same position and attributes
+std::vector<uint32_t> group_vertices(std::span<const Vertex3d> vertices, bool attributes)
+{
+	std::unordered_map<VertexKey, uint32_t, VertexKeyHash> first_in_group;
+	first_in_group.reserve(vertices.size());
+
+	std::vector<uint32_t> groups(vertices.size());
+	for (uint32_t i = 0; i < vertices.size(); i++)
+	{
+		groups[i] = first_in_group.try_emplace(vertex_key(vertices[i], attributes), i).first->second;
+	}
+	return groups;
+}
+
+uint64_t edge_key(uint32_t from, uint32_t to)
+{
+	return uint64_t{from} << 32 | to;
+}
+
+// Positions that must not move: open borders. Edges are compared by position, so the copies of a vertex
+// on both sides of an attribute seam, or of an unwelded mesh, don't count as borders.
+std::vector<uint8_t> find_locked_positions(std::span<const uint32_t> indices, std::span<const uint32_t> position_groups)
+{
+	std::vector<uint8_t> locked(position_groups.size(), 0);
+
+	// A directed edge without its opposite belongs to a single triangle
+	std::unordered_set<uint64_t> edges;
+	edges.reserve(indices.size());
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		for (size_t corner = 0; corner < 3; corner++)
+		{
+			edges.insert(edge_key(position_groups[indices[i + corner]], position_groups[indices[i + (corner + 1) % 3]]));
+		}
+	}
+	for (uint64_t edge: edges)
+	{
+		const uint32_t from = static_cast<uint32_t>(edge >> 32);
+		const uint32_t to = static_cast<uint32_t>(edge);
+		if (!edges.contains(edge_key(to, from)))
+		{
+			locked[from] = 1;
+			locked[to] = 1;
+		}
+	}
+
+	return locked;
+}
+
+glm::vec3 triangle_normal(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+{
+	return glm::cross(b - a, c - a);
+}
+
+}// namespace
+
+
+///// Method implementations
+
+MeshSimplifier::MeshSimplifier(Settings settings)
+	: settings_{settings}
+{
+}
+
+std::vector<MeshLod> MeshSimplifier::generate_lods(MeshData &mesh, uint32_t first_index, uint32_t index_count) const
+{
+	assert(uint64_t{first_index} + index_count <= mesh.indices.size());
+
+	std::vector<MeshLod> lods;
+
+	const float max_error = settings_.max_relative_error * mesh.compute_bounds().radius();
+	std::vector<uint32_t> previous(mesh.indices.begin() + first_index, mesh.indices.begin() + first_index + index_count);
+	float error = 0.0f;
+
+	for (uint32_t level = 0; level < settings_.max_levels && level + 1 < max_mesh_lods; level++)
+	{
+		const size_t target_index_count = static_cast<size_t>(static_cast<float>(previous.size()) * settings_.reduction_ratio) / 3 * 3;
+
+		float level_error = 0.0f;
+		std::vector<uint32_t> simplified = simplify(previous, mesh.vertices, target_index_count, max_error - error, &level_error);
+
+		// Stop once the locked vertices or the error limit keep the level from getting meaningfully smaller
+		if (simplified.empty() || static_cast<float>(simplified.size()) > static_cast<float>(previous.size()) * (1.0f - settings_.min_reduction))
+			break;
+
+		error += level_error;
+		MeshOptimizer::optimize_vertex_cache(simplified, mesh.vertices.size());
+
+		lods.push_back({static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(simplified.size()), error});
+		mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+		previous = std::move(simplified);
+	}
+
+	FLOWFORGE_INFO("Generated {} detail levels: {} -> {} triangles, error {:.5f}",
+				   lods.size(),
+				   index_count / 3,
+				   previous.size() / 3,
+				   error);
+
+	return lods;
+}
+
+std::vector<uint32_t> MeshSimplifier::simplify(std::span<const uint32_t> indices,
+											   std::span<const Vertex3d> vertices,
+											   size_t target_index_count,
+											   float target_error,
+											   float *out_error)
+{
+	assert(indices.size() % 3 == 0);
+
+	std::vector<uint32_t> result(indices.begin(), indices.end());
+	double max_error = 0.0;
+	const double error_limit = static_cast<double>(target_error) * target_error;
+
+	// Collapses move whole positions, together with every copy of their vertex
+	const size_t vertex_count = vertices.size();
+	const std::vector<uint32_t> position_groups = group_vertices(vertices, false);
+	const std::vector<uint32_t> attribute_groups = group_vertices(vertices, true);
+	const std::vector<uint8_t> locked = find_locked_positions(indices, position_groups);
+
+	// Every position starts with the planes of its triangles
+	std::vector<Quadric> quadrics(vertex_count);
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		const glm::vec3 &a = vertices[result[i + 0]].position;
+		const glm::vec3 &b = vertices[result[i + 1]].position;
+		const glm::vec3 &c = vertices[result[i + 2]].position;
+
+		const glm::vec3 normal = triangle_normal(a, b, c);
+		const float length = glm::length(normal);
+		if (length == 0.0f)
+			continue;
+
+		const glm::vec3 unit_normal = normal / length;
+		const Quadric quadric = Quadric::from_plane(unit_normal, -glm::dot(unit_normal, a), length * 0.5);
+		for (size_t corner = 0; corner < 3; corner++)
+		{
+			quadrics[position_groups[result[i + corner]]].add(quadric);
+		}
+	}
+
+	std::vector<uint32_t> adjacency_offsets(vertex_count + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<WedgeTarget> wedge_targets;
+	std::vector<uint32_t> remap(vertex_count);
+	std::vector<uint8_t> touched(vertex_count);
+
+	// Vertex of the triangle on the position group, or none
+	const auto corner_on = [&](const uint32_t *triangle, uint32_t position) -> const uint32_t * {
+		for (size_t corner = 0; corner < 3; corner++)
+		{
+			if (position_groups[triangle[corner]] == position)
+				return &triangle[corner];
+		}
+		return nullptr;
+	};
+
+	// Every pass collapses the cheapest edges whose neighbourhoods don't overlap, then rebuilds
+	while (result.size() > target_index_count)
+	{
+		// Position to triangle adjacency of the current triangles
+		std::fill(adjacency_offsets.begin(), adjacency_offsets.end(), 0);
+		for (uint32_t index: result)
+		{
+			adjacency_offsets[position_groups[index] + 1]++;
+		}
+		std::partial_sum(adjacency_offsets.begin(), adjacency_offsets.end(), adjacency_offsets.begin());
+
+		adjacency.resize(result.size());
+		{
+			std::vector<uint32_t> cursor(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+			for (size_t i = 0; i < result.size(); i++)
+			{
+				adjacency[cursor[position_groups[result[i]]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		// Candidate collapses of every edge in both directions
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (size_t corner = 0; corner < 3; corner++)
+			{
+				const uint32_t from = position_groups[result[i + corner]];
+				const uint32_t to = position_groups[result[i + (corner + 1) % 3]];
+				if (locked[from] || from == to)
+					continue;
+
+				Quadric combined = quadrics[from];
+				combined.add(quadrics[to]);
+				collapses.push_back({from, to, combined.error(vertices[to].position)});
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) {
+			return a.cost < b.cost;
+		});
+
+		std::iota(remap.begin(), remap.end(), 0);
+		std::fill(touched.begin(), touched.end(), 0);
+
+		const size_t triangles_to_remove = (result.size() - target_index_count) / 3;
+		size_t triangles_removed = 0;
+		size_t collapse_count = 0;
+
+		for (const Collapse &collapse: collapses)
+		{
+			if (collapse.cost > error_limit || triangles_removed >= triangles_to_remove)
+				break;
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			// The triangles on the edge pair every copy of the moved vertex with the copy it lands on. A vertex on an
+			// attribute seam only moves along the seam, where the triangles on both sides pair up its copies.
+			wedge_targets.clear();
+			bool ambiguous = false;
+			size_t degenerate = 0;
+			for (uint32_t offset = adjacency_offsets[collapse.from]; offset < adjacency_offsets[collapse.from + 1]; offset++)
+			{
+				const uint32_t *triangle = &result[adjacency[offset] * 3];
+				const uint32_t *target = corner_on(triangle, collapse.to);
+				if (target == nullptr)
+					continue;
+
+				degenerate++;
+				const uint32_t attribute_group = attribute_groups[*corner_on(triangle, collapse.from)];
+				const auto existing = std::find_if(wedge_targets.begin(), wedge_targets.end(), [&](const WedgeTarget &wedge) {
+					return wedge.attribute_group == attribute_group;
+				});
+				if (existing == wedge_targets.end())
+				{
+					wedge_targets.push_back({attribute_group, *target});
+				} else if (attribute_groups[existing->vertex] != attribute_groups[*target])
+				{
+					ambiguous = true;
+					break;
+				}
+			}
+			if (ambiguous)
+				continue;
+
+			// Reject collapses that would leave a copy behind or flip a remaining triangle around the moved position
+			bool rejected = false;
+			for (uint32_t offset = adjacency_offsets[collapse.from]; offset < adjacency_offsets[collapse.from + 1]; offset++)
+			{
+				const uint32_t *triangle = &result[adjacency[offset] * 3];
+				const uint32_t attribute_group = attribute_groups[*corner_on(triangle, collapse.from)];
+				const auto wedge = std::find_if(wedge_targets.begin(), wedge_targets.end(), [&](const WedgeTarget &target) {
+					return target.attribute_group == attribute_group;
+				});
+				if (wedge == wedge_targets.end())
+				{
+					rejected = true;
+					break;
+				}
+				if (corner_on(triangle, collapse.to) != nullptr)
+					continue;
+
+				std::array<glm::vec3, 3> before{};
+				std::array<glm::vec3, 3> after{};
+				for (size_t corner = 0; corner < 3; corner++)
+				{
+					before[corner] = vertices[triangle[corner]].position;
+					after[corner] = position_groups[triangle[corner]] == collapse.from ? vertices[collapse.to].position : before[corner];
+				}
+				if (glm::dot(triangle_normal(before[0], before[1], before[2]), triangle_normal(after[0], after[1], after[2])) <= 0.0f)
+				{
+					rejected = true;
+					break;
+				}
+			}
+			if (rejected)
+				continue;
+
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			max_error = std::max(max_error, collapse.cost);
+			triangles_removed += degenerate;
+			collapse_count++;
+
+			// Nothing around the moved position may change again this pass, so the flip tests stay exact
+			for (uint32_t offset = adjacency_offsets[collapse.from]; offset < adjacency_offsets[collapse.from + 1]; offset++)
+			{
+				const uint32_t *triangle = &result[adjacency[offset] * 3];
+				const uint32_t moved = *corner_on(triangle, collapse.from);
+				remap[moved] = std::find_if(wedge_targets.begin(), wedge_targets.end(), [&](const WedgeTarget &target) {
+								   return target.attribute_group == attribute_groups[moved];
+							   })->vertex;
+
+				touched[position_groups[triangle[0]]] = 1;
+				touched[position_groups[triangle[1]]] = 1;
+				touched[position_groups[triangle[2]]] = 1;
+			}
+		}
+
+		if (collapse_count == 0)
+			break;
+
+		// Apply the collapses and drop the triangles that became degenerate
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			const uint32_t a = remap[result[i + 0]];
+			const uint32_t b = remap[result[i + 1]];
+			const uint32_t c = remap[result[i + 2]];
+			if (position_groups[a] == position_groups[b] || position_groups[b] == position_groups[c] || position_groups[a] == position_groups[c])
+				continue;
+
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	if (out_error != nullptr)
+		*out_error = static_cast<float>(std::sqrt(max_error));
+
+	return result;
+}
+
+}// namespace flwfrg
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "mesh_data.hpp"
+
+#include <span>
+#include <vector>
+
+namespace flwfrg
+{
+
+/// <summary>
+/// Offline quadric error simplification, run at cook time after the mesh is optimized.
+/// Edges are collapsed onto one of their vertices, so every simplified level reuses the
+/// original vertices and only adds indices. Border vertices never move. Copies of a vertex, on both sides of an
+/// attribute seam or left by an unwelded mesh, move together, so seam vertices only collapse along the seam.
+/// </summary>
+class MeshSimplifier
+{
+public:
+	struct Settings
+	{
+		// Index count of every level relative to the level before it
+		float reduction_ratio = 0.5f;
+		// Levels are only kept while they remove at least this fraction of the previous level's indices
+		float min_reduction = 0.1f;
+		// Largest allowed error, relative to the radius of the mesh bounds
+		float max_relative_error = 0.05f;
+		// Detail levels generated after the full detail one
+		uint32_t max_levels = max_mesh_lods - 1;
+	};
+
+public:
+	MeshSimplifier() = default;
+	explicit MeshSimplifier(Settings settings);
+
+	// Appends the simplified levels of the index range to mesh.indices and returns them, coarsest last.
+	// The errors accumulate, so each one bounds the distance to the full detail range.
+	std::vector<MeshLod> generate_lods(MeshData &mesh, uint32_t first_index, uint32_t index_count) const;
+
+	// Collapses edges until at most target_index_count indices are left or the next collapse would exceed target_error.
+	// Writes the largest error introduced to out_error if given.
+	static std::vector<uint32_t> simplify(std::span<const uint32_t> indices,
+										  std::span<const Vertex3d> vertices,
+										  size_t target_index_count,
+										  float target_error,
+										  float *out_error = nullptr);
+
+private:
+	Settings settings_{};
+};
+
+}// namespace flwfrg
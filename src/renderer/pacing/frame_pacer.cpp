@@ -0,0 +1,130 @@
+#include "pch.hpp"
+
+#include "frame_pacer.hpp"
+
+#include <thread>
+
+namespace flwfrg
+{
+
+///// Local helper functions
+
+namespace
+{
+
+float to_ms(FramePacer::Clock::duration duration)
+{
+	return std::chrono::duration<float, std::milli>(duration).count();
+}
+
+}// namespace
+
+///// Method implementations
+
+FramePacer::FramePacer(Settings settings)
+	: settings_{settings}
+{
+	assert(settings_.smoothing > 0.0f && settings_.smoothing <= 1.0f);
+}
+
+void FramePacer::set_frame_limit(float max_fps)
+{
+	std::lock_guard lock{mutex_};
+	frame_limit_ = max_fps > 0.0f ? max_fps : 0.0f;
+	frame_interval_ = frame_limit_ > 0.0f
+							  ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(1.0f / frame_limit_))
+							  : Clock::duration::zero();
+	next_frame_ = {};
+	statistics_.limiter_wait_ms = 0.0f;
+}
+
+void FramePacer::wait_for_frame_slot()
+{
+	const Clock::time_point start = Clock::now();
+	Clock::time_point next_frame;
+	{
+		std::lock_guard lock{mutex_};
+		if (frame_interval_ == Clock::duration::zero())
+			return;
+
+		// Start over from now on the first frame, and when the last one missed its slot
+		next_frame_ += frame_interval_;
+		if (next_frame_ + frame_interval_ < start)
+		{
+			next_frame_ = start;
+			smooth(statistics_.limiter_wait_ms, 0.0f);
+			return;
+		}
+		next_frame = next_frame_;
+	}
+
+	if (next_frame - start > settings_.spin_threshold)
+		std::this_thread::sleep_until(next_frame - settings_.spin_threshold);
+	while (Clock::now() < next_frame)
+		std::this_thread::yield();
+
+	std::lock_guard lock{mutex_};
+	smooth(statistics_.limiter_wait_ms, to_ms(Clock::now() - start));
+}
+
+FramePacer::Clock::time_point FramePacer::mark_input()
+{
+	return Clock::now();
+}
+
+void FramePacer::mark_present(uint64_t present_id, Clock::time_point input_time)
+{
+	const Clock::time_point now = Clock::now();
+	std::lock_guard lock{mutex_};
+
+	smooth(statistics_.input_to_present_ms, to_ms(now - input_time));
+	if (last_present_ != Clock::time_point{})
+		smooth(statistics_.frame_ms, to_ms(now - last_present_));
+	last_present_ = now;
+
+	if (present_id == 0)
+		return;
+
+	if (pending_present_count_ == max_pending_presents)
+	{
+		// Forget the oldest
+		first_pending_present_ = (first_pending_present_ + 1) % max_pending_presents;
+		pending_present_count_--;
+	}
+	pending_present(pending_present_count_++) = {present_id, input_time};
+}
+
+void FramePacer::mark_displayed(uint64_t present_id, Clock::time_point time)
+{
+	std::lock_guard lock{mutex_};
+
+	// Presents are displayed in order, older ones that were never waited for are done as well
+	while (pending_present_count_ > 0 && pending_present(0).id <= present_id)
+	{
+		if (pending_present(0).id == present_id)
+			smooth(statistics_.input_to_display_ms, to_ms(time - pending_present(0).input));
+		first_pending_present_ = (first_pending_present_ + 1) % max_pending_presents;
+		pending_present_count_--;
+	}
+}
+
+float FramePacer::get_frame_limit() const
+{
+	std::lock_guard lock{mutex_};
+	return frame_limit_;
+}
+
+FrameLatencyStatistics FramePacer::statistics() const
+{
+	std::lock_guard lock{mutex_};
+	return statistics_;
+}
+
+///// Private methods
+
+void FramePacer::smooth(float &value, float sample) const
+{
+	value = value > 0.0f ? value + (sample - value) * settings_.smoothing : sample;
+}
+
+}// namespace flwfrg
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace flwfrg
+{
+
+struct FrameLatencyStatistics
+{
+	// From the input poll of a frame to queuing its present
+	float input_to_present_ms = 0.0f;
+	// From the input poll of a frame to the presentation engine showing it, zero when it isn't known
+	float input_to_display_ms = 0.0f;
+	// Time the frame limiter waited
+	float limiter_wait_ms = 0.0f;
+	// Time between presents
+	float frame_ms = 0.0f;
+};
+
+/// <summary>
+/// Caps the frame rate and measures the latency from polling input to presenting and displaying the frame.
+/// The limiter waits at the start of the frame, before input is polled, so the wait adds no latency to the input
+/// of the frame. It sleeps until shortly before the deadline and spins the rest, since sleeps overshoot by
+/// around a millisecond on most platforms. Deadlines advance by the frame interval and restart when a frame
+/// fell behind, so a single slow frame isn't followed by a burst of fast ones.
+/// Input may be marked on one thread while presents are marked on another.
+/// </summary>
+class FramePacer
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// Presents that wait to be displayed before the oldest is forgotten
+	static constexpr uint32_t max_pending_presents = 8;
+
+	struct Settings
+	{
+		// Time before the deadline that is spun instead of slept
+		std::chrono::microseconds spin_threshold{1500};
+		// Weight of a new measurement in the smoothed statistics
+		float smoothing = 0.1f;
+	};
+
+public:
+	FramePacer() = default;
+	explicit FramePacer(Settings settings);
+
+	// Methods
+
+	// Zero or less removes the limit
+	void set_frame_limit(float max_fps);
+	// Blocks until the next frame may start
+	void wait_for_frame_slot();
+
+	// Input of the frame was polled, returns the time it was marked at
+	Clock::time_point mark_input();
+	// The frame whose input was polled at input_time was queued for presentation, with its present id, or zero without one
+	void mark_present(uint64_t present_id, Clock::time_point input_time);
+	// The present with the id, and any older one, was displayed at the time
+	void mark_displayed(uint64_t present_id, Clock::time_point time);
+
+	[[nodiscard]] float get_frame_limit() const;
+	[[nodiscard]] FrameLatencyStatistics statistics() const;
+
+private:
+	struct PendingPresent
+	{
+		uint64_t id;
+		Clock::time_point input;
+	};
+
+	Settings settings_{};
+	mutable std::mutex mutex_{};
+
+	float frame_limit_ = 0.0f;
+	Clock::duration frame_interval_{};
+	Clock::time_point next_frame_{};
+
+	Clock::time_point last_present_{};
+	// Ring of the presents that weren't displayed yet, oldest first
+	std::array<PendingPresent, max_pending_presents> pending_presents_{};
+	uint32_t first_pending_present_ = 0;
+	uint32_t pending_present_count_ = 0;
+
+	FrameLatencyStatistics statistics_{};
+
+	///// Private methods
+
+	void smooth(float &value, float sample) const;
+	[[nodiscard]] inline PendingPresent &pending_present(uint32_t i) { return pending_presents_[(first_pending_present_ + i) % max_pending_presents]; };
+};
+
+}// namespace flwfrg
@@ -0,0 +1,85 @@
+#include "pch.hpp"
+
+#include "resolution_scaler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace flwfrg
+{
+
+///// Method implementations
+
+ResolutionScaler::ResolutionScaler(Settings settings)
+	: settings_{settings}
+{
+	assert(settings_.min_scale > 0.0f && settings_.min_scale <= settings_.max_scale);
+	assert(settings_.step > 0.0f);
+
+	reset();
+}
+
+void ResolutionScaler::update(float gpu_frame_ms, float rendered_scale)
+{
+	if (gpu_frame_ms <= 0.0f || rendered_scale <= 0.0f)
+		return;
+
+	// What the frame would have cost at the largest scale
+	const float max_pixels = settings_.max_scale * settings_.max_scale;
+	const float full_scale_ms = gpu_frame_ms * max_pixels / (rendered_scale * rendered_scale);
+	full_scale_ms_ = full_scale_ms_ > 0.0f ? full_scale_ms_ + (full_scale_ms - full_scale_ms_) * settings_.smoothing : full_scale_ms;
+
+	// Over budget, go straight to the scale that fits this frame, not the smoothed one
+	if (gpu_frame_ms > settings_.target_frame_ms)
+	{
+		const float fitting = settings_.max_scale * std::sqrt(settings_.target_frame_ms / full_scale_ms);
+		scale_ = std::min(scale_, quantize(fitting));
+		frames_under_headroom_ = 0;
+		return;
+	}
+
+	if (scale_ >= settings_.max_scale)
+	{
+		frames_under_headroom_ = 0;
+		return;
+	}
+
+	// Grow one step once the frames have been comfortably fast for a while, and the step is predicted to fit
+	const float predicted_ms = full_scale_ms_ * (scale_ + settings_.step) * (scale_ + settings_.step) / max_pixels;
+	if (predicted_ms > settings_.target_frame_ms * settings_.headroom)
+	{
+		frames_under_headroom_ = 0;
+		return;
+	}
+
+	if (++frames_under_headroom_ >= settings_.grow_delay_frames)
+	{
+		scale_ = std::min(scale_ + settings_.step, settings_.max_scale);
+		frames_under_headroom_ = 0;
+	}
+}
+
+void ResolutionScaler::reset()
+{
+	scale_ = settings_.max_scale;
+	full_scale_ms_ = 0.0f;
+	frames_under_headroom_ = 0;
+}
+
+glm::uvec2 ResolutionScaler::scaled_size(uint32_t width, uint32_t height) const
+{
+	return {std::max(1u, static_cast<uint32_t>(std::lround(width * scale_))),
+			std::max(1u, static_cast<uint32_t>(std::lround(height * scale_)))};
+}
+
+
+///// Private methods
+
+float ResolutionScaler::quantize(float scale) const
+{
+	// Steps down from the largest scale, rounding down so the picked scale fits
+	const float steps = std::floor((settings_.max_scale - scale) / settings_.step + 0.999f);
+	return std::clamp(settings_.max_scale - steps * settings_.step, settings_.min_scale, settings_.max_scale);
+}
+
+}// namespace flwfrg
@@ -0,0 +1,66 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+namespace flwfrg
+{
+
+/// <summary>
+/// Picks the scale the scene is rendered at from measured GPU frame times. GPU time is assumed to grow with the
+/// rendered pixel count, so the scale that would hit the target is the rendered one times sqrt(target / time).
+/// A frame over the target drops the scale right away, it only grows again one step at a time after the frame time
+/// stayed under the headroom for a while, so load spikes are absorbed without oscillating.
+/// Scales are quantized to steps, so the render area doesn't change every frame.
+/// </summary>
+class ResolutionScaler
+{
+public:
+	struct Settings
+	{
+		float target_frame_ms = 1000.0f / 60.0f;
+		float min_scale = 0.5f;
+		float max_scale = 1.0f;
+		float step = 0.05f;
+		// Fraction of the target the smoothed frame time has to stay under before the scale grows
+		float headroom = 0.85f;
+		uint32_t grow_delay_frames = 30;
+		// Weight of a new frame time in the smoothed one
+		float smoothing = 0.1f;
+	};
+
+public:
+	ResolutionScaler() = default;
+	explicit ResolutionScaler(Settings settings);
+
+	// Methods
+
+	// GPU time of a finished frame and the scale it was rendered at, which lags the current one by the frames in flight
+	void update(float gpu_frame_ms, float rendered_scale);
+	// Back to the largest scale, forgetting the measured times
+	void reset();
+
+	// Size of the rendered area for a target size, at least one pixel
+	[[nodiscard]] glm::uvec2 scaled_size(uint32_t width, uint32_t height) const;
+
+	[[nodiscard]] inline float scale() const { return scale_; };
+	// Smoothed frame time, scaled to what it would be at the largest scale
+	[[nodiscard]] inline float full_scale_frame_ms() const { return full_scale_ms_; };
+	[[nodiscard]] inline const Settings &settings() const { return settings_; };
+
+private:
+	Settings settings_{};
+
+	float scale_ = 1.0f;
+	float full_scale_ms_ = 0.0f;
+	uint32_t frames_under_headroom_ = 0;
+
+	///// Private methods
+
+	[[nodiscard]] float quantize(float scale) const;
+};
+
+}// namespace flwfrg
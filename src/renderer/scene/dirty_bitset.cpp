@@ -0,0 +1,68 @@
+#include "pch.hpp"
+
+#include "dirty_bitset.hpp"
+
+#include <algorithm>
+
+namespace flwfrg
+{
+
+///// Method implementations
+
+void DirtyBitset::resize(size_t size)
+{
+	// Clear the bits past the end, so the elements start clean when the array grows again
+	if (size < size_)
+	{
+		std::erase_if(indices_, [this, size](uint32_t index) {
+			if (index < size)
+				return false;
+			words_[index / 64] &= ~(uint64_t{1} << (index % 64));
+			return true;
+		});
+	}
+
+	words_.resize((size + 63) / 64, 0);
+	size_ = size;
+}
+
+void DirtyBitset::set(uint32_t index)
+{
+	assert(index < size_);
+
+	uint64_t &word = words_[index / 64];
+	const uint64_t bit = uint64_t{1} << (index % 64);
+	if ((word & bit) != 0)
+		return;
+
+	word |= bit;
+	indices_.push_back(index);
+}
+
+void DirtyBitset::set_all()
+{
+	for (uint32_t index = 0; index < size_; index++)
+	{
+		set(index);
+	}
+}
+
+void DirtyBitset::merge(const DirtyBitset &other)
+{
+	for (uint32_t index: other.indices_)
+	{
+		if (index < size_)
+			set(index);
+	}
+}
+
+void DirtyBitset::clear()
+{
+	for (uint32_t index: indices_)
+	{
+		words_[index / 64] &= ~(uint64_t{1} << (index % 64));
+	}
+	indices_.clear();
+}
+
+}// namespace flwfrg
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace flwfrg
+{
+
+/// <summary>
+/// Marks changed elements of an array. Besides the bits it keeps the list of marked indices,
+/// so walking and clearing the changes costs as much as there are changes, not as the array is long.
+/// </summary>
+class DirtyBitset
+{
+public:
+	DirtyBitset() = default;
+
+	// Methods
+
+	// New elements start clean, elements cut off are forgotten
+	void resize(size_t size);
+	void set(uint32_t index);
+	void set_all();
+	// Marks everything marked in other that is in range
+	void merge(const DirtyBitset &other);
+	void clear();
+
+	[[nodiscard]] inline bool test(uint32_t index) const { return (words_[index / 64] >> (index % 64) & 1) != 0; };
+	[[nodiscard]] inline bool any() const { return !indices_.empty(); };
+	[[nodiscard]] inline size_t count() const { return indices_.size(); };
+	[[nodiscard]] inline size_t size() const { return size_; };
+	// Marked indices, in the order they were marked
+	[[nodiscard]] inline std::span<const uint32_t> indices() const { return indices_; };
+
+private:
+	std::vector<uint64_t> words_{};
+	std::vector<uint32_t> indices_{};
+	size_t size_ = 0;
+};
+
+}// namespace flwfrg
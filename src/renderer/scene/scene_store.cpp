@@ -0,0 +1,106 @@
+#include "pch.hpp"
+
+#include "scene_store.hpp"
+
+namespace flwfrg
+{
+
+///// Method implementations
+
+SceneEntity SceneStore::create(const glm::mat4 &transform, const glm::vec4 &bounds, uint32_t mesh, uint32_t material)
+{
+	const auto entity = static_cast<SceneEntity>(transforms_.size());
+
+	transforms_.push_back(transform);
+	bounds_.push_back(bounds);
+	meshes_.push_back(mesh);
+	materials_.push_back(material);
+	visible_.push_back(1);
+
+	for (DirtyBitset &component: dirty_)
+	{
+		component.resize(transforms_.size());
+		component.set(entity);
+	}
+
+	return entity;
+}
+
+void SceneStore::set_transform(SceneEntity entity, const glm::mat4 &transform)
+{
+	if (transforms_[entity] == transform)
+		return;
+
+	transforms_[entity] = transform;
+	mark(SceneComponent::TRANSFORM, entity);
+}
+
+void SceneStore::set_bounds(SceneEntity entity, const glm::vec4 &bounds)
+{
+	if (bounds_[entity] == bounds)
+		return;
+
+	bounds_[entity] = bounds;
+	mark(SceneComponent::BOUNDS, entity);
+}
+
+void SceneStore::set_mesh(SceneEntity entity, uint32_t mesh)
+{
+	if (meshes_[entity] == mesh)
+		return;
+
+	meshes_[entity] = mesh;
+	mark(SceneComponent::MESH, entity);
+}
+
+void SceneStore::set_material(SceneEntity entity, uint32_t material)
+{
+	if (materials_[entity] == material)
+		return;
+
+	materials_[entity] = material;
+	mark(SceneComponent::MATERIAL, entity);
+}
+
+void SceneStore::set_visible(SceneEntity entity, bool visible)
+{
+	if ((visible_[entity] != 0) == visible)
+		return;
+
+	visible_[entity] = visible ? 1 : 0;
+	mark(SceneComponent::VISIBILITY, entity);
+}
+
+void SceneStore::clear()
+{
+	transforms_.clear();
+	bounds_.clear();
+	meshes_.clear();
+	materials_.clear();
+	visible_.clear();
+
+	for (DirtyBitset &component: dirty_)
+	{
+		component.clear();
+		component.resize(0);
+	}
+}
+
+void SceneStore::reserve(size_t count)
+{
+	transforms_.reserve(count);
+	bounds_.reserve(count);
+	meshes_.reserve(count);
+	materials_.reserve(count);
+	visible_.reserve(count);
+}
+
+void SceneStore::clear_dirty()
+{
+	for (DirtyBitset &component: dirty_)
+	{
+		component.clear();
+	}
+}
+
+}// namespace flwfrg
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "dirty_bitset.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace flwfrg
+{
+
+using SceneEntity = uint32_t;
+
+enum class SceneComponent : uint8_t
+{
+	TRANSFORM = 0,
+	// Local bounding sphere, xyz center and w radius
+	BOUNDS = 1,
+	MESH = 2,
+	MATERIAL = 3,
+	VISIBILITY = 4
+};
+constexpr size_t scene_component_count = 5;
+
+/// <summary>
+/// Entities of a scene as structure of arrays components, one array per component indexed by the entity.
+/// Every component has a dirty bitset of the entities changed since the last clear_dirty, so whoever mirrors
+/// the components, like the GPU scene, only has to copy what changed. Setting a component to the value it
+/// already has doesn't mark it.
+/// </summary>
+class SceneStore
+{
+public:
+	SceneStore() = default;
+
+	// Methods
+
+	// Every component of a new entity is dirty. Mesh and material are handles of whoever draws the scene.
+	SceneEntity create(const glm::mat4 &transform, const glm::vec4 &bounds, uint32_t mesh, uint32_t material);
+	void set_transform(SceneEntity entity, const glm::mat4 &transform);
+	void set_bounds(SceneEntity entity, const glm::vec4 &bounds);
+	void set_mesh(SceneEntity entity, uint32_t mesh);
+	void set_material(SceneEntity entity, uint32_t material);
+	void set_visible(SceneEntity entity, bool visible);
+	void clear();
+	void reserve(size_t count);
+
+	void clear_dirty();
+	[[nodiscard]] inline const DirtyBitset &dirty(SceneComponent component) const { return dirty_[static_cast<size_t>(component)]; };
+
+	[[nodiscard]] inline size_t size() const { return transforms_.size(); };
+	[[nodiscard]] inline bool empty() const { return transforms_.empty(); };
+
+	[[nodiscard]] inline const glm::mat4 &transform(SceneEntity entity) const { return transforms_[entity]; };
+	[[nodiscard]] inline const glm::vec4 &bounds(SceneEntity entity) const { return bounds_[entity]; };
+	[[nodiscard]] inline uint32_t mesh(SceneEntity entity) const { return meshes_[entity]; };
+	[[nodiscard]] inline uint32_t material(SceneEntity entity) const { return materials_[entity]; };
+	[[nodiscard]] inline bool is_visible(SceneEntity entity) const { return visible_[entity] != 0; };
+
+	[[nodiscard]] inline std::span<const glm::mat4> transforms() const { return transforms_; };
+	[[nodiscard]] inline std::span<const glm::vec4> bounds() const { return bounds_; };
+	[[nodiscard]] inline std::span<const uint32_t> meshes() const { return meshes_; };
+	[[nodiscard]] inline std::span<const uint32_t> materials() const { return materials_; };
+
+private:
+	std::vector<glm::mat4> transforms_{};
+	std::vector<glm::vec4> bounds_{};
+	std::vector<uint32_t> meshes_{};
+	std::vector<uint32_t> materials_{};
+	std::vector<uint8_t> visible_{};
+
+	std::array<DirtyBitset, scene_component_count> dirty_{};
+
+	///// Private methods
+
+	inline void mark(SceneComponent component, SceneEntity entity) { dirty_[static_cast<size_t>(component)].set(entity); };
+};
+
+}// namespace flwfrg
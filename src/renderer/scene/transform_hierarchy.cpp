@@ -0,0 +1,431 @@
+#include "pch.hpp"
+
+#include "transform_hierarchy.hpp"
+
+#include "core/job_system.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <type_traits>
+
+namespace flwfrg
+{
+
+///// Local helper functions
+
+namespace
+{
+
+// Smallest range of a level updated by one job
+constexpr uint32_t nodes_per_chunk = 2 * 1024;
+
+struct HierarchyArrays
+{
+	const uint32_t *parents;
+	const glm::mat4 *local;
+	const glm::vec4 *local_bounds;
+	const uint8_t *dirty;
+	uint8_t *updated;
+	glm::mat4 *world;
+	glm::vec4 *world_bounds;
+};
+
+// A node is recomputed when its own transform or its parent's world transform changed
+inline bool needs_update(const HierarchyArrays &arrays, uint32_t slot)
+{
+	const uint32_t parent = arrays.parents[slot];
+	return arrays.dirty[slot] != 0 || (parent != TransformHierarchy::no_parent && arrays.updated[parent] != 0);
+}
+
+// The radius grows with the largest axis scale, so the sphere stays conservative under rotation
+glm::vec4 transform_sphere(const glm::mat4 &world, const glm::vec4 &sphere)
+{
+	const float scale = std::sqrt(std::max({glm::dot(glm::vec3(world[0]), glm::vec3(world[0])),
+											glm::dot(glm::vec3(world[1]), glm::vec3(world[1])),
+											glm::dot(glm::vec3(world[2]), glm::vec3(world[2]))}));
+	return glm::vec4(glm::vec3(world * glm::vec4(glm::vec3(sphere), 1.0f)), sphere.w * scale);
+}
+
+uint32_t update_scalar(const HierarchyArrays &arrays, uint32_t begin, uint32_t end, uint32_t *out)
+{
+	uint32_t count = 0;
+	for (uint32_t slot = begin; slot < end; slot++)
+	{
+		if (!needs_update(arrays, slot))
+			continue;
+
+		const uint32_t parent = arrays.parents[slot];
+		arrays.world[slot] = parent != TransformHierarchy::no_parent ? arrays.world[parent] * arrays.local[slot] : arrays.local[slot];
+		arrays.world_bounds[slot] = transform_sphere(arrays.world[slot], arrays.local_bounds[slot]);
+		arrays.updated[slot] = 1;
+		out[count++] = slot;
+	}
+	return count;
+}
+
+#if FLOWFORGE_X86
+
+// Column major, every output column is the parent's columns weighted by the local column
+FLOWFORGE_TARGET_SSE inline void multiply_sse(const float *parent, const float *local, float *out)
+{
+	const __m128 parent0 = _mm_loadu_ps(parent);
+	const __m128 parent1 = _mm_loadu_ps(parent + 4);
+	const __m128 parent2 = _mm_loadu_ps(parent + 8);
+	const __m128 parent3 = _mm_loadu_ps(parent + 12);
+
+	for (int column = 0; column < 4; column++)
+	{
+		const float *weights = local + column * 4;
+		__m128 result = _mm_mul_ps(parent0, _mm_set1_ps(weights[0]));
+		result = _mm_add_ps(_mm_mul_ps(parent1, _mm_set1_ps(weights[1])), result);
+		result = _mm_add_ps(_mm_mul_ps(parent2, _mm_set1_ps(weights[2])), result);
+		result = _mm_add_ps(_mm_mul_ps(parent3, _mm_set1_ps(weights[3])), result);
+		_mm_storeu_ps(out + column * 4, result);
+	}
+}
+
+FLOWFORGE_TARGET_SSE inline glm::vec4 transform_sphere_sse(const float *world, const glm::vec4 &sphere)
+{
+	const __m128 column0 = _mm_loadu_ps(world);
+	const __m128 column1 = _mm_loadu_ps(world + 4);
+	const __m128 column2 = _mm_loadu_ps(world + 8);
+
+	__m128 center = _mm_add_ps(_mm_mul_ps(column0, _mm_set1_ps(sphere.x)), _mm_loadu_ps(world + 12));
+	center = _mm_add_ps(_mm_mul_ps(column1, _mm_set1_ps(sphere.y)), center);
+	center = _mm_add_ps(_mm_mul_ps(column2, _mm_set1_ps(sphere.z)), center);
+
+	// Transposed, the squared lengths of the axes are vertical sums that leave out w
+	__m128 x = _mm_mul_ps(column0, column0);
+	__m128 y = _mm_mul_ps(column1, column1);
+	__m128 z = _mm_mul_ps(column2, column2);
+	__m128 w = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	const __m128 lengths = _mm_add_ps(_mm_add_ps(x, y), z);
+	const __m128 largest = _mm_max_ps(lengths, _mm_max_ps(_mm_shuffle_ps(lengths, lengths, _MM_SHUFFLE(3, 0, 2, 1)),
+															_mm_shuffle_ps(lengths, lengths, _MM_SHUFFLE(3, 1, 0, 2))));
+
+	glm::vec4 result;
+	_mm_storeu_ps(&result[0], center);
+	result.w = sphere.w * _mm_cvtss_f32(_mm_sqrt_ss(largest));
+	return result;
+}
+
+FLOWFORGE_TARGET_SSE uint32_t update_sse(const HierarchyArrays &arrays, uint32_t begin, uint32_t end, uint32_t *out)
+{
+	uint32_t count = 0;
+	for (uint32_t slot = begin; slot < end; slot++)
+	{
+		if (!needs_update(arrays, slot))
+			continue;
+
+		const uint32_t parent = arrays.parents[slot];
+		float *world = &arrays.world[slot][0][0];
+		if (parent != TransformHierarchy::no_parent)
+			multiply_sse(&arrays.world[parent][0][0], &arrays.local[slot][0][0], world);
+		else
+			arrays.world[slot] = arrays.local[slot];
+
+		arrays.world_bounds[slot] = transform_sphere_sse(world, arrays.local_bounds[slot]);
+		arrays.updated[slot] = 1;
+		out[count++] = slot;
+	}
+	return count;
+}
+
+// Two output columns per register, each lane broadcasts the weights of its own column
+FLOWFORGE_TARGET_AVX2 inline void multiply_avx2(const float *parent, const float *local, float *out)
+{
+	const __m256 parent0 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(parent));
+	const __m256 parent1 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(parent + 4));
+	const __m256 parent2 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(parent + 8));
+	const __m256 parent3 = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(parent + 12));
+
+	for (int column = 0; column < 4; column += 2)
+	{
+		const __m256 weights = _mm256_loadu_ps(local + column * 4);
+		__m256 result = _mm256_mul_ps(parent0, _mm256_shuffle_ps(weights, weights, _MM_SHUFFLE(0, 0, 0, 0)));
+		result = _mm256_add_ps(_mm256_mul_ps(parent1, _mm256_shuffle_ps(weights, weights, _MM_SHUFFLE(1, 1, 1, 1))), result);
+		result = _mm256_add_ps(_mm256_mul_ps(parent2, _mm256_shuffle_ps(weights, weights, _MM_SHUFFLE(2, 2, 2, 2))), result);
+		result = _mm256_add_ps(_mm256_mul_ps(parent3, _mm256_shuffle_ps(weights, weights, _MM_SHUFFLE(3, 3, 3, 3))), result);
+		_mm256_storeu_ps(out + column * 4, result);
+	}
+}
+
+FLOWFORGE_TARGET_AVX2 uint32_t update_avx2(const HierarchyArrays &arrays, uint32_t begin, uint32_t end, uint32_t *out)
+{
+	uint32_t count = 0;
+	for (uint32_t slot = begin; slot < end; slot++)
+	{
+		if (!needs_update(arrays, slot))
+			continue;
+
+		const uint32_t parent = arrays.parents[slot];
+		float *world = &arrays.world[slot][0][0];
+		if (parent != TransformHierarchy::no_parent)
+			multiply_avx2(&arrays.world[parent][0][0], &arrays.local[slot][0][0], world);
+		else
+			arrays.world[slot] = arrays.local[slot];
+
+		arrays.world_bounds[slot] = transform_sphere_sse(world, arrays.local_bounds[slot]);
+		arrays.updated[slot] = 1;
+		out[count++] = slot;
+	}
+	return count;
+}
+
+#endif
+
+}// namespace
+
+
+///// Method implementations
+
+TransformHierarchy::TransformHierarchy()
+	: instruction_set_{supported_instruction_set()}
+{
+	level_offsets_.push_back(0);
+}
+
+TransformNode TransformHierarchy::add(const glm::mat4 &local, const glm::vec4 &local_bounds, std::optional<TransformNode> parent)
+{
+	assert(!parent.has_value() || parent.value() < slots_.size());
+
+	const auto node = static_cast<TransformNode>(slots_.size());
+	const uint32_t depth = parent.has_value() ? depths_[parent.value()] + 1 : 0;
+	const uint32_t slot = static_cast<uint32_t>(nodes_.size());
+
+	// Appended after its parent, so the slots are still in an order that can be updated until they are sorted by level
+	const bool in_level_order = nodes_.empty() || depth >= depths_[nodes_.back()];
+
+	parents_.push_back(parent.has_value() ? slots_[parent.value()] : no_parent);
+	local_.push_back(local);
+	local_bounds_.push_back(local_bounds);
+	world_.push_back(local);
+	world_bounds_.push_back(local_bounds);
+	dirty_.push_back(0);
+	updated_.push_back(0);
+	nodes_.push_back(node);
+	slots_.push_back(slot);
+	depths_.push_back(depth);
+
+	if (dirty_levels_.size() <= depth)
+		dirty_levels_.resize(depth + 1, 0);
+
+	if (reorder_ || !in_level_order)
+	{
+		reorder_ = true;
+	} else
+	{
+		// Still sorted, the node ends the last level or starts a new one
+		if (level_offsets_.size() < depth + 2)
+			level_offsets_.push_back(level_offsets_.back());
+		level_offsets_.back()++;
+	}
+
+	mark_dirty(node);
+	return node;
+}
+
+void TransformHierarchy::set_local(TransformNode node, const glm::mat4 &local)
+{
+	glm::mat4 &current = local_[slots_[node]];
+	if (current == local)
+		return;
+
+	current = local;
+	mark_dirty(node);
+}
+
+void TransformHierarchy::set_local_bounds(TransformNode node, const glm::vec4 &local_bounds)
+{
+	glm::vec4 &current = local_bounds_[slots_[node]];
+	if (current == local_bounds)
+		return;
+
+	current = local_bounds;
+	mark_dirty(node);
+}
+
+void TransformHierarchy::clear()
+{
+	for (auto *array: {&parents_, &slots_, &depths_, &updated_slots_})
+	{
+		array->clear();
+	}
+	local_.clear();
+	local_bounds_.clear();
+	world_.clear();
+	world_bounds_.clear();
+	dirty_.clear();
+	updated_.clear();
+	nodes_.clear();
+	dirty_levels_.clear();
+	level_offsets_.assign(1, 0);
+	changed_.clear();
+	changed_.resize(0);
+	reorder_ = false;
+}
+
+void TransformHierarchy::reserve(size_t count)
+{
+	for (auto *array: {&parents_, &slots_, &depths_, &nodes_})
+	{
+		array->reserve(count);
+	}
+	local_.reserve(count);
+	local_bounds_.reserve(count);
+	world_.reserve(count);
+	world_bounds_.reserve(count);
+	dirty_.reserve(count);
+	updated_.reserve(count);
+}
+
+void TransformHierarchy::update()
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	if (reorder_)
+		sort_levels();
+
+	// Forget what the last update recomputed
+	for (uint32_t slot: updated_slots_)
+	{
+		updated_[slot] = 0;
+	}
+	updated_slots_.clear();
+	changed_.clear();
+	changed_.resize(size());
+
+	statistics_.nodes = static_cast<uint32_t>(size());
+	statistics_.levels = static_cast<uint32_t>(level_offsets_.size() - 1);
+	statistics_.skipped_levels = 0;
+	statistics_.partitions = 0;
+
+	// Levels go in order, so the parents of a level are final before it starts
+	bool parent_level_updated = false;
+	for (uint32_t level = 0; level + 1 < level_offsets_.size(); level++)
+	{
+		if (dirty_levels_[level] == 0 && !parent_level_updated)
+		{
+			statistics_.skipped_levels++;
+			continue;
+		}
+		dirty_levels_[level] = 0;
+
+		// The chunks are gathered in order, so the updated slots stay sorted
+		const size_t level_updated_begin = updated_slots_.size();
+		const uint32_t chunk_count = parallel_compact(job_system_, level_offsets_[level], level_offsets_[level + 1], nodes_per_chunk, [this](uint32_t begin, uint32_t end, uint32_t *out) {
+			return update_range(begin, end, out);
+		}, updated_slots_);
+
+		parent_level_updated = updated_slots_.size() > level_updated_begin;
+		statistics_.partitions = std::max(statistics_.partitions, chunk_count);
+	}
+
+	for (uint32_t slot: updated_slots_)
+	{
+		dirty_[slot] = 0;
+		changed_.set(nodes_[slot]);
+	}
+
+	statistics_.updated_nodes = static_cast<uint32_t>(updated_slots_.size());
+	statistics_.microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+void TransformHierarchy::set_instruction_set(InstructionSet instruction_set)
+{
+	if (static_cast<uint8_t>(instruction_set) > static_cast<uint8_t>(supported_instruction_set()))
+	{
+		FLOWFORGE_WARN("Requested transform instruction set is not supported by this CPU");
+		return;
+	}
+	instruction_set_ = instruction_set;
+}
+
+void TransformHierarchy::set_job_system(JobSystem *job_system)
+{
+	job_system_ = job_system;
+}
+
+///// Private methods
+
+void TransformHierarchy::mark_dirty(TransformNode node)
+{
+	dirty_[slots_[node]] = 1;
+	dirty_levels_[depths_[node]] = 1;
+}
+
+void TransformHierarchy::sort_levels()
+{
+	const size_t node_count = nodes_.size();
+	const size_t level_count = dirty_levels_.size();
+
+	// Counting sort by depth
+	level_offsets_.assign(level_count + 1, 0);
+	for (uint32_t depth: depths_)
+	{
+		level_offsets_[depth + 1]++;
+	}
+	for (size_t level = 0; level < level_count; level++)
+	{
+		level_offsets_[level + 1] += level_offsets_[level];
+	}
+
+	// Walking the old slots in order keeps the order within a level
+	std::vector<uint32_t> cursors(level_offsets_.begin(), level_offsets_.end() - 1);
+	std::vector<uint32_t> new_slots(node_count);
+	for (size_t slot = 0; slot < node_count; slot++)
+	{
+		new_slots[slot] = cursors[depths_[nodes_[slot]]]++;
+	}
+
+	auto permute = [&](auto &array) {
+		std::remove_reference_t<decltype(array)> sorted(array.size());
+		for (size_t slot = 0; slot < node_count; slot++)
+		{
+			sorted[new_slots[slot]] = array[slot];
+		}
+		array.swap(sorted);
+	};
+	permute(local_);
+	permute(local_bounds_);
+	permute(world_);
+	permute(world_bounds_);
+	permute(dirty_);
+	permute(nodes_);
+	permute(parents_);
+	for (uint32_t &parent: parents_)
+	{
+		if (parent != no_parent)
+			parent = new_slots[parent];
+	}
+	for (size_t slot = 0; slot < node_count; slot++)
+	{
+		slots_[nodes_[slot]] = static_cast<uint32_t>(slot);
+	}
+
+	// The slots of the last update moved
+	updated_.assign(node_count, 0);
+	updated_slots_.clear();
+	reorder_ = false;
+}
+
+uint32_t TransformHierarchy::update_range(uint32_t begin, uint32_t end, uint32_t *out)
+{
+	const HierarchyArrays arrays{parents_.data(), local_.data(), local_bounds_.data(), dirty_.data(), updated_.data(), world_.data(), world_bounds_.data()};
+
+	switch (instruction_set_)
+	{
+#if FLOWFORGE_X86
+		case InstructionSet::AVX2:
+			return update_avx2(arrays, begin, end, out);
+		case InstructionSet::SSE:
+			return update_sse(arrays, begin, end, out);
+#endif
+		default:
+			return update_scalar(arrays, begin, end, out);
+	}
+}
+
+}// namespace flwfrg
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "core/cpu_features.hpp"
+#include "dirty_bitset.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace flwfrg
+{
+
+class JobSystem;
+
+using TransformNode = uint32_t;
+
+struct TransformHierarchyStatistics
+{
+	uint32_t nodes = 0;
+	uint32_t levels = 0;
+	uint32_t updated_nodes = 0;
+	// Levels without a changed node or parent, skipped without looking at their nodes
+	uint32_t skipped_levels = 0;
+	// Most chunks a level was split into for separate jobs
+	uint32_t partitions = 0;
+	double microseconds = 0.0;
+};
+
+/// <summary>
+/// Parent and child transforms, stored breadth first so every depth level is one contiguous range whose parents
+/// all come before it. update walks the levels in order and computes the world matrix and world bounding sphere
+/// of every node whose local transform, or whose parent's world transform, changed, in the same pass.
+/// Large levels are split into chunks updated by the jobs of a job system, when one is set, with SSE or AVX2 matrix multiplies.
+/// Nodes keep their handles when the levels are reordered, which only happens in update after nodes were added.
+/// Transforms are expected to be affine.
+/// </summary>
+class TransformHierarchy
+{
+public:
+	TransformHierarchy();
+
+	// Methods
+
+	// The parent has to exist already, the node is a root without one
+	TransformNode add(const glm::mat4 &local, const glm::vec4 &local_bounds, std::optional<TransformNode> parent = std::nullopt);
+	void set_local(TransformNode node, const glm::mat4 &local);
+	// Local bounding sphere, xyz center and w radius
+	void set_local_bounds(TransformNode node, const glm::vec4 &local_bounds);
+	void clear();
+	void reserve(size_t count);
+
+	// Recomputes the world transforms and bounds of the changed nodes and everything below them
+	void update();
+
+	// Forces an instruction set, the best supported one is used by default
+	void set_instruction_set(InstructionSet instruction_set);
+	// Updates on the calling thread alone without one
+	void set_job_system(JobSystem *job_system);
+
+	// Valid after update
+	[[nodiscard]] inline const glm::mat4 &world(TransformNode node) const { return world_[slots_[node]]; };
+	[[nodiscard]] inline const glm::vec4 &world_bounds(TransformNode node) const { return world_bounds_[slots_[node]]; };
+	// Nodes whose world transform was recomputed by the last update
+	[[nodiscard]] inline const DirtyBitset &changed() const { return changed_; };
+
+	[[nodiscard]] inline size_t size() const { return slots_.size(); };
+	[[nodiscard]] inline InstructionSet instruction_set() const { return instruction_set_; };
+	[[nodiscard]] inline const TransformHierarchyStatistics &statistics() const { return statistics_; };
+
+	static constexpr uint32_t no_parent = std::numeric_limits<uint32_t>::max();
+
+private:
+	// Indexed by slot, in level order
+	std::vector<uint32_t> parents_{};
+	std::vector<glm::mat4> local_{};
+	std::vector<glm::vec4> local_bounds_{};
+	std::vector<glm::mat4> world_{};
+	std::vector<glm::vec4> world_bounds_{};
+	std::vector<uint8_t> dirty_{};
+	// Set for the slots recomputed by the last update, children read it from their parent
+	std::vector<uint8_t> updated_{};
+	std::vector<TransformNode> nodes_{};
+
+	// Indexed by node
+	std::vector<uint32_t> slots_{};
+	std::vector<uint32_t> depths_{};
+
+	// First slot of every level, and one past the last
+	std::vector<uint32_t> level_offsets_{};
+	// Levels with a node whose own local transform changed
+	std::vector<uint8_t> dirty_levels_{};
+	bool reorder_ = false;
+
+	// Slots recomputed by the last update
+	std::vector<uint32_t> updated_slots_{};
+	DirtyBitset changed_{};
+
+	InstructionSet instruction_set_;
+	JobSystem *job_system_ = nullptr;
+
+	TransformHierarchyStatistics statistics_{};
+
+	///// Private methods
+
+	void mark_dirty(TransformNode node);
+	// Sorts the slots by depth, keeping the order within a level
+	void sort_levels();
+	// Returns the number of updated slots written to out
+	uint32_t update_range(uint32_t begin, uint32_t end, uint32_t *out);
+};
+
+}// namespace flwfrg
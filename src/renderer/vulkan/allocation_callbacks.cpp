@@ -0,0 +1,109 @@
+#include "pch.hpp"
+
+#include "allocation_callbacks.hpp"
+
+#include "core/allocation_tracker.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace flwfrg
+{
+
+///// Local helper functions
+
+#if FLOWFORGE_ALLOCATION_TRACKING_ENABLED
+namespace
+{
+
+// Stored right before every allocation, the alignment Vulkan asks for is met by padding in front of it
+struct AllocationHeader
+{
+	size_t size;
+	size_t offset;
+};
+
+void *VKAPI_CALL allocate(void *, size_t size, size_t alignment, VkSystemAllocationScope)
+{
+	alignment = std::max(alignment, alignof(AllocationHeader));
+
+	auto *base = static_cast<std::byte *>(std::malloc(size + sizeof(AllocationHeader) + alignment));
+	if (base == nullptr)
+		return nullptr;
+
+	const auto start = reinterpret_cast<uintptr_t>(base + sizeof(AllocationHeader));
+	auto *memory = reinterpret_cast<std::byte *>((start + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1));
+
+	AllocationHeader header{size, static_cast<size_t>(memory - base)};
+	std::memcpy(memory - sizeof(AllocationHeader), &header, sizeof(AllocationHeader));
+
+	AllocationTracker::record_vulkan_allocation(size);
+	return memory;
+}
+
+AllocationHeader header_of(void *memory)
+{
+	AllocationHeader header;
+	std::memcpy(&header, static_cast<std::byte *>(memory) - sizeof(AllocationHeader), sizeof(AllocationHeader));
+	return header;
+}
+
+void VKAPI_CALL free_memory(void *, void *memory)
+{
+	if (memory == nullptr)
+		return;
+	std::free(static_cast<std::byte *>(memory) - header_of(memory).offset);
+}
+
+void *VKAPI_CALL reallocate(void *user_data, void *original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	if (original == nullptr)
+		return allocate(user_data, size, alignment, scope);
+	if (size == 0)
+	{
+		free_memory(user_data, original);
+		return nullptr;
+	}
+
+	void *memory = allocate(user_data, size, alignment, scope);
+	if (memory == nullptr)
+		return nullptr;
+	std::memcpy(memory, original, std::min(size, header_of(original).size));
+	free_memory(user_data, original);
+	return memory;
+}
+
+// Memory the implementation allocated itself, for example for executable code
+void VKAPI_CALL internal_allocation(void *, size_t size, VkInternalAllocationType, VkSystemAllocationScope)
+{
+	AllocationTracker::record_vulkan_allocation(size);
+}
+
+void VKAPI_CALL internal_free(void *, size_t, VkInternalAllocationType, VkSystemAllocationScope)
+{
+}
+
+const VkAllocationCallbacks callbacks_s{
+		nullptr,
+		allocate,
+		reallocate,
+		free_memory,
+		internal_allocation,
+		internal_free};
+
+}// namespace
+#endif
+
+///// Method implementations
+
+const VkAllocationCallbacks *vulkan_allocator()
+{
+#if FLOWFORGE_ALLOCATION_TRACKING_ENABLED
+	return &callbacks_s;
+#else
+	return nullptr;
+#endif
+}
+
+}// namespace flwfrg
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+namespace flwfrg
+{
+
+// Callbacks to pass to every vkCreate*, vkAllocate* and their matching destroy and free calls.
+// With allocation tracking they count the host memory Vulkan asks for, otherwise they are nullptr.
+[[nodiscard]] const VkAllocationCallbacks *vulkan_allocator();
+
+}// namespace flwfrg
@@ -4,6 +4,8 @@
 
 #include "vulkan_context.hpp"
 
+#include <algorithm>
+
 namespace flwfrg
 {
 
@@ -23,7 +25,7 @@ VulkanBuffer::VulkanBuffer(VulkanContext *context, uint64_t size, VkBufferUsageF
 	buffer_create_info.usage = usage;
 	buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE; // Only used in a single queue
 
-	if (vkCreateBuffer(context->logical_device(), &buffer_create_info, nullptr, &handle_) != VK_SUCCESS)
+	if (vkCreateBuffer(context->logical_device(), &buffer_create_info, vulkan_allocator(), &handle_) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create buffer");
 	}
@@ -44,7 +46,7 @@ VulkanBuffer::VulkanBuffer(VulkanContext *context, uint64_t size, VkBufferUsageF
 	memory_allocate_info.memoryTypeIndex = static_cast<uint32_t>(memory_index_);
 
 	// Allocate the memory
-	if (vkAllocateMemory(context->logical_device(), &memory_allocate_info, nullptr, &memory_) != VK_SUCCESS)
+	if (vkAllocateMemory(context->logical_device(), &memory_allocate_info, vulkan_allocator(), &memory_) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to allocate memory");
 	}
@@ -59,11 +61,11 @@ VulkanBuffer::~VulkanBuffer()
 {
 	if (handle_ != VK_NULL_HANDLE)
 	{
-		vkDestroyBuffer(context_->logical_device(), handle_, nullptr);
+		vkDestroyBuffer(context_->logical_device(), handle_, vulkan_allocator());
 	}
 	if (memory_ != VK_NULL_HANDLE)
 	{
-		vkFreeMemory(context_->logical_device(), memory_, nullptr);
+		vkFreeMemory(context_->logical_device(), memory_, vulkan_allocator());
 	}
 }
 VulkanBuffer::VulkanBuffer(VulkanBuffer &&other) noexcept
@@ -85,11 +87,11 @@ VulkanBuffer &VulkanBuffer::operator=(VulkanBuffer &&other) noexcept
 	{
 		if (handle_ != VK_NULL_HANDLE)
 		{
-			vkDestroyBuffer(context_->logical_device(), handle_, nullptr);
+			vkDestroyBuffer(context_->logical_device(), handle_, vulkan_allocator());
 		}
 		if (memory_ != VK_NULL_HANDLE)
 		{
-			vkFreeMemory(context_->logical_device(), memory_, nullptr);
+			vkFreeMemory(context_->logical_device(), memory_, vulkan_allocator());
 		}
 
 		context_ = other.context_;
@@ -112,22 +114,13 @@ void VulkanBuffer::resize(uint64_t new_size, VkQueue queue, VkCommandPool pool)
 	// Create new buffer
 	VulkanBuffer new_buffer{context_, new_size, usage_, memory_property_flags_, true};
 
-	// Copy the data
-	copy_to(new_buffer, 0, new_size, 0, pool, VK_NULL_HANDLE, queue);
+	// Copy the data, only as much as both buffers hold
+	copy_to(new_buffer, 0, std::min(total_size_, new_size), 0, pool, VK_NULL_HANDLE, queue);
 
 	// Wait for device to be idle
 	vkDeviceWaitIdle(context_->logical_device());
 
-	if (handle_ != VK_NULL_HANDLE)
-	{
-		vkDestroyBuffer(context_->logical_device(), handle_, nullptr);
-	}
-	if (memory_ != VK_NULL_HANDLE)
-	{
-		vkFreeMemory(context_->logical_device(), memory_, nullptr);
-	}
-
-	// Move the new buffer to this
+	// Move the new buffer to this, which destroys the old one
 	*this = std::move(new_buffer);
 }
 void *VulkanBuffer::lock_memory(uint64_t offset, uint64_t size, uint32_t flags)
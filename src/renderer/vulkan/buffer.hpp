@@ -26,7 +26,9 @@ public:
 	// Methods
 
 	[[nodiscard]] inline VkBuffer get_handle() const { return handle_; };
+	[[nodiscard]] inline uint64_t get_size() const { return total_size_; };
 	
+	// Recreates the buffer with the new size and copies the contents over. Waits for the device to be idle.
 	void resize(uint64_t new_size, VkQueue queue, VkCommandPool pool);
 	
 	void *lock_memory(uint64_t offset, uint64_t size, uint32_t flags);
@@ -0,0 +1,353 @@
+#include "pch.hpp"
+
+#include "depth_pyramid.hpp"
+
+#include "command_buffer.hpp"
+#include "shaders/shader_stage.hpp"
+#include "vulkan_context.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+
+namespace flwfrg
+{
+
+///// Local helper functions
+
+namespace
+{
+
+constexpr uint32_t reduce_group_size = 8;
+constexpr const char *reduce_shader_file_name = "depth_reduce";
+// Enough levels for a 65536 texel wide attachment
+constexpr uint32_t max_pyramid_levels = 17;
+
+}// namespace
+
+
+///// Method implementations
+
+VulkanDepthPyramid::VulkanDepthPyramid(VulkanContext *context)
+	: context_{context}
+{
+	assert(context != nullptr);
+
+	create_pipeline();
+	create_sampler();
+}
+
+VulkanDepthPyramid::~VulkanDepthPyramid()
+{
+	destroy_retired(true);
+	destroy_mip_views(mip_views_);
+
+	if (sampler_ != VK_NULL_HANDLE)
+	{
+		vkDestroySampler(context_->logical_device(), sampler_, vulkan_allocator());
+	}
+}
+
+void VulkanDepthPyramid::prepare(VulkanCommandBuffer &command_buffer, VkExtent2D depth_extent)
+{
+	destroy_retired(false);
+
+	if (depth_extent_.has_value() && depth_extent_->width == depth_extent.width && depth_extent_->height == depth_extent.height)
+		return;
+
+	// The old pyramid may still be read by frames in flight
+	if (is_valid())
+		retire(true);
+
+	depth_extent_ = depth_extent;
+	depth_view_ = VK_NULL_HANDLE;
+
+	const uint32_t width = std::bit_floor(std::max(depth_extent.width, 1u));
+	const uint32_t height = std::bit_floor(std::max(depth_extent.height, 1u));
+	const uint32_t mip_levels = std::bit_width(std::max(width, height));
+
+	image_ = VulkanImage(context_,
+						 width,
+						 height,
+						 VK_FORMAT_R32_SFLOAT,
+						 VK_IMAGE_TILING_OPTIMAL,
+						 VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+						 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+						 VK_IMAGE_ASPECT_COLOR_BIT,
+						 true,
+						 mip_levels);
+
+	// A view per level to write it and to read it while reducing the next one
+	mip_views_.resize(mip_levels);
+	for (uint32_t level = 0; level < mip_levels; level++)
+	{
+		VkImageViewCreateInfo view_info{};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.image = image_.get_image_handle();
+		view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view_info.format = VK_FORMAT_R32_SFLOAT;
+		view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		view_info.subresourceRange.baseMipLevel = level;
+		view_info.subresourceRange.levelCount = 1;
+		view_info.subresourceRange.baseArrayLayer = 0;
+		view_info.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(context_->logical_device(), &view_info, vulkan_allocator(), &mip_views_[level]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create depth pyramid level view");
+		}
+	}
+
+	// Without a sampled depth attachment the pyramid only exists so culling descriptors stay valid
+	if (context_->vulkan_device().is_depth_sampling_supported())
+	{
+		create_descriptor_sets();
+	}
+
+	// Move the whole pyramid into the general layout once, before anything in the frame samples it
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image_.get_image_handle();
+	barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mip_levels, 0, 1};
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(command_buffer.get_handle(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+	generation_++;
+	FLOWFORGE_INFO("Depth pyramid created ({}x{}, {} levels)", width, height, mip_levels);
+}
+
+void VulkanDepthPyramid::build(VulkanCommandBuffer &command_buffer, VkImageView depth_view, VkExtent2D rendered_extent)
+{
+	assert(depth_extent_.has_value() && rendered_extent.width <= depth_extent_->width && rendered_extent.height <= depth_extent_->height);
+	assert(context_->vulkan_device().is_depth_sampling_supported());
+
+	// Frames in flight may still use the sets with the old attachment, the new one gets new sets
+	if (depth_view != depth_view_)
+	{
+		if (depth_view_ != VK_NULL_HANDLE)
+		{
+			retire(false);
+			create_descriptor_sets();
+		}
+		bind_depth_attachment(depth_view);
+	}
+
+	VkCommandBuffer handle = command_buffer.get_handle();
+
+	pipeline_.bind(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+
+	// The reduction maps any input size onto the level, smaller or larger
+	uint32_t input_width = std::max(rendered_extent.width, 1u);
+	uint32_t input_height = std::max(rendered_extent.height, 1u);
+	uint32_t output_width = image_.get_width();
+	uint32_t output_height = image_.get_height();
+	for (uint32_t level = 0; level < image_.get_mip_levels(); level++)
+	{
+		vkCmdBindDescriptorSets(handle, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_.layout(), 0, 1, &descriptor_sets_[level], 0, nullptr);
+
+		const ReduceConstants constants{input_width, input_height, output_width, output_height};
+		vkCmdPushConstants(handle, pipeline_.layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ReduceConstants), &constants);
+
+		vkCmdDispatch(handle, (output_width + reduce_group_size - 1) / reduce_group_size, (output_height + reduce_group_size - 1) / reduce_group_size, 1);
+
+		// The next level reads this one, the frame graph orders the last one against the culling pass
+		if (level + 1 == image_.get_mip_levels())
+			break;
+
+		VkMemoryBarrier level_barrier{};
+		level_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		level_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		level_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(handle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &level_barrier, 0, nullptr, 0, nullptr);
+
+		input_width = output_width;
+		input_height = output_height;
+		output_width = std::max(1u, output_width / 2);
+		output_height = std::max(1u, output_height / 2);
+	}
+}
+
+void VulkanDepthPyramid::create_pipeline()
+{
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+	bindings[0].binding = 0;
+	bindings[0].descriptorCount = 1;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].binding = 1;
+	bindings[1].descriptorCount = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layout_info{};
+	layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+	layout_info.pBindings = bindings.data();
+	descriptor_set_layout_ = VulkanDescriptorSetLayout(context_, layout_info);
+
+	std::optional<VulkanShaderStage> stage = VulkanShaderStage::create_shader_module(context_, reduce_shader_file_name, VK_SHADER_STAGE_COMPUTE_BIT);
+	if (!stage.has_value())
+	{
+		throw std::runtime_error("Failed to create depth reduction shader stage");
+	}
+
+	const std::array<VkDescriptorSetLayout, 1> layouts = {descriptor_set_layout_.get()};
+	auto created_pipeline = VulkanPipeline::create_compute_pipeline(context_,
+																	layouts,
+																	stage->get_shader_stage_create_info(),
+																	sizeof(ReduceConstants));
+	if (!created_pipeline.has_value())
+	{
+		throw std::runtime_error("Failed to create depth reduction pipeline");
+	}
+
+	pipeline_ = std::move(created_pipeline.value());
+}
+
+void VulkanDepthPyramid::create_sampler()
+{
+	// Exact texels only, the culling pass picks the level itself
+	VkSamplerCreateInfo sampler_info{};
+	sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_info.magFilter = VK_FILTER_NEAREST;
+	sampler_info.minFilter = VK_FILTER_NEAREST;
+	sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.anisotropyEnable = VK_FALSE;
+	sampler_info.compareEnable = VK_FALSE;
+	sampler_info.minLod = 0.0f;
+	sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+
+	if (vkCreateSampler(context_->logical_device(), &sampler_info, vulkan_allocator(), &sampler_) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid sampler");
+	}
+}
+
+void VulkanDepthPyramid::create_descriptor_sets()
+{
+	const uint32_t mip_levels = image_.get_mip_levels();
+
+	// The sets of the old pyramid were retired with their pool
+	std::array<VkDescriptorPoolSize, 2> pool_sizes{};
+	pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pool_sizes[0].descriptorCount = max_pyramid_levels;
+	pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	pool_sizes[1].descriptorCount = max_pyramid_levels;
+
+	VkDescriptorPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+	pool_info.pPoolSizes = pool_sizes.data();
+	pool_info.maxSets = max_pyramid_levels;
+	descriptor_pool_ = VulkanDescriptorPool(context_, pool_info);
+
+	std::vector<VkDescriptorSetLayout> layouts(mip_levels, descriptor_set_layout_.get());
+	descriptor_sets_.resize(mip_levels);
+
+	VkDescriptorSetAllocateInfo allocate_info{};
+	allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocate_info.descriptorPool = descriptor_pool_.get();
+	allocate_info.descriptorSetCount = mip_levels;
+	allocate_info.pSetLayouts = layouts.data();
+	if (vkAllocateDescriptorSets(context_->logical_device(), &allocate_info, descriptor_sets_.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate depth pyramid descriptor sets");
+	}
+
+	for (uint32_t level = 0; level < mip_levels; level++)
+	{
+		VkDescriptorImageInfo output_info{};
+		output_info.imageView = mip_views_[level];
+		output_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 2> writes{};
+		writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[0].dstSet = descriptor_sets_[level];
+		writes[0].dstBinding = 1;
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writes[0].descriptorCount = 1;
+		writes[0].pImageInfo = &output_info;
+
+		// The first level reads the depth attachment, bound once it is known, every other level the one above it
+		VkDescriptorImageInfo input_info{};
+		input_info.sampler = sampler_;
+		input_info.imageView = level > 0 ? mip_views_[level - 1] : VK_NULL_HANDLE;
+		input_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[1].dstSet = descriptor_sets_[level];
+		writes[1].dstBinding = 0;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		writes[1].descriptorCount = 1;
+		writes[1].pImageInfo = &input_info;
+
+		vkUpdateDescriptorSets(context_->logical_device(), level > 0 ? 2 : 1, writes.data(), 0, nullptr);
+	}
+}
+
+void VulkanDepthPyramid::bind_depth_attachment(VkImageView depth_view)
+{
+	VkDescriptorImageInfo input_info{};
+	input_info.sampler = sampler_;
+	input_info.imageView = depth_view;
+	input_info.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet write{};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = descriptor_sets_[0];
+	write.dstBinding = 0;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.descriptorCount = 1;
+	write.pImageInfo = &input_info;
+
+	vkUpdateDescriptorSets(context_->logical_device(), 1, &write, 0, nullptr);
+	depth_view_ = depth_view;
+}
+
+void VulkanDepthPyramid::retire(bool image)
+{
+	RetiredPyramid retired{};
+	if (image)
+	{
+		retired.image = std::move(image_);
+		retired.mip_views = std::move(mip_views_);
+		mip_views_.clear();
+	}
+	retired.descriptor_pool = std::move(descriptor_pool_);
+	retired.retired_frame = context_->get_swapchain().get_presented_frames();
+	retired_pyramids_.push_back(std::move(retired));
+
+	descriptor_sets_.clear();
+}
+
+void VulkanDepthPyramid::destroy_retired(bool all)
+{
+	const VulkanSwapchain &swapchain = context_->get_swapchain();
+	std::erase_if(retired_pyramids_, [&](RetiredPyramid &retired) {
+		if (!all && !swapchain.has_retired(retired.retired_frame))
+			return false;
+
+		// The image and the pool are destroyed with the entry
+		destroy_mip_views(retired.mip_views);
+		return true;
+	});
+}
+
+void VulkanDepthPyramid::destroy_mip_views(std::vector<VkImageView> &mip_views)
+{
+	for (VkImageView view: mip_views)
+	{
+		vkDestroyImageView(context_->logical_device(), view, vulkan_allocator());
+	}
+	mip_views.clear();
+}
+
+}// namespace flwfrg
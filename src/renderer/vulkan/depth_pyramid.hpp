@@ -0,0 +1,103 @@
+#pragma once
+
+#include "descriptor.hpp"
+#include "image.hpp"
+#include "shaders/pipeline.hpp"
+
+#include <optional>
+#include <vector>
+
+namespace flwfrg
+{
+class VulkanContext;
+class VulkanCommandBuffer;
+
+/// <summary>
+/// Mip chain of the farthest depth per texel, reduced from the depth attachment by a compute pass.
+/// The first level is the largest power of two that fits in the attachment. The image stays in the general layout,
+/// the frame graph orders the reduction against the passes that write the attachment and sample the pyramid.
+/// </summary>
+class VulkanDepthPyramid
+{
+public:
+	explicit VulkanDepthPyramid(VulkanContext *context);
+	~VulkanDepthPyramid();
+
+	// Not copyable or movable
+	VulkanDepthPyramid(const VulkanDepthPyramid &) = delete;
+	VulkanDepthPyramid &operator=(const VulkanDepthPyramid &) = delete;
+	VulkanDepthPyramid(VulkanDepthPyramid &&) = delete;
+	VulkanDepthPyramid &operator=(VulkanDepthPyramid &&) = delete;
+
+	// Methods
+
+	// Recreates the pyramid when the depth attachment changed size, recording its layout transition into the command buffer.
+	// The old one is destroyed once no frame in flight reads it anymore. Call it every frame, outside of a render pass.
+	void prepare(VulkanCommandBuffer &command_buffer, VkExtent2D depth_extent);
+
+	// Records the reduction of the depth attachment outside of a render pass. Requires a sampled depth format.
+	// The attachment has to be in the depth stencil read only layout. Only the top left rendered_extent of it is
+	// reduced, so a frame rendered at a lower scale still covers the whole pyramid.
+	void build(VulkanCommandBuffer &command_buffer, VkImageView depth_view, VkExtent2D rendered_extent);
+
+	[[nodiscard]] inline bool is_valid() const { return image_.get_image_handle() != VK_NULL_HANDLE; };
+	[[nodiscard]] inline VkImage get_image() const { return image_.get_image_handle(); };
+	[[nodiscard]] inline VkImageView get_view() const { return image_.get_image_view(); };
+	[[nodiscard]] inline VkSampler get_sampler() const { return sampler_; };
+	[[nodiscard]] inline uint32_t get_width() const { return image_.get_width(); };
+	[[nodiscard]] inline uint32_t get_height() const { return image_.get_height(); };
+	[[nodiscard]] inline uint32_t get_mip_levels() const { return image_.get_mip_levels(); };
+	// Changes every time the pyramid is recreated, descriptors of the old one are invalid then
+	[[nodiscard]] inline uint32_t get_generation() const { return generation_; };
+
+private:
+	// Image, views and sets replaced while frames in flight may still use them
+	struct RetiredPyramid
+	{
+		VulkanImage image;
+		std::vector<VkImageView> mip_views;
+		VulkanDescriptorPool descriptor_pool;
+		// Presented frames when it was replaced
+		uint64_t retired_frame;
+	};
+
+	struct ReduceConstants
+	{
+		uint32_t input_width;
+		uint32_t input_height;
+		uint32_t output_width;
+		uint32_t output_height;
+	};
+
+	VulkanContext *context_;
+
+	VulkanDescriptorSetLayout descriptor_set_layout_{};
+	VulkanDescriptorPool descriptor_pool_{};
+	VulkanPipeline pipeline_{};
+	VkSampler sampler_ = VK_NULL_HANDLE;
+
+	VulkanImage image_{};
+	std::vector<VkImageView> mip_views_{};
+	// One set per level
+	std::vector<VkDescriptorSet> descriptor_sets_{};
+
+	// Depth attachment size the pyramid was created for, and the view the first level reads
+	std::optional<VkExtent2D> depth_extent_{};
+	VkImageView depth_view_ = VK_NULL_HANDLE;
+	uint32_t generation_ = 0;
+
+	std::vector<RetiredPyramid> retired_pyramids_{};
+
+	///// Private methods
+
+	void create_pipeline();
+	void create_sampler();
+	void create_descriptor_sets();
+	void bind_depth_attachment(VkImageView depth_view);
+	// Moves the sets, and with the image the whole pyramid, to the retired ones
+	void retire(bool image);
+	void destroy_retired(bool all);
+	void destroy_mip_views(std::vector<VkImageView> &mip_views);
+};
+
+}// namespace flwfrg
@@ -4,16 +4,31 @@
 
 #include "vulkan_context.hpp"
 
+#include <algorithm>
+
 namespace flwfrg
 {
 
+///// Local helper functions
+
+namespace
+{
+
+size_t hash_combine(size_t seed, uint64_t value)
+{
+	return seed ^ (static_cast<size_t>(value) + 0x9E3779B9u + (seed << 6) + (seed >> 2));
+}
+
+}// namespace
+
+///// Method implementations
 
 VulkanDescriptorPool::VulkanDescriptorPool(VulkanContext *context, VkDescriptorPoolCreateInfo create_info)
 	: context_{context}, pool_{VK_NULL_HANDLE}
 {
 	assert(context_ != nullptr);
 
-	if (vkCreateDescriptorPool(context_->logical_device(), &create_info, nullptr, &pool_) != VK_SUCCESS)
+	if (vkCreateDescriptorPool(context_->logical_device(), &create_info, vulkan_allocator(), &pool_) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create descriptor pool");
 	}
@@ -22,7 +37,7 @@ VulkanDescriptorPool::~VulkanDescriptorPool()
 {
 	if (pool_ != VK_NULL_HANDLE)
 	{
-		vkDestroyDescriptorPool(context_->logical_device(), pool_, nullptr);
+		vkDestroyDescriptorPool(context_->logical_device(), pool_, vulkan_allocator());
 		pool_ = VK_NULL_HANDLE;
 	}
 }
@@ -38,7 +53,7 @@ VulkanDescriptorPool &VulkanDescriptorPool::operator=(VulkanDescriptorPool &&oth
 	{
 		if (pool_ != VK_NULL_HANDLE)
 		{
-			vkDestroyDescriptorPool(context_->logical_device(), pool_, nullptr);
+			vkDestroyDescriptorPool(context_->logical_device(), pool_, vulkan_allocator());
 		}
 
 		context_ = other.context_;
@@ -55,7 +70,7 @@ VulkanDescriptorSetLayout::VulkanDescriptorSetLayout(VulkanContext *context, VkD
 {
 	assert(context_ != nullptr);
 
-	if (vkCreateDescriptorSetLayout(context_->logical_device(), &create_info, nullptr, &layout_) != VK_SUCCESS)
+	if (vkCreateDescriptorSetLayout(context_->logical_device(), &create_info, vulkan_allocator(), &layout_) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create descriptor set layout");
 	}
@@ -64,7 +79,7 @@ VulkanDescriptorSetLayout::~VulkanDescriptorSetLayout()
 {
 	if (layout_ != VK_NULL_HANDLE)
 	{
-		vkDestroyDescriptorSetLayout(context_->logical_device(), layout_, nullptr);
+		vkDestroyDescriptorSetLayout(context_->logical_device(), layout_, vulkan_allocator());
 		layout_ = VK_NULL_HANDLE;
 	}
 }
@@ -79,7 +94,7 @@ VulkanDescriptorSetLayout &VulkanDescriptorSetLayout::operator=(VulkanDescriptor
 	{
 		if (layout_ != VK_NULL_HANDLE)
 		{
-			vkDestroyDescriptorSetLayout(context_->logical_device(), layout_, nullptr);
+			vkDestroyDescriptorSetLayout(context_->logical_device(), layout_, vulkan_allocator());
 		}
 
 		context_ = other.context_;
@@ -91,4 +106,181 @@ VulkanDescriptorSetLayout &VulkanDescriptorSetLayout::operator=(VulkanDescriptor
 	return *this;
 }
 
-}// namespace flwfrg
\ No newline at end of file
+VulkanDescriptorUpdateTemplate::VulkanDescriptorUpdateTemplate(VulkanContext *context, VkDescriptorUpdateTemplateCreateInfo create_info)
+	: context_{context}, update_template_{VK_NULL_HANDLE}
+{
+	assert(context_ != nullptr);
+
+	if (vkCreateDescriptorUpdateTemplate(context_->logical_device(), &create_info, vulkan_allocator(), &update_template_) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create descriptor update template");
+	}
+}
+VulkanDescriptorUpdateTemplate::~VulkanDescriptorUpdateTemplate()
+{
+	if (update_template_ != VK_NULL_HANDLE)
+	{
+		vkDestroyDescriptorUpdateTemplate(context_->logical_device(), update_template_, vulkan_allocator());
+		update_template_ = VK_NULL_HANDLE;
+	}
+}
+VulkanDescriptorUpdateTemplate::VulkanDescriptorUpdateTemplate(VulkanDescriptorUpdateTemplate &&other) noexcept
+	: context_{other.context_}, update_template_{other.update_template_}
+{
+	other.update_template_ = VK_NULL_HANDLE;
+}
+VulkanDescriptorUpdateTemplate &VulkanDescriptorUpdateTemplate::operator=(VulkanDescriptorUpdateTemplate &&other) noexcept
+{
+	if (this != &other)
+	{
+		if (update_template_ != VK_NULL_HANDLE)
+		{
+			vkDestroyDescriptorUpdateTemplate(context_->logical_device(), update_template_, vulkan_allocator());
+		}
+
+		context_ = other.context_;
+		update_template_ = other.update_template_;
+
+		other.update_template_ = VK_NULL_HANDLE;
+	}
+
+	return *this;
+}
+
+VulkanDescriptorAllocator::VulkanDescriptorAllocator(VulkanContext *context, std::span<const DescriptorPoolRatio> ratios, uint32_t sets_per_pool)
+	: context_{context}, ratios_{ratios.begin(), ratios.end()}, sets_per_pool_{std::max(sets_per_pool, 1u)}
+{
+	assert(context_ != nullptr);
+	assert(!ratios_.empty());
+}
+
+VkDescriptorSet VulkanDescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+{
+	if (used_pools_.empty())
+		used_pools_.push_back(take_pool());
+
+	VkDescriptorSetAllocateInfo allocate_info{};
+	allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocate_info.descriptorPool = used_pools_.back().get();
+	allocate_info.descriptorSetCount = 1;
+	allocate_info.pSetLayouts = &layout;
+
+	VkDescriptorSet set = VK_NULL_HANDLE;
+	VkResult result = vkAllocateDescriptorSets(context_->logical_device(), &allocate_info, &set);
+
+	// The current pool is full, continue in the next one
+	if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL)
+	{
+		used_pools_.push_back(take_pool());
+		allocate_info.descriptorPool = used_pools_.back().get();
+		result = vkAllocateDescriptorSets(context_->logical_device(), &allocate_info, &set);
+	}
+
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate descriptor set");
+	}
+
+	statistics_.allocated_sets++;
+	return set;
+}
+
+void VulkanDescriptorAllocator::reset()
+{
+	for (VulkanDescriptorPool &pool: used_pools_)
+	{
+		vkResetDescriptorPool(context_->logical_device(), pool.get(), 0);
+		free_pools_.push_back(std::move(pool));
+	}
+	used_pools_.clear();
+	statistics_.allocated_sets = 0;
+}
+
+VulkanDescriptorLayoutCache::VulkanDescriptorLayoutCache(VulkanContext *context)
+	: context_{context}
+{
+	assert(context_ != nullptr);
+}
+
+VkDescriptorSetLayout VulkanDescriptorLayoutCache::get(std::span<const VkDescriptorSetLayoutBinding> bindings, VkDescriptorSetLayoutCreateFlags flags)
+{
+	Key key{flags, {bindings.begin(), bindings.end()}};
+	std::sort(key.bindings.begin(), key.bindings.end(), [](const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b) {
+		return a.binding < b.binding;
+	});
+
+	if (auto found = layouts_.find(key); found != layouts_.end())
+		return found->second.get();
+
+	VkDescriptorSetLayoutCreateInfo create_info{};
+	create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	create_info.flags = flags;
+	create_info.bindingCount = static_cast<uint32_t>(key.bindings.size());
+	create_info.pBindings = key.bindings.data();
+	VulkanDescriptorSetLayout layout{context_, create_info};
+
+	const VkDescriptorSetLayout handle = layout.get();
+	layouts_.emplace(std::move(key), std::move(layout));
+	return handle;
+}
+
+bool VulkanDescriptorLayoutCache::Key::operator==(const Key &other) const
+{
+	return flags == other.flags &&
+		   std::equal(bindings.begin(), bindings.end(), other.bindings.begin(), other.bindings.end(),
+					  [](const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b) {
+						  return a.binding == b.binding &&
+								 a.descriptorType == b.descriptorType &&
+								 a.descriptorCount == b.descriptorCount &&
+								 a.stageFlags == b.stageFlags &&
+								 a.pImmutableSamplers == b.pImmutableSamplers;
+					  });
+}
+
+size_t VulkanDescriptorLayoutCache::KeyHash::operator()(const Key &key) const
+{
+	size_t hash = hash_combine(0, key.flags);
+	for (const VkDescriptorSetLayoutBinding &binding: key.bindings)
+	{
+		hash = hash_combine(hash, binding.binding);
+		hash = hash_combine(hash, binding.descriptorType);
+		hash = hash_combine(hash, binding.descriptorCount);
+		hash = hash_combine(hash, binding.stageFlags);
+		hash = hash_combine(hash, reinterpret_cast<uintptr_t>(binding.pImmutableSamplers));
+	}
+	return hash;
+}
+
+///// Private methods
+
+VulkanDescriptorPool VulkanDescriptorAllocator::take_pool()
+{
+	if (!free_pools_.empty())
+	{
+		VulkanDescriptorPool pool = std::move(free_pools_.back());
+		free_pools_.pop_back();
+		return pool;
+	}
+
+	std::vector<VkDescriptorPoolSize> pool_sizes(ratios_.size());
+	for (size_t i = 0; i < ratios_.size(); i++)
+	{
+		pool_sizes[i].type = ratios_[i].type;
+		pool_sizes[i].descriptorCount = std::max(1u, static_cast<uint32_t>(ratios_[i].per_set * static_cast<float>(sets_per_pool_)));
+	}
+
+	VkDescriptorPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+	pool_info.pPoolSizes = pool_sizes.data();
+	pool_info.maxSets = sets_per_pool_;
+
+	if (statistics_.pools > 0)
+		statistics_.pool_growths++;
+	statistics_.pools++;
+	sets_per_pool_ = std::min(sets_per_pool_ * 2, max_sets_per_pool_);
+
+	return VulkanDescriptorPool{context_, pool_info};
+}
+
+}// namespace flwfrg
@@ -4,6 +4,10 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include <span>
+#include <unordered_map>
+#include <vector>
+
 namespace flwfrg
 {
 class VulkanContext;
@@ -50,4 +54,133 @@ private:
 	VkDescriptorSetLayout layout_ = VK_NULL_HANDLE;
 };
 
-}// namespace flwfrg
\ No newline at end of file
+// Writes a whole set from a packed struct, with vkUpdateDescriptorSetWithTemplate or as push descriptors
+class VulkanDescriptorUpdateTemplate
+{
+public:
+	inline VulkanDescriptorUpdateTemplate() = default;
+	VulkanDescriptorUpdateTemplate(VulkanContext *context, VkDescriptorUpdateTemplateCreateInfo create_info);
+	~VulkanDescriptorUpdateTemplate();
+
+	// Not copyable but movable
+	VulkanDescriptorUpdateTemplate(const VulkanDescriptorUpdateTemplate&) = delete;
+	VulkanDescriptorUpdateTemplate& operator=(const VulkanDescriptorUpdateTemplate&) = delete;
+	VulkanDescriptorUpdateTemplate(VulkanDescriptorUpdateTemplate&& other) noexcept;
+	VulkanDescriptorUpdateTemplate& operator=(VulkanDescriptorUpdateTemplate&& other) noexcept;
+
+	[[nodiscard]] VkDescriptorUpdateTemplate get() const { return update_template_; }
+
+private:
+	VulkanContext *context_ = nullptr;
+
+	VkDescriptorUpdateTemplate update_template_ = VK_NULL_HANDLE;
+};
+
+// Descriptors of a type a pool holds for every set it can allocate
+struct DescriptorPoolRatio
+{
+	VkDescriptorType type;
+	float per_set;
+};
+
+struct DescriptorAllocatorStatistics
+{
+	uint32_t pools = 0;
+	// Sets allocated since the last reset
+	uint32_t allocated_sets = 0;
+	// Pools added because every pool before them ran out
+	uint32_t pool_growths = 0;
+};
+
+/// <summary>
+/// Allocates descriptor sets from a chain of pools. When the current pool runs out or is fragmented, the next one
+/// is taken, or created twice as large, so allocations don't fail for lack of room.
+/// Sets aren't freed one by one, reset returns every pool at once with vkResetDescriptorPool. Pools are kept
+/// across resets, so once the largest frame was seen no pool is created anymore.
+/// </summary>
+class VulkanDescriptorAllocator
+{
+public:
+	inline VulkanDescriptorAllocator() = default;
+	VulkanDescriptorAllocator(VulkanContext *context, std::span<const DescriptorPoolRatio> ratios, uint32_t sets_per_pool = 64);
+	~VulkanDescriptorAllocator() = default;
+
+	// Not copyable but movable
+	VulkanDescriptorAllocator(const VulkanDescriptorAllocator &) = delete;
+	VulkanDescriptorAllocator &operator=(const VulkanDescriptorAllocator &) = delete;
+	VulkanDescriptorAllocator(VulkanDescriptorAllocator &&other) noexcept = default;
+	VulkanDescriptorAllocator &operator=(VulkanDescriptorAllocator &&other) noexcept = default;
+
+	// Methods
+
+	[[nodiscard]] VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+	// Every set allocated so far becomes invalid, the GPU must be done with them
+	void reset();
+
+	[[nodiscard]] inline const DescriptorAllocatorStatistics &statistics() const { return statistics_; };
+
+private:
+	static constexpr uint32_t max_sets_per_pool_ = 4096;
+
+	VulkanContext *context_ = nullptr;
+
+	std::vector<DescriptorPoolRatio> ratios_{};
+	// Size of the next pool that is created
+	uint32_t sets_per_pool_ = 0;
+
+	// Pools allocated from since the last reset, the last one is allocated from
+	std::vector<VulkanDescriptorPool> used_pools_{};
+	// Reset pools waiting to be allocated from again
+	std::vector<VulkanDescriptorPool> free_pools_{};
+
+	DescriptorAllocatorStatistics statistics_{};
+
+	///// Private methods
+
+	VulkanDescriptorPool take_pool();
+};
+
+/// <summary>
+/// Creates every distinct descriptor set layout once and shares it between everything that asks for the same
+/// bindings and flags. Bindings are compared by value, immutable samplers by address. Layouts live as long as the cache.
+/// </summary>
+class VulkanDescriptorLayoutCache
+{
+public:
+	explicit VulkanDescriptorLayoutCache(VulkanContext *context);
+	~VulkanDescriptorLayoutCache() = default;
+
+	// Not copyable or movable
+	VulkanDescriptorLayoutCache(const VulkanDescriptorLayoutCache &) = delete;
+	VulkanDescriptorLayoutCache &operator=(const VulkanDescriptorLayoutCache &) = delete;
+	VulkanDescriptorLayoutCache(VulkanDescriptorLayoutCache &&) = delete;
+	VulkanDescriptorLayoutCache &operator=(VulkanDescriptorLayoutCache &&) = delete;
+
+	// Methods
+
+	// The order of the bindings doesn't matter
+	[[nodiscard]] VkDescriptorSetLayout get(std::span<const VkDescriptorSetLayoutBinding> bindings, VkDescriptorSetLayoutCreateFlags flags = 0);
+
+	[[nodiscard]] inline size_t size() const { return layouts_.size(); };
+
+private:
+	struct Key
+	{
+		VkDescriptorSetLayoutCreateFlags flags;
+		// Sorted by binding
+		std::vector<VkDescriptorSetLayoutBinding> bindings;
+
+		bool operator==(const Key &other) const;
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key &key) const;
+	};
+
+	VulkanContext *context_;
+
+	std::unordered_map<Key, VulkanDescriptorSetLayout, KeyHash> layouts_{};
+};
+
+}// namespace flwfrg
@@ -3,6 +3,7 @@
 #include "device.hpp"
 #include "vulkan_context.hpp"
 
+#include <algorithm>
 #include <map>
 #include <set>
 
@@ -20,9 +21,9 @@ VulkanDevice::VulkanDevice(VulkanContext *context)
 
 VulkanDevice::~VulkanDevice()
 {
-	vkDestroyCommandPool(logical_device_, graphics_command_pool_, nullptr);
+	vkDestroyCommandPool(logical_device_, graphics_command_pool_, vulkan_allocator());
 	FLOWFORGE_INFO("Graphics command pool destroyed");
-	vkDestroyDevice(logical_device_, nullptr);
+	vkDestroyDevice(logical_device_, vulkan_allocator());
 	FLOWFORGE_INFO("Logical device destroyed");
 }
 
@@ -199,6 +200,13 @@ QueueFamilyIndices VulkanDevice::find_queue_families(VkPhysicalDevice device)
 	return indices;
 }
 
+bool VulkanDevice::is_extension_enabled(const char *extension_name) const
+{
+	return std::any_of(enabled_extensions_.begin(), enabled_extensions_.end(), [extension_name](const char *enabled) {
+		return strcmp(enabled, extension_name) == 0;
+	});
+}
+
 bool VulkanDevice::check_device_extension_support(VkPhysicalDevice device)
 {
 	// Get the extension count
@@ -229,6 +237,20 @@ bool VulkanDevice::detect_depth_format()
 			VK_FORMAT_D32_SFLOAT_S8_UINT,
 			VK_FORMAT_D24_UNORM_S8_UINT};
 
+	// Prefer a format that can also be sampled, for the depth pyramid
+	uint32_t sampled_flags = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+	for (VkFormat format: candidates)
+	{
+		VkFormatProperties props;
+		vkGetPhysicalDeviceFormatProperties(physical_device_, format, &props);
+		if ((props.optimalTilingFeatures & sampled_flags) == sampled_flags)
+		{
+			depth_format_ = format;
+			depth_sampling_supported_ = true;
+			return true;
+		}
+	}
+
 	uint32_t flags = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
 	for (VkFormat format: candidates)
 	{
@@ -238,6 +260,7 @@ bool VulkanDevice::detect_depth_format()
 			((props.linearTilingFeatures & flags) == flags))
 		{
 			depth_format_ = format;
+			depth_sampling_supported_ = false;
 			return true;
 		}
 	}
@@ -245,6 +268,11 @@ bool VulkanDevice::detect_depth_format()
 	return false;
 }
 
+bool VulkanDevice::depth_format_has_stencil() const
+{
+	return depth_format_ == VK_FORMAT_D32_SFLOAT_S8_UINT || depth_format_ == VK_FORMAT_D24_UNORM_S8_UINT;
+}
+
 SwapchainSupportDetails VulkanDevice::query_swapchain_support(VkPhysicalDevice device)
 {
 	SwapchainSupportDetails details;
@@ -319,17 +347,101 @@ void VulkanDevice::create_logical_device()
 		queue_create_infos[i].pQueuePriorities = &queue_priority;
 	}
 
-	// Request device features.
-	VkPhysicalDeviceFeatures device_features = {};
-	device_features.samplerAnisotropy = VK_TRUE;
+	// Request device features. Indirect drawing features are optional.
+	VkPhysicalDeviceFeatures supported_features;
+	vkGetPhysicalDeviceFeatures(physical_device_, &supported_features);
+
+	enabled_features_ = {};
+	enabled_features_.samplerAnisotropy = VK_TRUE;
+	enabled_features_.multiDrawIndirect = supported_features.multiDrawIndirect;
+	enabled_features_.drawIndirectFirstInstance = supported_features.drawIndirectFirstInstance;
+
+	// Required extensions, plus the optional ones the device has
+	enabled_extensions_ = physical_device_requirements_.device_extension_names;
+
+	uint32_t extension_count;
+	vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, nullptr);
+	std::vector<VkExtensionProperties> available_extensions(extension_count);
+	vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &extension_count, available_extensions.data());
+
+	for (const char *optional_extension: physical_device_requirements_.optional_device_extension_names)
+	{
+		for (const auto &extension: available_extensions)
+		{
+			if (strcmp(optional_extension, extension.extensionName) == 0)
+			{
+				enabled_extensions_.push_back(optional_extension);
+				FLOWFORGE_INFO("Enabling optional device extension {}", optional_extension);
+				break;
+			}
+		}
+	}
+
+	// Dynamic rendering can't be enabled without its dependencies
+	if (!is_extension_enabled(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME) || !is_extension_enabled(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME))
+	{
+		std::erase_if(enabled_extensions_, [](const char *extension) {
+			return strcmp(extension, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME) == 0;
+		});
+	}
+
+	// Present wait needs present ids, and unlike the others its features are not implied by the extensions
+	if (is_extension_enabled(VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+	{
+		VkPhysicalDevicePresentWaitFeaturesKHR present_wait_support{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR};
+		VkPhysicalDevicePresentIdFeaturesKHR present_id_support{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR};
+		present_id_support.pNext = &present_wait_support;
+		VkPhysicalDeviceFeatures2 features{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+		features.pNext = &present_id_support;
+		vkGetPhysicalDeviceFeatures2(physical_device_, &features);
+
+		if (!is_extension_enabled(VK_KHR_PRESENT_ID_EXTENSION_NAME) || present_id_support.presentId == VK_FALSE || present_wait_support.presentWait == VK_FALSE)
+		{
+			std::erase_if(enabled_extensions_, [](const char *extension) {
+				return strcmp(extension, VK_KHR_PRESENT_WAIT_EXTENSION_NAME) == 0;
+			});
+		}
+	}
 
 	VkDeviceCreateInfo device_create_info = {VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
+
+	// Features of the optional extensions, chained in front of each other.
+	// Each feature is there when its extension is, present wait was checked above.
+	void *feature_chain = nullptr;
+
+	VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2_features{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR};
+	synchronization2_features.synchronization2 = VK_TRUE;
+	if (is_extension_enabled(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME))
+	{
+		synchronization2_features.pNext = feature_chain;
+		feature_chain = &synchronization2_features;
+	}
+
+	VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamic_rendering_features{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR};
+	dynamic_rendering_features.dynamicRendering = VK_TRUE;
+	if (is_extension_enabled(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME))
+	{
+		dynamic_rendering_features.pNext = feature_chain;
+		feature_chain = &dynamic_rendering_features;
+	}
+
+	VkPhysicalDevicePresentIdFeaturesKHR present_id_features{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR};
+	VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR};
+	if (is_extension_enabled(VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+	{
+		present_id_features.presentId = VK_TRUE;
+		present_id_features.pNext = feature_chain;
+		present_wait_features.presentWait = VK_TRUE;
+		present_wait_features.pNext = &present_id_features;
+		feature_chain = &present_wait_features;
+	}
+
+	device_create_info.pNext = feature_chain;
 	device_create_info.queueCreateInfoCount = index_count;
 	device_create_info.pQueueCreateInfos = queue_create_infos;
-	device_create_info.pEnabledFeatures = &device_features;
-	device_create_info.enabledExtensionCount = 1;
-	const char *extension_names = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
-	device_create_info.ppEnabledExtensionNames = &extension_names;
+	device_create_info.pEnabledFeatures = &enabled_features_;
+	device_create_info.enabledExtensionCount = static_cast<uint32_t>(enabled_extensions_.size());
+	device_create_info.ppEnabledExtensionNames = enabled_extensions_.data();
 
 	// Deprecated and ignored
 	device_create_info.enabledLayerCount = 0;
@@ -339,7 +451,7 @@ void VulkanDevice::create_logical_device()
 	if (vkCreateDevice(
 				physical_device_,
 				&device_create_info,
-				nullptr,
+				vulkan_allocator(),
 				&logical_device_) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create logical device");
@@ -374,7 +486,7 @@ void VulkanDevice::create_logical_device()
 	pool_info.queueFamilyIndex = graphics_queue_index_;
 	pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-	if (vkCreateCommandPool(logical_device_, &pool_info, nullptr, &graphics_command_pool_) != VK_SUCCESS)
+	if (vkCreateCommandPool(logical_device_, &pool_info, vulkan_allocator(), &graphics_command_pool_) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create command pool");
 	}
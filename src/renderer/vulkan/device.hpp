@@ -18,9 +18,19 @@ class VulkanRenderer;
 struct VulkanPhysicalDeviceRequirements {
 	bool graphics = true;
 	bool present = true;
-	bool compute = false;
+	bool compute = true;
 	bool transfer = true;
 	std::vector<const char *> device_extension_names{VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+	// Enabled when available, check with VulkanDevice::is_extension_enabled
+	// Extensions are dropped again when the ones they depend on are missing.
+	std::vector<const char *> optional_device_extension_names{VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME,
+															  VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME,
+															  VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME,
+															  VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME,
+															  VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+															  VK_KHR_PRESENT_ID_EXTENSION_NAME,
+															  VK_KHR_PRESENT_WAIT_EXTENSION_NAME,
+															  VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME};
 	bool sampler_anisotropy = true;
 	bool discrete_gpu = false;
 };
@@ -66,6 +76,12 @@ public:
 	[[nodiscard]] VkPhysicalDevice get_physical_device() const { return physical_device_; };
 	[[nodiscard]] VkCommandPool get_graphics_command_pool() const { return graphics_command_pool_; };
 	[[nodiscard]] VkPhysicalDeviceProperties get_physical_device_properties() const { return physical_device_properties_; };
+	[[nodiscard]] const VkPhysicalDeviceFeatures &get_enabled_features() const { return enabled_features_; };
+	[[nodiscard]] bool is_extension_enabled(const char *extension_name) const;
+	[[nodiscard]] VkFormat get_depth_format() const { return depth_format_; };
+	// False when the depth format can't be sampled, which disables depth based culling
+	[[nodiscard]] bool is_depth_sampling_supported() const { return depth_sampling_supported_; };
+	[[nodiscard]] bool depth_format_has_stencil() const;
 
 	
 private:
@@ -93,9 +109,12 @@ private:
 
 	VkPhysicalDeviceProperties physical_device_properties_;
 	VkPhysicalDeviceFeatures features_;
+	VkPhysicalDeviceFeatures enabled_features_{};
+	std::vector<const char *> enabled_extensions_{};
 	VkPhysicalDeviceMemoryProperties memory_;
 
 	VkFormat depth_format_ = VK_FORMAT_UNDEFINED;
+	bool depth_sampling_supported_ = false;
 
 
 	///// Private methods
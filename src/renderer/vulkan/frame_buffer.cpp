@@ -25,7 +25,7 @@ VulkanFrameBuffer::VulkanFrameBuffer(VulkanContext *context, VulkanRenderpass &r
 	create_info.height = height;
 	create_info.layers = 1;
 
-	if (vkCreateFramebuffer(context_->device_.logical_device_, &create_info, nullptr, &handle_) != VK_SUCCESS)
+	if (vkCreateFramebuffer(context_->device_.logical_device_, &create_info, vulkan_allocator(), &handle_) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create framebuffer");
 	}
@@ -45,7 +45,7 @@ VulkanFrameBuffer::~VulkanFrameBuffer()
 {
 	if (handle_ != VK_NULL_HANDLE)
 	{
-		vkDestroyFramebuffer(context_->device_.logical_device_, handle_, nullptr);
+		vkDestroyFramebuffer(context_->device_.logical_device_, handle_, vulkan_allocator());
 		FLOWFORGE_TRACE("Framebuffer destroyed");
 	}
 }
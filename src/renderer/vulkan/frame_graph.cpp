@@ -0,0 +1,1019 @@
+#include "pch.hpp"
+
+#include "frame_graph.hpp"
+
+#include "command_buffer.hpp"
+#include "render_pass.hpp"
+#include "vulkan_context.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace flwfrg
+{
+
+///// Local helper functions
+
+namespace
+{
+
+// A framebuffer unused for this many frames is no longer referenced by any frame in flight
+constexpr uint64_t frame_buffer_retire_frames = 8;
+
+// New memory blocks get a quarter more than they need, so a window that is dragged larger doesn't allocate every step
+constexpr VkDeviceSize block_headroom_divisor = 4;
+
+// Usages that let an image live in lazily allocated memory
+constexpr VkImageUsageFlags attachment_only_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+													VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+													VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+bool format_has_stencil(VkFormat format)
+{
+	return format == VK_FORMAT_S8_UINT ||
+		   format == VK_FORMAT_D16_UNORM_S8_UINT ||
+		   format == VK_FORMAT_D24_UNORM_S8_UINT ||
+		   format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+bool same_image_info(const FrameGraphImageInfo &a, const FrameGraphImageInfo &b)
+{
+	return a.format == b.format &&
+		   a.extent.width == b.extent.width &&
+		   a.extent.height == b.extent.height &&
+		   a.aspect == b.aspect &&
+		   a.usage == b.usage &&
+		   a.mip_levels == b.mip_levels;
+}
+
+}// namespace
+
+
+///// Method implementations
+
+VulkanFrameGraph::PassBuilder::PassBuilder(VulkanFrameGraph *graph, uint32_t pass)
+	: graph_{graph},
+	  pass_{pass}
+{
+}
+
+VulkanFrameGraph::PassBuilder &VulkanFrameGraph::PassBuilder::read(FrameGraphImage image, FrameGraphUsage usage)
+{
+	graph_->add_access(pass_, image.index, usage, false);
+	return *this;
+}
+
+VulkanFrameGraph::PassBuilder &VulkanFrameGraph::PassBuilder::write(FrameGraphImage image, FrameGraphUsage usage)
+{
+	graph_->add_access(pass_, image.index, usage, true);
+	return *this;
+}
+
+VulkanFrameGraph::PassBuilder &VulkanFrameGraph::PassBuilder::read(FrameGraphBuffer buffer, FrameGraphUsage usage)
+{
+	graph_->add_access(pass_, buffer.index, usage, false);
+	return *this;
+}
+
+VulkanFrameGraph::PassBuilder &VulkanFrameGraph::PassBuilder::write(FrameGraphBuffer buffer, FrameGraphUsage usage)
+{
+	graph_->add_access(pass_, buffer.index, usage, true);
+	return *this;
+}
+
+VulkanFrameGraph::PassBuilder &VulkanFrameGraph::PassBuilder::set_render_pass(VulkanRenderpass &render_pass, std::initializer_list<FrameGraphImage> attachments)
+{
+	assert(attachments.size() > 0);
+
+	Pass &pass = graph_->passes_[pass_];
+	pass.render_pass = &render_pass;
+	pass.attachments.clear();
+	for (FrameGraphImage attachment: attachments)
+	{
+		const bool is_depth = (graph_->resources_[attachment.index].info.aspect & VK_IMAGE_ASPECT_DEPTH_BIT) != 0;
+		graph_->add_access(pass_, attachment.index, is_depth ? FrameGraphUsage::DEPTH_ATTACHMENT : FrameGraphUsage::COLOR_ATTACHMENT, true);
+		pass.attachments.push_back(attachment.index);
+	}
+	return *this;
+}
+
+VulkanFrameGraph::PassBuilder &VulkanFrameGraph::PassBuilder::set_render_area(VkExtent2D render_area)
+{
+	graph_->passes_[pass_].render_area = render_area;
+	return *this;
+}
+
+VulkanFrameGraph::PassBuilder &VulkanFrameGraph::PassBuilder::set_side_effects()
+{
+	graph_->passes_[pass_].side_effects = true;
+	return *this;
+}
+
+VulkanFrameGraph::VulkanFrameGraph(VulkanContext *context)
+	: context_{context}
+{
+	assert(context != nullptr);
+
+	if (context_->vulkan_device().is_extension_enabled(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME))
+	{
+		pipeline_barrier2_ = reinterpret_cast<PFN_vkCmdPipelineBarrier2KHR>(
+				vkGetDeviceProcAddr(context_->logical_device(), "vkCmdPipelineBarrier2KHR"));
+	}
+
+	// Tile based GPUs keep attachments in tile memory, lazily allocated memory is only backed if they spill
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	vkGetPhysicalDeviceMemoryProperties(context_->vulkan_device().get_physical_device(), &memory_properties);
+	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++)
+	{
+		if ((memory_properties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0)
+			lazy_memory_types_ |= 1u << i;
+	}
+
+	FLOWFORGE_INFO("Frame graph created ({} barriers, {} lazily allocated attachments)",
+				   pipeline_barrier2_ != nullptr ? "synchronization 2" : "legacy",
+				   lazy_memory_types_ != 0 ? "with" : "without");
+}
+
+VulkanFrameGraph::~VulkanFrameGraph()
+{
+	// The transient images may still be used by frames in flight
+	vkDeviceWaitIdle(context_->logical_device());
+	retire_transients();
+	destroy_retired_transients(true);
+	destroy_passes();
+}
+
+void VulkanFrameGraph::begin(uint32_t swapchain_generation, std::pmr::memory_resource *frame_memory)
+{
+	assert(frame_memory != nullptr);
+
+	if (swapchain_generation_ != swapchain_generation)
+	{
+		// Frames in flight may still use the framebuffers of the old swapchain, they are never matched again
+		// and retire like any other unused framebuffer
+		for (CachedFrameBuffer &cached: frame_buffers_)
+		{
+			cached.stale = true;
+		}
+		swapchain_generation_ = swapchain_generation;
+	}
+
+	frame_index_++;
+	std::erase_if(frame_buffers_, [this](const CachedFrameBuffer &cached) {
+		return frame_index_ - cached.last_used_frame > frame_buffer_retire_frames;
+	});
+	destroy_retired_transients(false);
+
+	// The last frame's passes still point into the last frame memory
+	destroy_passes();
+	resources_.clear();
+	frame_memory_ = frame_memory;
+	compiled_ = false;
+}
+
+FrameGraphImage VulkanFrameGraph::import_image(std::string_view name,
+											   const FrameGraphImageInfo &info,
+											   VkImage image,
+											   VkImageView view,
+											   FrameGraphUsage last_usage,
+											   std::optional<FrameGraphUsage> final_usage,
+											   bool discard)
+{
+	Resource resource{name, frame_memory_};
+	resource.imported = true;
+	resource.info = info;
+	resource.image = image;
+	resource.view = view;
+	resource.last_usage = last_usage;
+	resource.final_usage = final_usage;
+	resource.discard = discard;
+	resources_.push_back(std::move(resource));
+
+	return {static_cast<uint32_t>(resources_.size() - 1)};
+}
+
+FrameGraphImage VulkanFrameGraph::create_image(std::string_view name, const FrameGraphImageInfo &info)
+{
+	Resource resource{name, frame_memory_};
+	resource.info = info;
+	resource.discard = true;
+	resources_.push_back(std::move(resource));
+
+	return {static_cast<uint32_t>(resources_.size() - 1)};
+}
+
+FrameGraphBuffer VulkanFrameGraph::import_buffer(std::string_view name, VkBuffer buffer, FrameGraphUsage last_usage)
+{
+	Resource resource{name, frame_memory_};
+	resource.is_buffer = true;
+	resource.imported = true;
+	resource.buffer = buffer;
+	resource.last_usage = last_usage;
+	resources_.push_back(std::move(resource));
+
+	return {static_cast<uint32_t>(resources_.size() - 1)};
+}
+
+void VulkanFrameGraph::compile()
+{
+	cull_passes();
+	compute_lifetimes();
+	realize_transients();
+
+	compiled_ = true;
+}
+
+void VulkanFrameGraph::execute(VulkanCommandBuffer &command_buffer)
+{
+	assert(compiled_);
+
+	VkCommandBuffer handle = command_buffer.get_handle();
+
+	std::pmr::vector<std::optional<ResourceState>> states(resources_.size(), frame_memory_);
+	std::pmr::vector<VkImageMemoryBarrier2KHR> image_barriers{frame_memory_};
+	std::pmr::vector<VkBufferMemoryBarrier2KHR> buffer_barriers{frame_memory_};
+	statistics_.barriers = 0;
+
+	auto add_barrier = [&](uint32_t resource_index,
+						   VkPipelineStageFlags2KHR src_stages,
+						   VkAccessFlags2KHR src_access,
+						   VkPipelineStageFlags2KHR dst_stages,
+						   VkAccessFlags2KHR dst_access,
+						   VkImageLayout old_layout,
+						   VkImageLayout new_layout) {
+		const Resource &resource = resources_[resource_index];
+		if (resource.is_buffer)
+		{
+			VkBufferMemoryBarrier2KHR barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2_KHR;
+			barrier.srcStageMask = src_stages;
+			barrier.srcAccessMask = src_access;
+			barrier.dstStageMask = dst_stages;
+			barrier.dstAccessMask = dst_access;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.buffer = resource.buffer;
+			barrier.offset = 0;
+			barrier.size = VK_WHOLE_SIZE;
+			buffer_barriers.push_back(barrier);
+			return;
+		}
+
+		VkImageMemoryBarrier2KHR barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2_KHR;
+		barrier.srcStageMask = src_stages;
+		barrier.srcAccessMask = src_access;
+		barrier.dstStageMask = dst_stages;
+		barrier.dstAccessMask = dst_access;
+		barrier.oldLayout = old_layout;
+		barrier.newLayout = new_layout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = get_image({resource_index});
+		barrier.subresourceRange = subresource_range(resource);
+		image_barriers.push_back(barrier);
+	};
+
+	auto use = [&](const Access &access) {
+		std::optional<ResourceState> &tracked = states[access.resource];
+		if (!tracked.has_value())
+			tracked = initial_state(access.resource);
+		ResourceState &state = tracked.value();
+
+		const bool layout_change = !resources_[access.resource].is_buffer && access.layout != state.layout;
+		if (access.write || layout_change)
+		{
+			// Wait for every earlier access, a layout transition writes the image too
+			const VkPipelineStageFlags2KHR src_stages = state.write_stages | state.read_stages;
+			if (src_stages != 0 || layout_change)
+				add_barrier(access.resource, src_stages, state.write_access, access.stages, access.access, state.layout, access.layout);
+
+			state.write_stages = access.stages;
+			state.write_access = access.write_access;
+			state.read_stages = 0;
+			state.visible_stages = access.stages;
+			state.visible_access = access.access;
+			state.layout = access.layout;
+			return;
+		}
+
+		// Reads only wait for the last write, and only once per stage and access
+		const bool visible = (access.stages & ~state.visible_stages) == 0 && (access.access & ~state.visible_access) == 0;
+		if (state.write_stages != 0 && !visible)
+		{
+			add_barrier(access.resource, state.write_stages, state.write_access, access.stages, access.access, state.layout, state.layout);
+			state.visible_stages |= access.stages;
+			state.visible_access |= access.access;
+		}
+		state.read_stages |= access.stages;
+	};
+
+	for (Pass &pass: passes_)
+	{
+		if (pass.culled)
+			continue;
+
+		image_barriers.clear();
+		buffer_barriers.clear();
+		for (const Access &access: pass.accesses)
+		{
+			use(access);
+		}
+		record_barriers(handle, image_barriers, buffer_barriers);
+
+		if (pass.render_pass == nullptr)
+		{
+			pass.execute.invoke(pass.execute.callable, command_buffer);
+			continue;
+		}
+
+		// Every attachment has the extent of the first one
+		const VkExtent2D extent = resources_[pass.attachments.front()].info.extent;
+		const VkExtent2D render_area = pass.render_area.value_or(extent);
+		assert(render_area.width <= extent.width && render_area.height <= extent.height);
+		pass.render_pass->set_render_area(glm::vec4(0.0f, 0.0f, render_area.width, render_area.height));
+
+		if (pass.render_pass->is_dynamic())
+		{
+			// Dynamic rendering begins on the views directly, without a framebuffer
+			std::pmr::vector<VkImageView> views{frame_memory_};
+			views.reserve(pass.attachments.size());
+			for (uint32_t attachment: pass.attachments)
+			{
+				views.push_back(get_view({attachment}));
+			}
+			pass.render_pass->begin(command_buffer, views);
+		} else
+		{
+			pass.render_pass->begin(command_buffer, get_frame_buffer(pass, extent));
+		}
+		pass.execute.invoke(pass.execute.callable, command_buffer);
+		pass.render_pass->end(command_buffer);
+	}
+
+	// Hand the imported images over in their final usage
+	image_barriers.clear();
+	buffer_barriers.clear();
+	for (uint32_t index = 0; index < resources_.size(); index++)
+	{
+		const Resource &resource = resources_[index];
+		if (!resource.imported || !resource.final_usage.has_value())
+			continue;
+
+		const UsageInfo usage = describe_usage(resource.final_usage.value());
+		Access access{};
+		access.resource = index;
+		access.stages = usage.stages;
+		access.access = usage.read_access;
+		access.layout = resource.is_buffer ? VK_IMAGE_LAYOUT_UNDEFINED : usage_layout(resource, resource.final_usage.value());
+		use(access);
+	}
+	record_barriers(handle, image_barriers, buffer_barriers);
+}
+
+VkImage VulkanFrameGraph::get_image(FrameGraphImage image) const
+{
+	const Resource &resource = resources_[image.index];
+	if (resource.imported)
+		return resource.image;
+
+	// Only images used by a pass that wasn't culled exist
+	return resource.transient.has_value() ? transients_[resource.transient.value()].image : VK_NULL_HANDLE;
+}
+
+VkImageView VulkanFrameGraph::get_view(FrameGraphImage image) const
+{
+	const Resource &resource = resources_[image.index];
+	if (resource.imported)
+		return resource.view;
+
+	return resource.transient.has_value() ? transients_[resource.transient.value()].view : VK_NULL_HANDLE;
+}
+
+
+///// Private methods
+
+VulkanFrameGraph::PassBuilder VulkanFrameGraph::add_pass_function(std::string_view name, ExecuteFunction execute)
+{
+	passes_.emplace_back(name, execute, frame_memory_);
+
+	return PassBuilder(this, static_cast<uint32_t>(passes_.size() - 1));
+}
+
+void VulkanFrameGraph::destroy_passes()
+{
+	for (Pass &pass: passes_)
+	{
+		pass.execute.destroy(pass.execute.callable, frame_memory_);
+	}
+	passes_.clear();
+}
+
+void VulkanFrameGraph::add_access(uint32_t pass_index, uint32_t resource_index, FrameGraphUsage usage, bool write)
+{
+	assert(pass_index < passes_.size());
+	assert(resource_index < resources_.size());
+
+	const Resource &resource = resources_[resource_index];
+	const UsageInfo info = describe_usage(usage);
+
+	Access access{};
+	access.resource = resource_index;
+	access.write = write;
+	access.stages = info.stages;
+	// Writes may read the old contents too, like attachments that are loaded
+	access.access = write ? info.read_access | info.write_access : info.read_access;
+	access.write_access = write ? info.write_access : 0;
+	access.layout = resource.is_buffer ? VK_IMAGE_LAYOUT_UNDEFINED : usage_layout(resource, usage);
+
+	// Every resource is accessed once per pass, with all of its usages merged
+	Pass &pass = passes_[pass_index];
+	for (Access &existing: pass.accesses)
+	{
+		if (existing.resource != resource_index)
+			continue;
+
+		existing.write = existing.write || access.write;
+		existing.stages |= access.stages;
+		existing.access |= access.access;
+		existing.write_access |= access.write_access;
+		if (existing.layout != access.layout)
+			existing.layout = VK_IMAGE_LAYOUT_GENERAL;
+		return;
+	}
+	pass.accesses.push_back(access);
+}
+
+void VulkanFrameGraph::cull_passes()
+{
+	// Imported resources outlive the frame, so whatever writes them is needed
+	std::pmr::vector<bool> needed(resources_.size(), frame_memory_);
+	for (size_t i = 0; i < resources_.size(); i++)
+	{
+		needed[i] = resources_[i].imported;
+	}
+
+	// Walk back from the end of the frame. A pass is kept when it writes something that is needed later,
+	// then everything it touches is needed by it. Writes may load the old contents, so they don't end the need.
+	statistics_.passes = static_cast<uint32_t>(passes_.size());
+	statistics_.culled_passes = 0;
+	for (size_t i = passes_.size(); i-- > 0;)
+	{
+		Pass &pass = passes_[i];
+
+		bool keep = pass.side_effects;
+		for (const Access &access: pass.accesses)
+		{
+			keep = keep || (access.write && needed[access.resource]);
+		}
+
+		pass.culled = !keep;
+		if (pass.culled)
+		{
+			statistics_.culled_passes++;
+			continue;
+		}
+
+		for (const Access &access: pass.accesses)
+		{
+			needed[access.resource] = true;
+		}
+	}
+}
+
+void VulkanFrameGraph::compute_lifetimes()
+{
+	for (Resource &resource: resources_)
+	{
+		resource.first_pass.reset();
+		resource.last_pass = 0;
+	}
+
+	for (uint32_t i = 0; i < passes_.size(); i++)
+	{
+		if (passes_[i].culled)
+			continue;
+
+		for (const Access &access: passes_[i].accesses)
+		{
+			Resource &resource = resources_[access.resource];
+			if (!resource.first_pass.has_value())
+				resource.first_pass = i;
+			resource.last_pass = i;
+		}
+	}
+}
+
+void VulkanFrameGraph::realize_transients()
+{
+	// Transient images used by a pass that wasn't culled, in declaration order
+	std::pmr::vector<TransientImage> wanted{frame_memory_};
+	for (uint32_t i = 0; i < resources_.size(); i++)
+	{
+		Resource &resource = resources_[i];
+		resource.transient.reset();
+		if (resource.imported || resource.is_buffer || !resource.first_pass.has_value())
+			continue;
+
+		TransientImage transient{};
+		transient.resource = i;
+		transient.info = resource.info;
+		transient.first_pass = resource.first_pass.value();
+		transient.last_pass = resource.last_pass;
+
+		resource.transient = static_cast<uint32_t>(wanted.size());
+		wanted.push_back(transient);
+	}
+	statistics_.transient_images = static_cast<uint32_t>(wanted.size());
+
+	// The same images with the same lifetimes alias the same way, keep them
+	const bool unchanged = std::equal(wanted.begin(), wanted.end(), transients_.begin(), transients_.end(),
+									  [](const TransientImage &a, const TransientImage &b) {
+										  return same_image_info(a.info, b.info) && a.first_pass == b.first_pass && a.last_pass == b.last_pass;
+									  });
+	if (unchanged)
+	{
+		for (size_t i = 0; i < wanted.size(); i++)
+		{
+			transients_[i].resource = wanted[i].resource;
+		}
+		// Once the size settles no new images will take the retired memory
+		free_blocks(free_blocks_);
+		return;
+	}
+
+	FLOWFORGE_TRACE("Recreating frame graph transient images");
+
+	// The old images and memory may still be used by frames in flight, they are destroyed once those are done.
+	// The memory of transients retired earlier that no frame uses anymore is kept for the new images.
+	VkDevice device = context_->logical_device();
+	retire_transients();
+	transients_.assign(wanted.begin(), wanted.end());
+
+	std::vector<VkMemoryRequirements> requirements(transients_.size());
+	for (size_t i = 0; i < transients_.size(); i++)
+	{
+		TransientImage &transient = transients_[i];
+		const bool attachment_only = lazy_memory_types_ != 0 && (transient.info.usage & ~attachment_only_usage) == 0;
+
+		VkImageCreateInfo image_info{};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.extent = {transient.info.extent.width, transient.info.extent.height, 1};
+		image_info.mipLevels = transient.info.mip_levels;
+		image_info.arrayLayers = 1;
+		image_info.format = transient.info.format;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		image_info.usage = transient.info.usage | (attachment_only ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0);
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		if (vkCreateImage(device, &image_info, vulkan_allocator(), &transient.image) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create frame graph image");
+		}
+
+		vkGetImageMemoryRequirements(device, transient.image, &requirements[i]);
+		transient.size = requirements[i].size;
+		transient.lazy = attachment_only && (requirements[i].memoryTypeBits & lazy_memory_types_) != 0;
+	}
+
+	// Place the images by first use. An image shares a block with earlier ones once they are all done,
+	// the block grows to the largest image in it. Images are bound at offset zero, so any alignment fits.
+	std::vector<uint32_t> order(transients_.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+		return transients_[a].first_pass < transients_[b].first_pass;
+	});
+
+	std::vector<uint32_t> block_last_pass;
+	for (uint32_t index: order)
+	{
+		TransientImage &transient = transients_[index];
+		const VkMemoryRequirements &requirement = requirements[index];
+
+		std::optional<uint32_t> block;
+		for (uint32_t b = 0; b < blocks_.size(); b++)
+		{
+			if (block_last_pass[b] < transient.first_pass &&
+				blocks_[b].lazy == transient.lazy &&
+				(requirement.memoryTypeBits & (1u << blocks_[b].memory_type)) != 0)
+			{
+				block = b;
+				break;
+			}
+		}
+
+		if (!block.has_value())
+		{
+			const int32_t memory_type = transient.lazy
+												? context_->find_memory_index(requirement.memoryTypeBits & lazy_memory_types_,
+																			  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+												: context_->find_memory_index(requirement.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			if (memory_type < 0)
+			{
+				throw std::runtime_error("Failed to find memory type for frame graph image");
+			}
+
+			block = static_cast<uint32_t>(blocks_.size());
+			blocks_.push_back({VK_NULL_HANDLE, 0, static_cast<uint32_t>(memory_type), transient.lazy});
+			block_last_pass.push_back(0);
+		}
+
+		MemoryBlock &memory_block = blocks_[block.value()];
+		memory_block.size = std::max(memory_block.size, requirement.size);
+		block_last_pass[block.value()] = transient.last_pass;
+		transient.block = block.value();
+	}
+
+	statistics_.memory_blocks = static_cast<uint32_t>(blocks_.size());
+	statistics_.lazy_images = static_cast<uint32_t>(std::count_if(transients_.begin(), transients_.end(), [](const TransientImage &transient) {
+		return transient.lazy;
+	}));
+	statistics_.unaliased_bytes = 0;
+
+	allocate_blocks(free_blocks_);
+
+	for (TransientImage &transient: transients_)
+	{
+		if (vkBindImageMemory(device, transient.image, blocks_[transient.block].memory, 0) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to bind frame graph image memory");
+		}
+
+		VkImageViewCreateInfo view_info{};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.image = transient.image;
+		view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view_info.format = transient.info.format;
+		view_info.subresourceRange.aspectMask = transient.info.aspect;
+		view_info.subresourceRange.baseMipLevel = 0;
+		view_info.subresourceRange.levelCount = transient.info.mip_levels;
+		view_info.subresourceRange.baseArrayLayer = 0;
+		view_info.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(device, &view_info, vulkan_allocator(), &transient.view) != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create frame graph image view");
+		}
+		statistics_.unaliased_bytes += transient.size;
+	}
+
+	FLOWFORGE_INFO("Frame graph created {} transient images in {} memory blocks ({} of {} bytes, {} lazy images, {} blocks reused)",
+				   transients_.size(), blocks_.size(), statistics_.transient_bytes, statistics_.unaliased_bytes,
+				   statistics_.lazy_images, statistics_.pooled_blocks);
+}
+
+void VulkanFrameGraph::allocate_blocks(std::vector<MemoryBlock> &pool)
+{
+	VkDevice device = context_->logical_device();
+
+	statistics_.pooled_blocks = 0;
+	statistics_.transient_bytes = 0;
+
+	// Largest blocks first, so they take the pooled blocks only they fit in
+	std::vector<uint32_t> order(blocks_.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+		return blocks_[a].size > blocks_[b].size;
+	});
+
+	for (uint32_t index: order)
+	{
+		MemoryBlock &memory_block = blocks_[index];
+
+		// The smallest pooled block of the same memory type that is large enough
+		auto best = pool.end();
+		for (auto it = pool.begin(); it != pool.end(); ++it)
+		{
+			if (it->memory_type == memory_block.memory_type && it->size >= memory_block.size &&
+				(best == pool.end() || it->size < best->size))
+			{
+				best = it;
+			}
+		}
+
+		if (best != pool.end())
+		{
+			memory_block.memory = best->memory;
+			memory_block.size = best->size;
+			pool.erase(best);
+			statistics_.pooled_blocks++;
+		} else
+		{
+			memory_block.size += memory_block.size / block_headroom_divisor;
+
+			VkMemoryAllocateInfo allocate_info{};
+			allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			allocate_info.allocationSize = memory_block.size;
+			allocate_info.memoryTypeIndex = memory_block.memory_type;
+
+			if (vkAllocateMemory(device, &allocate_info, vulkan_allocator(), &memory_block.memory) != VK_SUCCESS)
+			{
+				throw std::runtime_error("Failed to allocate frame graph memory");
+			}
+			statistics_.memory_allocations++;
+		}
+		statistics_.transient_bytes += memory_block.size;
+	}
+
+	// Whatever the new images didn't need
+	free_blocks(pool);
+}
+
+void VulkanFrameGraph::retire_transients()
+{
+	if (transients_.empty() && blocks_.empty())
+		return;
+
+	// Frames in flight may still use the cached framebuffers, they are never matched again and retire like any other
+	// unused framebuffer. Views created later can reuse the handles of the retired ones.
+	for (CachedFrameBuffer &cached: frame_buffers_)
+	{
+		cached.stale = true;
+	}
+
+	retired_transients_.push_back({std::move(transients_), std::move(blocks_), context_->get_swapchain().get_presented_frames()});
+	transients_.clear();
+	blocks_.clear();
+}
+
+void VulkanFrameGraph::destroy_retired_transients(bool all)
+{
+	VkDevice device = context_->logical_device();
+	const VulkanSwapchain &swapchain = context_->get_swapchain();
+
+	std::erase_if(retired_transients_, [&](RetiredTransients &retired) {
+		if (!all && !swapchain.has_retired(retired.retired_frame))
+			return false;
+
+		destroy_transient_images(device, retired.images);
+		free_blocks_.insert(free_blocks_.end(), retired.blocks.begin(), retired.blocks.end());
+		return true;
+	});
+
+	if (all)
+		free_blocks(free_blocks_);
+}
+
+void VulkanFrameGraph::free_blocks(std::vector<MemoryBlock> &blocks)
+{
+	VkDevice device = context_->logical_device();
+	for (MemoryBlock &memory_block: blocks)
+	{
+		if (memory_block.memory != VK_NULL_HANDLE)
+			vkFreeMemory(device, memory_block.memory, vulkan_allocator());
+	}
+	blocks.clear();
+}
+
+void VulkanFrameGraph::destroy_transient_images(VkDevice device, std::vector<TransientImage> &images)
+{
+	for (TransientImage &transient: images)
+	{
+		if (transient.view != VK_NULL_HANDLE)
+			vkDestroyImageView(device, transient.view, vulkan_allocator());
+		if (transient.image != VK_NULL_HANDLE)
+			vkDestroyImage(device, transient.image, vulkan_allocator());
+	}
+	images.clear();
+}
+
+VulkanFrameGraph::ResourceState VulkanFrameGraph::initial_state(uint32_t resource_index) const
+{
+	const Resource &resource = resources_[resource_index];
+
+	ResourceState state{};
+	if (resource.imported)
+	{
+		// Whatever last used the resource, likely the previous frame, has to finish first
+		const UsageInfo usage = describe_usage(resource.last_usage);
+		state.write_stages = usage.write_access != 0 ? usage.stages : 0;
+		state.write_access = usage.write_access;
+		state.read_stages = usage.stages;
+		state.layout = resource.is_buffer || resource.discard ? VK_IMAGE_LAYOUT_UNDEFINED : usage_layout(resource, resource.last_usage);
+		return state;
+	}
+
+	// A transient image continues from the image before it in its memory block.
+	// The first image of a block follows the last one, which used it during the previous frame.
+	const TransientImage &transient = transients_[resource.transient.value()];
+	const TransientImage *previous = nullptr;
+	const TransientImage *last = nullptr;
+	for (const TransientImage &other: transients_)
+	{
+		if (other.block != transient.block)
+			continue;
+		if (other.last_pass < transient.first_pass && (previous == nullptr || other.last_pass > previous->last_pass))
+			previous = &other;
+		if (last == nullptr || other.last_pass > last->last_pass)
+			last = &other;
+	}
+	if (previous == nullptr)
+		previous = last;
+
+	for (const Pass &pass: passes_)
+	{
+		if (pass.culled)
+			continue;
+
+		for (const Access &access: pass.accesses)
+		{
+			if (access.resource != previous->resource)
+				continue;
+
+			state.write_stages |= access.stages;
+			state.write_access |= access.write_access;
+		}
+	}
+	state.read_stages = state.write_stages;
+	state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	return state;
+}
+
+VkImageSubresourceRange VulkanFrameGraph::subresource_range(const Resource &resource) const
+{
+	// Depth stencil images transition both aspects together
+	VkImageAspectFlags aspect = resource.info.aspect;
+	if ((aspect & VK_IMAGE_ASPECT_DEPTH_BIT) != 0 && format_has_stencil(resource.info.format))
+		aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+
+	return {aspect, 0, resource.info.mip_levels, 0, 1};
+}
+
+VkImageLayout VulkanFrameGraph::usage_layout(const Resource &resource, FrameGraphUsage usage) const
+{
+	if ((usage == FrameGraphUsage::SAMPLED_COMPUTE || usage == FrameGraphUsage::SAMPLED_FRAGMENT) &&
+		(resource.info.aspect & VK_IMAGE_ASPECT_DEPTH_BIT) != 0)
+		return VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+	return describe_usage(usage).layout;
+}
+
+VkFramebuffer VulkanFrameGraph::get_frame_buffer(const Pass &pass, VkExtent2D extent)
+{
+	std::pmr::vector<VkImageView> views{frame_memory_};
+	views.reserve(pass.attachments.size());
+	for (uint32_t attachment: pass.attachments)
+	{
+		views.push_back(get_view({attachment}));
+	}
+
+	VkRenderPass render_pass = pass.render_pass->get_handle();
+	for (CachedFrameBuffer &cached: frame_buffers_)
+	{
+		if (!cached.stale &&
+			cached.render_pass == render_pass &&
+			std::ranges::equal(cached.views, views) &&
+			cached.extent.width == extent.width &&
+			cached.extent.height == extent.height)
+		{
+			cached.last_used_frame = frame_index_;
+			return cached.frame_buffer->get_handle();
+		}
+	}
+
+	CachedFrameBuffer cached{};
+	cached.render_pass = render_pass;
+	cached.views.assign(views.begin(), views.end());
+	cached.extent = extent;
+	cached.frame_buffer = std::make_unique<VulkanFrameBuffer>(context_, *pass.render_pass, extent.width, extent.height, cached.views);
+	cached.last_used_frame = frame_index_;
+	frame_buffers_.push_back(std::move(cached));
+
+	return frame_buffers_.back().frame_buffer->get_handle();
+}
+
+void VulkanFrameGraph::record_barriers(VkCommandBuffer command_buffer,
+									   std::span<const VkImageMemoryBarrier2KHR> image_barriers,
+									   std::span<const VkBufferMemoryBarrier2KHR> buffer_barriers)
+{
+	if (image_barriers.empty() && buffer_barriers.empty())
+		return;
+
+	statistics_.barriers += static_cast<uint32_t>(image_barriers.size() + buffer_barriers.size());
+
+	if (pipeline_barrier2_ != nullptr)
+	{
+		VkDependencyInfoKHR dependency_info{};
+		dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+		dependency_info.bufferMemoryBarrierCount = static_cast<uint32_t>(buffer_barriers.size());
+		dependency_info.pBufferMemoryBarriers = buffer_barriers.data();
+		dependency_info.imageMemoryBarrierCount = static_cast<uint32_t>(image_barriers.size());
+		dependency_info.pImageMemoryBarriers = image_barriers.data();
+
+		pipeline_barrier2_(command_buffer, &dependency_info);
+		return;
+	}
+
+	// Without synchronization 2 the stages of the batch are merged into one barrier.
+	// Every stage and access the usages produce fits in the original 32 bit flags.
+	VkPipelineStageFlags src_stages = 0;
+	VkPipelineStageFlags dst_stages = 0;
+
+	std::pmr::vector<VkImageMemoryBarrier> legacy_image_barriers{frame_memory_};
+	legacy_image_barriers.reserve(image_barriers.size());
+	for (const VkImageMemoryBarrier2KHR &barrier: image_barriers)
+	{
+		src_stages |= static_cast<VkPipelineStageFlags>(barrier.srcStageMask);
+		dst_stages |= static_cast<VkPipelineStageFlags>(barrier.dstStageMask);
+
+		VkImageMemoryBarrier legacy{};
+		legacy.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		legacy.srcAccessMask = static_cast<VkAccessFlags>(barrier.srcAccessMask);
+		legacy.dstAccessMask = static_cast<VkAccessFlags>(barrier.dstAccessMask);
+		legacy.oldLayout = barrier.oldLayout;
+		legacy.newLayout = barrier.newLayout;
+		legacy.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+		legacy.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+		legacy.image = barrier.image;
+		legacy.subresourceRange = barrier.subresourceRange;
+		legacy_image_barriers.push_back(legacy);
+	}
+
+	std::pmr::vector<VkBufferMemoryBarrier> legacy_buffer_barriers{frame_memory_};
+	legacy_buffer_barriers.reserve(buffer_barriers.size());
+	for (const VkBufferMemoryBarrier2KHR &barrier: buffer_barriers)
+	{
+		src_stages |= static_cast<VkPipelineStageFlags>(barrier.srcStageMask);
+		dst_stages |= static_cast<VkPipelineStageFlags>(barrier.dstStageMask);
+
+		VkBufferMemoryBarrier legacy{};
+		legacy.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		legacy.srcAccessMask = static_cast<VkAccessFlags>(barrier.srcAccessMask);
+		legacy.dstAccessMask = static_cast<VkAccessFlags>(barrier.dstAccessMask);
+		legacy.srcQueueFamilyIndex = barrier.srcQueueFamilyIndex;
+		legacy.dstQueueFamilyIndex = barrier.dstQueueFamilyIndex;
+		legacy.buffer = barrier.buffer;
+		legacy.offset = barrier.offset;
+		legacy.size = barrier.size;
+		legacy_buffer_barriers.push_back(legacy);
+	}
+
+	// Empty stage masks are not allowed here
+	if (src_stages == 0)
+		src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	if (dst_stages == 0)
+		dst_stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+	vkCmdPipelineBarrier(command_buffer,
+						 src_stages,
+						 dst_stages,
+						 0,
+						 0, nullptr,
+						 static_cast<uint32_t>(legacy_buffer_barriers.size()), legacy_buffer_barriers.data(),
+						 static_cast<uint32_t>(legacy_image_barriers.size()), legacy_image_barriers.data());
+}
+
+VulkanFrameGraph::UsageInfo VulkanFrameGraph::describe_usage(FrameGraphUsage usage)
+{
+	switch (usage)
+	{
+		case FrameGraphUsage::COLOR_ATTACHMENT:
+			return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
+					VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT_KHR,
+					VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT_KHR,
+					VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+		case FrameGraphUsage::DEPTH_ATTACHMENT:
+			return {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT_KHR | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT_KHR,
+					VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT_KHR,
+					VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT_KHR,
+					VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+		case FrameGraphUsage::SAMPLED_COMPUTE:
+			return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+					VK_ACCESS_2_SHADER_READ_BIT_KHR,
+					0,
+					VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+		case FrameGraphUsage::SAMPLED_FRAGMENT:
+			return {VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT_KHR,
+					VK_ACCESS_2_SHADER_READ_BIT_KHR,
+					0,
+					VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+		case FrameGraphUsage::STORAGE_COMPUTE:
+			return {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
+					VK_ACCESS_2_SHADER_READ_BIT_KHR,
+					VK_ACCESS_2_SHADER_WRITE_BIT_KHR,
+					VK_IMAGE_LAYOUT_GENERAL};
+		case FrameGraphUsage::INDIRECT:
+			return {VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR,
+					VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT_KHR,
+					0,
+					VK_IMAGE_LAYOUT_UNDEFINED};
+		case FrameGraphUsage::TRANSFER:
+			return {VK_PIPELINE_STAGE_2_TRANSFER_BIT_KHR,
+					VK_ACCESS_2_TRANSFER_READ_BIT_KHR,
+					VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR,
+					VK_IMAGE_LAYOUT_GENERAL};
+		case FrameGraphUsage::PRESENT:
+			// The acquire semaphore is waited on at the color attachment output stage, so barriers chain with it
+			return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
+					0,
+					0,
+					VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+	}
+
+	return {};
+}
+
+}// namespace flwfrg
@@ -0,0 +1,364 @@
+#pragma once
+
+#include "frame_buffer.hpp"
+
+#include <vulkan/vulkan_core.h>
+
+#include <initializer_list>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace flwfrg
+{
+class VulkanContext;
+class VulkanCommandBuffer;
+class VulkanRenderpass;
+
+// How a pass uses a resource, decides the stages, accesses and image layout barriers are built from
+enum class FrameGraphUsage : uint8_t
+{
+	COLOR_ATTACHMENT,
+	DEPTH_ATTACHMENT,
+	// Sampled by a compute shader, depth images use the depth read only layout
+	SAMPLED_COMPUTE,
+	// Sampled by a fragment shader
+	SAMPLED_FRAGMENT,
+	// Storage image or buffer of a compute shader, images use the general layout
+	STORAGE_COMPUTE,
+	// Indirect draw arguments, buffers only
+	INDIRECT,
+	// Copies and fills, images use the general layout
+	TRANSFER,
+	// Owned by the presentation engine
+	PRESENT
+};
+
+struct FrameGraphImageInfo
+{
+	VkFormat format;
+	VkExtent2D extent;
+	// Aspect of the view, barriers add the stencil aspect for formats that have one
+	VkImageAspectFlags aspect;
+	VkImageUsageFlags usage;
+	uint32_t mip_levels = 1;
+};
+
+struct FrameGraphImage
+{
+	uint32_t index;
+};
+
+struct FrameGraphBuffer
+{
+	uint32_t index;
+};
+
+struct FrameGraphStatistics
+{
+	uint32_t passes = 0;
+	uint32_t culled_passes = 0;
+	uint32_t barriers = 0;
+	uint32_t transient_images = 0;
+	uint32_t memory_blocks = 0;
+	// Attachment only images in lazily allocated memory, they may never be backed by memory at all
+	uint32_t lazy_images = 0;
+	// Blocks kept from the previous transients when they were last recreated
+	uint32_t pooled_blocks = 0;
+	// Memory allocations made since the graph was created
+	uint32_t memory_allocations = 0;
+	// Memory of the transient images, and what it would be without aliasing
+	uint64_t transient_bytes = 0;
+	uint64_t unaliased_bytes = 0;
+};
+
+/// <summary>
+/// Records a frame from passes that declare the resources they read and write, instead of hand placed barriers.
+/// Passes whose results are never read are culled, the barriers between the rest are derived from the declared
+/// usages and batched in front of every pass. Transient images live only for the frame and share memory with
+/// any transient whose lifetime doesn't overlap theirs. Imported resources are kept and returned to their final usage.
+/// Rebuild the graph every frame between begin and execute, the transient memory is only recreated when the declared
+/// images or their lifetimes change. The memory blocks are pooled across recreations, so a resize only allocates
+/// when the images outgrow them. Images that are only ever attachments use lazily allocated memory where the device has it.
+/// The passes, their names and callbacks and the scratch data of compiling and executing live in the frame memory given
+/// to begin, so a frame graph that is rebuilt the same way every frame doesn't touch the heap.
+/// </summary>
+class VulkanFrameGraph
+{
+public:
+	class PassBuilder
+	{
+	public:
+		PassBuilder &read(FrameGraphImage image, FrameGraphUsage usage);
+		PassBuilder &write(FrameGraphImage image, FrameGraphUsage usage);
+		PassBuilder &read(FrameGraphBuffer buffer, FrameGraphUsage usage);
+		PassBuilder &write(FrameGraphBuffer buffer, FrameGraphUsage usage);
+		// Records the pass inside the render pass, with a framebuffer of the attachments in attachment order,
+		// or on the attachment views directly when the render pass uses dynamic rendering.
+		// The attachments are written with the attachment usage of their aspect.
+		PassBuilder &set_render_pass(VulkanRenderpass &render_pass, std::initializer_list<FrameGraphImage> attachments);
+		// Renders only the top left part of the attachments, all of them by default
+		PassBuilder &set_render_area(VkExtent2D render_area);
+		// Keeps the pass when nothing reads what it writes
+		PassBuilder &set_side_effects();
+
+	private:
+		PassBuilder(VulkanFrameGraph *graph, uint32_t pass);
+
+		VulkanFrameGraph *graph_;
+		uint32_t pass_;
+
+		friend VulkanFrameGraph;
+	};
+
+public:
+	explicit VulkanFrameGraph(VulkanContext *context);
+	~VulkanFrameGraph();
+
+	// Not copyable or movable
+	VulkanFrameGraph(const VulkanFrameGraph &) = delete;
+	VulkanFrameGraph &operator=(const VulkanFrameGraph &) = delete;
+	VulkanFrameGraph(VulkanFrameGraph &&) = delete;
+	VulkanFrameGraph &operator=(VulkanFrameGraph &&) = delete;
+
+	// Methods
+
+	// Clears the passes and resources of the last frame. Cached framebuffers are retired when the swapchain generation changes,
+	// replaced transient images and memory once no frame in flight uses them.
+	// The frame's allocations come from frame_memory, it has to keep them until the next begin.
+	void begin(uint32_t swapchain_generation, std::pmr::memory_resource *frame_memory = std::pmr::get_default_resource());
+
+	// The image is in last_usage when the frame starts and is moved to final_usage after the last pass that uses it.
+	// Discarded images start from an undefined layout, their contents are not kept.
+	FrameGraphImage import_image(std::string_view name,
+								 const FrameGraphImageInfo &info,
+								 VkImage image,
+								 VkImageView view,
+								 FrameGraphUsage last_usage,
+								 std::optional<FrameGraphUsage> final_usage = std::nullopt,
+								 bool discard = false);
+	// An image that only lives for the frame, it starts with undefined contents
+	FrameGraphImage create_image(std::string_view name, const FrameGraphImageInfo &info);
+	FrameGraphBuffer import_buffer(std::string_view name, VkBuffer buffer, FrameGraphUsage last_usage);
+
+	// Passes execute in the order they are added, execute is called with the command buffer
+	template<typename Function>
+	PassBuilder add_pass(std::string_view name, Function &&execute);
+
+	// Culls unused passes and creates the transient images. When they have to be recreated, the old images and their
+	// memory are retired and only destroyed or reused once no frame in flight can use them anymore.
+	void compile();
+	// Records the passes and their barriers
+	void execute(VulkanCommandBuffer &command_buffer);
+
+	// Valid after compile
+	[[nodiscard]] VkImage get_image(FrameGraphImage image) const;
+	[[nodiscard]] VkImageView get_view(FrameGraphImage image) const;
+	[[nodiscard]] inline const FrameGraphStatistics &statistics() const { return statistics_; };
+
+private:
+	struct UsageInfo
+	{
+		VkPipelineStageFlags2KHR stages;
+		VkAccessFlags2KHR read_access;
+		VkAccessFlags2KHR write_access;
+		VkImageLayout layout;
+	};
+
+	struct Resource
+	{
+		Resource(std::string_view name, std::pmr::memory_resource *memory)
+			: name{name, memory}
+		{
+		}
+
+		std::pmr::string name;
+		bool is_buffer = false;
+		bool imported = false;
+		FrameGraphImageInfo info{};
+		VkImage image = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		VkBuffer buffer = VK_NULL_HANDLE;
+		FrameGraphUsage last_usage{};
+		std::optional<FrameGraphUsage> final_usage{};
+		bool discard = false;
+
+		// Compiled
+		std::optional<uint32_t> first_pass{};
+		uint32_t last_pass = 0;
+		// Index into the transient images
+		std::optional<uint32_t> transient{};
+	};
+
+	struct Access
+	{
+		uint32_t resource;
+		bool write;
+		VkPipelineStageFlags2KHR stages;
+		VkAccessFlags2KHR access;
+		// Part of access that writes
+		VkAccessFlags2KHR write_access;
+		VkImageLayout layout;
+	};
+
+	// Type erased callback of a pass, the callable itself is in the frame memory
+	struct ExecuteFunction
+	{
+		void *callable = nullptr;
+		void (*invoke)(void *callable, VulkanCommandBuffer &command_buffer) = nullptr;
+		// Destroys the callable and gives its memory back
+		void (*destroy)(void *callable, std::pmr::memory_resource *memory) = nullptr;
+	};
+
+	struct Pass
+	{
+		Pass(std::string_view name, ExecuteFunction execute, std::pmr::memory_resource *memory)
+			: name{name, memory},
+			  execute{execute},
+			  accesses{memory},
+			  attachments{memory}
+		{
+		}
+
+		std::pmr::string name;
+		ExecuteFunction execute;
+		std::pmr::vector<Access> accesses;
+		VulkanRenderpass *render_pass = nullptr;
+		std::pmr::vector<uint32_t> attachments;
+		std::optional<VkExtent2D> render_area{};
+		bool side_effects = false;
+
+		// Compiled
+		bool culled = false;
+	};
+
+	// What was known about a resource after its last barrier
+	struct ResourceState
+	{
+		VkPipelineStageFlags2KHR write_stages;
+		VkAccessFlags2KHR write_access;
+		VkPipelineStageFlags2KHR read_stages;
+		// Stages and accesses that already see the last write
+		VkPipelineStageFlags2KHR visible_stages;
+		VkAccessFlags2KHR visible_access;
+		VkImageLayout layout;
+	};
+
+	struct TransientImage
+	{
+		// Resource of the current frame
+		uint32_t resource;
+		FrameGraphImageInfo info;
+		uint32_t first_pass;
+		uint32_t last_pass;
+		uint32_t block;
+		bool lazy;
+		VkImage image;
+		VkImageView view;
+		VkDeviceSize size;
+	};
+
+	struct MemoryBlock
+	{
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		uint32_t memory_type;
+		bool lazy;
+	};
+
+	// Images and memory replaced while frames in flight may still use them
+	struct RetiredTransients
+	{
+		std::vector<TransientImage> images;
+		std::vector<MemoryBlock> blocks;
+		// Presented frames when they were replaced
+		uint64_t retired_frame;
+	};
+
+	struct CachedFrameBuffer
+	{
+		VkRenderPass render_pass;
+		std::vector<VkImageView> views;
+		VkExtent2D extent;
+		std::unique_ptr<VulkanFrameBuffer> frame_buffer;
+		uint64_t last_used_frame;
+		// Made for an older swapchain, whose views may have been reused
+		bool stale;
+	};
+
+	VulkanContext *context_;
+
+	PFN_vkCmdPipelineBarrier2KHR pipeline_barrier2_ = nullptr;
+	// Memory types that are lazily allocated, zero when the device has none
+	uint32_t lazy_memory_types_ = 0;
+
+	// Not owned, keeps the allocations of the current frame
+	std::pmr::memory_resource *frame_memory_ = std::pmr::get_default_resource();
+	std::vector<Resource> resources_{};
+	std::vector<Pass> passes_{};
+
+	std::vector<TransientImage> transients_{};
+	std::vector<MemoryBlock> blocks_{};
+	std::vector<RetiredTransients> retired_transients_{};
+	// Memory of retired transients no frame uses anymore, the next images take it before allocating
+	std::vector<MemoryBlock> free_blocks_{};
+	std::vector<CachedFrameBuffer> frame_buffers_{};
+	std::optional<uint32_t> swapchain_generation_{};
+	uint64_t frame_index_ = 0;
+	bool compiled_ = false;
+
+	FrameGraphStatistics statistics_{};
+
+	///// Private methods
+
+	PassBuilder add_pass_function(std::string_view name, ExecuteFunction execute);
+	void destroy_passes();
+	void add_access(uint32_t pass, uint32_t resource, FrameGraphUsage usage, bool write);
+	void cull_passes();
+	void compute_lifetimes();
+	void realize_transients();
+	void allocate_blocks(std::vector<MemoryBlock> &pool);
+	void retire_transients();
+	void destroy_retired_transients(bool all);
+	void free_blocks(std::vector<MemoryBlock> &blocks);
+	static void destroy_transient_images(VkDevice device, std::vector<TransientImage> &images);
+
+	[[nodiscard]] ResourceState initial_state(uint32_t resource) const;
+	[[nodiscard]] VkImageSubresourceRange subresource_range(const Resource &resource) const;
+	[[nodiscard]] VkImageLayout usage_layout(const Resource &resource, FrameGraphUsage usage) const;
+	VkFramebuffer get_frame_buffer(const Pass &pass, VkExtent2D extent);
+	void record_barriers(VkCommandBuffer command_buffer,
+						 std::span<const VkImageMemoryBarrier2KHR> image_barriers,
+						 std::span<const VkBufferMemoryBarrier2KHR> buffer_barriers);
+
+	static UsageInfo describe_usage(FrameGraphUsage usage);
+};
+
+template<typename Function>
+VulkanFrameGraph::PassBuilder VulkanFrameGraph::add_pass(std::string_view name, Function &&execute)
+{
+	using Callable = std::decay_t<Function>;
+
+	// std::function would take captures beyond a couple of pointers from the heap
+	std::pmr::polymorphic_allocator<Callable> allocator{frame_memory_};
+	Callable *callable = allocator.allocate(1);
+	std::construct_at(callable, std::forward<Function>(execute));
+
+	ExecuteFunction function{};
+	function.callable = callable;
+	function.invoke = [](void *stored, VulkanCommandBuffer &command_buffer) {
+		(*static_cast<Callable *>(stored))(command_buffer);
+	};
+	function.destroy = [](void *stored, std::pmr::memory_resource *memory) {
+		std::destroy_at(static_cast<Callable *>(stored));
+		std::pmr::polymorphic_allocator<Callable>{memory}.deallocate(static_cast<Callable *>(stored), 1);
+	};
+	return add_pass_function(name, function);
+}
+
+}// namespace flwfrg
@@ -0,0 +1,303 @@
+#include "pch.hpp"
+
+#include "geometry_pool.hpp"
+
+#include "vulkan_context.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace flwfrg
+{
+
+///// Local helper functions
+
+namespace
+{
+
+constexpr VkMemoryPropertyFlags direct_upload_memory_flags =
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+bool supports_direct_upload(VulkanContext *context)
+{
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	vkGetPhysicalDeviceMemoryProperties(context->vulkan_device().get_physical_device(), &memory_properties);
+
+	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++)
+	{
+		const VkMemoryType &type = memory_properties.memoryTypes[i];
+		// Small host visible device heaps (the 256MB BAR window) are left for uniform buffers
+		if ((type.propertyFlags & direct_upload_memory_flags) == direct_upload_memory_flags &&
+			memory_properties.memoryHeaps[type.heapIndex].size > 256ull * 1024 * 1024)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+uint32_t index_size(IndexType type)
+{
+	return type == IndexType::UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// Strided copy of the position stream straight into mapped memory. The source may be a file mapping
+// without any alignment, so copy member by member.
+void copy_positions(std::span<const std::byte> vertex_data, std::byte *destination)
+{
+	const size_t vertex_count = vertex_data.size() / sizeof(CompactVertex3d);
+	for (size_t i = 0; i < vertex_count; i++)
+	{
+		std::memcpy(destination + i * sizeof(Snorm16x4), vertex_data.data() + i * sizeof(CompactVertex3d) + offsetof(CompactVertex3d, position), sizeof(Snorm16x4));
+	}
+}
+
+}// namespace
+
+
+///// Method implementations
+
+VulkanGeometryPool::VulkanGeometryPool(VulkanContext *context, GeometryPoolSettings settings)
+	: context_{context},
+	  settings_{settings},
+	  direct_upload_{supports_direct_upload(context)},
+	  vertex_buffer_{context,
+					 sizeof(CompactVertex3d) * settings.initial_vertex_count,
+					 static_cast<VkBufferUsageFlagBits>(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT),
+					 direct_upload_ ? direct_upload_memory_flags : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+					 true},
+	  position_buffer_{context,
+					   sizeof(Snorm16x4) * settings.initial_vertex_count,
+					   static_cast<VkBufferUsageFlagBits>(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT),
+					   direct_upload_ ? direct_upload_memory_flags : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+					   true},
+	  index_buffer_{context,
+					sizeof(uint32_t) * settings.initial_index_count,
+					static_cast<VkBufferUsageFlagBits>(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT),
+					direct_upload_ ? direct_upload_memory_flags : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+					true}
+{
+	FLOWFORGE_INFO("Geometry pool created ({} upload)", direct_upload_ ? "direct" : "staged");
+}
+
+std::optional<std::vector<MeshHandle>> VulkanGeometryPool::upload_mesh_asset(const MeshAsset &asset)
+{
+	auto offsets = upload(asset.vertex_data(), asset.index_data());
+	if (!offsets.has_value())
+	{
+		return std::nullopt;
+	}
+	const auto [vertex_offset, index_offset] = offsets.value();
+
+	// The asset payloads were copied as a whole, so only the bases have to be added
+	std::vector<MeshHandle> handles;
+	handles.reserve(asset.submeshes().size());
+	for (const MeshAssetMesh &mesh: asset.meshes())
+	{
+		const uint32_t first_index = static_cast<uint32_t>((index_offset + mesh.index_byte_offset) / index_size(mesh.index_type));
+
+		for (const MeshAssetSubmesh &submesh: asset.submeshes(mesh))
+		{
+			GeometryMesh geometry{};
+			geometry.vertex_offset = static_cast<int32_t>(vertex_offset / sizeof(CompactVertex3d) + mesh.vertex_offset);
+			geometry.first_index = first_index + submesh.first_index;
+			geometry.index_count = submesh.index_count;
+			geometry.index_type = mesh.index_type;
+			geometry.material_index = submesh.material_index;
+			geometry.bounds = mesh.bounds;
+			geometry.quantization = mesh.bounds.quantization();
+			geometry.lods[0] = {geometry.first_index, geometry.index_count, 0.0f};
+			for (const MeshAssetLod &lod: asset.lods(submesh))
+			{
+				geometry.lods[geometry.lod_count++] = {first_index + lod.first_index, lod.index_count, lod.error};
+			}
+
+			handles.push_back(static_cast<MeshHandle>(meshes_.size()));
+			meshes_.push_back(geometry);
+		}
+	}
+
+	return handles;
+}
+
+std::optional<MeshHandle> VulkanGeometryPool::upload_mesh(const MeshData &mesh, std::span<const MeshLod> lods)
+{
+	assert(lods.size() < max_mesh_lods);
+
+	const IndexType index_type = mesh.index_type();
+
+	std::vector<uint16_t> indices_16;
+	std::span<const std::byte> index_data = std::as_bytes(std::span{mesh.indices});
+	if (index_type == IndexType::UINT16)
+	{
+		indices_16 = mesh.indices_16();
+		index_data = std::as_bytes(std::span{indices_16});
+	}
+
+	const std::vector<CompactVertex3d> vertices = mesh.compact_vertices();
+	auto offsets = upload(std::as_bytes(std::span{vertices}), index_data);
+	if (!offsets.has_value())
+	{
+		return std::nullopt;
+	}
+	const auto [vertex_offset, index_offset] = offsets.value();
+
+	GeometryMesh geometry{};
+	geometry.vertex_offset = static_cast<int32_t>(vertex_offset / sizeof(CompactVertex3d));
+	geometry.first_index = static_cast<uint32_t>(index_offset / index_size(index_type));
+	geometry.index_count = lods.empty() ? static_cast<uint32_t>(mesh.indices.size()) : lods[0].first_index;
+	geometry.index_type = index_type;
+	geometry.material_index = 0;
+	geometry.bounds = mesh.compute_bounds();
+	geometry.quantization = geometry.bounds.quantization();
+	geometry.lods[0] = {geometry.first_index, geometry.index_count, 0.0f};
+	for (const MeshLod &lod: lods)
+	{
+		geometry.lods[geometry.lod_count++] = {geometry.first_index + lod.first_index, lod.index_count, lod.error};
+	}
+
+	meshes_.push_back(geometry);
+	return static_cast<MeshHandle>(meshes_.size() - 1);
+}
+
+void VulkanGeometryPool::bind_vertex_buffer(VulkanCommandBuffer &command_buffer)
+{
+	VkBuffer buffers[] = {vertex_buffer_.get_handle()};
+	VkDeviceSize offsets[] = {0};
+	vkCmdBindVertexBuffers(command_buffer.get_handle(), 0, 1, buffers, offsets);
+}
+
+void VulkanGeometryPool::bind_position_buffer(VulkanCommandBuffer &command_buffer)
+{
+	VkBuffer buffers[] = {position_buffer_.get_handle()};
+	VkDeviceSize offsets[] = {0};
+	vkCmdBindVertexBuffers(command_buffer.get_handle(), 0, 1, buffers, offsets);
+}
+
+void VulkanGeometryPool::bind_index_buffer(VulkanCommandBuffer &command_buffer, IndexType index_type)
+{
+	vkCmdBindIndexBuffer(command_buffer.get_handle(),
+						 index_buffer_.get_handle(),
+						 0,
+						 index_type == IndexType::UINT16 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32);
+}
+
+std::optional<std::pair<uint64_t, uint64_t>> VulkanGeometryPool::upload(std::span<const std::byte> vertex_data, std::span<const std::byte> index_data)
+{
+	assert(vertex_data.size() % sizeof(CompactVertex3d) == 0);
+
+	const uint64_t vertex_offset = vertex_count_ * sizeof(CompactVertex3d);
+	const uint64_t position_offset = vertex_count_ * sizeof(Snorm16x4);
+	const uint64_t index_offset = index_size_;
+
+	if (!reserve(vertex_count_ + vertex_data.size() / sizeof(CompactVertex3d), index_offset + index_data.size()))
+	{
+		FLOWFORGE_ERROR("Geometry pool is out of memory ({} vertex bytes, {} index bytes requested)", vertex_data.size(), index_data.size());
+		return std::nullopt;
+	}
+
+	const uint64_t position_size = vertex_data.size() / sizeof(CompactVertex3d) * sizeof(Snorm16x4);
+
+	if (direct_upload_)
+	{
+		// Write straight into device memory, one copy from the source
+		if (!vertex_data.empty())
+		{
+			vertex_buffer_.load_data(vertex_data.data(), vertex_offset, vertex_data.size(), 0);
+			copy_positions(vertex_data, static_cast<std::byte *>(position_buffer_.lock_memory(position_offset, position_size, 0)));
+			position_buffer_.unlock_memory();
+		}
+		if (!index_data.empty())
+			index_buffer_.load_data(index_data.data(), index_offset, index_data.size(), 0);
+	} else
+	{
+		// Every payload shares one staging buffer and one submission
+		const uint64_t staging_size = vertex_data.size() + position_size + index_data.size();
+		if (staging_size > 0)
+		{
+			VulkanBuffer staging_buffer{context_,
+										staging_size,
+										VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+										VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+										true};
+
+			auto *staging_memory = static_cast<std::byte *>(staging_buffer.lock_memory(0, staging_size, 0));
+			std::memcpy(staging_memory, vertex_data.data(), vertex_data.size());
+			copy_positions(vertex_data, staging_memory + vertex_data.size());
+			std::memcpy(staging_memory + vertex_data.size() + position_size, index_data.data(), index_data.size());
+			staging_buffer.unlock_memory();
+
+			VkCommandPool pool = context_->vulkan_device().get_graphics_command_pool();
+			VkQueue queue = context_->vulkan_device().get_graphics_queue();
+			VulkanCommandBuffer command_buffer = VulkanCommandBuffer::begin_single_time_commands(context_, pool);
+
+			if (!vertex_data.empty())
+			{
+				VkBufferCopy vertex_region{0, vertex_offset, vertex_data.size()};
+				vkCmdCopyBuffer(command_buffer.get_handle(), staging_buffer.get_handle(), vertex_buffer_.get_handle(), 1, &vertex_region);
+
+				VkBufferCopy position_region{vertex_data.size(), position_offset, position_size};
+				vkCmdCopyBuffer(command_buffer.get_handle(), staging_buffer.get_handle(), position_buffer_.get_handle(), 1, &position_region);
+			}
+			if (!index_data.empty())
+			{
+				VkBufferCopy index_region{vertex_data.size() + position_size, index_offset, index_data.size()};
+				vkCmdCopyBuffer(command_buffer.get_handle(), staging_buffer.get_handle(), index_buffer_.get_handle(), 1, &index_region);
+			}
+
+			VulkanCommandBuffer::end_single_time_commands(context_, command_buffer, queue);
+		}
+	}
+
+	vertex_count_ += vertex_data.size() / sizeof(CompactVertex3d);
+	// Keep the next range 4 byte aligned so it can use either index type
+	index_size_ = (index_offset + index_data.size() + 3) & ~uint64_t{3};
+
+	return std::pair{vertex_offset, index_offset};
+}
+
+bool VulkanGeometryPool::reserve(uint64_t vertex_count, uint64_t index_bytes)
+{
+	if (vertex_count > settings_.max_vertex_count || index_bytes > sizeof(uint32_t) * settings_.max_index_count)
+	{
+		FLOWFORGE_ERROR("Geometry pool limit reached ({} vertices, {} indices at most)", settings_.max_vertex_count, settings_.max_index_count);
+		return false;
+	}
+
+	// A failed grow may have left the position stream smaller than the vertices
+	const uint64_t vertex_capacity = std::min(vertex_buffer_.get_size() / sizeof(CompactVertex3d), position_buffer_.get_size() / sizeof(Snorm16x4));
+	const uint64_t index_capacity = index_buffer_.get_size();
+	if (vertex_count <= vertex_capacity && index_bytes <= index_capacity)
+		return true;
+
+	// Double until it fits, the copies are the expensive part
+	uint64_t new_vertex_capacity = vertex_capacity;
+	while (new_vertex_capacity < vertex_count)
+		new_vertex_capacity = std::min(new_vertex_capacity * 2, settings_.max_vertex_count);
+	uint64_t new_index_capacity = index_capacity;
+	while (new_index_capacity < index_bytes)
+		new_index_capacity = std::min(new_index_capacity * 2, sizeof(uint32_t) * settings_.max_index_count);
+
+	VkCommandPool pool = context_->vulkan_device().get_graphics_command_pool();
+	VkQueue queue = context_->vulkan_device().get_graphics_queue();
+	try
+	{
+		if (new_vertex_capacity != vertex_capacity)
+		{
+			vertex_buffer_.resize(sizeof(CompactVertex3d) * new_vertex_capacity, queue, pool);
+			position_buffer_.resize(sizeof(Snorm16x4) * new_vertex_capacity, queue, pool);
+		}
+		if (new_index_capacity != index_capacity)
+			index_buffer_.resize(new_index_capacity, queue, pool);
+	} catch (const std::exception &e)
+	{
+		FLOWFORGE_ERROR("Failed to grow the geometry pool: {}", e.what());
+		return false;
+	}
+
+	FLOWFORGE_INFO("Geometry pool grown to {} vertices and {} index bytes", new_vertex_capacity, new_index_capacity);
+	return true;
+}
+
+}// namespace flwfrg
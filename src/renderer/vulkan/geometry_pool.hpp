@@ -0,0 +1,114 @@
+#pragma once
+
+#include "buffer.hpp"
+#include "renderer/mesh/mesh_asset.hpp"
+#include "renderer/mesh/mesh_data.hpp"
+
+#include <array>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace flwfrg
+{
+class VulkanContext;
+class VulkanCommandBuffer;
+
+using MeshHandle = uint32_t;
+
+/// <summary>
+/// A single drawable range inside the shared geometry buffers.
+/// Its detail levels are further index ranges over the same vertices, so switching them needs no rebinds.
+/// </summary>
+struct GeometryMesh
+{
+	// In vertices, passed as vertexOffset when drawing
+	int32_t vertex_offset;
+	// In indices of index_type, the full detail level
+	uint32_t first_index;
+	uint32_t index_count;
+	IndexType index_type;
+	uint32_t material_index;
+	MeshBounds bounds;
+	// Positions are stored normalized to the bounds, the dequantization matrix is folded into the instance's model matrix
+	VertexQuantization quantization;
+	// The first level is the full detail range above, first indices are absolute like it
+	uint32_t lod_count = 1;
+	std::array<MeshLod, max_mesh_lods> lods{};
+
+	[[nodiscard]] inline std::span<const MeshLod> detail_levels() const { return {lods.data(), lod_count}; }
+};
+
+struct GeometryPoolSettings
+{
+	// Capacities the buffers are created with. They double whenever an upload doesn't fit, up to the maximums.
+	uint64_t initial_vertex_count = 1024 * 1024;
+	uint64_t initial_index_count = 4 * 1024 * 1024;
+	// Uploads that would need more than this fail. Vertices are addressed by a signed 32 bit vertex offset.
+	uint64_t max_vertex_count = 32 * 1024 * 1024;
+	uint64_t max_index_count = 256 * 1024 * 1024;
+};
+
+/// <summary>
+/// Device local vertex and index buffers shared by every mesh.
+/// Meshes are sub allocated linearly and referenced by handle. Vertices are stored as CompactVertex3d.
+/// Positions are also kept in a separate tightly packed stream for depth only passes, indexed like the vertices.
+/// The buffers grow while uploading, which waits for the device, so meshes are best loaded up front.
+/// </summary>
+class VulkanGeometryPool
+{
+public:
+	explicit VulkanGeometryPool(VulkanContext *context, GeometryPoolSettings settings = {});
+	~VulkanGeometryPool() = default;
+
+	// Not copyable or movable
+	VulkanGeometryPool(const VulkanGeometryPool &) = delete;
+	VulkanGeometryPool &operator=(const VulkanGeometryPool &) = delete;
+	VulkanGeometryPool(VulkanGeometryPool &&) = delete;
+	VulkanGeometryPool &operator=(VulkanGeometryPool &&) = delete;
+
+	// Methods
+
+	// Uploads every submesh of the asset. The payloads are copied straight out of the mapping.
+	std::optional<std::vector<MeshHandle>> upload_mesh_asset(const MeshAsset &asset);
+	// The levels are the simplified ones from MeshSimplifier::generate_lods, the indices before the first one are the full detail level
+	std::optional<MeshHandle> upload_mesh(const MeshData &mesh, std::span<const MeshLod> lods = {});
+
+	[[nodiscard]] inline const GeometryMesh &get_mesh(MeshHandle handle) const { return meshes_[handle]; };
+	[[nodiscard]] inline size_t mesh_count() const { return meshes_.size(); };
+
+	void bind_vertex_buffer(VulkanCommandBuffer &command_buffer);
+	// Binds the position stream to binding 0 in place of the vertex buffer
+	void bind_position_buffer(VulkanCommandBuffer &command_buffer);
+	void bind_index_buffer(VulkanCommandBuffer &command_buffer, IndexType index_type);
+
+	[[nodiscard]] inline VkBuffer get_vertex_buffer_handle() const { return vertex_buffer_.get_handle(); };
+	[[nodiscard]] inline VkBuffer get_index_buffer_handle() const { return index_buffer_.get_handle(); };
+
+private:
+	VulkanContext *context_;
+
+	GeometryPoolSettings settings_;
+	// Set when device local memory is host visible, then uploads skip the staging buffer
+	bool direct_upload_ = false;
+
+	VulkanBuffer vertex_buffer_;
+	VulkanBuffer position_buffer_;
+	VulkanBuffer index_buffer_;
+
+	// In vertices
+	uint64_t vertex_count_ = 0;
+	// In bytes, always 4 byte aligned
+	uint64_t index_size_ = 0;
+
+	std::vector<GeometryMesh> meshes_{};
+
+	///// Private methods
+
+	// Returns the vertex and index byte offsets the data was written to
+	std::optional<std::pair<uint64_t, uint64_t>> upload(std::span<const std::byte> vertex_data, std::span<const std::byte> index_data);
+	// Grows the buffers until they hold the given counts, fails past the maximums of the settings
+	bool reserve(uint64_t vertex_count, uint64_t index_bytes);
+};
+
+}// namespace flwfrg
@@ -0,0 +1,581 @@
+#include "pch.hpp"
+
+#include "gpu_scene.hpp"
+
+#include "command_buffer.hpp"
+#include "depth_pyramid.hpp"
+#include "shaders/object_shader.hpp"
+#include "shaders/shader_stage.hpp"
+#include "shaders/vertex.hpp"
+#include "vulkan_context.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace flwfrg
+{
+
+///// Local helper functions
+
+namespace
+{
+
+constexpr uint32_t cull_group_size = 64;
+constexpr const char *cull_shader_file_name = "cull";
+constexpr uint32_t cull_data_binding = 6;
+constexpr uint32_t depth_pyramid_binding = 7;
+constexpr uint32_t lod_binding = 8;
+
+// Mirrored in cull.comp
+constexpr uint32_t object_hidden_flag = 1;
+
+constexpr VkMemoryPropertyFlags host_memory_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+}// namespace
+
+
+///// Method implementations
+
+VulkanGpuScene::VulkanGpuScene(VulkanContext *context, uint32_t max_objects, uint32_t max_batches)
+	: context_{context},
+	  max_objects_{max_objects},
+	  max_batches_{max_batches},
+	  frame_count_{context->get_swapchain().get_max_frames_in_flight()}
+{
+	assert(context != nullptr);
+
+	// Every object is its own instance, so draws have to start at an arbitrary instance
+	const VkPhysicalDeviceFeatures &features = context_->vulkan_device().get_enabled_features();
+	supported_ = features.drawIndirectFirstInstance == VK_TRUE;
+	if (!supported_)
+	{
+		FLOWFORGE_WARN("drawIndirectFirstInstance is not supported, GPU driven drawing is disabled");
+		return;
+	}
+
+	use_multi_draw_ = features.multiDrawIndirect == VK_TRUE;
+	if (use_multi_draw_ && context_->vulkan_device().is_extension_enabled(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME))
+	{
+		draw_indexed_indirect_count_ = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+				vkGetDeviceProcAddr(context_->logical_device(), "vkCmdDrawIndexedIndirectCountKHR"));
+		use_draw_count_ = draw_indexed_indirect_count_ != nullptr;
+	}
+
+	create_pipeline();
+	create_buffers();
+	create_descriptor_sets();
+
+	pending_objects_.resize(frame_count_);
+	pending_transforms_.resize(frame_count_);
+
+	FLOWFORGE_INFO("GPU scene created ({} draws)",
+				   use_draw_count_ ? "indirect count" : (use_multi_draw_ ? "multi draw indirect" : "single draw indirect"));
+}
+
+VulkanGpuScene::~VulkanGpuScene()
+{
+	if (mapped_objects_ != nullptr)
+		object_buffer_.unlock_memory();
+	if (mapped_transforms_ != nullptr)
+		transform_buffer_.unlock_memory();
+	if (mapped_batches_ != nullptr)
+		batch_buffer_.unlock_memory();
+	if (mapped_cull_data_ != nullptr)
+		cull_data_buffer_.unlock_memory();
+	if (mapped_lods_ != nullptr)
+		lod_buffer_.unlock_memory();
+}
+
+std::optional<GpuObjectHandle> VulkanGpuScene::add_object(MeshHandle mesh_handle, const GeometryRenderData &data)
+{
+	if (!supported_)
+		return std::nullopt;
+
+	if (scene_.size() >= max_objects_)
+	{
+		FLOWFORGE_ERROR("GPU scene is full ({} objects)", max_objects_);
+		return std::nullopt;
+	}
+
+	const GeometryMesh &mesh = context_->get_geometry_pool().get_mesh(mesh_handle);
+
+	// Objects are batched by material and index type, each batch is one indirect call.
+	// Their own uniforms are found through the material index of their instance.
+	const VulkanTexture *material = VulkanObjectShader::diffuse_texture(data);
+	auto batch = std::find_if(batches_.begin(), batches_.end(), [&](const Batch &candidate) {
+		return VulkanObjectShader::diffuse_texture(candidate.data) == material && candidate.index_type == mesh.index_type;
+	});
+	if (batch == batches_.end())
+	{
+		if (batches_.size() >= max_batches_)
+		{
+			FLOWFORGE_ERROR("GPU scene is out of batches ({} batches)", max_batches_);
+			return std::nullopt;
+		}
+		batches_.push_back({data, mesh.index_type, 0, 0});
+		batch = batches_.end() - 1;
+	}
+
+	// Objects of the same mesh share its detail levels
+	auto mesh_lods = mesh_lods_.find(mesh_handle);
+	if (mesh_lods == mesh_lods_.end())
+	{
+		if (lods_.size() + mesh.lod_count > max_objects_)
+		{
+			FLOWFORGE_ERROR("GPU scene is out of detail levels ({} levels)", max_objects_);
+			return std::nullopt;
+		}
+		mesh_lods = mesh_lods_.emplace(mesh_handle, static_cast<uint32_t>(lods_.size())).first;
+		// The culling shader works in the quantized space of the instance matrices, see make_object
+		for (const MeshLod &lod: mesh.detail_levels())
+		{
+			lods_.push_back({lod.first_index, lod.index_count, lod.error / mesh.quantization.scale, 0});
+		}
+	}
+
+	const SceneEntity entity = scene_.create(data.model,
+											 glm::vec4(mesh.bounds.center(), mesh.bounds.radius()),
+											 mesh_handle,
+											 static_cast<uint32_t>(batch - batches_.begin()));
+	batch_slots_.push_back(batch->object_count++);
+	material_indices_.push_back(data.object_id);
+
+	// The command ranges of the batches follow each other
+	uint32_t command_offset = 0;
+	for (Batch &existing: batches_)
+	{
+		existing.command_offset = command_offset;
+		command_offset += existing.object_count;
+	}
+
+	dirty_frames_ = frame_count_;
+	return static_cast<GpuObjectHandle>(entity);
+}
+
+void VulkanGpuScene::set_transform(GpuObjectHandle object, const glm::mat4 &model)
+{
+	scene_.set_transform(object, model);
+}
+
+void VulkanGpuScene::set_visible(GpuObjectHandle object, bool visible)
+{
+	scene_.set_visible(object, visible);
+}
+
+void VulkanGpuScene::clear()
+{
+	scene_.clear();
+	batch_slots_.clear();
+	material_indices_.clear();
+	for (uint32_t frame = 0; frame < pending_objects_.size(); frame++)
+	{
+		pending_objects_[frame].resize(0);
+		pending_transforms_[frame].resize(0);
+	}
+	batches_.clear();
+	lods_.clear();
+	mesh_lods_.clear();
+	dirty_frames_ = frame_count_;
+	reset_visibility_ = true;
+}
+
+void VulkanGpuScene::cull(VulkanCommandBuffer &command_buffer,
+						  uint32_t frame,
+						  GpuCullPhase phase,
+						  const glm::mat4 &projection,
+						  const glm::mat4 &view,
+						  const VulkanDepthPyramid &depth_pyramid,
+						  const LodSelector &lod_selector,
+						  bool occlusion)
+{
+	if (!supported_ || scene_.empty())
+		return;
+
+	// The late phase reads what the first phase of the frame uploaded
+	if (phase != GpuCullPhase::LATE)
+		upload(frame);
+	bind_depth_pyramid(frame, depth_pyramid);
+
+	VkCommandBuffer handle = command_buffer.get_handle();
+
+	// The late phase writes the second half of the frame's commands and counts
+	const uint32_t command_base = phase == GpuCullPhase::LATE ? max_objects_ : 0;
+	const uint32_t count_base = phase == GpuCullPhase::LATE ? max_batches_ : 0;
+
+	if (reset_visibility_)
+	{
+		vkCmdFillBuffer(handle, visibility_buffer_.get_handle(), 0, VK_WHOLE_SIZE, 0);
+		reset_visibility_ = false;
+	}
+	if (use_draw_count_)
+	{
+		// Reset the draw counts of the phase
+		vkCmdFillBuffer(handle, count_buffer_.get_handle(), count_slice_size_ * frame + count_base * sizeof(uint32_t), max_batches_ * sizeof(uint32_t), 0);
+	}
+
+	// Order the dispatch against the fills, the frame graph orders it against the other passes
+	VkMemoryBarrier clear_barrier{};
+	clear_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	clear_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	clear_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(handle,
+						 VK_PIPELINE_STAGE_TRANSFER_BIT,
+						 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+						 0, 1, &clear_barrier, 0, nullptr, 0, nullptr);
+
+	// Written every phase, both phases of a frame see the same values
+	GpuCullData data{};
+	data.view = view;
+	data.planes = Frustum::from_view_projection(projection * view).planes;
+	data.projection = glm::vec4(projection[0][0], projection[1][1], projection[2][2], projection[3][2]);
+	data.pyramid_size = glm::vec2(depth_pyramid.get_width(), depth_pyramid.get_height());
+	// Near plane distance of a [0, 1] depth perspective projection
+	data.near_clip = projection[3][2] / projection[2][2];
+	data.object_count = static_cast<uint32_t>(scene_.size());
+	data.lod = glm::vec4(lod_selector.error_scale(), 1.0f - lod_selector.hysteresis(), lod_selector.near_clip(), lod_selector.far_clip());
+	std::memcpy(mapped_cull_data_ + cull_data_slice_size_ * frame, &data, sizeof(GpuCullData));
+
+	pipeline_.bind(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE);
+	vkCmdBindDescriptorSets(handle, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_.layout(), 0, 1, &descriptor_sets_[frame], 0, nullptr);
+
+	CullConstants constants{};
+	constants.phase = static_cast<uint32_t>(phase);
+	constants.occlusion = occlusion ? 1 : 0;
+	constants.compact = use_draw_count_ ? 1 : 0;
+	constants.command_base = command_base;
+	constants.count_base = count_base;
+	vkCmdPushConstants(handle, pipeline_.layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullConstants), &constants);
+
+	// The frame graph makes the commands and counts visible to the indirect draws
+	vkCmdDispatch(handle, (data.object_count + cull_group_size - 1) / cull_group_size, 1, 1);
+}
+
+void VulkanGpuScene::draw(VulkanCommandBuffer &command_buffer, uint32_t frame, GpuCullPhase phase, VulkanObjectShader &object_shader)
+{
+	if (!supported_ || scene_.empty())
+		return;
+
+	VkCommandBuffer handle = command_buffer.get_handle();
+	VulkanGeometryPool &geometry_pool = context_->get_geometry_pool();
+
+	const uint32_t command_base = phase == GpuCullPhase::LATE ? max_objects_ : 0;
+	const uint32_t count_base = phase == GpuCullPhase::LATE ? max_batches_ : 0;
+
+	// The object transforms and material indices double as the instance data, indexed by first instance
+	geometry_pool.bind_vertex_buffer(command_buffer);
+	VkBuffer instance_buffers[] = {transform_buffer_.get_handle()};
+	VkDeviceSize instance_offsets[] = {transform_slice_size_ * frame};
+	vkCmdBindVertexBuffers(handle, 1, 1, instance_buffers, instance_offsets);
+
+	object_shader.use();
+
+	constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	for (size_t batch_index = 0; batch_index < batches_.size(); batch_index++)
+	{
+		const Batch &batch = batches_[batch_index];
+		if (batch.object_count == 0)
+			continue;
+
+		object_shader.bind_object(batch.data);
+		geometry_pool.bind_index_buffer(command_buffer, batch.index_type);
+
+		const VkDeviceSize command_offset = indirect_slice_size_ * frame + (uint64_t{command_base} + batch.command_offset) * stride;
+		if (use_draw_count_)
+		{
+			const VkDeviceSize count_offset = count_slice_size_ * frame + (count_base + batch_index) * sizeof(uint32_t);
+			draw_indexed_indirect_count_(handle, indirect_buffer_.get_handle(), command_offset, count_buffer_.get_handle(), count_offset, batch.object_count, stride);
+		} else if (use_multi_draw_)
+		{
+			// Culled objects are drawn with zero instances
+			vkCmdDrawIndexedIndirect(handle, indirect_buffer_.get_handle(), command_offset, batch.object_count, stride);
+		} else
+		{
+			for (uint32_t i = 0; i < batch.object_count; i++)
+			{
+				vkCmdDrawIndexedIndirect(handle, indirect_buffer_.get_handle(), command_offset + uint64_t{i} * stride, 1, stride);
+			}
+		}
+	}
+}
+
+GpuSceneBuffers VulkanGpuScene::import_buffers(VulkanFrameGraph &frame_graph) const
+{
+	// The last frame drew from its commands and counts, and culled into the visibility
+	GpuSceneBuffers buffers{};
+	buffers.commands = frame_graph.import_buffer("gpu scene commands", indirect_buffer_.get_handle(), FrameGraphUsage::INDIRECT);
+	buffers.counts = frame_graph.import_buffer("gpu scene counts", count_buffer_.get_handle(), FrameGraphUsage::INDIRECT);
+	buffers.visibility = frame_graph.import_buffer("gpu scene visibility", visibility_buffer_.get_handle(), FrameGraphUsage::STORAGE_COMPUTE);
+	return buffers;
+}
+
+void VulkanGpuScene::declare_cull(VulkanFrameGraph::PassBuilder &pass, const GpuSceneBuffers &buffers)
+{
+	// The counts and visibility are cleared by fills before the dispatch
+	pass.write(buffers.commands, FrameGraphUsage::STORAGE_COMPUTE)
+			.write(buffers.counts, FrameGraphUsage::TRANSFER)
+			.write(buffers.counts, FrameGraphUsage::STORAGE_COMPUTE)
+			.write(buffers.visibility, FrameGraphUsage::TRANSFER)
+			.write(buffers.visibility, FrameGraphUsage::STORAGE_COMPUTE);
+}
+
+void VulkanGpuScene::declare_draw(VulkanFrameGraph::PassBuilder &pass, const GpuSceneBuffers &buffers)
+{
+	pass.read(buffers.commands, FrameGraphUsage::INDIRECT)
+			.read(buffers.counts, FrameGraphUsage::INDIRECT);
+}
+
+void VulkanGpuScene::create_pipeline()
+{
+	// Objects, instances, batches, commands, counts and visibility, then the cull data, the depth pyramid and the detail levels
+	std::array<VkDescriptorSetLayoutBinding, 9> bindings{};
+	for (uint32_t i = 0; i < bindings.size(); i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].pImmutableSamplers = nullptr;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	bindings[cull_data_binding].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	bindings[depth_pyramid_binding].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+	VkDescriptorSetLayoutCreateInfo layout_info{};
+	layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+	layout_info.pBindings = bindings.data();
+	descriptor_set_layout_ = VulkanDescriptorSetLayout(context_, layout_info);
+
+	std::optional<VulkanShaderStage> stage = VulkanShaderStage::create_shader_module(context_, cull_shader_file_name, VK_SHADER_STAGE_COMPUTE_BIT);
+	if (!stage.has_value())
+	{
+		throw std::runtime_error("Failed to create culling shader stage");
+	}
+
+	const std::array<VkDescriptorSetLayout, 1> layouts = {descriptor_set_layout_.get()};
+	auto created_pipeline = VulkanPipeline::create_compute_pipeline(context_,
+																	layouts,
+																	stage->get_shader_stage_create_info(),
+																	sizeof(CullConstants));
+	if (!created_pipeline.has_value())
+	{
+		throw std::runtime_error("Failed to create culling pipeline");
+	}
+
+	pipeline_ = std::move(created_pipeline.value());
+}
+
+void VulkanGpuScene::create_buffers()
+{
+	// Every slice has to be a valid storage and uniform buffer offset
+	const VkPhysicalDeviceLimits limits = context_->vulkan_device().get_physical_device_properties().limits;
+	const uint64_t alignment = std::max(limits.minStorageBufferOffsetAlignment, limits.minUniformBufferOffsetAlignment);
+	auto align = [alignment](uint64_t size) {
+		return (size + alignment - 1) / alignment * alignment;
+	};
+
+	object_slice_size_ = align(sizeof(GpuObject) * max_objects_);
+	transform_slice_size_ = align(sizeof(InstanceData) * max_objects_);
+	batch_slice_size_ = align(sizeof(GpuBatch) * max_batches_);
+	// Room for one detail level per object, distinct meshes rarely come close
+	lod_slice_size_ = align(sizeof(GpuLod) * max_objects_);
+	cull_data_slice_size_ = align(sizeof(GpuCullData));
+	// Early and late commands and counts
+	indirect_slice_size_ = align(sizeof(VkDrawIndexedIndirectCommand) * max_objects_ * 2);
+	count_slice_size_ = align(sizeof(uint32_t) * max_batches_ * 2);
+
+	object_buffer_ = VulkanBuffer(context_, object_slice_size_ * frame_count_,
+								  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+								  host_memory_flags,
+								  true);
+	transform_buffer_ = VulkanBuffer(context_, transform_slice_size_ * frame_count_,
+									 static_cast<VkBufferUsageFlagBits>(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT),
+									 host_memory_flags,
+									 true);
+	batch_buffer_ = VulkanBuffer(context_, batch_slice_size_ * frame_count_,
+								 VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+								 host_memory_flags,
+								 true);
+	lod_buffer_ = VulkanBuffer(context_, lod_slice_size_ * frame_count_,
+							   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+							   host_memory_flags,
+							   true);
+	cull_data_buffer_ = VulkanBuffer(context_, cull_data_slice_size_ * frame_count_,
+									 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+									 host_memory_flags,
+									 true);
+	indirect_buffer_ = VulkanBuffer(context_, indirect_slice_size_ * frame_count_,
+									static_cast<VkBufferUsageFlagBits>(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT),
+									VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+									true);
+	count_buffer_ = VulkanBuffer(context_, count_slice_size_ * frame_count_,
+								 static_cast<VkBufferUsageFlagBits>(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+								 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+								 true);
+	visibility_buffer_ = VulkanBuffer(context_, sizeof(uint32_t) * max_objects_,
+									  static_cast<VkBufferUsageFlagBits>(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT),
+									  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+									  true);
+
+	// The host written buffers stay mapped
+	mapped_objects_ = static_cast<std::byte *>(object_buffer_.lock_memory(0, VK_WHOLE_SIZE, 0));
+	mapped_transforms_ = static_cast<std::byte *>(transform_buffer_.lock_memory(0, VK_WHOLE_SIZE, 0));
+	mapped_batches_ = static_cast<std::byte *>(batch_buffer_.lock_memory(0, VK_WHOLE_SIZE, 0));
+	mapped_cull_data_ = static_cast<std::byte *>(cull_data_buffer_.lock_memory(0, VK_WHOLE_SIZE, 0));
+	mapped_lods_ = static_cast<std::byte *>(lod_buffer_.lock_memory(0, VK_WHOLE_SIZE, 0));
+}
+
+void VulkanGpuScene::create_descriptor_sets()
+{
+	std::array<VkDescriptorPoolSize, 3> pool_sizes{};
+	pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pool_sizes[0].descriptorCount = 7 * frame_count_;
+	pool_sizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	pool_sizes[1].descriptorCount = frame_count_;
+	pool_sizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pool_sizes[2].descriptorCount = frame_count_;
+
+	VkDescriptorPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+	pool_info.pPoolSizes = pool_sizes.data();
+	pool_info.maxSets = frame_count_;
+	descriptor_pool_ = VulkanDescriptorPool(context_, pool_info);
+
+	// One set per frame in flight, pointing at the frame's slices
+	std::vector<VkDescriptorSetLayout> layouts(frame_count_, descriptor_set_layout_.get());
+	descriptor_sets_.resize(frame_count_);
+	pyramid_generations_.resize(frame_count_);
+
+	VkDescriptorSetAllocateInfo allocate_info{};
+	allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocate_info.descriptorPool = descriptor_pool_.get();
+	allocate_info.descriptorSetCount = frame_count_;
+	allocate_info.pSetLayouts = layouts.data();
+	if (vkAllocateDescriptorSets(context_->logical_device(), &allocate_info, descriptor_sets_.data()) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate culling descriptor sets");
+	}
+
+	for (uint32_t frame = 0; frame < frame_count_; frame++)
+	{
+		std::array<VkDescriptorBufferInfo, 8> buffer_infos = {
+				VkDescriptorBufferInfo{object_buffer_.get_handle(), object_slice_size_ * frame, object_slice_size_},
+				VkDescriptorBufferInfo{transform_buffer_.get_handle(), transform_slice_size_ * frame, transform_slice_size_},
+				VkDescriptorBufferInfo{batch_buffer_.get_handle(), batch_slice_size_ * frame, batch_slice_size_},
+				VkDescriptorBufferInfo{indirect_buffer_.get_handle(), indirect_slice_size_ * frame, indirect_slice_size_},
+				VkDescriptorBufferInfo{count_buffer_.get_handle(), count_slice_size_ * frame, count_slice_size_},
+				VkDescriptorBufferInfo{visibility_buffer_.get_handle(), 0, VK_WHOLE_SIZE},
+				VkDescriptorBufferInfo{cull_data_buffer_.get_handle(), cull_data_slice_size_ * frame, sizeof(GpuCullData)},
+				VkDescriptorBufferInfo{lod_buffer_.get_handle(), lod_slice_size_ * frame, lod_slice_size_}};
+
+		// The depth pyramid is written once it exists, so the detail levels take its place in the list
+		std::array<VkWriteDescriptorSet, 8> writes{};
+		for (uint32_t i = 0; i < writes.size(); i++)
+		{
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = descriptor_sets_[frame];
+			writes[i].dstBinding = i == depth_pyramid_binding ? lod_binding : i;
+			writes[i].dstArrayElement = 0;
+			writes[i].descriptorType = i == cull_data_binding ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].descriptorCount = 1;
+			writes[i].pBufferInfo = &buffer_infos[i];
+		}
+
+		vkUpdateDescriptorSets(context_->logical_device(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+}
+
+void VulkanGpuScene::upload(uint32_t frame)
+{
+	// Changes since the last upload are pending for the slices of every frame
+	for (uint32_t i = 0; i < frame_count_; i++)
+	{
+		pending_objects_[i].resize(scene_.size());
+		pending_transforms_[i].resize(scene_.size());
+
+		pending_transforms_[i].merge(scene_.dirty(SceneComponent::TRANSFORM));
+		for (SceneComponent component: {SceneComponent::BOUNDS, SceneComponent::MESH, SceneComponent::MATERIAL, SceneComponent::VISIBILITY})
+		{
+			pending_objects_[i].merge(scene_.dirty(component));
+		}
+	}
+	scene_.clear_dirty();
+
+	// The frame's slices are no longer read by the GPU once its fence has been waited on
+	auto *objects = reinterpret_cast<GpuObject *>(mapped_objects_ + object_slice_size_ * frame);
+	for (SceneEntity entity: pending_objects_[frame].indices())
+	{
+		objects[entity] = make_object(entity);
+	}
+	auto *instances = reinterpret_cast<InstanceData *>(mapped_transforms_ + transform_slice_size_ * frame);
+	for (SceneEntity entity: pending_transforms_[frame].indices())
+	{
+		const GeometryMesh &mesh = context_->get_geometry_pool().get_mesh(scene_.mesh(entity));
+		instances[entity].model = scene_.transform(entity) * mesh.quantization.dequantization_matrix();
+		// The material index never changes, new objects are written with their first transform
+		instances[entity].material = glm::uvec4(material_indices_[entity], 0, 0, 0);
+	}
+
+	statistics_.objects = static_cast<uint32_t>(scene_.size());
+	statistics_.uploaded_objects = static_cast<uint32_t>(pending_objects_[frame].count());
+	statistics_.uploaded_transforms = static_cast<uint32_t>(pending_transforms_[frame].count());
+	pending_objects_[frame].clear();
+	pending_transforms_[frame].clear();
+
+	if (dirty_frames_ == 0)
+		return;
+
+	std::memcpy(mapped_lods_ + lod_slice_size_ * frame, lods_.data(), lods_.size() * sizeof(GpuLod));
+
+	auto *batches = reinterpret_cast<GpuBatch *>(mapped_batches_ + batch_slice_size_ * frame);
+	for (size_t i = 0; i < batches_.size(); i++)
+	{
+		batches[i] = {batches_[i].command_offset, {}};
+	}
+
+	dirty_frames_--;
+}
+
+VulkanGpuScene::GpuObject VulkanGpuScene::make_object(SceneEntity entity) const
+{
+	const GeometryMesh &mesh = context_->get_geometry_pool().get_mesh(scene_.mesh(entity));
+
+	GpuObject object{};
+	// The instance matrix includes the mesh's dequantization, which only scales uniformly,
+	// so the sphere is moved into the quantized space and keeps its world size
+	const glm::vec4 &sphere = scene_.bounds(entity);
+	object.sphere = glm::vec4(glm::vec3(sphere) - mesh.quantization.center, sphere.w) / mesh.quantization.scale;
+	object.first_lod = mesh_lods_.at(scene_.mesh(entity));
+	object.lod_count = mesh.lod_count;
+	object.vertex_offset = mesh.vertex_offset;
+	object.batch = scene_.material(entity);
+	object.batch_slot = batch_slots_[entity];
+	object.flags = scene_.is_visible(entity) ? 0 : object_hidden_flag;
+	return object;
+}
+
+void VulkanGpuScene::bind_depth_pyramid(uint32_t frame, const VulkanDepthPyramid &depth_pyramid)
+{
+	// The frame's fence was waited on, so its set is not in use while the frame is recorded
+	if (pyramid_generations_[frame] == depth_pyramid.get_generation())
+		return;
+
+	VkDescriptorImageInfo image_info{};
+	image_info.sampler = depth_pyramid.get_sampler();
+	image_info.imageView = depth_pyramid.get_view();
+	image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	VkWriteDescriptorSet write{};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = descriptor_sets_[frame];
+	write.dstBinding = depth_pyramid_binding;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.descriptorCount = 1;
+	write.pImageInfo = &image_info;
+	vkUpdateDescriptorSets(context_->logical_device(), 1, &write, 0, nullptr);
+
+	pyramid_generations_[frame] = depth_pyramid.get_generation();
+}
+
+}// namespace flwfrg
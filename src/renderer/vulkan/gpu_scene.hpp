@@ -0,0 +1,243 @@
+#pragma once
+
+#include "buffer.hpp"
+#include "descriptor.hpp"
+#include "frame_graph.hpp"
+#include "geometry_pool.hpp"
+#include "renderer/culling/frustum.hpp"
+#include "renderer/mesh/lod_selector.hpp"
+#include "renderer/scene/scene_store.hpp"
+#include "shaders/object_types.inl"
+#include "shaders/pipeline.hpp"
+
+#include <array>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace flwfrg
+{
+class VulkanContext;
+class VulkanCommandBuffer;
+class VulkanObjectShader;
+class VulkanDepthPyramid;
+
+using GpuObjectHandle = uint32_t;
+
+enum class GpuCullPhase : uint32_t
+{
+	// Objects visible last frame, drawn before the depth pyramid is built
+	EARLY = 0,
+	// Objects that pass the depth pyramid test but were not drawn early
+	LATE = 1,
+	// Every object in the frustum, when occlusion culling is not used
+	ALL = 2
+};
+
+struct GpuSceneStatistics
+{
+	uint32_t objects = 0;
+	// Written to the slice of the last frame, only changed objects are
+	uint32_t uploaded_objects = 0;
+	uint32_t uploaded_transforms = 0;
+};
+
+// GPU written buffers of the scene, as frame graph resources
+struct GpuSceneBuffers
+{
+	FrameGraphBuffer commands;
+	FrameGraphBuffer counts;
+	FrameGraphBuffer visibility;
+};
+
+/// <summary>
+/// Persistent set of objects that are frustum culled by a compute pass, which writes the
+/// indirect draw commands. Drawing costs one indirect call per material batch, no matter the object count.
+/// With occlusion culling every frame runs an early and a late phase around the depth pyramid build,
+/// the visibility of the late phase decides what is drawn early in the next frame.
+/// The objects are kept in a scene store, only the objects whose components changed are written to the slices.
+/// </summary>
+class VulkanGpuScene
+{
+public:
+	VulkanGpuScene(VulkanContext *context, uint32_t max_objects, uint32_t max_batches);
+	~VulkanGpuScene();
+
+	// Not copyable or movable
+	VulkanGpuScene(const VulkanGpuScene &) = delete;
+	VulkanGpuScene &operator=(const VulkanGpuScene &) = delete;
+	VulkanGpuScene(VulkanGpuScene &&) = delete;
+	VulkanGpuScene &operator=(VulkanGpuScene &&) = delete;
+
+	// Methods
+
+	std::optional<GpuObjectHandle> add_object(MeshHandle mesh, const GeometryRenderData &data);
+	void set_transform(GpuObjectHandle object, const glm::mat4 &model);
+	// Hidden objects stay in the scene but are culled
+	void set_visible(GpuObjectHandle object, bool visible);
+	void clear();
+
+	// Records a culling phase, must be called outside of a render pass.
+	// The pyramid is always bound, but only sampled by the late phase when occlusion is set.
+	// Every phase picks the detail levels the same way, the late one remembers them for the next frame's hysteresis.
+	void cull(VulkanCommandBuffer &command_buffer,
+			  uint32_t frame,
+			  GpuCullPhase phase,
+			  const glm::mat4 &projection,
+			  const glm::mat4 &view,
+			  const VulkanDepthPyramid &depth_pyramid,
+			  const LodSelector &lod_selector,
+			  bool occlusion);
+	// Records the indirect draws of a culled phase, inside the render pass
+	void draw(VulkanCommandBuffer &command_buffer, uint32_t frame, GpuCullPhase phase, VulkanObjectShader &object_shader);
+
+	// Imports the GPU written buffers, every frame before the culling and drawing passes are added
+	[[nodiscard]] GpuSceneBuffers import_buffers(VulkanFrameGraph &frame_graph) const;
+	// Declare the buffers a culling pass writes, and the ones a pass drawing its commands reads
+	static void declare_cull(VulkanFrameGraph::PassBuilder &pass, const GpuSceneBuffers &buffers);
+	static void declare_draw(VulkanFrameGraph::PassBuilder &pass, const GpuSceneBuffers &buffers);
+
+	[[nodiscard]] inline uint32_t object_count() const { return static_cast<uint32_t>(scene_.size()); };
+	[[nodiscard]] inline uint32_t batch_count() const { return static_cast<uint32_t>(batches_.size()); };
+	// False when the device can't draw indirectly with a first instance, nothing is culled or drawn then
+	[[nodiscard]] inline bool is_supported() const { return supported_; };
+	[[nodiscard]] inline const GpuSceneStatistics &statistics() const { return statistics_; };
+
+private:
+	///// GPU side structs, mirrored in cull.comp
+
+	struct GpuObject
+	{
+		glm::vec4 sphere;
+		uint32_t first_lod;
+		uint32_t lod_count;
+		int32_t vertex_offset;
+		uint32_t batch;
+		uint32_t batch_slot;
+		uint32_t flags;
+		uint32_t _reserved[2];
+	};
+	static_assert(sizeof(GpuObject) == 48);
+
+	struct GpuBatch
+	{
+		uint32_t command_offset;
+		uint32_t _reserved[3];
+	};
+
+	struct GpuLod
+	{
+		uint32_t first_index;
+		uint32_t index_count;
+		float error;
+		uint32_t _reserved;
+	};
+
+	struct GpuCullData
+	{
+		glm::mat4 view;
+		std::array<glm::vec4, 6> planes;
+		// P00, P11, P22 and P32 of the projection
+		glm::vec4 projection;
+		glm::vec2 pyramid_size;
+		float near_clip;
+		uint32_t object_count;
+		// Error scale, coarsening limit (1 - hysteresis), near and far clip of the LOD selector
+		glm::vec4 lod;
+	};
+	static_assert(sizeof(GpuCullData) == 208);
+
+	struct CullConstants
+	{
+		uint32_t phase;
+		uint32_t occlusion;
+		uint32_t compact;
+		uint32_t command_base;
+		uint32_t count_base;
+	};
+
+	// CPU side batch, one per material and index type.
+	// The data is that of the first object, the others only share its material bindings.
+	struct Batch
+	{
+		GeometryRenderData data;
+		IndexType index_type;
+		uint32_t object_count;
+		uint32_t command_offset;
+	};
+
+	VulkanContext *context_;
+
+	uint32_t max_objects_;
+	uint32_t max_batches_;
+	uint32_t frame_count_;
+
+	bool supported_ = false;
+	bool use_draw_count_ = false;
+	bool use_multi_draw_ = false;
+	PFN_vkCmdDrawIndexedIndirectCountKHR draw_indexed_indirect_count_ = nullptr;
+
+	// Mesh handles and batch indices as the mesh and material components
+	SceneStore scene_{};
+	std::vector<uint32_t> batch_slots_{};
+	// Index of every object's uniforms in the object shader's material buffer
+	std::vector<uint32_t> material_indices_{};
+	std::vector<Batch> batches_{};
+	std::vector<GpuLod> lods_{};
+	// First detail level of every mesh used by an object
+	std::unordered_map<MeshHandle, uint32_t> mesh_lods_{};
+	// Objects and transforms changed since each frame's slices were last written
+	std::vector<DirtyBitset> pending_objects_{};
+	std::vector<DirtyBitset> pending_transforms_{};
+	// Frames whose batch and detail level slices are outdated
+	uint32_t dirty_frames_ = 0;
+	// Set when handles were reused, so last frame's visibility means nothing
+	bool reset_visibility_ = true;
+	// Generation of the depth pyramid bound to each frame's set
+	std::vector<std::optional<uint32_t>> pyramid_generations_{};
+
+	VulkanDescriptorSetLayout descriptor_set_layout_{};
+	VulkanDescriptorPool descriptor_pool_{};
+	std::vector<VkDescriptorSet> descriptor_sets_{};
+	VulkanPipeline pipeline_{};
+
+	GpuSceneStatistics statistics_{};
+
+	// Host written, one slice per frame in flight. The transforms are the objects' InstanceData.
+	VulkanBuffer object_buffer_{};
+	VulkanBuffer transform_buffer_{};
+	VulkanBuffer batch_buffer_{};
+	VulkanBuffer lod_buffer_{};
+	VulkanBuffer cull_data_buffer_{};
+	// GPU written, one slice per frame in flight with an early and a late half
+	VulkanBuffer indirect_buffer_{};
+	VulkanBuffer count_buffer_{};
+	// GPU written, shared by all frames
+	VulkanBuffer visibility_buffer_{};
+
+	std::byte *mapped_objects_ = nullptr;
+	std::byte *mapped_transforms_ = nullptr;
+	std::byte *mapped_batches_ = nullptr;
+	std::byte *mapped_lods_ = nullptr;
+	std::byte *mapped_cull_data_ = nullptr;
+
+	uint64_t object_slice_size_ = 0;
+	uint64_t transform_slice_size_ = 0;
+	uint64_t batch_slice_size_ = 0;
+	uint64_t lod_slice_size_ = 0;
+	uint64_t cull_data_slice_size_ = 0;
+	uint64_t indirect_slice_size_ = 0;
+	uint64_t count_slice_size_ = 0;
+
+	///// Private methods
+
+	void create_pipeline();
+	void create_buffers();
+	void create_descriptor_sets();
+
+	void upload(uint32_t frame);
+	[[nodiscard]] GpuObject make_object(SceneEntity entity) const;
+	void bind_depth_pyramid(uint32_t frame, const VulkanDepthPyramid &depth_pyramid);
+};
+
+}// namespace flwfrg
@@ -0,0 +1,90 @@
+#include "pch.hpp"
+
+#include "gpu_timer.hpp"
+
+#include "command_buffer.hpp"
+#include "vulkan_context.hpp"
+
+#include <array>
+
+namespace flwfrg
+{
+
+///// Method implementations
+
+VulkanGpuTimer::VulkanGpuTimer(VulkanContext *context, uint32_t frames_in_flight)
+	: context_{context},
+	  pending_(frames_in_flight, false)
+{
+	assert(context != nullptr);
+
+	const VkPhysicalDeviceLimits limits = context_->vulkan_device().get_physical_device_properties().limits;
+	if (limits.timestampComputeAndGraphics == VK_FALSE || limits.timestampPeriod <= 0.0f)
+	{
+		FLOWFORGE_WARN("GPU timestamps are not supported, GPU frame times are unavailable");
+		return;
+	}
+	timestamp_period_ = limits.timestampPeriod;
+
+	VkQueryPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	pool_info.queryCount = frames_in_flight * 2;
+
+	if (vkCreateQueryPool(context_->logical_device(), &pool_info, vulkan_allocator(), &query_pool_) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create GPU timer query pool");
+	}
+}
+
+VulkanGpuTimer::~VulkanGpuTimer()
+{
+	if (query_pool_ != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(context_->logical_device(), query_pool_, vulkan_allocator());
+	}
+}
+
+void VulkanGpuTimer::begin(VulkanCommandBuffer &command_buffer, uint32_t frame)
+{
+	if (!is_supported())
+		return;
+
+	assert(frame < pending_.size());
+
+	// The frame's fence was waited on, so the last recording of the slot is done
+	vkCmdResetQueryPool(command_buffer.get_handle(), query_pool_, frame * 2, 2);
+	vkCmdWriteTimestamp(command_buffer.get_handle(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool_, frame * 2);
+	pending_[frame] = false;
+}
+
+void VulkanGpuTimer::end(VulkanCommandBuffer &command_buffer, uint32_t frame)
+{
+	if (!is_supported())
+		return;
+
+	vkCmdWriteTimestamp(command_buffer.get_handle(), VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool_, frame * 2 + 1);
+	pending_[frame] = true;
+}
+
+std::optional<float> VulkanGpuTimer::read(uint32_t frame)
+{
+	if (!is_supported() || !pending_[frame])
+		return std::nullopt;
+
+	std::array<uint64_t, 2> timestamps{};
+	const VkResult result = vkGetQueryPoolResults(context_->logical_device(), query_pool_, frame * 2, 2,
+												  sizeof(timestamps), timestamps.data(), sizeof(uint64_t),
+												  VK_QUERY_RESULT_64_BIT);
+	// Not ready when the frame was recorded but never submitted
+	if (result != VK_SUCCESS)
+		return std::nullopt;
+
+	pending_[frame] = false;
+	if (timestamps[1] < timestamps[0])
+		return std::nullopt;
+
+	return static_cast<float>(static_cast<double>(timestamps[1] - timestamps[0]) * timestamp_period_ / 1'000'000.0);
+}
+
+}// namespace flwfrg
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <optional>
+#include <vector>
+
+namespace flwfrg
+{
+class VulkanContext;
+class VulkanCommandBuffer;
+
+/// <summary>
+/// GPU time of whole frames, from a pair of timestamps per frame in flight. A frame's time can only be read
+/// once its fence signaled, so it arrives frames in flight later than the frame was recorded.
+/// Devices without timestamps on the graphics queue never report a time.
+/// </summary>
+class VulkanGpuTimer
+{
+public:
+	VulkanGpuTimer(VulkanContext *context, uint32_t frames_in_flight);
+	~VulkanGpuTimer();
+
+	// Not copyable or movable
+	VulkanGpuTimer(const VulkanGpuTimer &) = delete;
+	VulkanGpuTimer &operator=(const VulkanGpuTimer &) = delete;
+	VulkanGpuTimer(VulkanGpuTimer &&) = delete;
+	VulkanGpuTimer &operator=(VulkanGpuTimer &&) = delete;
+
+	// Methods
+
+	// Record first and last in the frame's command buffer, outside of a render pass
+	void begin(VulkanCommandBuffer &command_buffer, uint32_t frame);
+	void end(VulkanCommandBuffer &command_buffer, uint32_t frame);
+
+	// Milliseconds between the timestamps the frame slot last recorded, once per recording.
+	// Call after waiting for the frame's fence.
+	std::optional<float> read(uint32_t frame);
+
+	[[nodiscard]] inline bool is_supported() const { return query_pool_ != VK_NULL_HANDLE; };
+
+private:
+	VulkanContext *context_;
+
+	VkQueryPool query_pool_ = VK_NULL_HANDLE;
+	// Nanoseconds per timestamp tick
+	float timestamp_period_ = 0.0f;
+	// Frames whose timestamps were recorded and not read yet
+	std::vector<bool> pending_{};
+};
+
+}// namespace flwfrg
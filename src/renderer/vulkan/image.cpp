@@ -19,10 +19,12 @@ VulkanImage::VulkanImage(
 		VkImageUsageFlags usage,
 		VkMemoryPropertyFlags memory_flags,
 		VkImageAspectFlags aspect_flags,
-		bool create_view)
+		bool create_view,
+		uint32_t mip_levels)
 	: context_{context},
 	  width_{width},
-	  height_{height}
+	  height_{height},
+	  mip_levels_{mip_levels}
 {
 	assert(context != nullptr);
 	
@@ -33,7 +35,7 @@ VulkanImage::VulkanImage(
 	image_info.extent.width = width;
 	image_info.extent.height = height;
 	image_info.extent.depth = 1;
-	image_info.mipLevels = 1;
+	image_info.mipLevels = mip_levels;
 	image_info.arrayLayers = 1;
 	image_info.format = format;
 	image_info.tiling = tiling;
@@ -46,7 +48,7 @@ VulkanImage::VulkanImage(
 	if (vkCreateImage(
 				context_->device_.logical_device_,
 				&image_info,
-				nullptr,
+				vulkan_allocator(),
 				&image_handle_) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create image!");
@@ -75,7 +77,7 @@ VulkanImage::VulkanImage(
 	if (vkAllocateMemory(
 				context_->device_.logical_device_,
 				&memory_allocate_info,
-				nullptr,
+				vulkan_allocator(),
 				&memory_) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to allocate image memory");
@@ -101,15 +103,15 @@ VulkanImage::~VulkanImage()
 {
 	if (view_)
 	{
-		vkDestroyImageView(context_->device_.logical_device_, view_, nullptr);
+		vkDestroyImageView(context_->device_.logical_device_, view_, vulkan_allocator());
 	}
 	if (image_handle_)
 	{
-		vkDestroyImage(context_->device_.logical_device_, image_handle_, nullptr);
+		vkDestroyImage(context_->device_.logical_device_, image_handle_, vulkan_allocator());
 	}
 	if (memory_)
 	{
-		vkFreeMemory(context_->device_.logical_device_, memory_, nullptr);
+		vkFreeMemory(context_->device_.logical_device_, memory_, vulkan_allocator());
 	}
 }
 VulkanImage::VulkanImage(VulkanImage &&other) noexcept
@@ -118,7 +120,8 @@ VulkanImage::VulkanImage(VulkanImage &&other) noexcept
 	  memory_{other.memory_},
 	  view_{other.view_},
 	  width_{other.width_},
-	  height_{other.height_}
+	  height_{other.height_},
+	  mip_levels_{other.mip_levels_}
 {
 	other.image_handle_ = VK_NULL_HANDLE;
 	other.memory_ = VK_NULL_HANDLE;
@@ -132,15 +135,15 @@ VulkanImage &VulkanImage::operator=(VulkanImage &&other) noexcept
 	{
 		if (view_)
 		{
-			vkDestroyImageView(context_->device_.logical_device_, view_, nullptr);
+			vkDestroyImageView(context_->device_.logical_device_, view_, vulkan_allocator());
 		}
 		if (image_handle_)
 		{
-			vkDestroyImage(context_->device_.logical_device_, image_handle_, nullptr);
+			vkDestroyImage(context_->device_.logical_device_, image_handle_, vulkan_allocator());
 		}
 		if (memory_)
 		{
-			vkFreeMemory(context_->device_.logical_device_, memory_, nullptr);
+			vkFreeMemory(context_->device_.logical_device_, memory_, vulkan_allocator());
 		}
 
 		context_ = other.context_;
@@ -149,6 +152,7 @@ VulkanImage &VulkanImage::operator=(VulkanImage &&other) noexcept
 		view_ = other.view_;
 		width_ = other.width_;
 		height_ = other.height_;
+		mip_levels_ = other.mip_levels_;
 
 		other.image_handle_ = VK_NULL_HANDLE;
 		other.memory_ = VK_NULL_HANDLE;
@@ -244,14 +248,14 @@ void VulkanImage::view_create(VkFormat format, VkImageAspectFlags aspect_flags)
 	view_info.subresourceRange.aspectMask = aspect_flags;
 	
 	view_info.subresourceRange.baseMipLevel = 0;
-	view_info.subresourceRange.levelCount = 1;
+	view_info.subresourceRange.levelCount = mip_levels_;
 	view_info.subresourceRange.baseArrayLayer = 0;
 	view_info.subresourceRange.layerCount = 1;
 
 	if (vkCreateImageView(
 				context_->device_.logical_device_,
 				&view_info,
-				nullptr,
+				vulkan_allocator(),
 				&view_) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create image view");
@@ -24,7 +24,8 @@ public:
 			VkImageUsageFlags usage,
 			VkMemoryPropertyFlags memory_flags,
 			VkImageAspectFlags aspect_flags,
-			bool create_view = true);
+			bool create_view = true,
+			uint32_t mip_levels = 1);
 	~VulkanImage();
 
 	// Not copyable but movable
@@ -44,6 +45,7 @@ public:
 	[[nodiscard]] inline VkImageView get_image_view() const { return view_; }
 	[[nodiscard]] inline uint32_t get_width() const { return width_; }
 	[[nodiscard]] inline uint32_t get_height() const { return height_; }
+	[[nodiscard]] inline uint32_t get_mip_levels() const { return mip_levels_; }
 
 private:
 	VulkanContext *context_ = nullptr;
@@ -53,6 +55,7 @@ private:
 	VkImageView view_ = VK_NULL_HANDLE;
 	uint32_t width_ = 0;
 	uint32_t height_ = 0;
+	uint32_t mip_levels_ = 1;
 
 	void view_create(VkFormat format, VkImageAspectFlags aspect_flags);
 
@@ -0,0 +1,61 @@
+#include "pch.hpp"
+
+#include "instance_buffer.hpp"
+
+#include "command_buffer.hpp"
+#include "vulkan_context.hpp"
+
+namespace flwfrg
+{
+
+VulkanInstanceBuffer::VulkanInstanceBuffer(VulkanContext *context, uint32_t frame_count, uint32_t max_instances_per_frame)
+	: context_{context},
+	  frame_count_{frame_count},
+	  max_instances_per_frame_{max_instances_per_frame},
+	  buffer_{context,
+			  sizeof(InstanceData) * max_instances_per_frame * frame_count,
+			  VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			  true}
+{
+	assert(context != nullptr);
+	assert(frame_count > 0);
+
+	// Stays mapped for the lifetime of the buffer
+	mapped_ = static_cast<InstanceData *>(buffer_.lock_memory(0, VK_WHOLE_SIZE, 0));
+}
+
+VulkanInstanceBuffer::~VulkanInstanceBuffer()
+{
+	if (mapped_ != nullptr)
+	{
+		buffer_.unlock_memory();
+	}
+}
+
+void VulkanInstanceBuffer::begin_frame(uint32_t frame)
+{
+	assert(frame < frame_count_);
+
+	frame_ = frame;
+	instance_count_ = 0;
+}
+
+std::span<InstanceData> VulkanInstanceBuffer::allocate(uint32_t count, uint32_t &out_first_instance)
+{
+	if (instance_count_ + count > max_instances_per_frame_)
+		return {};
+
+	out_first_instance = instance_count_;
+	instance_count_ += count;
+	return {mapped_ + static_cast<size_t>(frame_) * max_instances_per_frame_ + out_first_instance, count};
+}
+
+void VulkanInstanceBuffer::bind(VulkanCommandBuffer &command_buffer, uint32_t binding)
+{
+	VkBuffer buffers[] = {buffer_.get_handle()};
+	VkDeviceSize offsets[] = {sizeof(InstanceData) * max_instances_per_frame_ * frame_};
+	vkCmdBindVertexBuffers(command_buffer.get_handle(), binding, 1, buffers, offsets);
+}
+
+}// namespace flwfrg
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "buffer.hpp"
+#include "shaders/vertex.hpp"
+
+#include <span>
+
+namespace flwfrg
+{
+class VulkanContext;
+class VulkanCommandBuffer;
+
+/// <summary>
+/// Persistently mapped per instance vertex buffer with one slice per frame in flight.
+/// A slice is only rewritten after the fence of its frame has been waited on.
+/// </summary>
+class VulkanInstanceBuffer
+{
+public:
+	VulkanInstanceBuffer(VulkanContext *context, uint32_t frame_count, uint32_t max_instances_per_frame);
+	~VulkanInstanceBuffer();
+
+	// Not copyable or movable
+	VulkanInstanceBuffer(const VulkanInstanceBuffer &) = delete;
+	VulkanInstanceBuffer &operator=(const VulkanInstanceBuffer &) = delete;
+	VulkanInstanceBuffer(VulkanInstanceBuffer &&) = delete;
+	VulkanInstanceBuffer &operator=(VulkanInstanceBuffer &&) = delete;
+
+	// Methods
+
+	// Starts writing into the slice of the given frame
+	void begin_frame(uint32_t frame);
+
+	// Returns space for count instances, or an empty span if the slice is full. The caller reports what it dropped.
+	// out_first_instance is the firstInstance to draw them with.
+	std::span<InstanceData> allocate(uint32_t count, uint32_t &out_first_instance);
+
+	// Binds the current slice to the instance binding
+	void bind(VulkanCommandBuffer &command_buffer, uint32_t binding);
+
+	[[nodiscard]] inline uint32_t instance_count() const { return instance_count_; };
+	[[nodiscard]] inline uint32_t capacity() const { return max_instances_per_frame_; };
+
+private:
+	VulkanContext *context_;
+
+	uint32_t frame_count_;
+	uint32_t max_instances_per_frame_;
+
+	VulkanBuffer buffer_;
+	InstanceData *mapped_ = nullptr;
+
+	uint32_t frame_ = 0;
+	uint32_t instance_count_ = 0;
+};
+
+}// namespace flwfrg
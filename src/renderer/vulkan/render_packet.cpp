@@ -0,0 +1,83 @@
+#include "pch.hpp"
+
+#include "render_packet.hpp"
+
+#include <cstring>
+
+namespace flwfrg
+{
+
+///// Local helper functions
+
+namespace
+{
+
+// Keeps the capacity of the destination, unlike ImVector's assignment which frees it first
+template<typename T>
+void copy_im_vector(ImVector<T> &destination, const ImVector<T> &source)
+{
+	destination.resize(source.Size);
+	if (source.Size > 0)
+		std::memcpy(destination.Data, source.Data, static_cast<size_t>(source.Size) * sizeof(T));
+}
+
+}// namespace
+
+///// Method implementations
+
+RenderPacket::~RenderPacket()
+{
+	for (ImDrawList *list: ui_lists_)
+	{
+		IM_DELETE(list);
+	}
+}
+
+void RenderPacket::capture_ui(ImDrawData *draw_data, bool copy)
+{
+	if (!copy || draw_data == nullptr)
+	{
+		ui_ = draw_data;
+		return;
+	}
+
+	// The vertices and commands are copied into the lists of earlier frames, textures are still referenced
+	for (int i = static_cast<int>(ui_lists_.size()); i < draw_data->CmdListsCount; i++)
+	{
+		ui_lists_.push_back(IM_NEW(ImDrawList)(draw_data->CmdLists[i]->_Data));
+	}
+
+	ui_copy_.Valid = draw_data->Valid;
+	ui_copy_.CmdListsCount = draw_data->CmdListsCount;
+	ui_copy_.TotalIdxCount = draw_data->TotalIdxCount;
+	ui_copy_.TotalVtxCount = draw_data->TotalVtxCount;
+	ui_copy_.DisplayPos = draw_data->DisplayPos;
+	ui_copy_.DisplaySize = draw_data->DisplaySize;
+	ui_copy_.FramebufferScale = draw_data->FramebufferScale;
+	ui_copy_.OwnerViewport = draw_data->OwnerViewport;
+	ui_copy_.CmdLists.resize(draw_data->CmdListsCount);
+	for (int i = 0; i < draw_data->CmdListsCount; i++)
+	{
+		const ImDrawList &source = *draw_data->CmdLists[i];
+		ImDrawList &list = *ui_lists_[i];
+		copy_im_vector(list.CmdBuffer, source.CmdBuffer);
+		copy_im_vector(list.IdxBuffer, source.IdxBuffer);
+		copy_im_vector(list.VtxBuffer, source.VtxBuffer);
+		list.Flags = source.Flags;
+		ui_copy_.CmdLists[i] = &list;
+	}
+	ui_ = &ui_copy_;
+}
+
+void RenderPacket::clear()
+{
+	draws.clear();
+	instanced_draws.clear();
+	instance_transforms.clear();
+	object_transforms.clear();
+	object_visibility.clear();
+	node_locals.clear();
+	ui_ = nullptr;
+}
+
+}// namespace flwfrg
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "../pacing/frame_pacer.hpp"
+#include "../scene/transform_hierarchy.hpp"
+#include "gpu_scene.hpp"
+#include "render_queue.hpp"
+
+#include <imgui.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace flwfrg
+{
+
+/// <summary>
+/// Everything the simulation hands the renderer for one frame: the camera, the draws and the changes to persistent
+/// objects. The renderer records a frame from a packet alone, so the next packet can be filled while it does.
+/// </summary>
+struct RenderPacket
+{
+	struct Draw
+	{
+		MeshHandle mesh;
+		GeometryRenderData data;
+		DrawPass pass;
+		// World space bounding sphere and the largest axis scale
+		glm::vec3 center;
+		float radius;
+		float scale;
+		uint32_t *lod_level;
+	};
+
+	struct InstancedDraw
+	{
+		MeshHandle mesh;
+		GeometryRenderData data;
+		DrawPass pass;
+		// Range in instance_transforms
+		uint32_t first_transform;
+		uint32_t transform_count;
+	};
+
+	RenderPacket() = default;
+	~RenderPacket();
+
+	// Not copyable or movable
+	RenderPacket(const RenderPacket &) = delete;
+	RenderPacket &operator=(const RenderPacket &) = delete;
+	RenderPacket(RenderPacket &&) = delete;
+	RenderPacket &operator=(RenderPacket &&) = delete;
+
+	// Methods
+
+	// Keeps the draw lists of the UI. With copy they are copied into lists the packet keeps between frames, so the UI of
+	// the next frame can be built meanwhile, otherwise the packet has to be rendered before ImGui starts a new frame.
+	void capture_ui(ImDrawData *draw_data, bool copy);
+	// Forgets the frame's draws, changes and UI. The camera stays, it is only replaced when it changes.
+	void clear();
+
+	[[nodiscard]] inline ImDrawData *ui() { return ui_; };
+
+	// Camera
+	glm::mat4 projection{1.0f};
+	glm::mat4 view{1.0f};
+	float near_clip = 0.1f;
+	float far_clip = 1000.0f;
+
+	float delta_time = 0.0f;
+	FramePacer::Clock::time_point input_time{};
+
+	std::vector<Draw> draws{};
+	std::vector<InstancedDraw> instanced_draws{};
+	std::vector<glm::mat4> instance_transforms{};
+
+	// Changes to persistent objects, applied in order before the frame is culled
+	std::vector<std::pair<GpuObjectHandle, glm::mat4>> object_transforms{};
+	std::vector<std::pair<GpuObjectHandle, bool>> object_visibility{};
+	std::vector<std::pair<TransformNode, glm::mat4>> node_locals{};
+
+private:
+	ImDrawData *ui_ = nullptr;
+	ImDrawData ui_copy_{};
+	// Owned, reused by every copy so their buffers only grow
+	std::vector<ImDrawList *> ui_lists_{};
+};
+
+}// namespace flwfrg
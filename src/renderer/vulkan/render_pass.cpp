@@ -10,16 +10,38 @@
 namespace flwfrg
 {
 
-VulkanRenderpass::VulkanRenderpass(VulkanContext *context, glm::vec4 draw_area, glm::vec4 clear_color, float depth, uint32_t stencil)
+VulkanRenderpass::VulkanRenderpass(VulkanContext *context, glm::vec4 draw_area, glm::vec4 clear_color, float depth, uint32_t stencil, bool has_previous_pass, bool has_next_pass)
 	: context_{context},
 	  draw_area_{draw_area},
 	  clear_color_{clear_color},
+	  color_format_{context->swapchain_.swapchain_image_format_.format},
+	  depth_format_{context->device_.depth_format_},
+	  load_op_{has_previous_pass ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR},
+	  depth_store_op_{has_next_pass ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE},
+	  dynamic_{context->dynamic_rendering_},
 	  depth{depth},
 	  stencil{stencil},
 	  state_{State::NOT_ALLOCATED}
 {
 	assert(context != nullptr);
-	
+
+	if (dynamic_)
+	{
+		VkDevice device = context->device_.logical_device_;
+		begin_rendering_ = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(vkGetDeviceProcAddr(device, "vkCmdBeginRenderingKHR"));
+		end_rendering_ = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(vkGetDeviceProcAddr(device, "vkCmdEndRenderingKHR"));
+		if (begin_rendering_ == nullptr || end_rendering_ == nullptr)
+		{
+			throw std::runtime_error("Failed to load the dynamic rendering functions");
+		}
+
+		// Pipelines are created against the formats, there is nothing else to create
+		handle_ = VK_NULL_HANDLE;
+		state_ = State::READY;
+		FLOWFORGE_TRACE("Dynamic render pass created successfully");
+		return;
+	}
+
 	// Main subpass
 	VkSubpassDescription main_subpass{};
 	main_subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
@@ -30,14 +52,15 @@ VulkanRenderpass::VulkanRenderpass(VulkanContext *context, glm::vec4 draw_area,
 
 	// Color attachment
 	VkAttachmentDescription color_attachment{};
-	color_attachment.format = context->swapchain_.swapchain_image_format_.format;
+	color_attachment.format = color_format_;
 	color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	color_attachment.loadOp = load_op_;
 	color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// The frame graph moves the attachments into and out of their layouts
+	color_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 	color_attachment.flags = 0;
 
 	attachment_descriptions[0] = color_attachment;
@@ -51,13 +74,13 @@ VulkanRenderpass::VulkanRenderpass(VulkanContext *context, glm::vec4 draw_area,
 
 	// Depth attachment
 	VkAttachmentDescription depth_attachment{};
-	depth_attachment.format = context->device_.depth_format_;
+	depth_attachment.format = depth_format_;
 	depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depth_attachment.loadOp = load_op_;
+	depth_attachment.storeOp = depth_store_op_;
 	depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depth_attachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 	depth_attachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 	attachment_descriptions[1] = depth_attachment;
@@ -79,15 +102,7 @@ VulkanRenderpass::VulkanRenderpass(VulkanContext *context, glm::vec4 draw_area,
 	main_subpass.preserveAttachmentCount = 0;
 	main_subpass.pPreserveAttachments = nullptr;
 
-	// Render pass dependencies
-	VkSubpassDependency subpass_dependency{};
-	subpass_dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	subpass_dependency.dstSubpass = 0;
-	subpass_dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	subpass_dependency.srcAccessMask = 0;
-	subpass_dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	subpass_dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	subpass_dependency.dependencyFlags = 0;
+	// No external dependencies, the frame graph records the barriers around the pass
 
 	// Create info
 	VkRenderPassCreateInfo render_pass_info{};
@@ -96,13 +111,13 @@ VulkanRenderpass::VulkanRenderpass(VulkanContext *context, glm::vec4 draw_area,
 	render_pass_info.pAttachments = attachment_descriptions.data();
 	render_pass_info.subpassCount = 1;
 	render_pass_info.pSubpasses = &main_subpass;
-	render_pass_info.dependencyCount = 1;
-	render_pass_info.pDependencies = &subpass_dependency;
+	render_pass_info.dependencyCount = 0;
+	render_pass_info.pDependencies = nullptr;
 	render_pass_info.pNext = nullptr;
 	render_pass_info.flags = 0;
 
 	// Create the render pass
-	if (vkCreateRenderPass(context->device_.logical_device_, &render_pass_info, nullptr, &handle_) != VK_SUCCESS)
+	if (vkCreateRenderPass(context->device_.logical_device_, &render_pass_info, vulkan_allocator(), &handle_) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create render pass");
 	}
@@ -113,9 +128,9 @@ VulkanRenderpass::VulkanRenderpass(VulkanContext *context, glm::vec4 draw_area,
 
 VulkanRenderpass::~VulkanRenderpass()
 {
-	if (state_ != State::NOT_ALLOCATED)
+	if (state_ != State::NOT_ALLOCATED && handle_ != VK_NULL_HANDLE)
 	{
-		vkDestroyRenderPass(context_->device_.logical_device_, handle_, nullptr);
+		vkDestroyRenderPass(context_->device_.logical_device_, handle_, vulkan_allocator());
 		FLOWFORGE_TRACE("Render pass destroyed");
 	}
 }
@@ -151,6 +166,40 @@ void VulkanRenderpass::begin(VulkanCommandBuffer &command_buffer, VkFramebuffer
 	state_ = State::IN_RENDER_PASS;
 }
 
+void VulkanRenderpass::begin(VulkanCommandBuffer &command_buffer, std::span<const VkImageView> attachments)
+{
+	assert(dynamic_);
+	assert(attachments.size() == 2);
+
+	VkRenderingAttachmentInfoKHR color_attachment{VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR};
+	color_attachment.imageView = attachments[0];
+	color_attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	color_attachment.loadOp = load_op_;
+	color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	color_attachment.clearValue.color = {clear_color_.x, clear_color_.y, clear_color_.z, clear_color_.w};
+
+	VkRenderingAttachmentInfoKHR depth_attachment{VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR};
+	depth_attachment.imageView = attachments[1];
+	depth_attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depth_attachment.loadOp = load_op_;
+	depth_attachment.storeOp = depth_store_op_;
+	depth_attachment.clearValue.depthStencil = {depth, stencil};
+
+	VkRenderingInfoKHR rendering_info{VK_STRUCTURE_TYPE_RENDERING_INFO_KHR};
+	rendering_info.renderArea.offset = {static_cast<int32_t>(draw_area_.x), static_cast<int32_t>(draw_area_.y)};
+	rendering_info.renderArea.extent = {static_cast<uint32_t>(draw_area_.z), static_cast<uint32_t>(draw_area_.w)};
+	rendering_info.layerCount = 1;
+	rendering_info.colorAttachmentCount = 1;
+	rendering_info.pColorAttachments = &color_attachment;
+	// The stencil aspect is never used, so it isn't attached
+	rendering_info.pDepthAttachment = &depth_attachment;
+
+	begin_rendering_(command_buffer.handle_, &rendering_info);
+	command_buffer.state_ = VulkanCommandBuffer::State::IN_RENDER_PASS;
+
+	state_ = State::IN_RENDER_PASS;
+}
+
 void VulkanRenderpass::end(VulkanCommandBuffer &command_buffer)
 {
 	if (state_ != State::IN_RENDER_PASS)
@@ -158,7 +207,13 @@ void VulkanRenderpass::end(VulkanCommandBuffer &command_buffer)
 		throw std::runtime_error("Render pass not in progress");
 	}
 	
-	vkCmdEndRenderPass(command_buffer.handle_);
+	if (dynamic_)
+	{
+		end_rendering_(command_buffer.handle_);
+	} else
+	{
+		vkCmdEndRenderPass(command_buffer.handle_);
+	}
 	
 	command_buffer.state_ = VulkanCommandBuffer::State::RECORDING;
 
@@ -9,6 +9,9 @@
 
 #include <vulkan/vulkan_core.h>
 
+#include <span>
+#include <vector>
+
 namespace flwfrg
 {
 class VulkanFrameBuffer;
@@ -28,7 +31,10 @@ public:
 	};
 	
 public:
-	VulkanRenderpass(VulkanContext *context, glm::vec4 draw_area, glm::vec4 clear_color, float depth, uint32_t stencil);
+	// A pass with a previous pass loads its attachments instead of clearing them,
+	// a pass with a next pass stores its depth attachment. Attachments stay in their attachment layouts.
+	// With dynamic rendering no render pass object is created, the pass is begun on image views directly.
+	VulkanRenderpass(VulkanContext *context, glm::vec4 draw_area, glm::vec4 clear_color, float depth, uint32_t stencil, bool has_previous_pass = false, bool has_next_pass = false);
 	~VulkanRenderpass();
 
 	// Not copyable or movable
@@ -37,11 +43,17 @@ public:
 	VulkanRenderpass(VulkanRenderpass&&) = delete;
 	VulkanRenderpass& operator=(VulkanRenderpass&&) = delete;
 
+	// Null with dynamic rendering
 	[[nodiscard]] inline VkRenderPass get_handle() const { return handle_;};
+	[[nodiscard]] inline bool is_dynamic() const { return dynamic_; };
+	[[nodiscard]] inline VkFormat get_color_format() const { return color_format_; };
+	[[nodiscard]] inline VkFormat get_depth_format() const { return depth_format_; };
 
 	void set_render_area(glm::vec4 draw_area);
 
 	void begin(VulkanCommandBuffer& command_buffer, VkFramebuffer frame_buffer);
+	// Dynamic rendering, the color and depth views in attachment order
+	void begin(VulkanCommandBuffer& command_buffer, std::span<const VkImageView> attachments);
 	void end(VulkanCommandBuffer& command_buffer);
 
 private:
@@ -51,6 +63,15 @@ private:
 	glm::vec4 draw_area_;
 	glm::vec4 clear_color_;
 
+	VkFormat color_format_;
+	VkFormat depth_format_;
+	VkAttachmentLoadOp load_op_;
+	VkAttachmentStoreOp depth_store_op_;
+
+	bool dynamic_;
+	PFN_vkCmdBeginRenderingKHR begin_rendering_ = nullptr;
+	PFN_vkCmdEndRenderingKHR end_rendering_ = nullptr;
+
 	float depth;
 	uint32_t stencil;
 
@@ -0,0 +1,339 @@
+#include "pch.hpp"
+
+#include "render_queue.hpp"
+
+#include "command_buffer.hpp"
+#include "core/frame_arena.hpp"
+#include "core/job_system.hpp"
+#include "shaders/object_shader.hpp"
+
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <utility>
+
+namespace flwfrg
+{
+
+///// Local helper functions
+
+namespace
+{
+
+uint64_t quantize(float value, uint32_t bits)
+{
+	const uint32_t max = (1u << bits) - 1;
+	return static_cast<uint64_t>(std::clamp(value, 0.0f, 1.0f) * static_cast<float>(max));
+}
+
+uint64_t mask(uint32_t value, uint32_t bits)
+{
+	return value & ((1u << bits) - 1);
+}
+
+}// namespace
+
+
+///// Method implementations
+
+uint64_t DrawKey::make(DrawPass pass, DrawPipeline pipeline, uint32_t material, IndexType index_type, MeshHandle mesh, float depth)
+{
+	const uint64_t index_bit = index_type == IndexType::UINT32 ? 1 : 0;
+
+	uint64_t key = uint64_t{static_cast<uint8_t>(pass)} << 60 | uint64_t{static_cast<uint8_t>(pipeline)} << 52;
+	if (pass == DrawPass::TRANSLUCENT)
+	{
+		// Back to front, then by state
+		key |= ((1u << 24) - 1 - quantize(depth, 24)) << 28 | mask(material, 20) << 8 | index_bit << 7 | mask(mesh, 7);
+	} else
+	{
+		// Group by state, then front to back within each instance batch
+		key |= mask(material, 20) << 32 | index_bit << 31 | mask(mesh, 20) << 11 | quantize(depth, 11);
+	}
+	return key;
+}
+
+void RenderQueue::submit(DrawPass pass, DrawPipeline pipeline, MeshHandle mesh, const GeometryRenderData &data, IndexType index_type, float depth, uint32_t lod)
+{
+	submit_instanced(pass, pipeline, mesh, data, index_type, depth, {&data.model, 1}, lod);
+}
+
+void RenderQueue::submit_instanced(DrawPass pass,
+								   DrawPipeline pipeline,
+								   MeshHandle mesh,
+								   const GeometryRenderData &data,
+								   IndexType index_type,
+								   float depth,
+								   std::span<const glm::mat4> transforms,
+								   uint32_t lod)
+{
+	if (transforms.empty())
+		return;
+
+	const uint32_t material = VulkanObjectShader::material_key(data);
+	packets_.push_back({DrawKey::make(pass, pipeline, material, index_type, mesh, depth), static_cast<uint32_t>(draws_.size()), 0});
+	draws_.push_back({mesh, lod, depth, data, static_cast<uint32_t>(transforms_.size()), static_cast<uint32_t>(transforms.size())});
+	transforms_.insert(transforms_.end(), transforms.begin(), transforms.end());
+}
+
+void RenderQueue::sort()
+{
+	std::pmr::memory_resource *memory = frame_allocator_ != nullptr ? frame_allocator_->resource() : std::pmr::get_default_resource();
+	radix_sort(packets_, scratch_, default_sort_chunk_size, job_system_, memory);
+}
+
+void RenderQueue::flush(VulkanCommandBuffer &command_buffer,
+						VulkanGeometryPool &geometry_pool,
+						VulkanInstanceBuffer &instance_buffer,
+						VulkanObjectShader &object_shader)
+{
+	statistics_ = {};
+	if (packets_.empty())
+		return;
+
+	sort();
+	build_batches(geometry_pool, instance_buffer);
+
+	// Every instance lives in the frame's instance slice
+	instance_buffer.bind(command_buffer, 1);
+
+	if (depth_prepass_)
+	{
+		record_depth_prepass(command_buffer, geometry_pool, object_shader);
+	}
+
+	// Every mesh lives in the same vertex buffer
+	geometry_pool.bind_vertex_buffer(command_buffer);
+
+	std::optional<std::pair<DrawPipeline, PipelineVariant>> bound_pipeline{};
+	std::optional<const VulkanTexture *> bound_material{};
+	std::optional<IndexType> bound_index_type{};
+
+	for (const Batch &batch: batches_)
+	{
+		const DrawPacket &packet = packets_[batch.begin];
+		const QueuedDraw &draw = draws_[packet.draw_index];
+		const GeometryMesh &mesh = geometry_pool.get_mesh(draw.mesh);
+
+		// Solid draws only shade what the pre-pass left in the depth buffer
+		const bool depth_tested = depth_prepass_ && DrawKey::pass(packet.key) == DrawPass::SOLID;
+		const std::pair pipeline{DrawKey::pipeline(packet.key), depth_tested ? PipelineVariant::DEPTH_EQUAL : PipelineVariant::DEFAULT};
+
+		// Only bind what changed since the previous batch
+		if (bound_pipeline != pipeline)
+		{
+			object_shader.use(pipeline.second);
+			bound_pipeline = pipeline;
+			bound_material.reset();
+			statistics_.pipeline_binds++;
+		}
+		// Objects only differ in their material index within a material, which the instances carry
+		const VulkanTexture *material = VulkanObjectShader::diffuse_texture(draw.data);
+		if (bound_material != material)
+		{
+			object_shader.bind_object(draw.data);
+			bound_material = material;
+			statistics_.descriptor_binds++;
+		}
+		if (bound_index_type != mesh.index_type)
+		{
+			geometry_pool.bind_index_buffer(command_buffer, mesh.index_type);
+			bound_index_type = mesh.index_type;
+			statistics_.index_buffer_binds++;
+		}
+
+		assert(draw.lod < mesh.lod_count);
+		const MeshLod &lod = mesh.lods[draw.lod];
+		vkCmdDrawIndexed(command_buffer.get_handle(), lod.index_count, batch.instance_count, lod.first_index, mesh.vertex_offset, batch.first_instance);
+		statistics_.draws++;
+		statistics_.instances += batch.instance_count;
+		statistics_.triangles += uint64_t{lod.index_count} / 3 * batch.instance_count;
+	}
+
+	packets_.clear();
+	draws_.clear();
+	transforms_.clear();
+	batches_.clear();
+}
+
+///// Private methods
+
+void RenderQueue::build_batches(const VulkanGeometryPool &geometry_pool, VulkanInstanceBuffer &instance_buffer)
+{
+	batches_.clear();
+
+	for (size_t batch_begin = 0; batch_begin < packets_.size();)
+	{
+		const DrawPacket &packet = packets_[batch_begin];
+		const QueuedDraw &draw = draws_[packet.draw_index];
+		const DrawPass pass = DrawKey::pass(packet.key);
+		const DrawPipeline pipeline = DrawKey::pipeline(packet.key);
+
+		// Extend the batch over every following draw with the same pass, pipeline, mesh, level and material.
+		// Passes draw with different state, and solid batches are the only ones the depth pre-pass records.
+		// Objects of one material keep their own uniforms through the material index of their instances.
+		const VulkanTexture *material = VulkanObjectShader::diffuse_texture(draw.data);
+		size_t batch_end = batch_begin + 1;
+		uint32_t instance_count = draw.transform_count;
+		float depth = draw.depth;
+		while (batch_end < packets_.size())
+		{
+			const DrawPacket &next_packet = packets_[batch_end];
+			const QueuedDraw &next = draws_[next_packet.draw_index];
+			if (DrawKey::pass(next_packet.key) != pass || DrawKey::pipeline(next_packet.key) != pipeline ||
+				next.mesh != draw.mesh || next.lod != draw.lod || VulkanObjectShader::diffuse_texture(next.data) != material)
+				break;
+
+			instance_count += next.transform_count;
+			depth = std::min(depth, next.depth);
+			batch_end++;
+		}
+
+		// Write the batch's transforms into the instance buffer. Smaller batches after one that didn't fit may still do.
+		uint32_t first_instance = 0;
+		std::span<InstanceData> instances = instance_buffer.allocate(instance_count, first_instance);
+		if (instances.empty())
+		{
+			statistics_.dropped_draws += static_cast<uint32_t>(batch_end - batch_begin);
+			statistics_.dropped_instances += instance_count;
+			batch_begin = batch_end;
+			continue;
+		}
+
+		size_t instance_index = 0;
+		for (size_t i = batch_begin; i < batch_end; i++)
+		{
+			const QueuedDraw &batch_draw = draws_[packets_[i].draw_index];
+			const glm::mat4 dequantization = geometry_pool.get_mesh(batch_draw.mesh).quantization.dequantization_matrix();
+			for (uint32_t t = 0; t < batch_draw.transform_count; t++)
+			{
+				InstanceData &instance = instances[instance_index++];
+				instance.model = transforms_[batch_draw.first_transform + t] * dequantization;
+				instance.material = glm::uvec4(batch_draw.data.object_id, 0, 0, 0);
+			}
+		}
+
+		batches_.push_back({batch_begin, batch_end, first_instance, instance_count, depth});
+		batch_begin = batch_end;
+	}
+
+	if (statistics_.dropped_draws > 0 && !overflow_reported_)
+	{
+		FLOWFORGE_WARN("Instance buffer is full ({} instances per frame), dropped {} draws with {} instances",
+					   instance_buffer.capacity(),
+					   statistics_.dropped_draws,
+					   statistics_.dropped_instances);
+		overflow_reported_ = true;
+	}
+}
+
+void RenderQueue::record_depth_prepass(VulkanCommandBuffer &command_buffer, VulkanGeometryPool &geometry_pool, VulkanObjectShader &object_shader)
+{
+	// Solid packets sort first, their batches are the leading ones
+	prepass_order_.clear();
+	for (uint32_t i = 0; i < batches_.size() && DrawKey::pass(packets_[batches_[i].begin].key) == DrawPass::SOLID; i++)
+	{
+		prepass_order_.push_back(i);
+	}
+	if (prepass_order_.empty())
+		return;
+
+	// The depth only pipeline has a single state, so the batches are free to go front to back
+	std::sort(prepass_order_.begin(), prepass_order_.end(), [this](uint32_t a, uint32_t b) {
+		return batches_[a].depth < batches_[b].depth;
+	});
+
+	// Positions only, materials are not needed
+	geometry_pool.bind_position_buffer(command_buffer);
+	object_shader.use(PipelineVariant::DEPTH_ONLY);
+	statistics_.pipeline_binds++;
+
+	std::optional<IndexType> bound_index_type{};
+	for (uint32_t batch_index: prepass_order_)
+	{
+		const Batch &batch = batches_[batch_index];
+		const QueuedDraw &draw = draws_[packets_[batch.begin].draw_index];
+		const GeometryMesh &mesh = geometry_pool.get_mesh(draw.mesh);
+
+		if (bound_index_type != mesh.index_type)
+		{
+			geometry_pool.bind_index_buffer(command_buffer, mesh.index_type);
+			bound_index_type = mesh.index_type;
+			statistics_.index_buffer_binds++;
+		}
+
+		const MeshLod &lod = mesh.lods[draw.lod];
+		vkCmdDrawIndexed(command_buffer.get_handle(), lod.index_count, batch.instance_count, lod.first_index, mesh.vertex_offset, batch.first_instance);
+		statistics_.prepass_draws++;
+	}
+}
+
+void radix_sort(std::vector<DrawPacket> &packets, std::vector<DrawPacket> &scratch, size_t chunk_size, JobSystem *job_system, std::pmr::memory_resource *memory)
+{
+	const size_t count = packets.size();
+	if (count < 2)
+		return;
+
+	scratch.resize(count);
+	const size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+	std::pmr::vector<std::array<uint32_t, 256>> histograms(chunk_count, memory);
+
+	// Bits that differ between any two keys
+	uint64_t differing_bits = 0;
+	for (const DrawPacket &packet: packets)
+	{
+		differing_bits |= packet.key ^ packets[0].key;
+	}
+
+	for (uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		// Every key has the same digit here, the pass wouldn't move anything
+		if (((differing_bits >> shift) & 0xFF) == 0)
+			continue;
+
+		// Count the digits of each chunk
+		parallel_for(job_system, 0, static_cast<uint32_t>(chunk_count), 1, [&](uint32_t first_chunk, uint32_t last_chunk) {
+			for (size_t chunk = first_chunk; chunk < last_chunk; chunk++)
+			{
+				std::array<uint32_t, 256> &histogram = histograms[chunk];
+				histogram.fill(0);
+
+				const size_t end = std::min(count, (chunk + 1) * chunk_size);
+				for (size_t i = chunk * chunk_size; i < end; i++)
+				{
+					histogram[(packets[i].key >> shift) & 0xFF]++;
+				}
+			}
+		});
+
+		// Turn the counts into output offsets. Digit major, then chunk order, which keeps the sort stable.
+		uint32_t offset = 0;
+		for (size_t digit = 0; digit < 256; digit++)
+		{
+			for (size_t chunk = 0; chunk < chunk_count; chunk++)
+			{
+				const uint32_t digit_count = histograms[chunk][digit];
+				histograms[chunk][digit] = offset;
+				offset += digit_count;
+			}
+		}
+
+		// Scatter, each chunk writes to its own ranges
+		parallel_for(job_system, 0, static_cast<uint32_t>(chunk_count), 1, [&](uint32_t first_chunk, uint32_t last_chunk) {
+			for (size_t chunk = first_chunk; chunk < last_chunk; chunk++)
+			{
+				std::array<uint32_t, 256> &histogram = histograms[chunk];
+
+				const size_t end = std::min(count, (chunk + 1) * chunk_size);
+				for (size_t i = chunk * chunk_size; i < end; i++)
+				{
+					scratch[histogram[(packets[i].key >> shift) & 0xFF]++] = packets[i];
+				}
+			}
+		});
+
+		packets.swap(scratch);
+	}
+}
+
+}// namespace flwfrg
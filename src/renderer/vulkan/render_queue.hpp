@@ -0,0 +1,172 @@
+#pragma once
+
+#include "geometry_pool.hpp"
+#include "instance_buffer.hpp"
+#include "shaders/object_types.inl"
+
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <vector>
+
+namespace flwfrg
+{
+class FrameAllocator;
+class JobSystem;
+class VulkanCommandBuffer;
+class VulkanObjectShader;
+
+enum class DrawPass : uint8_t
+{
+	SOLID = 0,
+	TRANSLUCENT = 1,
+	OVERLAY = 2
+};
+
+enum class DrawPipeline : uint8_t
+{
+	OBJECT = 0
+};
+
+/// <summary>
+/// 64 bit draw sort key. From the most significant bit:
+/// pass (4) | pipeline (8) | material (20) | index type (1) | mesh (20) | depth (11).
+/// Equal meshes and materials end up next to each other so they can be drawn instanced.
+/// Translucent draws use pass | pipeline | inverted depth (24) | material (20) | index type (1) | mesh (7),
+/// so they sort back to front.
+/// </summary>
+struct DrawKey
+{
+	static uint64_t make(DrawPass pass, DrawPipeline pipeline, uint32_t material, IndexType index_type, MeshHandle mesh, float depth);
+
+	[[nodiscard]] static constexpr DrawPass pass(uint64_t key) { return static_cast<DrawPass>(key >> 60); }
+	[[nodiscard]] static constexpr DrawPipeline pipeline(uint64_t key) { return static_cast<DrawPipeline>((key >> 52) & 0xFF); }
+};
+
+/// <summary>
+/// Compact entry that is sorted, the draw data itself stays in place.
+/// </summary>
+struct DrawPacket
+{
+	uint64_t key;
+	uint32_t draw_index;
+	uint32_t _reserved;
+};
+static_assert(sizeof(DrawPacket) == 16);
+
+struct RenderQueueStatistics
+{
+	uint32_t draws = 0;
+	uint32_t instances = 0;
+	uint32_t pipeline_binds = 0;
+	uint32_t descriptor_binds = 0;
+	uint32_t index_buffer_binds = 0;
+	uint64_t triangles = 0;
+	// Draws recorded by the depth pre-pass, not counted in draws
+	uint32_t prepass_draws = 0;
+	// Queued draws skipped because the frame's instance buffer slice was full
+	uint32_t dropped_draws = 0;
+	uint32_t dropped_instances = 0;
+};
+
+/// <summary>
+/// Collects the draws of a frame, sorts them by key and records them with as few state changes as possible.
+/// With the depth pre-pass enabled, solid draws are first recorded front to back into depth only, then shaded
+/// with an equal depth test, so every covered pixel of them is shaded once.
+/// </summary>
+class RenderQueue
+{
+public:
+	RenderQueue() = default;
+
+	// Methods
+
+	// Depth is the normalized view depth in [0, 1], lod the detail level of the mesh to draw
+	void submit(DrawPass pass, DrawPipeline pipeline, MeshHandle mesh, const GeometryRenderData &data, IndexType index_type, float depth, uint32_t lod = 0);
+	// Draws the mesh once per transform. The model matrix in data is ignored.
+	void submit_instanced(DrawPass pass,
+						  DrawPipeline pipeline,
+						  MeshHandle mesh,
+						  const GeometryRenderData &data,
+						  IndexType index_type,
+						  float depth,
+						  std::span<const glm::mat4> transforms,
+						  uint32_t lod = 0);
+
+	void sort();
+	// Records every queued draw into the command buffer and clears the queue.
+	// Consecutive draws of the same mesh, detail level and material are collapsed into one instanced draw.
+	void flush(VulkanCommandBuffer &command_buffer,
+			   VulkanGeometryPool &geometry_pool,
+			   VulkanInstanceBuffer &instance_buffer,
+			   VulkanObjectShader &object_shader);
+
+	void set_depth_prepass(bool enabled) { depth_prepass_ = enabled; };
+	// Sorts on the calling thread alone without one
+	void set_job_system(JobSystem *job_system) { job_system_ = job_system; };
+	// Scratch memory of the sort comes from the frame's arena, from the heap without one
+	void set_frame_allocator(FrameAllocator *frame_allocator) { frame_allocator_ = frame_allocator; };
+
+	[[nodiscard]] inline bool is_depth_prepass_enabled() const { return depth_prepass_; };
+	[[nodiscard]] inline size_t size() const { return packets_.size(); };
+	[[nodiscard]] inline const RenderQueueStatistics &statistics() const { return statistics_; };
+
+private:
+	struct QueuedDraw
+	{
+		MeshHandle mesh;
+		uint32_t lod;
+		float depth;
+		GeometryRenderData data;
+		// Range in transforms_
+		uint32_t first_transform;
+		uint32_t transform_count;
+	};
+
+	std::vector<DrawPacket> packets_{};
+	std::vector<DrawPacket> scratch_{};
+	std::vector<QueuedDraw> draws_{};
+	std::vector<glm::mat4> transforms_{};
+
+	// Consecutive packets drawn with one instanced draw
+	struct Batch
+	{
+		size_t begin;
+		size_t end;
+		uint32_t first_instance;
+		uint32_t instance_count;
+		// Of the closest draw
+		float depth;
+	};
+
+	std::vector<Batch> batches_{};
+	// Solid batches, front to back
+	std::vector<uint32_t> prepass_order_{};
+
+	bool depth_prepass_ = false;
+	JobSystem *job_system_ = nullptr;
+	FrameAllocator *frame_allocator_ = nullptr;
+
+	RenderQueueStatistics statistics_{};
+	// Dropped draws are only logged the first time
+	bool overflow_reported_ = false;
+
+	///// Private methods
+
+	// Splits the sorted packets into batches and writes their transforms, with the dequantization of their mesh, to the instance buffer
+	void build_batches(const VulkanGeometryPool &geometry_pool, VulkanInstanceBuffer &instance_buffer);
+	void record_depth_prepass(VulkanCommandBuffer &command_buffer, VulkanGeometryPool &geometry_pool, VulkanObjectShader &object_shader);
+};
+
+constexpr size_t default_sort_chunk_size = 4096;
+
+// Stable LSD radix sort on the packet keys. Digits every key agrees on are skipped.
+// Histograms and scatters work on independent chunks of chunk_size packets, which are spread over the jobs of job_system when there is one.
+// The histograms are allocated from memory.
+void radix_sort(std::vector<DrawPacket> &packets,
+				std::vector<DrawPacket> &scratch,
+				size_t chunk_size = default_sort_chunk_size,
+				JobSystem *job_system = nullptr,
+				std::pmr::memory_resource *memory = std::pmr::get_default_resource());
+
+}// namespace flwfrg
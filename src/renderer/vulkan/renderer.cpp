@@ -2,11 +2,43 @@
 
 #include "renderer.hpp"
 
+#include "core/allocation_tracker.hpp"
+#include "core/job_system.hpp"
+
 #include <imgui_impl_glfw.h>
 
+#include <algorithm>
+#include <chrono>
+
 namespace flwfrg
 {
 
+///// Local helper functions
+
+namespace
+{
+
+const char *present_mode_name(VkPresentModeKHR present_mode)
+{
+	switch (present_mode)
+	{
+		case VK_PRESENT_MODE_IMMEDIATE_KHR:
+			return "immediate";
+		case VK_PRESENT_MODE_MAILBOX_KHR:
+			return "mailbox";
+		case VK_PRESENT_MODE_FIFO_KHR:
+			return "FIFO";
+		case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+			return "FIFO relaxed";
+		default:
+			return "other";
+	}
+}
+
+}// namespace
+
+///// Method implementations
+
 VulkanRenderer::VulkanRenderer(uint32_t initial_width, uint32_t initial_height, std::string window_name)
 	: window_name_(std::move(window_name)), window_(initial_width, initial_height, window_name_), vulkan_context_(window_)
 {
@@ -14,100 +46,453 @@ VulkanRenderer::VulkanRenderer(uint32_t initial_width, uint32_t initial_height,
 	default_diffuse_ = &state_.default_texture;
 	vulkan_context_.object_shader_ = std::move(VulkanObjectShader(&vulkan_context_, default_diffuse_));
 	vulkan_context_.init_imgui();
+
+	frame_scales_.resize(vulkan_context_.get_swapchain().get_max_frames_in_flight(), 1.0f);
+	render_extent_ = vulkan_context_.get_swapchain().get_extent();
+	render_queue_.set_frame_allocator(&frame_allocator_);
 }
 VulkanRenderer::~VulkanRenderer()
 {
+	set_render_thread(false);
 }
 
 bool VulkanRenderer::begin_frame(float delta_time)
 {
-	vulkan_context_.frame_delta_time_ = delta_time;
-	
+	// Nothing changed since the last frame, wait for events instead of drawing the same image again
+	if (on_demand_ && !needs_redraw())
+	{
+		glfwWaitEventsTimeout(idle_timeout_seconds_);
+		if (!needs_redraw())
+		{
+			skipped_frames_++;
+			return false;
+		}
+	}
+
+	// Every wait happens before input is polled, so the frame is built from the latest input.
+	// The render thread does the GPU waits itself, the simulation only waits for it to take the last packet.
+	if (!render_thread_enabled_)
+	{
+		std::lock_guard lock{render_mutex_};
+		if (!vulkan_context_.get_current_frame_fence_in_flight().wait(std::numeric_limits<uint64_t>::max()))
+		{
+			FLOWFORGE_WARN("Failure to wait for fence in flight");
+			return false;
+		}
+		wait_for_displayed_frame();
+	}
+	frame_pacer_.wait_for_frame_slot();
+
 	glfwPollEvents();
+	RenderPacket &packet = packets_[write_packet_];
+	packet.input_time = frame_pacer_.mark_input();
+	needs_redraw();
 	if (window_.should_close())
 		return false;
 
-	// Wait for the fence of the frame we wish to write to.
-	if (!vulkan_context_.get_current_frame_fence_in_flight().wait(std::numeric_limits<uint64_t>::max()))
+	// A minimized window can't be rendered to, so sleep until events arrive instead of spinning
+	if (window_.get_width() == 0 || window_.get_height() == 0)
 	{
-		FLOWFORGE_WARN("Failure to wait for fence in flight");
+		glfwWaitEvents();
 		return false;
 	}
 
-	// Get the next image index
-	if (!vulkan_context_.swapchain_.acquire_next_image(
-				std::numeric_limits<uint64_t>::max(),
-				vulkan_context_.image_avaliable_semaphores_[vulkan_context_.current_frame_],
-				VK_NULL_HANDLE,
-				&vulkan_context_.image_index_))
+	packet.delta_time = delta_time;
+
+	ImGui_ImplVulkan_NewFrame();
+	ImGui_ImplGlfw_NewFrame();
+	ImGui::NewFrame();
+
+	ImGui::ShowDemoWindow();
+
+	return true;
+}
+
+void VulkanRenderer::update_global_state(glm::mat4 projection, glm::mat4 view)
+{
+	RenderPacket &packet = packets_[write_packet_];
+	if (projection != packet.projection || view != packet.view)
+		request_redraw();
+
+	// Applied when the packet is rendered, the UBO is written into the frame's command buffer
+	packet.projection = projection;
+	packet.view = view;
+}
+
+void VulkanRenderer::update_projection(glm::mat4 projection)
+{
+	RenderPacket &packet = packets_[write_packet_];
+	if (projection != packet.projection)
+		request_redraw();
+
+	packet.projection = projection;
+}
+
+void VulkanRenderer::update_view(glm::mat4 view)
+{
+	RenderPacket &packet = packets_[write_packet_];
+	if (view != packet.view)
+		request_redraw();
+
+	packet.view = view;
+}
+
+void VulkanRenderer::update_near_clip(float near_clip)
+{
+	RenderPacket &packet = packets_[write_packet_];
+	if (near_clip != packet.near_clip)
+		request_redraw();
+
+	packet.near_clip = near_clip;
+}
+
+void VulkanRenderer::update_far_clip(float far_clip)
+{
+	RenderPacket &packet = packets_[write_packet_];
+	if (far_clip != packet.far_clip)
+		request_redraw();
+
+	packet.far_clip = far_clip;
+}
+
+std::optional<std::vector<MeshHandle>> VulkanRenderer::load_mesh_asset(const std::string &path)
+{
+	std::optional<MeshAsset> asset = MeshAsset::open(path);
+	if (!asset.has_value())
 	{
-		FLOWFORGE_WARN("Failed to acquire next image");
-		return false;
+		FLOWFORGE_ERROR("Failed to load mesh asset: {}", path);
+		return std::nullopt;
 	}
 
-	VulkanCommandBuffer &command_buffer = vulkan_context_.graphics_command_buffers_[vulkan_context_.image_index_];
-	command_buffer.reset();
-	command_buffer.begin(false, false, false);
+	// The mapping is only needed until the upload is done. Uploads use the graphics queue, which the render thread submits to.
+	request_redraw();
+	std::lock_guard lock{render_mutex_};
+	return vulkan_context_.get_geometry_pool().upload_mesh_asset(asset.value());
+}
 
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = static_cast<float>(window_.get_width());
-	viewport.height = static_cast<float>(window_.get_height());
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
+std::optional<MeshHandle> VulkanRenderer::load_mesh(const MeshData &mesh)
+{
+	request_redraw();
+	std::lock_guard lock{render_mutex_};
+	return vulkan_context_.get_geometry_pool().upload_mesh(mesh);
+}
 
-	VkRect2D scissor{};
-	scissor.offset = {0, 0};
-	scissor.extent = {window_.get_width(), window_.get_height()};
+void VulkanRenderer::draw_mesh(MeshHandle mesh, const GeometryRenderData &data, DrawPass pass, uint32_t *lod_level)
+{
+	// Meshes are only added on this thread, reading them doesn't need the render thread to be idle
+	const GeometryMesh &geometry = vulkan_context_.get_geometry_pool().get_mesh(mesh);
 
-	vkCmdSetViewport(command_buffer.get_handle(), 0, 1, &viewport);
-	vkCmdSetScissor(command_buffer.get_handle(), 0, 1, &scissor);
+	// The sphere is scaled by the largest axis so it stays tight under rotation
+	const glm::vec3 center = glm::vec3(data.model * glm::vec4(geometry.bounds.center(), 1.0f));
+	const float scale = std::max({glm::length(glm::vec3(data.model[0])), glm::length(glm::vec3(data.model[1])), glm::length(glm::vec3(data.model[2]))});
+
+	packets_[write_packet_].draws.push_back({mesh, data, pass, center, geometry.bounds.radius() * scale, scale, lod_level});
+}
+
+void VulkanRenderer::cull_pending_draws(RenderPacket &packet)
+{
+	for (const RenderPacket::Draw &draw: packet.draws)
+	{
+		const GeometryMesh &geometry = vulkan_context_.get_geometry_pool().get_mesh(draw.mesh);
+		const MeshBounds box = geometry.bounds.transformed(draw.data.model);
+		frustum_culler_.add(draw.center, draw.radius, box.min, box.max);
+	}
+	frustum_culler_.cull(Frustum::from_view_projection(state_.projection * state_.view), visible_draws_);
 
-	vulkan_context_.main_renderpass_.set_render_area({0, 0, window_.get_width(), window_.get_height()});
+	for (CullObjectHandle visible: visible_draws_)
+	{
+		const RenderPacket::Draw &draw = packet.draws[visible];
+		const GeometryMesh &geometry = vulkan_context_.get_geometry_pool().get_mesh(draw.mesh);
 
-	// Begin the render pass.
-	vulkan_context_.main_renderpass_.begin(command_buffer, vulkan_context_.get_frame_buffer_handle());
+		const glm::vec3 view_center = glm::vec3(state_.view * glm::vec4(draw.center, 1.0f));
+		const uint32_t previous = draw.lod_level != nullptr ? *draw.lod_level : LodSelector::no_level;
+		const uint32_t lod = lod_selector_.select(geometry.detail_levels(), lod_selector_.distance(view_center, draw.radius), draw.scale, previous);
+		if (draw.lod_level != nullptr)
+			*draw.lod_level = lod;
 
-	ImGui_ImplVulkan_NewFrame();
-	ImGui_ImplGlfw_NewFrame();
-	ImGui::NewFrame();
+		render_queue_.submit(draw.pass, DrawPipeline::OBJECT, draw.mesh, draw.data, geometry.index_type, view_depth(geometry, draw.data.model), lod);
+	}
 
-	ImGui::ShowDemoWindow();
+	frustum_culler_.clear();
 
-	return true;
+	for (const RenderPacket::InstancedDraw &draw: packet.instanced_draws)
+	{
+		submit_instanced_draw(draw.mesh, draw.data, {packet.instance_transforms.data() + draw.first_transform, draw.transform_count}, draw.pass);
+	}
 }
-void VulkanRenderer::update_global_state(glm::mat4 projection, glm::mat4 view)
+
+void VulkanRenderer::draw_mesh_instanced(MeshHandle mesh, const GeometryRenderData &data, std::span<const glm::mat4> transforms, DrawPass pass)
 {
-	// Get the current command buffer
-	VulkanCommandBuffer &command_buffer = vulkan_context_.get_command_buffer();
+	if (transforms.empty())
+		return;
 
-	vulkan_context_.object_shader_.use();
+	RenderPacket &packet = packets_[write_packet_];
+	packet.instanced_draws.push_back({mesh, data, pass, static_cast<uint32_t>(packet.instance_transforms.size()), static_cast<uint32_t>(transforms.size())});
+	packet.instance_transforms.insert(packet.instance_transforms.end(), transforms.begin(), transforms.end());
+}
+
+void VulkanRenderer::submit_instanced_draw(MeshHandle mesh, const GeometryRenderData &data, std::span<const glm::mat4> transforms, DrawPass pass)
+{
+	const GeometryMesh &geometry = vulkan_context_.get_geometry_pool().get_mesh(mesh);
+
+	// The closest instance decides the detail level of all of them
+	float distance = std::numeric_limits<float>::max();
+	float scale = 0.0f;
+	for (const glm::mat4 &model: transforms)
+	{
+		const float model_scale = std::max({glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))});
+		const glm::vec3 view_center = glm::vec3(state_.view * model * glm::vec4(geometry.bounds.center(), 1.0f));
+		distance = std::min(distance, lod_selector_.distance(view_center, geometry.bounds.radius() * model_scale));
+		scale = std::max(scale, model_scale);
+	}
+	const uint32_t lod = lod_selector_.select(geometry.detail_levels(), distance, scale);
+
+	// The whole batch is sorted by its first instance
+	render_queue_.submit_instanced(pass, DrawPipeline::OBJECT, mesh, data, geometry.index_type, view_depth(geometry, transforms[0]), transforms, lod);
+}
+
+std::optional<GpuObjectHandle> VulkanRenderer::add_gpu_object(MeshHandle mesh, const GeometryRenderData &data)
+{
+	request_redraw();
+	std::lock_guard lock{render_mutex_};
+	return gpu_scene_.add_object(mesh, data);
+}
+
+void VulkanRenderer::set_gpu_object_transform(GpuObjectHandle object, const glm::mat4 &model)
+{
+	request_redraw();
+	packets_[write_packet_].object_transforms.emplace_back(object, model);
+}
+
+void VulkanRenderer::set_gpu_object_visible(GpuObjectHandle object, bool visible)
+{
+	request_redraw();
+	packets_[write_packet_].object_visibility.emplace_back(object, visible);
+}
+
+TransformNode VulkanRenderer::add_transform_node(const glm::mat4 &local, std::optional<TransformNode> parent, const glm::vec4 &local_bounds)
+{
+	request_redraw();
+	std::lock_guard lock{render_mutex_};
+	node_objects_.push_back(no_gpu_object);
+	return transform_hierarchy_.add(local, local_bounds, parent);
+}
+
+void VulkanRenderer::set_transform_node_local(TransformNode node, const glm::mat4 &local)
+{
+	request_redraw();
+	packets_[write_packet_].node_locals.emplace_back(node, local);
+}
+
+void VulkanRenderer::attach_gpu_object(GpuObjectHandle object, TransformNode node)
+{
+	std::lock_guard lock{render_mutex_};
+	node_objects_[node] = object;
+	gpu_scene_.set_transform(object, transform_hierarchy_.world(node));
+}
 
-	vulkan_context_.object_shader_.global_ubo.projection = projection;
-	vulkan_context_.object_shader_.global_ubo.view = view;
+void VulkanRenderer::apply_packet(const RenderPacket &packet)
+{
+	state_.projection = packet.projection;
+	state_.view = packet.view;
+	state_.near_clip = packet.near_clip;
+	state_.far_clip = packet.far_clip;
+	vulkan_context_.frame_delta_time_ = packet.delta_time;
+	update_lod_selector();
 
+	vulkan_context_.object_shader_.use();
+	vulkan_context_.object_shader_.global_ubo.projection = state_.projection;
+	vulkan_context_.object_shader_.global_ubo.view = state_.view;
 	vulkan_context_.object_shader_.update_global_state(vulkan_context_.get_delta_time());
+
+	for (const auto &[object, model]: packet.object_transforms)
+	{
+		gpu_scene_.set_transform(object, model);
+	}
+	for (const auto &[object, visible]: packet.object_visibility)
+	{
+		gpu_scene_.set_visible(object, visible);
+	}
+	for (const auto &[node, local]: packet.node_locals)
+	{
+		transform_hierarchy_.set_local(node, local);
+	}
 }
 
-void VulkanRenderer::update_projection(glm::mat4 projection)
+void VulkanRenderer::update_transform_hierarchy()
 {
-	state_.projection = projection;
+	// Only the nodes below a changed one were recomputed
+	transform_hierarchy_.update();
+	for (TransformNode node: transform_hierarchy_.changed().indices())
+	{
+		if (node_objects_[node] != no_gpu_object)
+			gpu_scene_.set_transform(node_objects_[node], transform_hierarchy_.world(node));
+	}
 }
 
-void VulkanRenderer::update_view(glm::mat4 view)
+void VulkanRenderer::set_job_system(JobSystem *job_system)
 {
-	state_.view = view;
+	std::lock_guard lock{render_mutex_};
+	job_system_ = job_system;
+	frustum_culler_.set_job_system(job_system);
+	transform_hierarchy_.set_job_system(job_system);
+	render_queue_.set_job_system(job_system);
 }
 
-void VulkanRenderer::update_near_clip(float near_clip)
+void VulkanRenderer::set_lod_settings(const LodSelector::Settings &settings)
 {
-	state_.near_clip = near_clip;
+	std::lock_guard lock{render_mutex_};
+	lod_selector_ = LodSelector(settings);
+	update_lod_selector();
 }
 
-void VulkanRenderer::update_far_clip(float far_clip)
+void VulkanRenderer::set_depth_prepass(bool enabled)
+{
+	std::lock_guard lock{render_mutex_};
+	render_queue_.set_depth_prepass(enabled);
+}
+
+void VulkanRenderer::set_dynamic_resolution(bool enabled, UpscaleFilter filter)
+{
+	std::lock_guard lock{render_mutex_};
+	// Start from full resolution, the times measured before don't apply anymore
+	dynamic_resolution_ = enabled;
+	upscale_filter_ = filter;
+	resolution_scaler_.reset();
+}
+
+void VulkanRenderer::set_resolution_settings(const ResolutionScaler::Settings &settings)
+{
+	std::lock_guard lock{render_mutex_};
+	resolution_scaler_ = ResolutionScaler(settings);
+}
+
+void VulkanRenderer::set_present_mode(VkPresentModeKHR present_mode)
+{
+	std::lock_guard lock{render_mutex_};
+	vulkan_context_.swapchain_.set_present_mode(present_mode);
+}
+
+void VulkanRenderer::set_frames_in_flight(uint8_t frames_in_flight)
+{
+	std::lock_guard lock{render_mutex_};
+	vulkan_context_.swapchain_.set_frames_in_flight(frames_in_flight);
+}
+
+void VulkanRenderer::set_frame_limit(float max_fps)
+{
+	frame_pacer_.set_frame_limit(max_fps);
+}
+
+void VulkanRenderer::set_present_wait(bool enabled)
 {
-	state_.far_clip = far_clip;
+	if (enabled && !vulkan_context_.get_swapchain().supports_present_wait())
+	{
+		FLOWFORGE_WARN("Present wait is not supported by the device");
+		enabled = false;
+	}
+	std::lock_guard lock{render_mutex_};
+	present_wait_ = enabled;
+}
+
+void VulkanRenderer::set_low_latency_mode(bool enabled)
+{
+	set_frames_in_flight(enabled ? 1 : VulkanSwapchain::default_frames_in_flight);
+	set_present_wait(enabled);
+}
+
+void VulkanRenderer::set_on_demand_rendering(bool enabled, float idle_timeout_seconds)
+{
+	on_demand_ = enabled;
+	idle_timeout_seconds_ = std::max(idle_timeout_seconds, 0.0f);
+	request_redraw();
+}
+
+void VulkanRenderer::set_render_thread(bool enabled)
+{
+	if (enabled == render_thread_enabled_)
+		return;
+
+	if (enabled)
+	{
+		stop_render_thread_ = false;
+		render_thread_enabled_ = true;
+		render_thread_ = std::thread([this]() { render_loop(); });
+		return;
+	}
+
+	// Renders the packet that is still queued, then the simulation records frames itself again
+	{
+		std::lock_guard lock{packet_mutex_};
+		stop_render_thread_ = true;
+	}
+	packet_condition_.notify_all();
+	render_thread_.join();
+	render_thread_enabled_ = false;
+
+	// The packet being written becomes a regular frame, its UI is captured when it ends
+	packets_[write_packet_ ^ 1].clear();
+}
+
+void VulkanRenderer::request_redraw()
+{
+	// Only the first request since the last frame has to wake the wait
+	if (!redraw_requested_.exchange(true, std::memory_order_relaxed))
+		glfwPostEmptyEvent();
+}
+
+bool VulkanRenderer::needs_redraw()
+{
+	const uint64_t event_count = window_.get_event_count();
+	if (event_count != seen_event_count_ || redraw_requested_.exchange(false, std::memory_order_relaxed))
+	{
+		seen_event_count_ = event_count;
+		redraw_frames_ = redraw_settle_frames_;
+	}
+	return redraw_frames_ > 0;
+}
+
+void VulkanRenderer::wait_for_displayed_frame()
+{
+	if (!present_wait_)
+		return;
+
+	// Frames in flight minus one presents may still be queued, the one before them has to be on screen
+	const VulkanSwapchain &swapchain = vulkan_context_.get_swapchain();
+	const uint64_t queued = swapchain.get_frames_in_flight() - 1;
+	if (swapchain.get_present_id() <= queued)
+		return;
+
+	// The time the wait returns is the closest the display time is known without present timing
+	const uint64_t present_id = swapchain.get_present_id() - queued;
+	if (swapchain.wait_for_present(present_id, present_wait_timeout_ns_))
+		frame_pacer_.mark_displayed(present_id, FramePacer::Clock::now());
+}
+
+void VulkanRenderer::update_lod_selector()
+{
+	// Detail levels are picked with the projection and viewport the frame is drawn with
+	lod_selector_.update(state_.projection, static_cast<float>(render_extent_.height), state_.near_clip, state_.far_clip);
+}
+
+void VulkanRenderer::update_render_extent()
+{
+	const VkExtent2D extent = vulkan_context_.get_swapchain().get_extent();
+	if (dynamic_resolution_)
+	{
+		const glm::uvec2 size = resolution_scaler_.scaled_size(extent.width, extent.height);
+		render_extent_ = {std::min(size.x, extent.width), std::min(size.y, extent.height)};
+	} else
+	{
+		render_extent_ = extent;
+	}
+}
+
+float VulkanRenderer::view_depth(const GeometryMesh &mesh, const glm::mat4 &model) const
+{
+	// Normalized view depth of the bounds center, the camera looks down negative z
+	const glm::vec4 view_position = state_.view * model * glm::vec4(mesh.bounds.center(), 1.0f);
+	return (-view_position.z - state_.near_clip) / (state_.far_clip - state_.near_clip);
 }
 
 void VulkanRenderer::generate_default_texture()
@@ -134,13 +519,371 @@ void VulkanRenderer::generate_default_texture()
 	state_.default_texture = std::move(VulkanTexture(&vulkan_context_, 0, texture_width, texture_height, false, texture_data));
 }
 
+void VulkanRenderer::draw_statistics_window() const
+{
+	// Published by the last rendered frame, the frame being built isn't culled or compiled yet
+	const RendererStatistics statistics = get_statistics();
+	const FrustumCullerStatistics &culling = statistics.culling;
+	const RenderQueueStatistics &queue = statistics.queue;
+	const FrameGraphStatistics &graph = statistics.frame_graph;
+	const GpuSceneStatistics &gpu_scene = statistics.gpu_scene;
+	const TransformHierarchyStatistics &transforms = statistics.transforms;
+	const FrameLatencyStatistics latency = frame_pacer_.statistics();
+
+	ImGui::Begin("Renderer statistics");
+	ImGui::Text("Culled %u of %u objects in %.1f us (%u chunks)", culling.objects - culling.visible, culling.objects, culling.microseconds, culling.partitions);
+	ImGui::Text("Culling rate: %.1f objects/us", culling.objects_per_microsecond());
+	ImGui::Text("Draws: %u, instances: %u, triangles: %llu", queue.draws, queue.instances, static_cast<unsigned long long>(queue.triangles));
+	ImGui::Text("Binds: %u pipeline, %u descriptor, %u index buffer", queue.pipeline_binds, queue.descriptor_binds, queue.index_buffer_binds);
+	if (statistics.depth_prepass)
+		ImGui::Text("Depth pre-pass draws: %u", queue.prepass_draws);
+	if (queue.dropped_draws > 0)
+		ImGui::Text("Dropped draws: %u (%u instances), the instance buffer is full", queue.dropped_draws, queue.dropped_instances);
+	ImGui::Text("GPU scene: %u objects, uploaded %u objects and %u transforms",
+				gpu_scene.objects, gpu_scene.uploaded_objects, gpu_scene.uploaded_transforms);
+	ImGui::Text("Transforms: %u of %u nodes updated, %u of %u levels skipped, %.1f us",
+				transforms.updated_nodes, transforms.nodes, transforms.skipped_levels, transforms.levels, transforms.microseconds);
+	ImGui::Text("Frame graph: %u passes, %u culled, %u barriers", graph.passes, graph.culled_passes, graph.barriers);
+	ImGui::Text("Transient images: %u in %u blocks, %.1f of %.1f MiB",
+				graph.transient_images, graph.memory_blocks,
+				static_cast<double>(graph.transient_bytes) / (1024.0 * 1024.0),
+				static_cast<double>(graph.unaliased_bytes) / (1024.0 * 1024.0));
+	ImGui::Text("GPU frame: %.2f ms, rendered at %ux%u (%.0f%%)",
+				statistics.gpu_frame_ms, statistics.render_extent.width, statistics.render_extent.height, statistics.render_scale * 100.0f);
+	ImGui::Text("Lazy images: %u, pooled blocks: %u, allocations: %u", graph.lazy_images, graph.pooled_blocks, graph.memory_allocations);
+	ImGui::Text("Present: %s, %u frames in flight, %.2f ms per frame%s",
+				present_mode_name(statistics.present_mode), statistics.frames_in_flight, latency.frame_ms,
+				present_wait_ ? ", present wait" : "");
+	ImGui::Text("Latency: input to present %.2f ms, to display %.2f ms, limiter wait %.2f ms",
+				latency.input_to_present_ms, latency.input_to_display_ms, latency.limiter_wait_ms);
+	if (render_thread_enabled_)
+		ImGui::Text("Render thread: recording %.2f ms per frame", statistics.render_thread_ms);
+	ImGui::Text("Frame memory: %.1f of %.1f KiB, peak %.1f KiB, %llu blocks allocated",
+				static_cast<double>(statistics.frame_memory.used_bytes) / 1024.0,
+				static_cast<double>(statistics.frame_memory.capacity_bytes) / 1024.0,
+				static_cast<double>(statistics.frame_memory.peak_bytes) / 1024.0,
+				static_cast<unsigned long long>(statistics.frame_memory.block_allocations));
+	ImGui::Text("Descriptors: %u transient sets in %u pools, %u pool growths%s",
+				statistics.descriptors.allocated_sets, statistics.descriptors.pools, statistics.descriptors.pool_growths,
+				vulkan_context_.object_shader_.uses_push_descriptors() ? ", push descriptors" : "");
+	if (on_demand_)
+		ImGui::Text("On demand rendering: %llu frames skipped", static_cast<unsigned long long>(skipped_frames_));
+	if (job_system_ != nullptr)
+	{
+		const JobSystemStatistics jobs = job_system_->statistics();
+		ImGui::Text("Jobs: %u workers, %llu executed, %llu stolen, %llu on the main thread",
+					jobs.workers, static_cast<unsigned long long>(jobs.executed_jobs),
+					static_cast<unsigned long long>(jobs.stolen_jobs), static_cast<unsigned long long>(jobs.main_thread_jobs));
+	}
+	ImGui::End();
+}
+
+void VulkanRenderer::draw_allocation_window() const
+{
+	// Closed by the render thread, one frame behind the statistics of the frame being built
+	const AllocationStatistics frame = AllocationTracker::last_frame();
+
+	ImGui::Begin("Allocations");
+	ImGui::Text("Frame %llu: %llu allocations, %llu frees, %.1f KiB",
+				static_cast<unsigned long long>(frame.frame), static_cast<unsigned long long>(frame.allocations),
+				static_cast<unsigned long long>(frame.frees), static_cast<double>(frame.bytes) / 1024.0);
+	ImGui::Text("Vulkan: %llu allocations, %.1f KiB",
+				static_cast<unsigned long long>(frame.vulkan_allocations), static_cast<double>(frame.vulkan_bytes) / 1024.0);
+	ImGui::Text("Steady state violations: %llu", static_cast<unsigned long long>(AllocationTracker::steady_state_violations()));
+	if (frame.unattributed > 0)
+		ImGui::Text("Unattributed: %llu", static_cast<unsigned long long>(frame.unattributed));
+	for (uint32_t i = 0; i < frame.site_count; i++)
+	{
+		// Sites seen before are named from the cache, only new ones allocate to be named
+		const AllocationSite &site = frame.sites[i];
+		const std::string_view name = AllocationTracker::describe_site(site);
+		ImGui::TextWrapped("%llu allocations, %llu bytes: %.*s", static_cast<unsigned long long>(site.count),
+						   static_cast<unsigned long long>(site.bytes), static_cast<int>(name.size()), name.data());
+	}
+	ImGui::End();
+}
+
+void VulkanRenderer::publish_statistics(float render_ms)
+{
+	const VulkanSwapchain &swapchain = vulkan_context_.get_swapchain();
+
+	std::lock_guard lock{statistics_mutex_};
+	statistics_.culling = frustum_culler_.statistics();
+	statistics_.queue = render_queue_.statistics();
+	statistics_.frame_graph = frame_graph_.statistics();
+	statistics_.gpu_scene = gpu_scene_.statistics();
+	statistics_.transforms = transform_hierarchy_.statistics();
+	statistics_.gpu_frame_ms = gpu_frame_ms_;
+	statistics_.render_extent = render_extent_;
+	statistics_.render_scale = dynamic_resolution_ ? resolution_scaler_.scale() : 1.0f;
+	statistics_.present_mode = swapchain.get_present_mode();
+	statistics_.frames_in_flight = swapchain.get_frames_in_flight();
+	statistics_.depth_prepass = render_queue_.is_depth_prepass_enabled();
+	statistics_.render_thread_ms = render_ms;
+	statistics_.frame_memory = frame_allocator_.statistics();
+	statistics_.descriptors = vulkan_context_.frame_descriptor_statistics();
+}
+
+RendererStatistics VulkanRenderer::get_statistics() const
+{
+	std::lock_guard lock{statistics_mutex_};
+	return statistics_;
+}
+
+void VulkanRenderer::render_loop()
+{
+	while (true)
+	{
+		uint32_t packet;
+		{
+			std::unique_lock lock{packet_mutex_};
+			packet_condition_.wait(lock, [this]() { return queued_packet_.has_value() || stop_render_thread_; });
+			// A queued packet is still rendered when stopping
+			if (!queued_packet_.has_value())
+				return;
+			packet = queued_packet_.value();
+		}
+
+		render_frame(packets_[packet]);
+
+		{
+			std::lock_guard lock{packet_mutex_};
+			queued_packet_.reset();
+		}
+		packet_condition_.notify_all();
+	}
+}
+
 bool VulkanRenderer::end_frame()
 {
-	VulkanCommandBuffer &command_buffer = vulkan_context_.graphics_command_buffers_[vulkan_context_.image_index_];
+	draw_statistics_window();
+	if constexpr (AllocationTracker::enabled)
+		draw_allocation_window();
+
+	// Widgets being dragged or typed into change without new events, a text caret blinks on its own
+	if (ImGui::IsAnyItemActive() || ImGui::GetIO().WantTextInput)
+		redraw_frames_ = std::max(redraw_frames_, 2u);
+	if (redraw_frames_ > 0)
+		redraw_frames_--;
 
-	// ImGui rendering
 	ImGui::Render();
-	ImDrawData *main_draw_data = ImGui::GetDrawData();
+	RenderPacket &packet = packets_[write_packet_];
+	packet.capture_ui(ImGui::GetDrawData(), render_thread_enabled_);
+
+	if (!render_thread_enabled_)
+	{
+		const bool rendered = render_frame(packet);
+		packet.clear();
+		return rendered;
+	}
+
+	// The render thread has to be done with the last packet, the one before it was rendered and is written next
+	{
+		std::unique_lock lock{packet_mutex_};
+		packet_condition_.wait(lock, [this]() { return !queued_packet_.has_value(); });
+		queued_packet_ = write_packet_;
+	}
+	packet_condition_.notify_all();
+
+	RenderPacket &next = packets_[write_packet_ ^ 1];
+	next.clear();
+	next.projection = packet.projection;
+	next.view = packet.view;
+	next.near_clip = packet.near_clip;
+	next.far_clip = packet.far_clip;
+	write_packet_ ^= 1;
+
+	return true;
+}
+
+bool VulkanRenderer::render_frame(RenderPacket &packet)
+{
+	std::lock_guard lock{render_mutex_};
+	const auto start = std::chrono::steady_clock::now();
+
+	// Without a render thread begin_frame already waited, before input was polled
+	if (!vulkan_context_.get_current_frame_fence_in_flight().wait(std::numeric_limits<uint64_t>::max()))
+	{
+		FLOWFORGE_WARN("Failure to wait for fence in flight");
+		return false;
+	}
+	if (render_thread_enabled_)
+		wait_for_displayed_frame();
+
+	// The oldest frame's scratch data is no longer used, its arenas are reused
+	frame_allocator_.begin_frame();
+	AllocationTracker::begin_frame();
+
+	// Resizes of the last frame are applied once, here, before an image of the swapchain is acquired
+	const uint32_t swapchain_generation = vulkan_context_.swapchain_.get_generation();
+	if (!vulkan_context_.swapchain_.recreate_if_requested())
+		return false;
+	// Recreating allocates, the frames after it aren't steady yet
+	if (vulkan_context_.swapchain_.get_generation() != swapchain_generation)
+		AllocationTracker::restart_warmup();
+
+	// The last frame in this slot is done, its GPU time decides the scale of this one
+	const uint32_t frame = vulkan_context_.current_frame();
+	if (std::optional<float> gpu_frame_ms = gpu_timer_.read(frame))
+	{
+		gpu_frame_ms_ = gpu_frame_ms.value();
+		if (dynamic_resolution_)
+			resolution_scaler_.update(gpu_frame_ms_, frame_scales_[frame]);
+	}
+
+	// The frame's instance slice and transient descriptor sets are no longer read by the GPU
+	vulkan_context_.get_instance_buffer().begin_frame(vulkan_context_.current_frame());
+	vulkan_context_.get_frame_descriptor_allocator().reset();
+
+	// Get the next image index
+	if (!vulkan_context_.swapchain_.acquire_next_image(
+				std::numeric_limits<uint64_t>::max(),
+				vulkan_context_.image_avaliable_semaphores_[vulkan_context_.current_frame_],
+				VK_NULL_HANDLE,
+				&vulkan_context_.image_index_))
+	{
+		FLOWFORGE_WARN("Failed to acquire next image");
+		return false;
+	}
+
+	// Wait for the previous frame to not use the image, nor the command buffer of its index
+	if (auto *fence = vulkan_context_.get_image_index_frame_fence_in_flight())
+	{
+		if (!fence->wait(std::numeric_limits<uint64_t>::max()))
+		{
+			FLOWFORGE_WARN("Failed to wait for image index fence in flight");
+			return false;
+		}
+	}
+
+	VulkanCommandBuffer &command_buffer = vulkan_context_.graphics_command_buffers_[vulkan_context_.image_index_];
+	command_buffer.reset();
+	command_buffer.begin(false, false, false);
+	gpu_timer_.begin(command_buffer, frame);
+
+	// The swapchain may have been recreated above
+	update_render_extent();
+	frame_scales_[frame] = dynamic_resolution_ ? resolution_scaler_.scale() : 1.0f;
+
+	// The scene passes draw into the rendered area, the upscale and UI passes set their own
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(render_extent_.width);
+	viewport.height = static_cast<float>(render_extent_.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	VkRect2D scissor{};
+	scissor.offset = {0, 0};
+	scissor.extent = render_extent_;
+
+	vkCmdSetViewport(command_buffer.get_handle(), 0, 1, &viewport);
+	vkCmdSetScissor(command_buffer.get_handle(), 0, 1, &scissor);
+
+	apply_packet(packet);
+
+	// Only the visible draws reach the queue
+	cull_pending_draws(packet);
+	update_transform_hierarchy();
+
+	const uint32_t image_index = vulkan_context_.image_index();
+	const VulkanSwapchain &swapchain = vulkan_context_.get_swapchain();
+	const VulkanDevice &device = vulkan_context_.vulkan_device();
+	const VkExtent2D extent = swapchain.get_extent();
+
+	depth_pyramid_.prepare(command_buffer, extent);
+
+	// Occlusion culling needs GPU scene objects and a depth buffer it can read
+	const bool gpu_objects = gpu_scene_.is_supported() && gpu_scene_.object_count() > 0;
+	const bool occlusion = gpu_objects && device.is_depth_sampling_supported();
+
+	frame_graph_.begin(swapchain.get_generation(), frame_allocator_.resource());
+
+	// The acquired image is cleared by the first pass, so whatever it held is discarded
+	const FrameGraphImage backbuffer = frame_graph_.import_image(
+			"backbuffer",
+			{swapchain.get_format(), extent, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT},
+			swapchain.get_image(image_index),
+			swapchain.get_image_view(image_index),
+			FrameGraphUsage::PRESENT,
+			FrameGraphUsage::PRESENT,
+			true);
+	// Only lives for the frame. Unless the depth pyramid is built from it, it is only an attachment,
+	// which lets the frame graph put it in lazily allocated memory.
+	VkImageUsageFlags depth_usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	if (occlusion)
+		depth_usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+	const FrameGraphImage depth = frame_graph_.create_image("depth", {device.get_depth_format(), extent, VK_IMAGE_ASPECT_DEPTH_BIT, depth_usage});
+
+	// With dynamic resolution the scene goes to the top left of a window sized target, so changing the scale
+	// never recreates it, and is stretched over the backbuffer afterwards
+	const VkExtent2D render_extent = render_extent_;
+	std::optional<FrameGraphImage> scene_color;
+	if (dynamic_resolution_)
+	{
+		scene_color = frame_graph_.create_image(
+				"scene color",
+				{swapchain.get_format(), extent, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT});
+	}
+	const FrameGraphImage scene_target = scene_color.value_or(backbuffer);
+
+	std::optional<GpuSceneBuffers> gpu_buffers;
+	if (gpu_objects)
+		gpu_buffers = gpu_scene_.import_buffers(frame_graph_);
+
+	VulkanRenderpass *final_renderpass = &vulkan_context_.main_renderpass_;
+	GpuCullPhase final_phase = GpuCullPhase::ALL;
+	std::optional<FrameGraphImage> pyramid;
+	if (occlusion)
+	{
+		// Sampled by the late culling phase, the previous frame's one may still be reading it
+		pyramid = frame_graph_.import_image(
+				"depth pyramid",
+				{VK_FORMAT_R32_SFLOAT,
+				 {depth_pyramid_.get_width(), depth_pyramid_.get_height()},
+				 VK_IMAGE_ASPECT_COLOR_BIT,
+				 VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+				 depth_pyramid_.get_mip_levels()},
+				depth_pyramid_.get_image(),
+				depth_pyramid_.get_view(),
+				FrameGraphUsage::STORAGE_COMPUTE);
+
+		// Draw what was visible last frame, then build the depth pyramid from it
+		VulkanFrameGraph::PassBuilder early_cull = frame_graph_.add_pass("early cull", [this, frame](VulkanCommandBuffer &pass_command_buffer) {
+			gpu_scene_.cull(pass_command_buffer, frame, GpuCullPhase::EARLY, state_.projection, state_.view, depth_pyramid_, lod_selector_, false);
+		});
+		VulkanGpuScene::declare_cull(early_cull, gpu_buffers.value());
+
+		VulkanFrameGraph::PassBuilder early_geometry = frame_graph_.add_pass("early geometry", [this, frame](VulkanCommandBuffer &pass_command_buffer) {
+			gpu_scene_.draw(pass_command_buffer, frame, GpuCullPhase::EARLY, vulkan_context_.object_shader_);
+		});
+		early_geometry.set_render_pass(vulkan_context_.early_renderpass_, {scene_target, depth})
+				.set_render_area(render_extent);
+		VulkanGpuScene::declare_draw(early_geometry, gpu_buffers.value());
+
+		frame_graph_.add_pass("depth pyramid", [this, depth, render_extent](VulkanCommandBuffer &pass_command_buffer) {
+						depth_pyramid_.build(pass_command_buffer, frame_graph_.get_view(depth), render_extent);
+					})
+				.read(depth, FrameGraphUsage::SAMPLED_COMPUTE)
+				.write(pyramid.value(), FrameGraphUsage::STORAGE_COMPUTE);
+
+		final_renderpass = &vulkan_context_.late_renderpass_;
+		final_phase = GpuCullPhase::LATE;
+	}
+
+	if (gpu_objects)
+	{
+		VulkanFrameGraph::PassBuilder cull = frame_graph_.add_pass("cull", [this, frame, final_phase, occlusion](VulkanCommandBuffer &pass_command_buffer) {
+			gpu_scene_.cull(pass_command_buffer, frame, final_phase, state_.projection, state_.view, depth_pyramid_, lod_selector_, occlusion);
+		});
+		VulkanGpuScene::declare_cull(cull, gpu_buffers.value());
+		if (pyramid.has_value())
+			cull.read(pyramid.value(), FrameGraphUsage::STORAGE_COMPUTE);
+	}
+
+	// ImGui rendering, the UI was built and captured by the simulation
+	ImDrawData *main_draw_data = packet.ui();
 	const bool main_is_minimized = (main_draw_data->DisplaySize.x <= 0.0f || main_draw_data->DisplaySize.y <= 0.0f);
 	// if (!main_is_minimized)
 	// 	FrameRender(wd, main_draw_data);
@@ -156,24 +899,50 @@ bool VulkanRenderer::end_frame()
 	// if (!main_is_minimized)
 	// 	FramePresent(wd);
 
-	ImGui_ImplVulkan_RenderDrawData(main_draw_data, command_buffer.get_handle());
-
-	// ImGui render end
+	auto draw_scene = [this, frame, final_phase](VulkanCommandBuffer &pass_command_buffer) {
+		// Sort and record the queued draws. They are not occluders, but are ordered against everything drawn.
+		render_queue_.flush(pass_command_buffer,
+							vulkan_context_.get_geometry_pool(),
+							vulkan_context_.get_instance_buffer(),
+							vulkan_context_.object_shader_);
 
-	vulkan_context_.main_renderpass_.end(command_buffer);
+		// Draw whatever survived culling
+		gpu_scene_.draw(pass_command_buffer, frame, final_phase, vulkan_context_.object_shader_);
+	};
 
-	command_buffer.end();
-
-	// Wait for the previous frame to not use the image
-	if (auto *fence = vulkan_context_.get_image_index_frame_fence_in_flight())
+	if (!scene_color.has_value())
 	{
-		if (!fence->wait(std::numeric_limits<uint64_t>::max()))
-		{
-			FLOWFORGE_WARN("Failed to wait for image index fence in flight");
-			return false;
-		}
+		VulkanFrameGraph::PassBuilder main_pass = frame_graph_.add_pass("main", [draw_scene, main_draw_data](VulkanCommandBuffer &pass_command_buffer) {
+			draw_scene(pass_command_buffer);
+			ImGui_ImplVulkan_RenderDrawData(main_draw_data, pass_command_buffer.get_handle());
+		});
+		main_pass.set_render_pass(*final_renderpass, {backbuffer, depth});
+		if (gpu_buffers.has_value())
+			VulkanGpuScene::declare_draw(main_pass, gpu_buffers.value());
+	} else
+	{
+		VulkanFrameGraph::PassBuilder scene_pass = frame_graph_.add_pass("scene", draw_scene);
+		scene_pass.set_render_pass(*final_renderpass, {scene_color.value(), depth})
+				.set_render_area(render_extent);
+		if (gpu_buffers.has_value())
+			VulkanGpuScene::declare_draw(scene_pass, gpu_buffers.value());
+
+		// The depth attachment is only there to stay compatible with the UI pipeline, which is built for the main render pass
+		const UpscaleFilter filter = upscale_filter_;
+		frame_graph_.add_pass("upscale", [this, scene_color, extent, render_extent, filter, main_draw_data](VulkanCommandBuffer &pass_command_buffer) {
+						upscaler_.record(pass_command_buffer, frame_graph_.get_view(scene_color.value()), extent, render_extent, extent, filter);
+						ImGui_ImplVulkan_RenderDrawData(main_draw_data, pass_command_buffer.get_handle());
+					})
+				.read(scene_color.value(), FrameGraphUsage::SAMPLED_FRAGMENT)
+				.set_render_pass(vulkan_context_.main_renderpass_, {backbuffer, depth});
 	}
 
+	frame_graph_.compile();
+	frame_graph_.execute(command_buffer);
+
+	gpu_timer_.end(command_buffer, frame);
+	command_buffer.end();
+
 	// Set the fence as image in flight
 	vulkan_context_.images_in_flight_[vulkan_context_.image_index_] = &vulkan_context_.get_current_frame_fence_in_flight();
 
@@ -200,6 +969,9 @@ bool VulkanRenderer::end_frame()
 		FLOWFORGE_WARN("Failed to present swap chain image");
 		return false;
 	}
+	frame_pacer_.mark_present(vulkan_context_.get_swapchain().get_present_id(), packet.input_time);
+
+	publish_statistics(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
 
 	return true;
 }
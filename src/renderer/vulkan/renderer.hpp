@@ -1,6 +1,19 @@
 #pragma once
 
+#include "../culling/frustum_culler.hpp"
 #include "../glfw_context.hpp"
+#include "../mesh/lod_selector.hpp"
+#include "../pacing/frame_pacer.hpp"
+#include "../resolution/resolution_scaler.hpp"
+#include "../scene/transform_hierarchy.hpp"
+#include "core/frame_arena.hpp"
+#include "depth_pyramid.hpp"
+#include "frame_graph.hpp"
+#include "gpu_scene.hpp"
+#include "gpu_timer.hpp"
+#include "render_packet.hpp"
+#include "render_queue.hpp"
+#include "upscaler.hpp"
 #include "vulkan_context.hpp"
 #include "window.hpp"
 
@@ -10,9 +23,40 @@
 
 #include "resources/VulkanTexture.hpp"
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 namespace flwfrg
 {
 
+class JobSystem;
+
+// Snapshot of the last rendered frame, safe to read while the render thread records the next one
+struct RendererStatistics
+{
+	FrustumCullerStatistics culling{};
+	RenderQueueStatistics queue{};
+	FrameGraphStatistics frame_graph{};
+	GpuSceneStatistics gpu_scene{};
+	TransformHierarchyStatistics transforms{};
+	// GPU time of the last frame that finished, zero without timestamp support
+	float gpu_frame_ms = 0.0f;
+	VkExtent2D render_extent{};
+	float render_scale = 1.0f;
+	VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
+	uint32_t frames_in_flight = 0;
+	bool depth_prepass = false;
+	// CPU time the renderer spent recording and submitting the frame
+	float render_thread_ms = 0.0f;
+	// Transient memory of the frames in flight, over every thread
+	FrameArenaStatistics frame_memory{};
+	// Transient descriptor sets of the frames in flight
+	DescriptorAllocatorStatistics descriptors{};
+};
+
 class VulkanRenderer
 {
 public:
@@ -20,8 +64,8 @@ public:
 	{
 		glm::mat4 projection;
 		glm::mat4 view;
-		float near_clip;
-		float far_clip;
+		float near_clip = 0.1f;
+		float far_clip = 1000.0f;
 
 		VulkanTexture default_texture;
 	};
@@ -38,6 +82,75 @@ public:
 	void update_near_clip(float near_clip);
 	void update_far_clip(float far_clip);
 
+	// Maps the cooked mesh file and uploads every submesh to the shared geometry buffers
+	std::optional<std::vector<MeshHandle>> load_mesh_asset(const std::string &path);
+	std::optional<MeshHandle> load_mesh(const MeshData &mesh);
+
+	// Queues a draw, the queue is culled, sorted and recorded when the frame is rendered.
+	// lod_level keeps the object's detail level between frames for hysteresis, it starts as LodSelector::no_level
+	// and is written when the frame is rendered, so it has to stay valid until the next end_frame returns.
+	// Without it the level is picked from scratch every frame.
+	void draw_mesh(MeshHandle mesh, const GeometryRenderData &data, DrawPass pass = DrawPass::SOLID, uint32_t *lod_level = nullptr);
+	// Draws the mesh with the material of data once per transform, in as few draw calls as possible.
+	// Every instance uses the detail level of the closest one.
+	void draw_mesh_instanced(MeshHandle mesh, const GeometryRenderData &data, std::span<const glm::mat4> transforms, DrawPass pass = DrawPass::SOLID);
+
+	// Adds a persistent object that is culled and drawn on the GPU every frame
+	std::optional<GpuObjectHandle> add_gpu_object(MeshHandle mesh, const GeometryRenderData &data);
+	void set_gpu_object_transform(GpuObjectHandle object, const glm::mat4 &model);
+	void set_gpu_object_visible(GpuObjectHandle object, bool visible);
+
+	// Transforms relative to a parent, updated once per frame before the GPU scene is culled
+	TransformNode add_transform_node(const glm::mat4 &local, std::optional<TransformNode> parent = std::nullopt, const glm::vec4 &local_bounds = glm::vec4(0.0f));
+	void set_transform_node_local(TransformNode node, const glm::mat4 &local);
+	// The object follows the world transform of the node from then on, a node moves one object
+	void attach_gpu_object(GpuObjectHandle object, TransformNode node);
+
+	// Culling, transform updates and draw sorting are spread over its jobs, they run on the calling thread without one.
+	// The job system has to outlive the renderer.
+	void set_job_system(JobSystem *job_system);
+
+	void set_lod_settings(const LodSelector::Settings &settings);
+	// Renders queued solid draws to depth first, then shades them with an equal depth test.
+	// Pays off when fragment shading is expensive and solid draws overlap.
+	void set_depth_prepass(bool enabled);
+	// Renders the scene into an offscreen target at a scale that follows the GPU frame time, then stretches it
+	// over the window. The UI is drawn at the window's resolution either way.
+	void set_dynamic_resolution(bool enabled, UpscaleFilter filter = UpscaleFilter::SHARPENED);
+	void set_resolution_settings(const ResolutionScaler::Settings &settings);
+
+	// Takes effect when the swapchain is recreated at the start of the next frame, FIFO is used when the surface doesn't support the mode
+	void set_present_mode(VkPresentModeKHR present_mode);
+	// Frames the CPU records ahead of the GPU, fewer lower latency and more smooth out uneven frames
+	void set_frames_in_flight(uint8_t frames_in_flight);
+	// Caps the frame rate by waiting before input is polled, zero removes the cap
+	void set_frame_limit(float max_fps);
+	// Starts a frame only once the present of the frames in flight before it was displayed, so frames don't queue
+	// up in the presentation engine. Ignored when the device lacks VK_KHR_present_wait.
+	void set_present_wait(bool enabled);
+	// One frame in flight with present wait, or back to the defaults
+	void set_low_latency_mode(bool enabled);
+
+	// Only renders when something changed: window events, a redraw request, new geometry, a camera change or an
+	// ImGui widget in use. Otherwise begin_frame blocks for events up to the idle timeout and skips the frame.
+	void set_on_demand_rendering(bool enabled, float idle_timeout_seconds = 0.5f);
+	// Records and submits frames on a render thread, while the caller builds the next frame. end_frame hands the frame
+	// over and only blocks when the render thread is still busy with the frame before. GLFW and ImGui stay on the
+	// calling thread, the UI's draw lists are copied into the frame.
+	void set_render_thread(bool enabled);
+	// Makes the next frames render in on demand mode, call it every frame while something animates.
+	// Safe to call from any thread, it wakes up a begin_frame waiting for events.
+	void request_redraw();
+
+	[[nodiscard]] RendererStatistics get_statistics() const;
+	[[nodiscard]] inline FrameLatencyStatistics get_latency_statistics() const { return frame_pacer_.statistics(); };
+	// Only safe to read without the render thread, it updates the hierarchy while the next frame is built
+	[[nodiscard]] inline const TransformHierarchy &get_transform_hierarchy() const { return transform_hierarchy_; };
+	[[nodiscard]] inline bool is_render_thread_enabled() const { return render_thread_enabled_; };
+	[[nodiscard]] inline bool is_on_demand_rendering() const { return on_demand_; };
+	// Frames skipped in on demand mode because nothing changed
+	[[nodiscard]] inline uint64_t get_skipped_frames() const { return skipped_frames_; };
+
 	[[nodiscard]] bool should_close() const { return window_.should_close(); };
 
 private:
@@ -49,10 +162,93 @@ private:
 
 	RendererState state_;
 
+	// The simulation fills packets_[write_packet_] while the render thread renders the other one
+	std::array<RenderPacket, 2> packets_{};
+	uint32_t write_packet_ = 0;
+
+	bool render_thread_enabled_ = false;
+	std::thread render_thread_{};
+	std::mutex packet_mutex_{};
+	std::condition_variable packet_condition_{};
+	// Packet handed to the render thread and not rendered yet
+	std::optional<uint32_t> queued_packet_{};
+	bool stop_render_thread_ = false;
+	// Held while a frame is rendered, and by everything that changes what the frame reads from the simulation thread
+	std::mutex render_mutex_{};
+
+	mutable std::mutex statistics_mutex_{};
+	RendererStatistics statistics_{};
+
+	// Not owned, null when everything runs on the calling thread
+	JobSystem *job_system_ = nullptr;
+	// Scratch data of the frame being recorded, kept until the frames in flight after it began.
+	// Declared before everything that allocates from it.
+	FrameAllocator frame_allocator_{vulkan_context_.get_swapchain().get_max_frames_in_flight() + 1u};
+	FrustumCuller frustum_culler_{};
+	std::vector<CullObjectHandle> visible_draws_{};
+
+	LodSelector lod_selector_{};
+
+	RenderQueue render_queue_{};
+	VulkanDepthPyramid depth_pyramid_{&vulkan_context_};
+	VulkanGpuScene gpu_scene_{&vulkan_context_, max_gpu_objects_, max_gpu_batches_};
+	VulkanFrameGraph frame_graph_{&vulkan_context_};
+	VulkanGpuTimer gpu_timer_{&vulkan_context_, vulkan_context_.get_swapchain().get_max_frames_in_flight()};
+	VulkanUpscaler upscaler_{&vulkan_context_};
+
+	TransformHierarchy transform_hierarchy_{};
+	// GPU object attached to every node
+	std::vector<GpuObjectHandle> node_objects_{};
+	static constexpr GpuObjectHandle no_gpu_object = std::numeric_limits<GpuObjectHandle>::max();
+
+	ResolutionScaler resolution_scaler_{};
+	bool dynamic_resolution_ = false;
+	UpscaleFilter upscale_filter_ = UpscaleFilter::SHARPENED;
+	// Size the scene is rendered at this frame, the swapchain extent without dynamic resolution
+	VkExtent2D render_extent_{};
+	// Scale every frame in flight was recorded at, its GPU time is read back frames later
+	std::vector<float> frame_scales_{};
+	float gpu_frame_ms_ = 0.0f;
+
+	FramePacer frame_pacer_{};
+	bool present_wait_ = false;
+	// Bounds the present wait, so a present that is never shown can't stall the frame
+	static constexpr uint64_t present_wait_timeout_ns_ = 100'000'000;
+
+	bool on_demand_ = false;
+	double idle_timeout_seconds_ = 0.5;
+	// Frames left to render in on demand mode
+	uint32_t redraw_frames_ = 0;
+	std::atomic<bool> redraw_requested_{false};
+	uint64_t seen_event_count_ = 0;
+	uint64_t skipped_frames_ = 0;
+	// A change renders a few frames, so ImGui can settle hover states and the frames in flight catch up
+	static constexpr uint32_t redraw_settle_frames_ = 3;
+
+	static constexpr uint32_t max_gpu_objects_ = 64 * 1024;
+	// One batch per material and index type, not per object
+	static constexpr uint32_t max_gpu_batches_ = 256;
+
 	// non-owning
 	VulkanTexture* default_diffuse_ = nullptr;
 	
 	void generate_default_texture();
+	// Renders the packet, false when the swapchain couldn't be recreated
+	bool render_frame(RenderPacket &packet);
+	void apply_packet(const RenderPacket &packet);
+	void cull_pending_draws(RenderPacket &packet);
+	void submit_instanced_draw(MeshHandle mesh, const GeometryRenderData &data, std::span<const glm::mat4> transforms, DrawPass pass);
+	void update_lod_selector();
+	void update_render_extent();
+	void update_transform_hierarchy();
+	void wait_for_displayed_frame();
+	// Picks up window events and redraw requests, true while frames are left to render
+	bool needs_redraw();
+	void draw_statistics_window() const;
+	void draw_allocation_window() const;
+	void publish_statistics(float render_ms);
+	void render_loop();
+	[[nodiscard]] float view_depth(const GeometryMesh &mesh, const glm::mat4 &model) const;
 };
 
 }// namespace flwfrg
\ No newline at end of file
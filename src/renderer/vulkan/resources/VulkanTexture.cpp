@@ -73,7 +73,7 @@ VulkanTexture::VulkanTexture(VulkanContext *context, uint32_t id, uint32_t width
 	sampler_info.maxLod = 0.0f;
 
 	// Create the sampler and check the result
-	if (vkCreateSampler(context->logical_device(), &sampler_info, nullptr, &sampler_) != VK_SUCCESS)
+	if (vkCreateSampler(context->logical_device(), &sampler_info, vulkan_allocator(), &sampler_) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create texture sampler");
 	}
@@ -85,7 +85,7 @@ VulkanTexture::~VulkanTexture()
 {
 	if (sampler_ != VK_NULL_HANDLE)
 	{
-		vkDestroySampler(context_->logical_device(), sampler_, nullptr);
+		vkDestroySampler(context_->logical_device(), sampler_, vulkan_allocator());
 	}
 }
 VulkanTexture::VulkanTexture(VulkanTexture &&other) noexcept
@@ -107,7 +107,7 @@ VulkanTexture &VulkanTexture::operator=(VulkanTexture &&other) noexcept
 	{
 		if (sampler_ != VK_NULL_HANDLE)
 		{
-			vkDestroySampler(context_->logical_device(), sampler_, nullptr);
+			vkDestroySampler(context_->logical_device(), sampler_, vulkan_allocator());
 		}
 
 		context_ = other.context_;
@@ -126,9 +126,9 @@ VulkanTexture &VulkanTexture::operator=(VulkanTexture &&other) noexcept
 	return *this;
 }
 
-bool VulkanTexture::load_texture_from_file(std::string texture_name)
+bool VulkanTexture::load_texture_from_file(std::string_view texture_name)
 {
-	std::string path = "assets/textures/" + texture_name + ".png";
+	std::string path = fmt::format("assets/textures/{}.png", texture_name);
 	const int32_t required_channel_count = 4;
 	stbi_set_flip_vertically_on_load(true);
 	
@@ -178,7 +178,7 @@ bool VulkanTexture::load_texture_from_file(std::string texture_name)
 
 	stbi_image_free(data);
 
-	*this = VulkanTexture{context_, id_, static_cast<uint32_t>(width), static_cast<uint32_t>(height), has_transparency, data_vec};
+	*this = VulkanTexture{context_, id_, static_cast<uint32_t>(width), static_cast<uint32_t>(height), has_transparency, std::move(data_vec)};
 
 	if (generation == std::numeric_limits<uint32_t>::max())
 		generation_ = 0;
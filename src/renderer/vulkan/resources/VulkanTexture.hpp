@@ -7,6 +7,8 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 
+#include <string_view>
+
 namespace flwfrg
 {
 
@@ -46,7 +48,7 @@ public:
 	inline const VulkanImage &get_image() const { return image_; }
 	[[nodiscard]] VkSampler get_sampler() const { return sampler_; }
 
-	bool load_texture_from_file(std::string texture_name);
+	bool load_texture_from_file(std::string_view texture_name);
 
 private:
 	VulkanContext *context_ = nullptr;
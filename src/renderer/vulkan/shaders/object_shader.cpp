@@ -2,6 +2,8 @@
 
 #include "object_shader.hpp"
 
+#include <algorithm>
+#include <cstddef>
 #include <utility>
 
 #include "../vulkan_context.hpp"
@@ -31,6 +33,13 @@ VulkanObjectShader::VulkanObjectShader(VulkanContext *context, VulkanTexture *de
 		stages.emplace_back(std::move(stage.value()));
 	}
 
+	std::optional<VulkanShaderStage> depth_prepass_stage = VulkanShaderStage::create_shader_module(context_, depth_prepass_file_name, VK_SHADER_STAGE_VERTEX_BIT);
+	if (!depth_prepass_stage.has_value())
+	{
+		throw std::runtime_error("Failed to create depth pre-pass shader stage");
+	}
+	stages.emplace_back(std::move(depth_prepass_stage.value()));
+
 	// Global descriptors
 	VkDescriptorSetLayoutBinding global_ubo_layout_binding{};
 	global_ubo_layout_binding.binding = 0;
@@ -39,74 +48,31 @@ VulkanObjectShader::VulkanObjectShader(VulkanContext *context, VulkanTexture *de
 	global_ubo_layout_binding.pImmutableSamplers = nullptr;
 	global_ubo_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
-	VkDescriptorSetLayoutCreateInfo layout_info{};
-	layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layout_info.bindingCount = 1;
-	layout_info.pBindings = &global_ubo_layout_binding;
-	global_descriptor_set_layout_ = VulkanDescriptorSetLayout(context_, layout_info);
-
-	// Global descriptor pool
-	VkDescriptorPoolSize global_pool_size{};
-	global_pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	global_pool_size.descriptorCount = context_->get_swapchain().get_image_count();
+	global_descriptor_set_layout_ = context_->get_descriptor_layout_cache().get({&global_ubo_layout_binding, 1});
 
 	// Local/object descriptors
-	const uint32_t local_sampler_count = 1;
 	std::array<VkDescriptorType, VULKAN_OBJECT_SHADER_DESCRIPTOR_COUNT> descriptor_types = {
-			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER};
-	std::array<VkDescriptorSetLayoutBinding, VULKAN_OBJECT_SHADER_DESCRIPTOR_COUNT> bindings{};
+	std::array<VkDescriptorSetLayoutBinding, VULKAN_OBJECT_SHADER_DESCRIPTOR_COUNT> local_bindings{};
 	for (uint32_t i = 0; i < VULKAN_OBJECT_SHADER_DESCRIPTOR_COUNT; i++)
 	{
-		bindings[i].binding = i;
-		bindings[i].descriptorCount = 1;
-		bindings[i].descriptorType = descriptor_types[i];
-		bindings[i].pImmutableSamplers = nullptr;
-		bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		local_bindings[i].binding = i;
+		local_bindings[i].descriptorCount = 1;
+		local_bindings[i].descriptorType = descriptor_types[i];
+		local_bindings[i].pImmutableSamplers = nullptr;
+		local_bindings[i].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	}
 
-	// Create descriptor set layout
-	VkDescriptorSetLayoutCreateInfo local_layout_create_info{};
-	local_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	local_layout_create_info.bindingCount = VULKAN_OBJECT_SHADER_DESCRIPTOR_COUNT;
-	local_layout_create_info.pBindings = bindings.data();
-	// Create and check result
-	local_descriptor_set_layout_ = VulkanDescriptorSetLayout(context_, local_layout_create_info);
-
-	// Local layout pool
-	std::array<VkDescriptorPoolSize, VULKAN_OBJECT_SHADER_DESCRIPTOR_COUNT> local_pool_sizes{};
-	local_pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	local_pool_sizes[0].descriptorCount = VULKAN_OBJECT_SHADER_MAX_OBJECT_COUNT;
-
-	local_pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	local_pool_sizes[1].descriptorCount = local_sampler_count * VULKAN_OBJECT_SHADER_MAX_OBJECT_COUNT;
-
-	VkDescriptorPoolCreateInfo local_pool_info{};
-	local_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	local_pool_info.poolSizeCount = local_pool_sizes.size();
-	local_pool_info.pPoolSizes = local_pool_sizes.data();
-	local_pool_info.maxSets = VULKAN_OBJECT_SHADER_MAX_OBJECT_COUNT;
-
-	// Create local/object descriptor pool
-	local_descriptor_pool_ = VulkanDescriptorPool(context_, local_pool_info);
-
-	// Image sampler pool
-	VkDescriptorPoolSize image_sampler_pool_size{};
-	image_sampler_pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	image_sampler_pool_size.descriptorCount = 1;
-
-	std::vector<VkDescriptorPoolSize> pool_sizes = {
-			global_pool_size,
-			image_sampler_pool_size};
-
-	VkDescriptorPoolCreateInfo global_pool_info{};
-	global_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	global_pool_info.poolSizeCount = pool_sizes.size();
-	global_pool_info.pPoolSizes = pool_sizes.data();
-	global_pool_info.maxSets = context_->get_swapchain().get_image_count() + 1;
-	global_pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
-
-	global_descriptor_pool_ = VulkanDescriptorPool(context_, global_pool_info);
+	// Object bindings change with every material, with push descriptors they never live in a set
+	if (context_->vulkan_device().is_extension_enabled(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME))
+	{
+		push_descriptor_set_with_template_ = reinterpret_cast<PFN_vkCmdPushDescriptorSetWithTemplateKHR>(
+				vkGetDeviceProcAddr(context_->logical_device(), "vkCmdPushDescriptorSetWithTemplateKHR"));
+	}
+
+	local_descriptor_set_layout_ = context_->get_descriptor_layout_cache().get(
+			local_bindings, uses_push_descriptors() ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0);
 
 	// Pipeline creation
 	VkViewport viewport{};
@@ -121,40 +87,115 @@ VulkanObjectShader::VulkanObjectShader(VulkanContext *context, VulkanTexture *de
 	scissor.offset = {0, 0};
 	scissor.extent = {context_->get_window().get_width(), context_->get_window().get_height()};
 
-	// Attributes
-	auto binding_description = Vertex3d::get_binding_description();
+	// Attributes. Per vertex data in binding 0, per instance data in binding 1.
+	constexpr auto vertex_attributes = CompactVertex3d::Layout::attributes(0, 0);
+	constexpr auto instance_attributes = InstanceData::Layout::attributes(1, vertex_attributes.size());
+
+	std::array<VkVertexInputAttributeDescription, vertex_attributes.size() + instance_attributes.size()> attributes{};
+	std::copy(vertex_attributes.begin(), vertex_attributes.end(), attributes.begin());
+	std::copy(instance_attributes.begin(), instance_attributes.end(), attributes.begin() + vertex_attributes.size());
+
+	constexpr std::array<VkVertexInputBindingDescription, 2> bindings = {
+			CompactVertex3d::Layout::binding_description(0, VK_VERTEX_INPUT_RATE_VERTEX),
+			InstanceData::Layout::binding_description(1, VK_VERTEX_INPUT_RATE_INSTANCE)};
 
 	// Descriptor set layouts
-	std::vector<VkDescriptorSetLayout> descriptor_set_layouts = {
-			global_descriptor_set_layout_.get(),
-			local_descriptor_set_layout_.get()};
+	const std::array<VkDescriptorSetLayout, 2> descriptor_set_layouts = {
+			global_descriptor_set_layout_,
+			local_descriptor_set_layout_};
 
 
 	// Stages
-	std::vector<VkPipelineShaderStageCreateInfo> stage_create_infos{};
-	stage_create_infos.resize(shader_stage_count);
+	std::array<VkPipelineShaderStageCreateInfo, shader_stage_count> stage_create_infos{};
 	for (uint16_t i = 0; i < shader_stage_count; i++)
 	{
 		stage_create_infos[i] = stages[i].get_shader_stage_create_info();
 	}
 
-	// Create the pipeline
-	auto created_pipeline = VulkanPipeline::create_pipeline(context_,
-															context_->get_renderpass(),
-															binding_description,
-															descriptor_set_layouts,
-															stage_create_infos,
-															viewport,
-															scissor,
-															false);
-
-	// Check that it was created
-	if (!created_pipeline.has_value())
+	// Create the pipelines, the blended one and the equal depth one for shading after a depth pre-pass
+	for (PipelineVariant variant: {PipelineVariant::DEFAULT, PipelineVariant::DEPTH_EQUAL})
 	{
-		throw std::runtime_error("Failed to create pipeline");
+		auto created_pipeline = VulkanPipeline::create_pipeline(context_,
+																context_->get_renderpass(),
+																bindings,
+																attributes,
+																descriptor_set_layouts,
+																stage_create_infos,
+																viewport,
+																scissor,
+																false,
+																variant);
+
+		// Check that it was created
+		if (!created_pipeline.has_value())
+		{
+			throw std::runtime_error("Failed to create pipeline");
+		}
+
+		pipelines_[static_cast<size_t>(variant)] = std::move(created_pipeline.value());
 	}
 
-	pipeline_ = std::move(created_pipeline.value());
+	// The depth only variant reads positions from their own stream and has no fragment stage
+	constexpr auto position_attributes = VertexLayout<Snorm16x4>::attributes(0, 0);
+	constexpr auto depth_instance_attributes = InstanceData::Layout::attributes(1, position_attributes.size());
+
+	std::array<VkVertexInputAttributeDescription, position_attributes.size() + depth_instance_attributes.size()> depth_attributes{};
+	std::copy(position_attributes.begin(), position_attributes.end(), depth_attributes.begin());
+	std::copy(depth_instance_attributes.begin(), depth_instance_attributes.end(), depth_attributes.begin() + position_attributes.size());
+
+	constexpr std::array<VkVertexInputBindingDescription, 2> depth_bindings = {
+			VertexLayout<Snorm16x4>::binding_description(0, VK_VERTEX_INPUT_RATE_VERTEX),
+			InstanceData::Layout::binding_description(1, VK_VERTEX_INPUT_RATE_INSTANCE)};
+
+	const std::array<VkPipelineShaderStageCreateInfo, 1> depth_stage_create_infos = {stages[shader_stage_count].get_shader_stage_create_info()};
+
+	auto depth_pipeline = VulkanPipeline::create_pipeline(context_,
+														  context_->get_renderpass(),
+														  depth_bindings,
+														  depth_attributes,
+														  descriptor_set_layouts,
+														  depth_stage_create_infos,
+														  viewport,
+														  scissor,
+														  false,
+														  PipelineVariant::DEPTH_ONLY);
+	if (!depth_pipeline.has_value())
+	{
+		throw std::runtime_error("Failed to create depth pre-pass pipeline");
+	}
+
+	pipelines_[static_cast<size_t>(PipelineVariant::DEPTH_ONLY)] = std::move(depth_pipeline.value());
+
+	// Update template of the object bindings, reading them from ObjectDescriptorData
+	std::array<VkDescriptorUpdateTemplateEntry, VULKAN_OBJECT_SHADER_DESCRIPTOR_COUNT> template_entries{};
+	for (uint32_t i = 0; i < VULKAN_OBJECT_SHADER_DESCRIPTOR_COUNT; i++)
+	{
+		template_entries[i].dstBinding = i;
+		template_entries[i].dstArrayElement = 0;
+		template_entries[i].descriptorCount = 1;
+		template_entries[i].descriptorType = descriptor_types[i];
+		template_entries[i].stride = sizeof(ObjectDescriptorData);
+	}
+	template_entries[0].offset = offsetof(ObjectDescriptorData, materials);
+	template_entries[1].offset = offsetof(ObjectDescriptorData, diffuse);
+
+	VkDescriptorUpdateTemplateCreateInfo template_info{};
+	template_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+	template_info.descriptorUpdateEntryCount = template_entries.size();
+	template_info.pDescriptorUpdateEntries = template_entries.data();
+	if (uses_push_descriptors())
+	{
+		template_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR;
+		template_info.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		template_info.pipelineLayout = pipelines_[0].layout();
+		template_info.set = 1;
+	}
+	else
+	{
+		template_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+		template_info.descriptorSetLayout = local_descriptor_set_layout_;
+	}
+	object_update_template_ = VulkanDescriptorUpdateTemplate(context_, template_info);
 
 	// Create global uniform buffer
 	global_uniform_buffer_ = VulkanBuffer(context_, sizeof(GlobalUniformObject) * 3,
@@ -162,69 +203,64 @@ VulkanObjectShader::VulkanObjectShader(VulkanContext *context, VulkanTexture *de
 										  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 										  true);
 
-	// Allocate global descriptor sets
-	std::vector<VkDescriptorSetLayout> global_layouts = {
-			global_descriptor_set_layout_.get(),
-			global_descriptor_set_layout_.get(),
-			global_descriptor_set_layout_.get()};
-
-	VkDescriptorSetAllocateInfo allocate_info{};
-	allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocate_info.descriptorPool = global_descriptor_pool_.get();
-	allocate_info.descriptorSetCount = global_layouts.size();
-	allocate_info.pSetLayouts = global_layouts.data();
-	// Allocate it
-	if (vkAllocateDescriptorSets(context_->logical_device(), &allocate_info, global_descriptor_sets_.data()) != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to allocate descriptor sets");
-	}
-
-	// Create local uniform buffer
+	// Create the material buffer, read by each instance at its material index
 	local_uniform_buffer_ = VulkanBuffer(context_, sizeof(LocalUniformObject) * VULKAN_OBJECT_SHADER_MAX_OBJECT_COUNT,
-										 static_cast<VkBufferUsageFlagBits>(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT),
+										 static_cast<VkBufferUsageFlagBits>(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT),
 										 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 										 true);
+	local_uniforms_ = static_cast<LocalUniformObject *>(local_uniform_buffer_.lock_memory(0, VK_WHOLE_SIZE, 0));
+}
+
+VulkanObjectShader::~VulkanObjectShader()
+{
+	if (local_uniforms_ != nullptr)
+	{
+		local_uniform_buffer_.unlock_memory();
+	}
 }
 
 VulkanObjectShader::VulkanObjectShader(VulkanObjectShader &&other)
 	: context_(other.context_),
 	  stages(std::move(other.stages)),
-	  global_descriptor_pool_(std::move(other.global_descriptor_pool_)),
-	  local_descriptor_pool_(std::move(other.local_descriptor_pool_)),
-	  global_descriptor_set_layout_(std::move(other.global_descriptor_set_layout_)),
-	  local_descriptor_set_layout_(std::move(other.local_descriptor_set_layout_)),
-	  global_descriptor_sets_(std::move(other.global_descriptor_sets_)),
-	  global_descriptor_updated_(std::move(other.global_descriptor_updated_)),
+	  global_descriptor_set_layout_(other.global_descriptor_set_layout_),
+	  local_descriptor_set_layout_(other.local_descriptor_set_layout_),
+	  object_update_template_(std::move(other.object_update_template_)),
+	  push_descriptor_set_with_template_(other.push_descriptor_set_with_template_),
 	  global_uniform_buffer_(std::move(other.global_uniform_buffer_)),
 	  local_uniform_buffer_(std::move(other.local_uniform_buffer_)),
+	  local_uniforms_(other.local_uniforms_),
 	  object_uniform_buffer_index(other.object_uniform_buffer_index),
-	  object_states_(std::move(other.object_states_)),
+	  free_object_ids_(std::move(other.free_object_ids_)),
 	  default_diffuse_(other.default_diffuse_),
-	  pipeline_(std::move(other.pipeline_))
+	  pipelines_(std::move(other.pipelines_))
 {
 	other.context_ = nullptr;
+	other.local_uniforms_ = nullptr;
 	other.default_diffuse_ = nullptr;
 }
 VulkanObjectShader &VulkanObjectShader::operator=(VulkanObjectShader &&other)
 {
 	if (this != &other)
 	{
+		if (local_uniforms_ != nullptr)
+			local_uniform_buffer_.unlock_memory();
+
 		context_ = other.context_;
 		stages = std::move(other.stages);
-		global_descriptor_pool_ = std::move(other.global_descriptor_pool_);
-		local_descriptor_pool_ = std::move(other.local_descriptor_pool_);
-		global_descriptor_set_layout_ = std::move(other.global_descriptor_set_layout_);
-		local_descriptor_set_layout_ = std::move(other.local_descriptor_set_layout_);
-		global_descriptor_sets_ = std::move(other.global_descriptor_sets_);
-		global_descriptor_updated_ = std::move(other.global_descriptor_updated_);
+		global_descriptor_set_layout_ = other.global_descriptor_set_layout_;
+		local_descriptor_set_layout_ = other.local_descriptor_set_layout_;
+		object_update_template_ = std::move(other.object_update_template_);
+		push_descriptor_set_with_template_ = other.push_descriptor_set_with_template_;
 		global_uniform_buffer_ = std::move(other.global_uniform_buffer_);
 		local_uniform_buffer_ = std::move(other.local_uniform_buffer_);
+		local_uniforms_ = other.local_uniforms_;
 		object_uniform_buffer_index = other.object_uniform_buffer_index;
-		object_states_ = std::move(other.object_states_);
+		free_object_ids_ = std::move(other.free_object_ids_);
 		default_diffuse_ = other.default_diffuse_;
-		pipeline_ = std::move(other.pipeline_);
+		pipelines_ = std::move(other.pipelines_);
 
 		other.context_ = nullptr;
+		other.local_uniforms_ = nullptr;
 		other.default_diffuse_ = nullptr;
 	}
 	return *this;
@@ -235,42 +271,37 @@ void VulkanObjectShader::update_global_state(float delta_time)
 	VulkanCommandBuffer &command_buffer = context_->get_command_buffer();
 	auto image_index = context_->image_index();
 
-	VkDescriptorSet global_descriptor = global_descriptor_sets_[image_index];
+	// Written every frame, the set is returned to the frame's pool when the frame retires
+	VkDescriptorSet global_descriptor = context_->get_frame_descriptor_allocator().allocate(global_descriptor_set_layout_);
 
-	if (!global_descriptor_updated_[image_index])
-	{
-		// Configure the descriptors for the given index
-		uint32_t range = sizeof(GlobalUniformObject);
-		uint64_t offset = sizeof(GlobalUniformObject) * image_index;
-
-		// Copy data to buffer
-		global_uniform_buffer_.load_data(&global_ubo, offset, range, 0);
-
-		VkDescriptorBufferInfo buffer_info{};
-		buffer_info.buffer = global_uniform_buffer_.get_handle();
-		buffer_info.offset = offset;
-		buffer_info.range = range;
-
-		// Update the descriptor sets
-
-		// Global ubo
-		VkWriteDescriptorSet ubo_descriptor_write{};
-		ubo_descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		ubo_descriptor_write.dstSet = global_descriptor;
-		ubo_descriptor_write.dstBinding = 0;
-		ubo_descriptor_write.dstArrayElement = 0;
-		ubo_descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		ubo_descriptor_write.descriptorCount = 1;
-		ubo_descriptor_write.pBufferInfo = &buffer_info;
-
-		vkUpdateDescriptorSets(context_->logical_device(), 1, &ubo_descriptor_write, 0, nullptr);
-		global_descriptor_updated_[image_index] = true;
-	}
+	// Configure the descriptors for the given index
+	uint32_t range = sizeof(GlobalUniformObject);
+	uint64_t offset = sizeof(GlobalUniformObject) * image_index;
+
+	// Copy data to buffer
+	global_uniform_buffer_.load_data(&global_ubo, offset, range, 0);
+
+	VkDescriptorBufferInfo buffer_info{};
+	buffer_info.buffer = global_uniform_buffer_.get_handle();
+	buffer_info.offset = offset;
+	buffer_info.range = range;
+
+	// Global ubo
+	VkWriteDescriptorSet ubo_descriptor_write{};
+	ubo_descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	ubo_descriptor_write.dstSet = global_descriptor;
+	ubo_descriptor_write.dstBinding = 0;
+	ubo_descriptor_write.dstArrayElement = 0;
+	ubo_descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	ubo_descriptor_write.descriptorCount = 1;
+	ubo_descriptor_write.pBufferInfo = &buffer_info;
+
+	vkUpdateDescriptorSets(context_->logical_device(), 1, &ubo_descriptor_write, 0, nullptr);
 
 	// Bind descriptor set
 	vkCmdBindDescriptorSets(command_buffer.get_handle(),
 							VK_PIPELINE_BIND_POINT_GRAPHICS,
-							pipeline_.layout(),
+							pipelines_[0].layout(),
 							0,
 							1,
 							&global_descriptor,
@@ -278,100 +309,38 @@ void VulkanObjectShader::update_global_state(float delta_time)
 							nullptr);
 }
 
-void VulkanObjectShader::update_object(GeometryRenderData data)
+void VulkanObjectShader::bind_object(const GeometryRenderData &data)
 {
 	VulkanCommandBuffer &command_buffer = context_->get_command_buffer();
-	auto image_index = context_->image_index();
-
-	vkCmdPushConstants(command_buffer.get_handle(), pipeline_.layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &data.model);
-
-	// Obtain material data
-	ObjectShaderObjectState *object_state = &object_states_[data.object_id];
-	VkDescriptorSet object_descriptor_set = object_state->descriptor_sets[image_index];
 
-	// Todo: check if it actually needs to update
-	std::array<VkWriteDescriptorSet, VULKAN_OBJECT_SHADER_DESCRIPTOR_COUNT> descriptor_writes{};
-	uint32_t descriptor_count = 0;
-	uint32_t descriptor_index = 0;
-
-	// Descriptor 0
-	uint32_t range = sizeof(LocalUniformObject);
-	uint64_t offset = sizeof(LocalUniformObject) * data.object_id;
-	LocalUniformObject lbo;
-
-	// Todo: get diffuse color from material
-
-	local_uniform_buffer_.load_data(&lbo, offset, range, 0);
-
-	// Only update if the descriptor hasn't already been updated
-	if (object_state->descriptor_states[descriptor_index].generations[image_index] == std::numeric_limits<uint32_t>::max())
+	// Textures that aren't loaded yet are drawn with the default one
+	const VulkanTexture *texture = diffuse_texture(data);
+	if (texture == nullptr)
+		texture = default_diffuse_;
+
+	// Descriptor 0 is the whole material buffer, the instances index it
+	ObjectDescriptorData descriptors{};
+	descriptors.materials.buffer = local_uniform_buffer_.get_handle();
+	descriptors.materials.offset = 0;
+	descriptors.materials.range = VK_WHOLE_SIZE;
+	descriptors.diffuse.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	descriptors.diffuse.imageView = texture->get_image().get_image_view();
+	descriptors.diffuse.sampler = texture->get_sampler();
+
+	if (uses_push_descriptors())
 	{
-		VkDescriptorBufferInfo buffer_info{};
-		buffer_info.buffer = local_uniform_buffer_.get_handle();
-		buffer_info.offset = offset;
-		buffer_info.range = range;
-
-		descriptor_writes[descriptor_count].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptor_writes[descriptor_count].dstSet = object_descriptor_set;
-		descriptor_writes[descriptor_count].dstBinding = descriptor_index;
-		descriptor_writes[descriptor_count].dstArrayElement = 0;
-		descriptor_writes[descriptor_count].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptor_writes[descriptor_count].descriptorCount = 1;
-		descriptor_writes[descriptor_count].pBufferInfo = &buffer_info;
-
-		descriptor_count++;
-		object_state->descriptor_states[descriptor_index].generations[image_index] = 1;
+		push_descriptor_set_with_template_(command_buffer.get_handle(), object_update_template_.get(), pipelines_[0].layout(), 1, &descriptors);
+		return;
 	}
-	descriptor_index++;
 
-	const uint32_t sampler_count = 1;
-	std::array<VkDescriptorImageInfo, 1> image_infos;
-	for (uint32_t sampler_index = 0; sampler_index < sampler_count; sampler_index++)
-	{
-		VulkanTexture* texture = data.textures[sampler_index];
-		auto& descriptor_generation = object_state->descriptor_states[descriptor_index].generations[image_index];
-
-		if (texture->get_generation() == std::numeric_limits<uint32_t>::max())
-		{
-			texture = default_diffuse_;
-
-			descriptor_generation = std::numeric_limits<uint32_t>::max();
-		}
-
-		if (texture && (descriptor_generation != texture->get_generation() || descriptor_generation == std::numeric_limits<uint32_t>::max()))
-		{
-			image_infos[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			image_infos[0].imageView = texture->get_image().get_image_view();
-			image_infos[0].sampler = texture->get_sampler();
-			
-			descriptor_writes[descriptor_count].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptor_writes[descriptor_count].dstSet = object_descriptor_set;
-			descriptor_writes[descriptor_count].dstBinding = descriptor_index;
-			descriptor_writes[descriptor_count].dstArrayElement = 0;
-			descriptor_writes[descriptor_count].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptor_writes[descriptor_count].descriptorCount = image_infos.size();
-			descriptor_writes[descriptor_count].pImageInfo = image_infos.data();
-			
-			descriptor_count++;
-			object_state->descriptor_states[descriptor_index].generations[image_index] = texture->get_generation();
-
-			// If not using default texture, sync the generation. 
-			if (texture->get_generation() != std::numeric_limits<uint32_t>::max()) {
-				descriptor_generation = texture->get_generation();
-			}
-			descriptor_index++;
-		}
-	}
-
-	if (descriptor_count > 0)
-	{
-		vkUpdateDescriptorSets(context_->logical_device(), descriptor_count, descriptor_writes.data(), 0, nullptr);
-	}
+	// Without push descriptors the bindings go into a transient set, returned to the pool when the frame retires
+	VkDescriptorSet object_descriptor_set = context_->get_frame_descriptor_allocator().allocate(local_descriptor_set_layout_);
+	vkUpdateDescriptorSetWithTemplate(context_->logical_device(), object_descriptor_set, object_update_template_.get(), &descriptors);
 
 	// Bind descriptor set
 	vkCmdBindDescriptorSets(command_buffer.get_handle(),
 							VK_PIPELINE_BIND_POINT_GRAPHICS,
-							pipeline_.layout(),
+							pipelines_[0].layout(),
 							1,
 							1,
 							&object_descriptor_set,
@@ -379,71 +348,55 @@ void VulkanObjectShader::update_object(GeometryRenderData data)
 							nullptr);
 }
 
-void VulkanObjectShader::use()
+const VulkanTexture *VulkanObjectShader::diffuse_texture(const GeometryRenderData &data)
 {
-	pipeline_.bind(context_->get_command_buffer(), VK_PIPELINE_BIND_POINT_GRAPHICS);
+	const VulkanTexture *texture = data.textures[0];
+	if (texture == nullptr || texture->get_generation() == std::numeric_limits<uint32_t>::max())
+		return nullptr;
+	return texture;
 }
 
-uint32_t VulkanObjectShader::acquire_resources()
+uint32_t VulkanObjectShader::material_key(const GeometryRenderData &data)
 {
-	// TODO: free list
-	uint32_t object_id = object_uniform_buffer_index;
-	object_uniform_buffer_index++;
-
-	auto &object_state = object_states_[object_id];
-	for (VulkanDescriptorState &descriptor_state: object_state.descriptor_states)
-	{
-		for (uint32_t &generation: descriptor_state.generations)
-		{
-			generation = std::numeric_limits<uint32_t>::max();
-		}
-	}
-
-	// Allocate descriptor sets
-	std::array<VkDescriptorSetLayout, 3> layouts = {
-			local_descriptor_set_layout_.get(),
-			local_descriptor_set_layout_.get(),
-			local_descriptor_set_layout_.get()};
-
-	VkDescriptorSetAllocateInfo alloc_info{};
-	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	alloc_info.descriptorPool = local_descriptor_pool_.get();
-	alloc_info.descriptorSetCount = layouts.size();
-	alloc_info.pSetLayouts = layouts.data();
-
-	// Do the allocation and check the result
-	if (vkAllocateDescriptorSets(context_->logical_device(), &alloc_info, object_state.descriptor_sets.data()) != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to allocate descriptor sets");
-	}
-
-	return object_id;
+	const VulkanTexture *texture = diffuse_texture(data);
+	return texture == nullptr ? 0 : texture->get_id() + 1;
 }
 
-void VulkanObjectShader::release_resources(uint32_t object_id)
+void VulkanObjectShader::use(PipelineVariant variant)
 {
-	ObjectShaderObjectState &object_state = object_states_[object_id];
+	pipelines_[static_cast<size_t>(variant)].bind(context_->get_command_buffer(), VK_PIPELINE_BIND_POINT_GRAPHICS);
+}
 
-	// Free the descriptor sets of the object state and check the resutl
-	if (vkFreeDescriptorSets(context_->logical_device(),
-							 local_descriptor_pool_.get(),
-							 object_state.descriptor_sets.size(),
-							 object_state.descriptor_sets.data()) != VK_SUCCESS)
+uint32_t VulkanObjectShader::acquire_resources()
+{
+	uint32_t object_id;
+	if (!free_object_ids_.empty())
 	{
-		throw std::runtime_error("Failed to free descriptor sets");
+		object_id = free_object_ids_.back();
+		free_object_ids_.pop_back();
 	}
-
-	// set generations to an invalid state
-	for (VulkanDescriptorState &descriptor_state: object_state.descriptor_states)
+	else
 	{
-		for (uint32_t &generation: descriptor_state.generations)
+		if (object_uniform_buffer_index >= VULKAN_OBJECT_SHADER_MAX_OBJECT_COUNT)
 		{
-			generation = std::numeric_limits<uint32_t>::max();
+			FLOWFORGE_WARN("Object shader is out of object slots ({} in use), the object is refused", VULKAN_OBJECT_SHADER_MAX_OBJECT_COUNT);
+			return no_object;
 		}
+		object_id = object_uniform_buffer_index++;
 	}
 
+	// Todo: get diffuse color from material
+	local_uniforms_[object_id] = LocalUniformObject{};
+	return object_id;
+}
+
+void VulkanObjectShader::release_resources(uint32_t object_id)
+{
+	if (object_id == no_object)
+		return;
 
-	// TODO: add the object id back into the pool
+	// Only the material buffer slot is per object, descriptors are written on every bind
+	free_object_ids_.push_back(object_id);
 }
 
 }// namespace flwfrg
@@ -18,7 +18,7 @@ public:
 public:
 	explicit VulkanObjectShader() = default;
 	explicit VulkanObjectShader(VulkanContext *context, VulkanTexture* default_diffuse);
-	~VulkanObjectShader() = default;
+	~VulkanObjectShader();
 
 	// Not copyable or movable
 	VulkanObjectShader(const VulkanObjectShader &) = delete;
@@ -28,47 +28,64 @@ public:
 
 	// Methods
 
-	[[nodiscard]] const VulkanDescriptorPool &get_global_descriptor_pool() const { return global_descriptor_pool_; };
+	// Writes the global uniforms into a transient set of the frame and binds it
 	void update_global_state(float delta_time);
-	void update_object(GeometryRenderData data);
+	// Writes the material bindings of the object straight into the command buffer with push descriptors,
+	// otherwise into a transient set of the frame that is then bound. Transforms and material indices come from the instance buffer.
+	// Objects with the same material_key share the bindings, so only changes of the key need a new bind.
+	void bind_object(const GeometryRenderData &data);
 
-	void use();
+	// The depth only variant reads the position stream of the geometry pool in binding 0
+	void use(PipelineVariant variant = PipelineVariant::DEFAULT);
 
+	static constexpr uint32_t no_object = ~0u;
+
+	// Reserves the object's uniforms and writes their defaults, draws only reference them afterwards.
+	// Returns no_object when every one of the VULKAN_OBJECT_SHADER_MAX_OBJECT_COUNT slots is taken.
 	[[nodiscard]] uint32_t acquire_resources();
 	void release_resources(uint32_t object_id);
 
+	[[nodiscard]] inline bool uses_push_descriptors() const { return push_descriptor_set_with_template_ != nullptr; };
+
+	// Diffuse texture the object is drawn with, nullptr when it falls back to the default one
+	[[nodiscard]] static const VulkanTexture *diffuse_texture(const GeometryRenderData &data);
+	// Identity of the bindings of the object, zero for the default texture. Keys may collide, equal diffuse textures decide.
+	[[nodiscard]] static uint32_t material_key(const GeometryRenderData &data);
+
 private:
 	VulkanContext *context_ = nullptr;
 
 	std::vector<VulkanShaderStage> stages{};
 
-	VulkanDescriptorPool global_descriptor_pool_{};
-	VulkanDescriptorPool local_descriptor_pool_{};
-	VulkanDescriptorSetLayout global_descriptor_set_layout_{};
-	VulkanDescriptorSetLayout local_descriptor_set_layout_{};
+	// Owned by the context's layout cache
+	VkDescriptorSetLayout global_descriptor_set_layout_ = VK_NULL_HANDLE;
+	VkDescriptorSetLayout local_descriptor_set_layout_ = VK_NULL_HANDLE;
 
-	// One set per frame (max 3)
-	std::array<VkDescriptorSet, 3> global_descriptor_sets_{};
-	std::array<bool, 3> global_descriptor_updated_{};
+	// Writes ObjectDescriptorData into set 1, as push descriptors when the device supports them
+	VulkanDescriptorUpdateTemplate object_update_template_{};
+	PFN_vkCmdPushDescriptorSetWithTemplateKHR push_descriptor_set_with_template_ = nullptr;
 
 	// Global uniform buffer
 	VulkanBuffer global_uniform_buffer_{};
 
-	// local object uniform buffer
+	// Storage buffer of every object's uniforms, mapped for the lifetime of the shader
 	VulkanBuffer local_uniform_buffer_{};
-	uint32_t object_uniform_buffer_index = 0;// Todo: manage a free list instead
-
-	std::array<ObjectShaderObjectState, VULKAN_OBJECT_SHADER_MAX_OBJECT_COUNT> object_states_{}; // Todo: Make dynamic later
+	LocalUniformObject *local_uniforms_ = nullptr;
+	uint32_t object_uniform_buffer_index = 0;
+	std::vector<uint32_t> free_object_ids_{};
 
 	// Pointers to default textures
 	VulkanTexture* default_diffuse_{};
 	
-	VulkanPipeline pipeline_{};
+	// Indexed by PipelineVariant, every variant has the same layout
+	std::array<VulkanPipeline, pipeline_variant_count> pipelines_{};
 
 	// Static members
 
 	static constexpr uint16_t shader_stage_count = 2;
 	static constexpr const char *shader_file_name = "object_shader";
+	// Vertex stage of the depth only variant, stored after the shader stages
+	static constexpr const char *depth_prepass_file_name = "depth_prepass";
 };
 
 }// namespace flwfrg
\ No newline at end of file
@@ -14,19 +14,15 @@ namespace flwfrg
 {
 class VulkanTexture;
 
-struct VulkanDescriptorState
-{
-	std::array<uint32_t, 3> generations{};
-};
-
 #define VULKAN_OBJECT_SHADER_DESCRIPTOR_COUNT 2
 #define VULKAN_OBJECT_SHADER_MAX_OBJECT_COUNT 1024
 
-struct ObjectShaderObjectState
+// Bindings of an object's set, in binding order. Read through the object shader's update template.
+// The material buffer is the same for every draw, only the diffuse texture changes between materials.
+struct ObjectDescriptorData
 {
-	std::array<VkDescriptorSet, 3> descriptor_sets{};
-
-	std::array<VulkanDescriptorState, VULKAN_OBJECT_SHADER_DESCRIPTOR_COUNT> descriptor_states{};
+	VkDescriptorBufferInfo materials;
+	VkDescriptorImageInfo diffuse;
 };
 
 struct GeometryRenderData
@@ -44,6 +40,7 @@ struct GlobalUniformObject
 	glm::mat4 _reserved1;	// 64 bytes
 };
 
+// Element of the object shader's material buffer, indexed by the material of each instance
 struct LocalUniformObject
 {
 	glm::vec4 diffuse_color = {1.0f, 1.0f, 1.0f, 1.0f};
@@ -4,7 +4,6 @@
 
 #include "../command_buffer.hpp"
 #include "renderer/vulkan/vulkan_context.hpp"
-#include "vertex.hpp"
 
 #include <array>
 
@@ -14,11 +13,11 @@ VulkanPipeline::~VulkanPipeline()
 {
 	if (handle_ != VK_NULL_HANDLE)
 	{
-		vkDestroyPipeline(context_->logical_device(), handle_, nullptr);
+		vkDestroyPipeline(context_->logical_device(), handle_, vulkan_allocator());
 	}
 	if (pipeline_layout_ != VK_NULL_HANDLE)
 	{
-		vkDestroyPipelineLayout(context_->logical_device(), pipeline_layout_, nullptr);
+		vkDestroyPipelineLayout(context_->logical_device(), pipeline_layout_, vulkan_allocator());
 	}
 }
 VulkanPipeline::VulkanPipeline(VulkanPipeline &&other) noexcept
@@ -35,11 +34,11 @@ VulkanPipeline &VulkanPipeline::operator=(VulkanPipeline &&other) noexcept
 	{
 		if (handle_ != VK_NULL_HANDLE)
 		{
-			vkDestroyPipeline(context_->logical_device(), handle_, nullptr);
+			vkDestroyPipeline(context_->logical_device(), handle_, vulkan_allocator());
 		}
 		if (pipeline_layout_ != VK_NULL_HANDLE)
 		{
-			vkDestroyPipelineLayout(context_->logical_device(), pipeline_layout_, nullptr);
+			vkDestroyPipelineLayout(context_->logical_device(), pipeline_layout_, vulkan_allocator());
 		}
 
 		context_ = other.context_;
@@ -53,7 +52,7 @@ VulkanPipeline &VulkanPipeline::operator=(VulkanPipeline &&other) noexcept
 	return *this;
 }
 
-std::optional<VulkanPipeline> VulkanPipeline::create_pipeline(VulkanContext *context, const VulkanRenderpass &renderpass, const std::vector<VkVertexInputAttributeDescription> &attributes, const std::vector<VkDescriptorSetLayout> &descriptor_set_layouts, const std::vector<VkPipelineShaderStageCreateInfo> &stages, VkViewport viewport, VkRect2D scissor, bool is_wireframe)
+std::optional<VulkanPipeline> VulkanPipeline::create_pipeline(VulkanContext *context, const VulkanRenderpass &renderpass, std::span<const VkVertexInputBindingDescription> vertex_bindings, std::span<const VkVertexInputAttributeDescription> attributes, std::span<const VkDescriptorSetLayout> descriptor_set_layouts, std::span<const VkPipelineShaderStageCreateInfo> stages, VkViewport viewport, VkRect2D scissor, bool is_wireframe, PipelineVariant variant)
 {
 	assert(context != nullptr);
 	
@@ -74,7 +73,8 @@ std::optional<VulkanPipeline> VulkanPipeline::create_pipeline(VulkanContext *con
 	rasterizer.rasterizerDiscardEnable = VK_FALSE;
 	rasterizer.polygonMode = is_wireframe ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL;
 	rasterizer.lineWidth = 1.0f;
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+	// The full screen triangle is wound whichever way is simplest
+	rasterizer.cullMode = variant == PipelineVariant::FULLSCREEN ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
 	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 	rasterizer.depthBiasEnable = VK_FALSE;
 	rasterizer.depthBiasConstantFactor = 0.0f;
@@ -94,16 +94,20 @@ std::optional<VulkanPipeline> VulkanPipeline::create_pipeline(VulkanContext *con
 	// Depth and stencil
 	VkPipelineDepthStencilStateCreateInfo depth_stencil{};
 	depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depth_stencil.depthTestEnable = VK_TRUE;
-	depth_stencil.depthWriteEnable = VK_TRUE;
-	depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	depth_stencil.depthTestEnable = variant == PipelineVariant::FULLSCREEN ? VK_FALSE : VK_TRUE;
+	// The depth buffer is already final after a pre-pass, only the matching fragments are shaded
+	depth_stencil.depthWriteEnable = variant == PipelineVariant::DEPTH_EQUAL || variant == PipelineVariant::FULLSCREEN ? VK_FALSE : VK_TRUE;
+	depth_stencil.depthCompareOp = variant == PipelineVariant::DEPTH_EQUAL ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS;
 	depth_stencil.depthBoundsTestEnable = VK_FALSE;
 	depth_stencil.stencilTestEnable = VK_FALSE;
 
 	// Color blend attachment state
 	VkPipelineColorBlendAttachmentState color_blend_attachment{};
-	color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	color_blend_attachment.blendEnable = VK_TRUE;
+	color_blend_attachment.colorWriteMask = variant == PipelineVariant::DEPTH_ONLY
+													? 0
+													: VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	// Opaque variants skip blending
+	color_blend_attachment.blendEnable = variant == PipelineVariant::DEFAULT ? VK_TRUE : VK_FALSE;
 	color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
 	color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
 	color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
@@ -131,17 +135,11 @@ std::optional<VulkanPipeline> VulkanPipeline::create_pipeline(VulkanContext *con
 	dynamic_state.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
 	dynamic_state.pDynamicStates = dynamic_states.data();
 
-	// Vertex input
-	VkVertexInputBindingDescription vertex_binding_description{};
-	vertex_binding_description.binding = 0;
-	vertex_binding_description.stride = sizeof(Vertex3d);
-	vertex_binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
 	// Attributes
 	VkPipelineVertexInputStateCreateInfo vertex_input_info{};
 	vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertex_input_info.vertexBindingDescriptionCount = 1;
-	vertex_input_info.pVertexBindingDescriptions = &vertex_binding_description;
+	vertex_input_info.vertexBindingDescriptionCount = static_cast<uint32_t>(vertex_bindings.size());
+	vertex_input_info.pVertexBindingDescriptions = vertex_bindings.data();
 	vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size());
 	vertex_input_info.pVertexAttributeDescriptions = attributes.data();
 
@@ -168,7 +166,7 @@ std::optional<VulkanPipeline> VulkanPipeline::create_pipeline(VulkanContext *con
 	pipeline_layout_info.pSetLayouts = descriptor_set_layouts.data();
 
 	// Create the pipeline layout
-	if (vkCreatePipelineLayout(context->logical_device(), &pipeline_layout_info, nullptr, &return_pipeline.pipeline_layout_) != VK_SUCCESS)
+	if (vkCreatePipelineLayout(context->logical_device(), &pipeline_layout_info, vulkan_allocator(), &return_pipeline.pipeline_layout_) != VK_SUCCESS)
 	{
 		FLOWFORGE_ERROR("Failed to create pipeline layout");
 		return std::nullopt;
@@ -192,13 +190,25 @@ std::optional<VulkanPipeline> VulkanPipeline::create_pipeline(VulkanContext *con
 
 	pipeline_info.layout = return_pipeline.pipeline_layout_;
 
+	// With dynamic rendering the pipeline only knows the attachment formats, there is no render pass
+	const VkFormat color_format = renderpass.get_color_format();
+	VkPipelineRenderingCreateInfoKHR rendering_info{VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR};
+	rendering_info.colorAttachmentCount = 1;
+	rendering_info.pColorAttachmentFormats = &color_format;
+	rendering_info.depthAttachmentFormat = renderpass.get_depth_format();
+	rendering_info.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+	if (renderpass.is_dynamic())
+	{
+		pipeline_info.pNext = &rendering_info;
+	}
+
 	pipeline_info.renderPass = renderpass.get_handle();
 	pipeline_info.subpass = 0;
 	pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
 	pipeline_info.basePipelineIndex = -1;
 
 	// Create the pipeline
-	if (vkCreateGraphicsPipelines(context->logical_device(), VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &return_pipeline.handle_) != VK_SUCCESS)
+	if (vkCreateGraphicsPipelines(context->logical_device(), VK_NULL_HANDLE, 1, &pipeline_info, vulkan_allocator(), &return_pipeline.handle_) != VK_SUCCESS)
 	{
 		FLOWFORGE_ERROR("Failed to create graphics pipeline");
 		return std::nullopt;
@@ -207,6 +217,53 @@ std::optional<VulkanPipeline> VulkanPipeline::create_pipeline(VulkanContext *con
 	return return_pipeline;
 }
 
+std::optional<VulkanPipeline> VulkanPipeline::create_compute_pipeline(VulkanContext *context, std::span<const VkDescriptorSetLayout> descriptor_set_layouts, const VkPipelineShaderStageCreateInfo &stage, uint32_t push_constant_size)
+{
+	assert(context != nullptr);
+	assert(stage.stage == VK_SHADER_STAGE_COMPUTE_BIT);
+
+	VulkanPipeline return_pipeline{context};
+
+	// Pipeline layout
+	VkPipelineLayoutCreateInfo pipeline_layout_info{};
+	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+
+	// Push constants
+	VkPushConstantRange push_constant_range{};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = push_constant_size;
+	pipeline_layout_info.pushConstantRangeCount = push_constant_size > 0 ? 1 : 0;
+	pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+	// Descriptor set layouts
+	pipeline_layout_info.setLayoutCount = static_cast<uint32_t>(descriptor_set_layouts.size());
+	pipeline_layout_info.pSetLayouts = descriptor_set_layouts.data();
+
+	// Create the pipeline layout
+	if (vkCreatePipelineLayout(context->logical_device(), &pipeline_layout_info, vulkan_allocator(), &return_pipeline.pipeline_layout_) != VK_SUCCESS)
+	{
+		FLOWFORGE_ERROR("Failed to create compute pipeline layout");
+		return std::nullopt;
+	}
+
+	// Create the pipeline
+	VkComputePipelineCreateInfo pipeline_info{};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_info.stage = stage;
+	pipeline_info.layout = return_pipeline.pipeline_layout_;
+	pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+	pipeline_info.basePipelineIndex = -1;
+
+	if (vkCreateComputePipelines(context->logical_device(), VK_NULL_HANDLE, 1, &pipeline_info, vulkan_allocator(), &return_pipeline.handle_) != VK_SUCCESS)
+	{
+		FLOWFORGE_ERROR("Failed to create compute pipeline");
+		return std::nullopt;
+	}
+
+	return return_pipeline;
+}
+
 void VulkanPipeline::bind(VulkanCommandBuffer &command_buffer, VkPipelineBindPoint bind_point) const
 {
 	vkCmdBindPipeline(command_buffer.get_handle(), bind_point, handle_);
@@ -2,6 +2,8 @@
 
 #include "imgui_impl_vulkan.h"
 
+#include <optional>
+#include <span>
 #include <vector>
 
 namespace flwfrg
@@ -10,6 +12,22 @@ class VulkanContext;
 class VulkanRenderpass;
 class VulkanCommandBuffer;
 
+/// <summary>
+/// Fixed function state a graphics pipeline is created with.
+/// DEPTH_ONLY writes depth and no color, for the depth pre-pass.
+/// DEPTH_EQUAL shades only the fragments that ended up in the depth buffer, without blending or depth writes.
+/// FULLSCREEN draws a single opaque triangle over the whole target, without depth testing or culling.
+/// </summary>
+enum class PipelineVariant : uint8_t
+{
+	DEFAULT = 0,
+	DEPTH_ONLY = 1,
+	DEPTH_EQUAL = 2,
+	FULLSCREEN = 3
+};
+
+constexpr uint32_t pipeline_variant_count = 4;
+
 class VulkanPipeline
 {
 public:
@@ -27,12 +45,19 @@ public:
 	// Create shader function
 	static std::optional<VulkanPipeline> create_pipeline(VulkanContext *context,
 														 const VulkanRenderpass &renderpass,
-														 const std::vector<VkVertexInputAttributeDescription> &attributes,
-														 const std::vector<VkDescriptorSetLayout> &descriptor_set_layouts,
-														 const std::vector<VkPipelineShaderStageCreateInfo> &stages,
+														 std::span<const VkVertexInputBindingDescription> vertex_bindings,
+														 std::span<const VkVertexInputAttributeDescription> attributes,
+														 std::span<const VkDescriptorSetLayout> descriptor_set_layouts,
+														 std::span<const VkPipelineShaderStageCreateInfo> stages,
 														 VkViewport viewport,
 														 VkRect2D scissor,
-														 bool is_wireframe);
+														 bool is_wireframe,
+														 PipelineVariant variant = PipelineVariant::DEFAULT);
+
+	static std::optional<VulkanPipeline> create_compute_pipeline(VulkanContext *context,
+																 std::span<const VkDescriptorSetLayout> descriptor_set_layouts,
+																 const VkPipelineShaderStageCreateInfo &stage,
+																 uint32_t push_constant_size);
 
 	[[nodiscard]] VkPipelineLayout layout() const { return pipeline_layout_; }
 
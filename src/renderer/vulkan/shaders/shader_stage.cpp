@@ -14,7 +14,7 @@ VulkanShaderStage::~VulkanShaderStage()
 {
 	if (handle_ != VK_NULL_HANDLE)
 	{
-		vkDestroyShaderModule(context_->logical_device(), handle_, nullptr);
+		vkDestroyShaderModule(context_->logical_device(), handle_, vulkan_allocator());
 	}
 }
 VulkanShaderStage::VulkanShaderStage(VulkanShaderStage &&other) noexcept
@@ -64,7 +64,7 @@ std::optional<VulkanShaderStage> VulkanShaderStage::create_shader_module(VulkanC
 	file.close();
 
 	// Create the shader module and check the result
-	if (vkCreateShaderModule(context->logical_device(), &return_stage.create_info, nullptr, &return_stage.handle_) != VK_SUCCESS)
+	if (vkCreateShaderModule(context->logical_device(), &return_stage.create_info, vulkan_allocator(), &return_stage.handle_) != VK_SUCCESS)
 	{
 		FLOWFORGE_ERROR("Failed to create shader module");
 		return std::nullopt;
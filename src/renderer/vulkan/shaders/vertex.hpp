@@ -5,24 +5,148 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 
+#include "vertex_layout.hpp"
+
+#include <cstddef>
+
 namespace flwfrg
 {
 
+// Full precision vertex used while importing and cooking, the geometry pool stores CompactVertex3d
 struct Vertex3d
 {
-	glm::vec4 position{0};
+	glm::vec3 position{0};
 	glm::vec2 texture_coordiante{0};
 
-	static std::vector<VkVertexInputAttributeDescription> get_binding_description()
+	using Layout = VertexLayout<glm::vec3, glm::vec2>;
+};
+
+static_assert(sizeof(Vertex3d) == Vertex3d::Layout::stride);
+static_assert(offsetof(Vertex3d, position) == Vertex3d::Layout::offsets[0]);
+static_assert(offsetof(Vertex3d, texture_coordiante) == Vertex3d::Layout::offsets[1]);
+
+/// <summary>
+/// Per instance vertex data, streamed from the frame's slice of the instance buffer.
+/// The model matrix is passed as four column attributes, followed by the material.
+/// x of the material is the index of the instance's uniforms in the object shader's material buffer,
+/// the rest pads the struct to the std430 stride the culling shader writes it with.
+/// </summary>
+struct InstanceData
+{
+	glm::mat4 model{1.0f};
+	glm::uvec4 material{0};
+
+	using Layout = VertexLayout<glm::vec4, glm::vec4, glm::vec4, glm::vec4, glm::uvec4>;
+};
+
+static_assert(sizeof(InstanceData) == InstanceData::Layout::stride);
+static_assert(offsetof(InstanceData, material) == InstanceData::Layout::offsets[4]);
+
+/// <summary>
+/// Maps positions inside a bounding box to and from the [-1, 1] range stored in quantized vertices.
+/// The dequantization is a uniform scale and an offset, so it can be folded into the model matrix
+/// without changing the direction of normals or the shape of bounding spheres.
+/// </summary>
+struct VertexQuantization
+{
+	glm::vec3 center{0};
+	float scale = 1.0f;
+
+	static VertexQuantization from_bounds(glm::vec3 min, glm::vec3 max)
+	{
+		const glm::vec3 extent = (max - min) * 0.5f;
+		VertexQuantization result{};
+		result.center = (min + max) * 0.5f;
+		result.scale = glm::max(glm::max(extent.x, extent.y), glm::max(extent.z, 1e-6f));
+		return result;
+	}
+
+	[[nodiscard]] glm::vec3 quantize(glm::vec3 position) const { return glm::clamp((position - center) / scale, -1.0f, 1.0f); }
+	[[nodiscard]] glm::vec3 dequantize(glm::vec3 position) const { return position * scale + center; }
+
+	// Matrix taking the normalized position read by the shader back to model space
+	[[nodiscard]] glm::mat4 dequantization_matrix() const
+	{
+		glm::mat4 result{scale};
+		result[3] = glm::vec4(center, 1.0f);
+		return result;
+	}
+};
+
+///// Octahedral normal encoding
+
+inline glm::vec2 octahedral_encode(glm::vec3 normal)
+{
+	normal /= glm::abs(normal.x) + glm::abs(normal.y) + glm::abs(normal.z);
+	glm::vec2 result{normal.x, normal.y};
+	if (normal.z < 0.0f)
 	{
-		std::vector<VkVertexInputAttributeDescription> attributeDescriptions{};
+		glm::vec2 sign{result.x >= 0.0f ? 1.0f : -1.0f, result.y >= 0.0f ? 1.0f : -1.0f};
+		result = (1.0f - glm::abs(glm::vec2{result.y, result.x})) * sign;
+	}
+	return result;
+}
+
+inline glm::vec3 octahedral_decode(glm::vec2 encoded)
+{
+	glm::vec3 normal{encoded.x, encoded.y, 1.0f - glm::abs(encoded.x) - glm::abs(encoded.y)};
+	float t = glm::max(-normal.z, 0.0f);
+	normal.x += normal.x >= 0.0f ? -t : t;
+	normal.y += normal.y >= 0.0f ? -t : t;
+	return glm::normalize(normal);
+}
+
+/// <summary>
+/// Compact 16 byte vertex the geometry pool stores. Positions are snorm16 relative to the mesh's VertexQuantization,
+/// texture coordinates are unorm16 and normals are octahedral snorm16.
+/// The position is also the depth pre-pass stream, so both passes read the same bits.
+/// </summary>
+struct CompactVertex3d
+{
+	Snorm16x4 position{};
+	Unorm16x2 texture_coordinate{};
+	Snorm16x2 normal{};
 
-		attributeDescriptions.push_back({0, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(Vertex3d, position)});
-		attributeDescriptions.push_back({1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex3d, texture_coordiante)});
-		
-		return attributeDescriptions;
+	using Layout = VertexLayout<Snorm16x4, Unorm16x2, Snorm16x2>;
+
+	static CompactVertex3d pack(const Vertex3d &vertex, glm::vec3 normal, const VertexQuantization &quantization)
+	{
+		CompactVertex3d result{};
+		result.position = Snorm16x4::pack(glm::vec4(quantization.quantize(vertex.position), 1.0f));
+		result.texture_coordinate = Unorm16x2::pack(glm::clamp(vertex.texture_coordiante, 0.0f, 1.0f));
+		result.normal = Snorm16x2::pack(octahedral_encode(normal));
+		return result;
 	}
-	
 };
 
-}
\ No newline at end of file
+static_assert(sizeof(CompactVertex3d) == 16);
+static_assert(sizeof(CompactVertex3d) == CompactVertex3d::Layout::stride);
+static_assert(offsetof(CompactVertex3d, texture_coordinate) == CompactVertex3d::Layout::offsets[1]);
+static_assert(offsetof(CompactVertex3d, normal) == CompactVertex3d::Layout::offsets[2]);
+
+/// <summary>
+/// Half float variant of the compact vertex, for meshes where 16 bit fixed point positions lose too much precision.
+/// Positions are stored in model space, so it needs no dequantization.
+/// </summary>
+struct HalfVertex3d
+{
+	Half4 position{};
+	Unorm16x2 texture_coordinate{};
+	Snorm16x2 normal{};
+
+	using Layout = VertexLayout<Half4, Unorm16x2, Snorm16x2>;
+
+	static HalfVertex3d pack(const Vertex3d &vertex, glm::vec3 normal)
+	{
+		HalfVertex3d result{};
+		result.position = Half4::pack(glm::vec4(vertex.position, 1.0f));
+		result.texture_coordinate = Unorm16x2::pack(glm::clamp(vertex.texture_coordiante, 0.0f, 1.0f));
+		result.normal = Snorm16x2::pack(octahedral_encode(normal));
+		return result;
+	}
+};
+
+static_assert(sizeof(HalfVertex3d) == 16);
+static_assert(sizeof(HalfVertex3d) == HalfVertex3d::Layout::stride);
+
+}// namespace flwfrg
@@ -0,0 +1,167 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <vulkan/vulkan_core.h>
+
+#include <array>
+#include <cstdint>
+
+namespace flwfrg
+{
+
+///// Packed attribute storage types
+
+// Four half floats (8 bytes)
+struct Half4
+{
+	std::array<uint16_t, 4> value{};
+
+	static Half4 pack(glm::vec4 v)
+	{
+		return {{glm::packHalf1x16(v.x), glm::packHalf1x16(v.y), glm::packHalf1x16(v.z), glm::packHalf1x16(v.w)}};
+	}
+};
+
+// Four signed normalized 16 bit integers (8 bytes). Read as [-1, 1] floats by the shader.
+struct Snorm16x4
+{
+	std::array<uint16_t, 4> value{};
+
+	static Snorm16x4 pack(glm::vec4 v)
+	{
+		return {{glm::packSnorm1x16(v.x), glm::packSnorm1x16(v.y), glm::packSnorm1x16(v.z), glm::packSnorm1x16(v.w)}};
+	}
+};
+
+// Two signed normalized 16 bit integers (4 bytes). Used for octahedral normals.
+struct Snorm16x2
+{
+	std::array<uint16_t, 2> value{};
+
+	static Snorm16x2 pack(glm::vec2 v)
+	{
+		return {{glm::packSnorm1x16(v.x), glm::packSnorm1x16(v.y)}};
+	}
+};
+
+// Two unsigned normalized 16 bit integers (4 bytes). Read as [0, 1] floats by the shader.
+struct Unorm16x2
+{
+	std::array<uint16_t, 2> value{};
+
+	static Unorm16x2 pack(glm::vec2 v)
+	{
+		return {{glm::packUnorm1x16(v.x), glm::packUnorm1x16(v.y)}};
+	}
+};
+
+
+///// Attribute type to format mapping
+
+template<typename T>
+struct VertexAttributeFormat;
+
+template<>
+struct VertexAttributeFormat<float> {
+	static constexpr VkFormat format = VK_FORMAT_R32_SFLOAT;
+};
+template<>
+struct VertexAttributeFormat<glm::vec2> {
+	static constexpr VkFormat format = VK_FORMAT_R32G32_SFLOAT;
+};
+template<>
+struct VertexAttributeFormat<glm::vec3> {
+	static constexpr VkFormat format = VK_FORMAT_R32G32B32_SFLOAT;
+};
+template<>
+struct VertexAttributeFormat<glm::vec4> {
+	static constexpr VkFormat format = VK_FORMAT_R32G32B32A32_SFLOAT;
+};
+template<>
+struct VertexAttributeFormat<uint32_t> {
+	static constexpr VkFormat format = VK_FORMAT_R32_UINT;
+};
+template<>
+struct VertexAttributeFormat<glm::uvec4> {
+	static constexpr VkFormat format = VK_FORMAT_R32G32B32A32_UINT;
+};
+template<>
+struct VertexAttributeFormat<Half4> {
+	static constexpr VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;
+};
+template<>
+struct VertexAttributeFormat<Snorm16x4> {
+	static constexpr VkFormat format = VK_FORMAT_R16G16B16A16_SNORM;
+};
+template<>
+struct VertexAttributeFormat<Snorm16x2> {
+	static constexpr VkFormat format = VK_FORMAT_R16G16_SNORM;
+};
+template<>
+struct VertexAttributeFormat<Unorm16x2> {
+	static constexpr VkFormat format = VK_FORMAT_R16G16_UNORM;
+};
+
+
+///// Compile time vertex layout
+
+/// <summary>
+/// Describes a vertex struct as the ordered list of its member types.
+/// Offsets follow the C++ layout rules, so a struct declaring the same members in the same order
+/// can static_assert against the generated offsets and stride.
+/// </summary>
+template<typename... Attributes>
+struct VertexLayout
+{
+	static constexpr uint32_t attribute_count = sizeof...(Attributes);
+
+	static constexpr std::array<uint32_t, attribute_count> offsets = [] {
+		std::array<uint32_t, attribute_count> result{};
+		constexpr std::array<uint32_t, attribute_count> sizes = {sizeof(Attributes)...};
+		constexpr std::array<uint32_t, attribute_count> alignments = {alignof(Attributes)...};
+
+		uint32_t offset = 0;
+		for (uint32_t i = 0; i < attribute_count; i++)
+		{
+			offset = (offset + alignments[i] - 1) / alignments[i] * alignments[i];
+			result[i] = offset;
+			offset += sizes[i];
+		}
+		return result;
+	}();
+
+	static constexpr uint32_t alignment = [] {
+		uint32_t result = 1;
+		((result = alignof(Attributes) > result ? alignof(Attributes) : result), ...);
+		return result;
+	}();
+
+	static constexpr uint32_t stride = [] {
+		constexpr std::array<uint32_t, attribute_count> sizes = {sizeof(Attributes)...};
+		uint32_t end = offsets[attribute_count - 1] + sizes[attribute_count - 1];
+		return (end + alignment - 1) / alignment * alignment;
+	}();
+
+	static constexpr std::array<VkFormat, attribute_count> formats = {VertexAttributeFormat<Attributes>::format...};
+
+	static constexpr std::array<VkVertexInputAttributeDescription, attribute_count> attributes(uint32_t binding = 0, uint32_t first_location = 0)
+	{
+		std::array<VkVertexInputAttributeDescription, attribute_count> result{};
+		for (uint32_t i = 0; i < attribute_count; i++)
+		{
+			result[i] = {first_location + i, binding, formats[i], offsets[i]};
+		}
+		return result;
+	}
+
+	static constexpr VkVertexInputBindingDescription binding_description(uint32_t binding = 0, VkVertexInputRate input_rate = VK_VERTEX_INPUT_RATE_VERTEX)
+	{
+		return {binding, stride, input_rate};
+	}
+};
+
+}// namespace flwfrg
@@ -3,6 +3,8 @@
 #include "swapchain.hpp"
 #include "vulkan_context.hpp"
 
+#include <algorithm>
+
 
 namespace flwfrg
 {
@@ -10,20 +12,31 @@ VulkanSwapchain::VulkanSwapchain(VulkanContext *context)
 	: context_{context}
 {
 	assert(context != nullptr);
+
+	if (context_->device_.is_extension_enabled(VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+	{
+		wait_for_present_ = reinterpret_cast<PFN_vkWaitForPresentKHR>(
+				vkGetDeviceProcAddr(context_->device_.logical_device_, "vkWaitForPresentKHR"));
+	}
 	
 	FLOWFORGE_INFO("Creating initial swapchain");
-	recreate_swapchain();
+	if (!recreate_swapchain())
+	{
+		throw std::runtime_error("Failed to create swapchain, the surface has no area!");
+	}
 }
 
 VulkanSwapchain::~VulkanSwapchain()
 {
+	destroy_retired_swapchains(true);
+
 	// Destroy the views
 	for (auto view: swapchain_image_views_)
 	{
-		vkDestroyImageView(context_->device_.logical_device_, view, nullptr);
+		vkDestroyImageView(context_->device_.logical_device_, view, vulkan_allocator());
 	}
 	
-	vkDestroySwapchainKHR(context_->device_.logical_device_, swapchain_, nullptr);
+	vkDestroySwapchainKHR(context_->device_.logical_device_, swapchain_, vulkan_allocator());
 	FLOWFORGE_INFO("Vulkan swapchain destroyed");
 }
 
@@ -39,11 +52,14 @@ bool VulkanSwapchain::acquire_next_image(uint64_t timeout_ns, VkSemaphore image_
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR)
 	{
-		// Trigger swapchain recreation, then boot out of the render loop.
-		recreate_swapchain();
-		context_->regenerate_framebuffers();
+		// Recreate at the start of the next frame, then boot out of the render loop.
+		request_recreation();
 		return false;
-	} else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+	} else if (result == VK_SUBOPTIMAL_KHR)
+	{
+		// The image can still be presented
+		request_recreation();
+	} else if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to acquire swapchain image!");
 	}
@@ -61,27 +77,92 @@ bool VulkanSwapchain::present(VkQueue graphics_queue, VkQueue present_queue, VkS
 	present_info.pImageIndices = &present_image_index;
 	present_info.pResults = nullptr;
 
+	// Ids are only needed to wait for the present
+	VkPresentIdKHR present_id_info{VK_STRUCTURE_TYPE_PRESENT_ID_KHR};
+	const uint64_t present_id = present_id_ + 1;
+	if (supports_present_wait())
+	{
+		present_id_info.swapchainCount = 1;
+		present_id_info.pPresentIds = &present_id;
+		present_info.pNext = &present_id_info;
+	}
+
 	VkResult result = vkQueuePresentKHR(present_queue, &present_info);
+	if (supports_present_wait())
+		present_id_ = present_id;
+
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
 	{
-		recreate_swapchain();
-		context_->regenerate_framebuffers();
+		request_recreation();
 	} else if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to present swapchain image!");
 	}
 
-	context_->current_frame_ = (context_->current_frame_ + 1) % max_frames_in_flight_;
+	context_->current_frame_ = (context_->current_frame_ + 1) % frames_in_flight_;
+	presented_frames_++;
+	destroy_retired_swapchains(false);
 
 	return true;
 }
 
-void VulkanSwapchain::recreate_swapchain()
+bool VulkanSwapchain::recreate_if_requested()
 {
-	FLOWFORGE_TRACE("Recreating swapchain");
+	if (!recreation_requested_)
+		return true;
+
+	if (!recreate_swapchain())
+		return false;
 
+	recreation_requested_ = false;
+	return true;
+}
+
+void VulkanSwapchain::set_present_mode(VkPresentModeKHR present_mode)
+{
+	preferred_present_mode_ = present_mode;
+	request_recreation();
+}
+
+void VulkanSwapchain::set_frames_in_flight(uint8_t frames_in_flight)
+{
+	frames_in_flight = std::clamp<uint8_t>(frames_in_flight, 1, max_frames_in_flight_);
+	if (frames_in_flight == frames_in_flight_)
+		return;
+
+	// Every frame slot has to be idle before the cycle changes length
 	vkDeviceWaitIdle(context_->device_.logical_device_);
-	
+	frames_in_flight_ = frames_in_flight;
+	context_->current_frame_ = 0;
+	context_->images_in_flight_.assign(swapchain_images_.size(), nullptr);
+
+	FLOWFORGE_INFO("{} frames in flight", frames_in_flight_);
+}
+
+bool VulkanSwapchain::wait_for_present(uint64_t present_id, uint64_t timeout_ns) const
+{
+	if (!supports_present_wait() || present_id == 0)
+		return false;
+
+	// Presents of a swapchain that was replaced are never reported
+	if (present_id < swapchain_first_present_id_)
+		return true;
+
+	const VkResult result = wait_for_present_(context_->device_.logical_device_, swapchain_, present_id, timeout_ns);
+	return result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR;
+}
+
+bool VulkanSwapchain::recreate_swapchain()
+{
+	context_->device_.swapchain_support_ = context_->device_.query_swapchain_support(); // TODO: This really shouldn't be done here?
+
+	// Minimized windows have no area, a swapchain can't be created until they get one back
+	const VkExtent2D surface_extent = context_->device_.swapchain_support_.capabilities.currentExtent;
+	if (surface_extent.width == 0 || surface_extent.height == 0)
+		return false;
+
+	FLOWFORGE_TRACE("Recreating swapchain");
+
 	VkSwapchainKHR old_swapchain = swapchain_;
 	swapchain_ = VK_NULL_HANDLE;
 
@@ -91,19 +172,17 @@ void VulkanSwapchain::recreate_swapchain()
 		throw std::runtime_error("Failed to choose swapchain surface format!");
 	}
 
-	// Choose present mode
+	// Choose present mode, FIFO is always supported
+	const std::vector<VkPresentModeKHR> &present_modes = context_->device_.swapchain_support_.present_modes;
 	VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
-	for (size_t i = 0; i < context_->device_.swapchain_support_.present_modes.size(); i++)
+	if (std::find(present_modes.begin(), present_modes.end(), preferred_present_mode_) != present_modes.end())
 	{
-		if (context_->device_.swapchain_support_.present_modes[i] == VK_PRESENT_MODE_MAILBOX_KHR)
-		{
-			present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
-			break;
-		}
+		present_mode = preferred_present_mode_;
+	} else if (preferred_present_mode_ != VK_PRESENT_MODE_FIFO_KHR)
+	{
+		FLOWFORGE_WARN("Present mode {} is not supported, falling back to FIFO", static_cast<int>(preferred_present_mode_));
 	}
 
-	context_->device_.swapchain_support_ = context_->device_.query_swapchain_support(); // TODO: This really shouldn't be done here?
-
 	VkExtent2D extent = context_->device_.swapchain_support_.capabilities.currentExtent;
 	
 	// Clamp size
@@ -161,24 +240,19 @@ void VulkanSwapchain::recreate_swapchain()
 	if (vkCreateSwapchainKHR(
 				context_->device_.logical_device_,
 				&create_info,
-				nullptr,
+				vulkan_allocator(),
 				&swapchain_) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create swapchain!");
 	}
 
+	// Frames in flight may still render to the old images, they are destroyed once those frames are done
 	if (old_swapchain != VK_NULL_HANDLE)
 	{
-		vkDestroySwapchainKHR(context_->device_.logical_device_, old_swapchain, nullptr);
-	}
-
-	// Destroy the old images (if they exist)
-	for (auto view: swapchain_image_views_)
-	{
-		vkDestroyImageView(context_->device_.logical_device_, view, nullptr);
+		retired_swapchains_.push_back({old_swapchain, std::move(swapchain_image_views_), presented_frames_});
+		swapchain_image_views_.clear();
 	}
 
-	context_->current_frame_ = 0;
 	// Get the image count and check result
 	if (vkGetSwapchainImagesKHR(
 				context_->device_.logical_device_,
@@ -219,30 +293,47 @@ void VulkanSwapchain::recreate_swapchain()
 		if (vkCreateImageView(
 					context_->device_.logical_device_,
 					&image_view_create_info,
-					nullptr,
+					vulkan_allocator(),
 					&swapchain_image_views_[i]) != VK_SUCCESS)
 		{
 			throw std::runtime_error("Failed to create image views");
 		}
 	}
 
-	// Check if depth formats are supported
+	// Check if depth formats are supported, the depth attachment itself belongs to the frame graph
 	if (!context_->device_.detect_depth_format())
 	{
 		throw std::runtime_error("Failed to detect depth format");
 	}
 
-	// Create the depth attachment with view
-	depth_attachment_ = std::make_unique<VulkanImage>(
-			context_,
-			extent.width,
-			extent.height,
-			context_->device_.depth_format_,
-			VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			VK_IMAGE_ASPECT_DEPTH_BIT,
-			true);
+	// The fences guard the command buffer of the image index, which the new images reuse
+	if (old_swapchain != VK_NULL_HANDLE)
+		context_->images_in_flight_.resize(swapchain_images_.size(), nullptr);
+
+	extent_ = extent;
+	present_mode_ = present_mode;
+	swapchain_first_present_id_ = present_id_ + 1;
+	generation_++;
+
+	return true;
+}
+
+void VulkanSwapchain::destroy_retired_swapchains(bool all)
+{
+	// Every frame slot waits for its fence before it is reused, so once as many frames as there are slots were
+	// presented after the retirement, the GPU is done with the old images. One more frame covers the present
+	// that was queued last, which the presentation engine may still hold.
+	std::erase_if(retired_swapchains_, [this, all](RetiredSwapchain &retired) {
+		if (!all && !has_retired(retired.retired_frame))
+			return false;
+
+		for (VkImageView view: retired.image_views)
+		{
+			vkDestroyImageView(context_->device_.logical_device_, view, vulkan_allocator());
+		}
+		vkDestroySwapchainKHR(context_->device_.logical_device_, retired.swapchain, vulkan_allocator());
+		return true;
+	});
 }
 
 bool VulkanSwapchain::choose_swapchain_surface_format()
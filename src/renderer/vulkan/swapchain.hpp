@@ -1,16 +1,17 @@
 #pragma once
 
-#include <memory>
-
 #include "device.hpp"
-#include "frame_buffer.hpp"
-#include "image.hpp"
+
+#include <atomic>
 
 namespace flwfrg
 {
 
 class VulkanSwapchain
 {
+public:
+	static constexpr uint8_t default_frames_in_flight = 2;
+
 public:
 	explicit VulkanSwapchain(VulkanContext *context);
 	~VulkanSwapchain();
@@ -24,22 +25,78 @@ public:
 	// Methods
 	bool acquire_next_image(uint64_t timeout_ns, VkSemaphore image_availiable_semaphore, VkFence fence, uint32_t *out_image_index);
 	bool present(VkQueue graphics_queue, VkQueue present_queue, VkSemaphore render_complete_semaphore, uint32_t present_image_index);
+
+	// Marks the swapchain out of date, it is recreated by the next recreate_if_requested
+	inline void request_recreation() { recreation_requested_ = true; };
+	// Applies the requested recreation, at most once per frame and while no image is acquired.
+	// The old swapchain is retired without waiting for the device. Returns false while the surface has no area.
+	bool recreate_if_requested();
+
+	// Switches to the mode with the next recreation, or to FIFO when the surface doesn't support it
+	void set_present_mode(VkPresentModeKHR present_mode);
+	// Waits for the device and starts over at the first frame, at most get_max_frames_in_flight
+	void set_frames_in_flight(uint8_t frames_in_flight);
+	// Blocks until the present with the id was shown, or the timeout passed. Presents of an older swapchain count as shown.
+	// Returns false on a timeout, or without present wait support.
+	bool wait_for_present(uint64_t present_id, uint64_t timeout_ns) const;
+
 	[[nodiscard]] inline uint8_t get_image_count() const { return swapchain_images_.size(); };
+	// Per frame resources are created for this many frames, fewer may be in flight
+	[[nodiscard]] inline uint8_t get_max_frames_in_flight() const { return max_frames_in_flight_; };
+	[[nodiscard]] inline uint8_t get_frames_in_flight() const { return frames_in_flight_; };
+	[[nodiscard]] inline VkPresentModeKHR get_present_mode() const { return present_mode_; };
+	[[nodiscard]] inline bool supports_present_wait() const { return wait_for_present_ != nullptr; };
+	// Id of the last queued present, zero before the first one or without present wait support
+	[[nodiscard]] inline uint64_t get_present_id() const { return present_id_; };
+	[[nodiscard]] inline VkExtent2D get_extent() const { return extent_; };
+	[[nodiscard]] inline VkFormat get_format() const { return swapchain_image_format_.format; };
+	[[nodiscard]] inline VkImage get_image(uint32_t index) const { return swapchain_images_[index]; };
+	[[nodiscard]] inline VkImageView get_image_view(uint32_t index) const { return swapchain_image_views_[index]; };
+	// Changes every time the swapchain is recreated
+	[[nodiscard]] inline uint32_t get_generation() const { return generation_; };
+	// Frames presented so far. Resources replaced at one count can be destroyed once has_retired is true for it,
+	// no frame in flight uses them anymore then.
+	[[nodiscard]] inline uint64_t get_presented_frames() const { return presented_frames_; };
+	[[nodiscard]] inline bool has_retired(uint64_t presented_frames) const { return presented_frames_ > presented_frames + max_frames_in_flight_ + 1; };
 
 private:
 	VulkanContext *context_;
 
+	static constexpr uint8_t max_frames_in_flight_ = 3;
+
 	VkSurfaceFormatKHR swapchain_image_format_;
-	uint8_t max_frames_in_flight_ = 2;
+	uint8_t frames_in_flight_ = default_frames_in_flight;
+	VkPresentModeKHR preferred_present_mode_ = VK_PRESENT_MODE_MAILBOX_KHR;
+	VkPresentModeKHR present_mode_ = VK_PRESENT_MODE_FIFO_KHR;
 	VkSwapchainKHR swapchain_ = VK_NULL_HANDLE;
+	VkExtent2D extent_{};
 
 	std::vector<VkImage> swapchain_images_;
 	std::vector<VkImageView> swapchain_image_views_;
-	std::unique_ptr<VulkanImage> depth_attachment_;
+	uint32_t generation_ = 0;
+
+	PFN_vkWaitForPresentKHR wait_for_present_ = nullptr;
+	uint64_t present_id_ = 0;
+	// First present id of the current swapchain
+	uint64_t swapchain_first_present_id_ = 1;
+
+	// Swapchains replaced while frames in flight may still use their images
+	struct RetiredSwapchain
+	{
+		VkSwapchainKHR swapchain;
+		std::vector<VkImageView> image_views;
+		// Presents queued before it was retired
+		uint64_t retired_frame;
+	};
 
-	std::vector<VulkanFrameBuffer> frame_buffers_;
+	// Requested by the window callbacks on the main thread, checked by the thread that renders
+	std::atomic<bool> recreation_requested_{false};
+	uint64_t presented_frames_ = 0;
+	std::vector<RetiredSwapchain> retired_swapchains_{};
 
-	void recreate_swapchain();
+	// Returns false, keeping the current swapchain, when the surface has no area
+	bool recreate_swapchain();
+	void destroy_retired_swapchains(bool all);
 
 	bool choose_swapchain_surface_format();
 
@@ -0,0 +1,201 @@
+#include "pch.hpp"
+
+#include "upscaler.hpp"
+
+#include "command_buffer.hpp"
+#include "shaders/shader_stage.hpp"
+#include "vulkan_context.hpp"
+
+#include <array>
+
+namespace flwfrg
+{
+
+///// Local helper functions
+
+namespace
+{
+
+constexpr const char *upscale_shader_file_name = "upscale";
+// Strength of the sharpening, one undoes most of the blur of a half scale bilinear stretch
+constexpr float sharpened_strength = 0.6f;
+
+}// namespace
+
+
+///// Method implementations
+
+VulkanUpscaler::VulkanUpscaler(VulkanContext *context)
+	: context_{context}
+{
+	assert(context != nullptr);
+
+	create_pipeline();
+	create_sampler();
+	create_descriptor_set();
+}
+
+VulkanUpscaler::~VulkanUpscaler()
+{
+	if (sampler_ != VK_NULL_HANDLE)
+	{
+		vkDestroySampler(context_->logical_device(), sampler_, vulkan_allocator());
+	}
+}
+
+void VulkanUpscaler::record(VulkanCommandBuffer &command_buffer,
+							VkImageView source_view,
+							VkExtent2D source_extent,
+							VkExtent2D rendered_extent,
+							VkExtent2D target_extent,
+							UpscaleFilter filter)
+{
+	if (source_view != source_view_)
+	{
+		bind_source(source_view);
+	}
+
+	VkCommandBuffer handle = command_buffer.get_handle();
+
+	VkViewport viewport{};
+	viewport.width = static_cast<float>(target_extent.width);
+	viewport.height = static_cast<float>(target_extent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(handle, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.extent = target_extent;
+	vkCmdSetScissor(handle, 0, 1, &scissor);
+
+	pipeline_.bind(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS);
+	vkCmdBindDescriptorSets(handle, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_.layout(), 0, 1, &descriptor_set_, 0, nullptr);
+
+	UpscaleConstants constants{};
+	constants.uv_scale = {static_cast<float>(rendered_extent.width) / static_cast<float>(source_extent.width),
+						  static_cast<float>(rendered_extent.height) / static_cast<float>(source_extent.height)};
+	constants.texel_size = {1.0f / static_cast<float>(source_extent.width), 1.0f / static_cast<float>(source_extent.height)};
+	constants.sharpness = filter == UpscaleFilter::SHARPENED ? sharpened_strength : 0.0f;
+	vkCmdPushConstants(handle, pipeline_.layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(UpscaleConstants), &constants);
+
+	vkCmdDraw(handle, 3, 1, 0, 0);
+}
+
+
+///// Private methods
+
+void VulkanUpscaler::create_pipeline()
+{
+	VkDescriptorSetLayoutBinding binding{};
+	binding.binding = 0;
+	binding.descriptorCount = 1;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layout_info{};
+	layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_info.bindingCount = 1;
+	layout_info.pBindings = &binding;
+	descriptor_set_layout_ = VulkanDescriptorSetLayout(context_, layout_info);
+
+	std::optional<VulkanShaderStage> vertex_stage = VulkanShaderStage::create_shader_module(context_, upscale_shader_file_name, VK_SHADER_STAGE_VERTEX_BIT);
+	std::optional<VulkanShaderStage> fragment_stage = VulkanShaderStage::create_shader_module(context_, upscale_shader_file_name, VK_SHADER_STAGE_FRAGMENT_BIT);
+	if (!vertex_stage.has_value() || !fragment_stage.has_value())
+	{
+		throw std::runtime_error("Failed to create upscale shader stages");
+	}
+
+	// Viewport and scissor are dynamic, these only have to be valid
+	const VkExtent2D extent = context_->get_swapchain().get_extent();
+	const VkViewport viewport{0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f};
+	const VkRect2D scissor{{0, 0}, extent};
+
+	const std::array<VkDescriptorSetLayout, 1> layouts = {descriptor_set_layout_.get()};
+	const std::array<VkPipelineShaderStageCreateInfo, 2> stages = {vertex_stage->get_shader_stage_create_info(), fragment_stage->get_shader_stage_create_info()};
+
+	// The triangle is generated from the vertex index, there is no vertex input
+	auto created_pipeline = VulkanPipeline::create_pipeline(context_,
+															context_->get_renderpass(),
+															{},
+															{},
+															layouts,
+															stages,
+															viewport,
+															scissor,
+															false,
+															PipelineVariant::FULLSCREEN);
+	if (!created_pipeline.has_value())
+	{
+		throw std::runtime_error("Failed to create upscale pipeline");
+	}
+
+	pipeline_ = std::move(created_pipeline.value());
+}
+
+void VulkanUpscaler::create_sampler()
+{
+	VkSamplerCreateInfo sampler_info{};
+	sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_info.magFilter = VK_FILTER_LINEAR;
+	sampler_info.minFilter = VK_FILTER_LINEAR;
+	sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.anisotropyEnable = VK_FALSE;
+	sampler_info.compareEnable = VK_FALSE;
+	sampler_info.minLod = 0.0f;
+	sampler_info.maxLod = 0.0f;
+
+	if (vkCreateSampler(context_->logical_device(), &sampler_info, vulkan_allocator(), &sampler_) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create upscale sampler");
+	}
+}
+
+void VulkanUpscaler::create_descriptor_set()
+{
+	VkDescriptorPoolSize pool_size{};
+	pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pool_size.descriptorCount = 1;
+
+	VkDescriptorPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = 1;
+	pool_info.pPoolSizes = &pool_size;
+	pool_info.maxSets = 1;
+	descriptor_pool_ = VulkanDescriptorPool(context_, pool_info);
+
+	const VkDescriptorSetLayout layout = descriptor_set_layout_.get();
+
+	VkDescriptorSetAllocateInfo allocate_info{};
+	allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocate_info.descriptorPool = descriptor_pool_.get();
+	allocate_info.descriptorSetCount = 1;
+	allocate_info.pSetLayouts = &layout;
+	if (vkAllocateDescriptorSets(context_->logical_device(), &allocate_info, &descriptor_set_) != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate upscale descriptor set");
+	}
+}
+
+void VulkanUpscaler::bind_source(VkImageView source_view)
+{
+	VkDescriptorImageInfo image_info{};
+	image_info.sampler = sampler_;
+	image_info.imageView = source_view;
+	image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet write{};
+	write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write.dstSet = descriptor_set_;
+	write.dstBinding = 0;
+	write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write.descriptorCount = 1;
+	write.pImageInfo = &image_info;
+
+	vkUpdateDescriptorSets(context_->logical_device(), 1, &write, 0, nullptr);
+	source_view_ = source_view;
+}
+
+}// namespace flwfrg
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "descriptor.hpp"
+#include "shaders/pipeline.hpp"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace flwfrg
+{
+class VulkanContext;
+class VulkanCommandBuffer;
+
+enum class UpscaleFilter : uint8_t
+{
+	BILINEAR = 0,
+	// Bilinear, then sharpened within the range of the neighbouring texels so edges don't ring
+	SHARPENED = 1
+};
+
+/// <summary>
+/// Stretches the rendered top left part of a color target over the whole render area with a full screen triangle.
+/// Records inside a render pass compatible with the main one, the source has to be in the shader read only layout.
+/// </summary>
+class VulkanUpscaler
+{
+public:
+	explicit VulkanUpscaler(VulkanContext *context);
+	~VulkanUpscaler();
+
+	// Not copyable or movable
+	VulkanUpscaler(const VulkanUpscaler &) = delete;
+	VulkanUpscaler &operator=(const VulkanUpscaler &) = delete;
+	VulkanUpscaler(VulkanUpscaler &&) = delete;
+	VulkanUpscaler &operator=(VulkanUpscaler &&) = delete;
+
+	// Methods
+
+	// The source view may only change after the device waited for the frames that read the last one
+	void record(VulkanCommandBuffer &command_buffer,
+				VkImageView source_view,
+				VkExtent2D source_extent,
+				VkExtent2D rendered_extent,
+				VkExtent2D target_extent,
+				UpscaleFilter filter);
+
+private:
+	// Pushed to the vertex stage, which hands them on to the fragment stage
+	struct UpscaleConstants
+	{
+		// Rendered part of the source and the size of a source texel, in uv coordinates
+		glm::vec2 uv_scale;
+		glm::vec2 texel_size;
+		float sharpness;
+		float padding[3];
+	};
+
+	VulkanContext *context_;
+
+	VulkanDescriptorSetLayout descriptor_set_layout_{};
+	VulkanDescriptorPool descriptor_pool_{};
+	VulkanPipeline pipeline_{};
+	VkSampler sampler_ = VK_NULL_HANDLE;
+
+	VkDescriptorSet descriptor_set_ = VK_NULL_HANDLE;
+	VkImageView source_view_ = VK_NULL_HANDLE;
+
+	///// Private methods
+
+	void create_pipeline();
+	void create_sampler();
+	void create_descriptor_set();
+	void bind_source(VkImageView source_view);
+};
+
+}// namespace flwfrg
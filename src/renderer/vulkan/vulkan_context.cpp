@@ -3,6 +3,7 @@
 #include "vulkan_context.hpp"
 #include "imgui_impl_vulkan.h"
 
+#include <array>
 #include <unordered_set>
 
 
@@ -77,8 +78,6 @@ VulkanContext::VulkanContext(Window& window)
 {
 	window_.register_resize_callback(resize_callback, this);
 	
-	FLOWFORGE_INFO("Creating frame buffers");
-	regenerate_framebuffers();
 	FLOWFORGE_INFO("Creating command buffers");
 	create_command_buffers();
 
@@ -88,13 +87,23 @@ VulkanContext::VulkanContext(Window& window)
 	{
 		VkSemaphoreCreateInfo semaphore_info{};
 		semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-		vkCreateSemaphore(device_.logical_device_, &semaphore_info, nullptr, &image_avaliable_semaphores_[i]);
-		vkCreateSemaphore(device_.logical_device_, &semaphore_info, nullptr, &queue_complete_semaphores_[i]);
+		vkCreateSemaphore(device_.logical_device_, &semaphore_info, vulkan_allocator(), &image_avaliable_semaphores_[i]);
+		vkCreateSemaphore(device_.logical_device_, &semaphore_info, vulkan_allocator(), &queue_complete_semaphores_[i]);
 		
 		in_flight_fences_.emplace_back(this, true);
 	}
 
 	images_in_flight_.resize(swapchain_.get_image_count());
+
+	// Transient sets hold a uniform or storage buffer and a texture at most
+	constexpr std::array<DescriptorPoolRatio, 3> frame_descriptor_ratios = {{
+			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f},
+			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.0f},
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f}}};
+	for (size_t i = 0; i < swapchain_.max_frames_in_flight_; i++)
+	{
+		frame_descriptor_allocators_.emplace_back(this, frame_descriptor_ratios);
+	}
 }
 VulkanContext::~VulkanContext()
 {
@@ -103,8 +112,8 @@ VulkanContext::~VulkanContext()
 	// Destroy semaphores
 	for (size_t i = 0; i < swapchain_.max_frames_in_flight_; i++)
 	{
-		vkDestroySemaphore(device_.logical_device_, image_avaliable_semaphores_[i], nullptr);
-		vkDestroySemaphore(device_.logical_device_, queue_complete_semaphores_[i], nullptr);
+		vkDestroySemaphore(device_.logical_device_, image_avaliable_semaphores_[i], vulkan_allocator());
+		vkDestroySemaphore(device_.logical_device_, queue_complete_semaphores_[i], vulkan_allocator());
 	}
 }
 
@@ -116,18 +125,54 @@ void VulkanContext::populate_imgui_init_info(ImGui_ImplVulkan_InitInfo &out_init
 	out_init_info.QueueFamily = device_.graphics_queue_index_;
 	out_init_info.Queue = device_.graphics_queue_;
 	out_init_info.PipelineCache = VK_NULL_HANDLE;
-	out_init_info.DescriptorPool = object_shader_.get_global_descriptor_pool().get();
+	out_init_info.DescriptorPool = imgui_descriptor_pool_.get();
 	out_init_info.Subpass = 0;
 	out_init_info.MinImageCount = swapchain_.get_image_count();
 	out_init_info.ImageCount = swapchain_.get_image_count();
 	out_init_info.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
-	out_init_info.Allocator = nullptr;
+	out_init_info.Allocator = vulkan_allocator();
 	out_init_info.CheckVkResultFn = nullptr;
 	out_init_info.RenderPass = get_main_render_pass();
+#ifdef IMGUI_IMPL_VULKAN_HAS_DYNAMIC_RENDERING
+	if (dynamic_rendering_)
+	{
+		// The formats are read when the pipeline is created, the swapchain format outlives it
+		out_init_info.UseDynamicRendering = true;
+		out_init_info.PipelineRenderingCreateInfo = {VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR};
+		out_init_info.PipelineRenderingCreateInfo.colorAttachmentCount = 1;
+		out_init_info.PipelineRenderingCreateInfo.pColorAttachmentFormats = &swapchain_.swapchain_image_format_.format;
+		out_init_info.PipelineRenderingCreateInfo.depthAttachmentFormat = device_.depth_format_;
+	}
+#endif
+}
+
+DescriptorAllocatorStatistics VulkanContext::frame_descriptor_statistics() const
+{
+	DescriptorAllocatorStatistics statistics{};
+	for (const VulkanDescriptorAllocator &allocator: frame_descriptor_allocators_)
+	{
+		statistics.pools += allocator.statistics().pools;
+		statistics.allocated_sets += allocator.statistics().allocated_sets;
+		statistics.pool_growths += allocator.statistics().pool_growths;
+	}
+	return statistics;
 }
 
 void VulkanContext::init_imgui()
 {
+	// The font atlas and any texture shown through ImGui::Image
+	VkDescriptorPoolSize pool_size{};
+	pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pool_size.descriptorCount = max_imgui_textures_;
+
+	VkDescriptorPoolCreateInfo pool_info{};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	pool_info.poolSizeCount = 1;
+	pool_info.pPoolSizes = &pool_size;
+	pool_info.maxSets = max_imgui_textures_;
+	imgui_descriptor_pool_ = VulkanDescriptorPool(this, pool_info);
+
 	imgui_instance_ = ImGuiInstance(this);
 }
 
@@ -158,29 +203,29 @@ void VulkanContext::create_command_buffers()
 	}
 }
 
-void VulkanContext::regenerate_framebuffers()
+bool VulkanContext::detect_dynamic_rendering() const
 {
-	swapchain_.frame_buffers_.clear();
-	
-	for (size_t i = 0; i < swapchain_.get_image_count(); i++)
+#ifdef IMGUI_IMPL_VULKAN_HAS_DYNAMIC_RENDERING
+	if (device_.is_extension_enabled(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME))
 	{
-		std::vector<VkImageView> attachments{swapchain_.swapchain_image_views_[i], swapchain_.depth_attachment_->view_};
-		swapchain_.frame_buffers_.emplace_back(
-			this,
-			main_renderpass_,
-			device_.swapchain_support_.capabilities.currentExtent.width,
-			device_.swapchain_support_.capabilities.currentExtent.height,
-			attachments);
+		FLOWFORGE_INFO("Using dynamic rendering");
+		return true;
 	}
+#endif
+	// Without the extension, or a UI backend that can draw without a render pass, fall back to render pass objects
+	FLOWFORGE_INFO("Using render pass objects");
+	return false;
 }
+
 void VulkanContext::resize_callback(void *context)
 {
 	auto* vulkan_context = reinterpret_cast<VulkanContext*>(context);
 
 	FLOWFORGE_TRACE("Resize callback beginning in vulkan context");
 
-	vulkan_context->swapchain_.recreate_swapchain();
-	vulkan_context->regenerate_framebuffers();
+	// Called from inside the event processing, possibly many times a frame while the window is dragged.
+	// The renderer recreates the swapchain once at the start of the next frame.
+	vulkan_context->swapchain_.request_recreation();
 }
 
 
@@ -207,8 +252,8 @@ VulkanInstance::VulkanInstance()
 	appInfo.pEngineName = "FlowForge";
 	// Specify the engine version
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-	// Specify the vulkan API version.
-	appInfo.apiVersion = VK_API_VERSION_1_0;
+	// Specify the vulkan API version. 1.1 makes the physical device properties 2 functions core, which optional device extensions depend on.
+	appInfo.apiVersion = VK_API_VERSION_1_1;
 
 	// Create the instance_ create info
 	VkInstanceCreateInfo createInfo{};
@@ -254,7 +299,7 @@ VulkanInstance::VulkanInstance()
 	}
 	
 	// Finally, create the instance_
-	if (vkCreateInstance(&createInfo, nullptr, &instance_) != VK_SUCCESS)
+	if (vkCreateInstance(&createInfo, vulkan_allocator(), &instance_) != VK_SUCCESS)
 	{
 		// If the instance failed to be created, throw a runtime error.
 		throw std::runtime_error("failed to create instance_!");
@@ -264,7 +309,7 @@ VulkanInstance::VulkanInstance()
 }
 VulkanInstance::~VulkanInstance()
 {
-	vkDestroyInstance(instance_, nullptr);
+	vkDestroyInstance(instance_, vulkan_allocator());
 	FLOWFORGE_INFO("Vulkan instance destroyed");
 }
 
@@ -405,7 +450,7 @@ VulkanDebugMessenger::VulkanDebugMessenger(const VulkanInstance& instance)
 	createInfo.pUserData = nullptr;  // Optional
 	
 	// Try to create the debug messenger. Throw a runtime error if it failed.
-	if (CreateDebugUtilsMessengerEXT(instance_, &createInfo, nullptr, &debug_messenger_) != VK_SUCCESS)
+	if (CreateDebugUtilsMessengerEXT(instance_, &createInfo, vulkan_allocator(), &debug_messenger_) != VK_SUCCESS)
 	{
 		FLOWFORGE_FATAL("Failed to set up debug messenger");
 		throw std::runtime_error("Failed to set up debug messenger!");
@@ -413,7 +458,7 @@ VulkanDebugMessenger::VulkanDebugMessenger(const VulkanInstance& instance)
 }
 VulkanDebugMessenger::~VulkanDebugMessenger()
 {
-	DestroyDebugUtilsMessengerEXT(instance_, debug_messenger_, nullptr);
+	DestroyDebugUtilsMessengerEXT(instance_, debug_messenger_, vulkan_allocator());
 	FLOWFORGE_INFO("Vulkan debug callback destroyed");
 }
 VulkanSurface::VulkanSurface(const VulkanInstance &instance, const Window &window)
@@ -422,7 +467,7 @@ VulkanSurface::VulkanSurface(const VulkanInstance &instance, const Window &windo
 }
 VulkanSurface::~VulkanSurface()
 {
-	vkDestroySurfaceKHR(instance_, surface_, nullptr);
+	vkDestroySurfaceKHR(instance_, surface_, vulkan_allocator());
 	FLOWFORGE_INFO("Vulkan surface destroyed");
 }
 
@@ -1,8 +1,11 @@
 #pragma once
 
+#include "allocation_callbacks.hpp"
 #include "buffer.hpp"
 #include "device.hpp"
+#include "geometry_pool.hpp"
 #include "imgui_instance.hpp"
+#include "instance_buffer.hpp"
 #include "render_pass.hpp"
 #include "shaders/object_shader.hpp"
 #include "shaders/vertex.hpp"
@@ -81,13 +84,22 @@ public:
 	inline VulkanCommandBuffer &get_command_buffer() { return graphics_command_buffers_[image_index_]; };
 	inline VulkanFence &get_current_frame_fence_in_flight() { return in_flight_fences_[current_frame_]; };
 	inline VulkanFence *get_image_index_frame_fence_in_flight() { return images_in_flight_[image_index_]; };
-	inline VkFramebuffer get_frame_buffer_handle() { return swapchain_.frame_buffers_[image_index_].get_handle(); };
 	inline const VulkanRenderpass &get_renderpass() { return main_renderpass_; };
 	inline const VulkanSwapchain &get_swapchain() { return swapchain_; };
+	inline VulkanGeometryPool &get_geometry_pool() { return geometry_pool_; };
+	inline VulkanInstanceBuffer &get_instance_buffer() { return instance_buffer_; };
+	inline VulkanDescriptorLayoutCache &get_descriptor_layout_cache() { return descriptor_layout_cache_; };
+	// Transient sets of the frame being recorded, reset once the frame's fence was waited on again
+	inline VulkanDescriptorAllocator &get_frame_descriptor_allocator() { return frame_descriptor_allocators_[current_frame_]; };
+	// Summed over the frames in flight
+	[[nodiscard]] DescriptorAllocatorStatistics frame_descriptor_statistics() const;
+	[[nodiscard]] inline uint32_t current_frame() const { return current_frame_; };
 	[[nodiscard]] inline float get_delta_time() const { return frame_delta_time_; };
 
 	void populate_imgui_init_info(ImGui_ImplVulkan_InitInfo &out_init_info);
 	[[nodiscard]] VkRenderPass get_main_render_pass() const { return main_renderpass_.get_handle(); };
+	// True when passes render straight into image views, without render pass and framebuffer objects
+	[[nodiscard]] inline bool uses_dynamic_rendering() const { return dynamic_rendering_; };
 
 	void init_imgui();
 	void set_default_diffuse_texture(VulkanTexture* new_default);
@@ -100,6 +112,9 @@ private:
 #else
 	static constexpr bool enable_validation_layers_ = true;
 #endif
+	static constexpr uint32_t max_instances_per_frame_ = 128 * 1024;
+	static constexpr uint32_t max_imgui_textures_ = 64;
+
 	Window &window_;
 	VulkanInstance instance_{};
 #ifndef NDEBUG
@@ -109,6 +124,8 @@ private:
 	
 	VulkanSurface surface_{instance_, window_};
 	VulkanDevice device_{this};
+	// Decided before any render pass or pipeline is created
+	bool dynamic_rendering_{detect_dynamic_rendering()};
 
 	VulkanSwapchain swapchain_{this};
 	VulkanRenderpass main_renderpass_{
@@ -117,17 +134,29 @@ private:
 			{0, 0, 0.2f, 1.0f},
 			1.0f,
 			0};
+	// The main pass split in two around the depth pyramid build, for occlusion culling
+	VulkanRenderpass early_renderpass_{
+			this,
+			{0, 0, window_.get_width(), window_.get_height()},
+			{0, 0, 0.2f, 1.0f},
+			1.0f,
+			0,
+			false,
+			true};
+	VulkanRenderpass late_renderpass_{
+			this,
+			{0, 0, window_.get_width(), window_.get_height()},
+			{0, 0, 0.2f, 1.0f},
+			1.0f,
+			0,
+			true,
+			false};
+
+	VulkanDescriptorLayoutCache descriptor_layout_cache_{this};
+	std::vector<VulkanDescriptorAllocator> frame_descriptor_allocators_{};
 
-	VulkanBuffer vertex_buffer_{this,
-								sizeof(Vertex3d) * 1024 * 1024,
-								static_cast<VkBufferUsageFlagBits>(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT),
-								VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-								false};
-	VulkanBuffer index_buffer_{this,
-							   sizeof(uint32_t) * 1024 * 1024,
-							   static_cast<VkBufferUsageFlagBits>(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT),
-							   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-							   false};
+	VulkanGeometryPool geometry_pool_{this};
+	VulkanInstanceBuffer instance_buffer_{this, swapchain_.get_max_frames_in_flight(), max_instances_per_frame_};
 
 	std::vector<VulkanCommandBuffer> graphics_command_buffers_{};
 
@@ -142,12 +171,14 @@ private:
 
 	VulkanObjectShader object_shader_{};
 
+	// ImGui frees its sets one by one, it gets a pool of its own
+	VulkanDescriptorPool imgui_descriptor_pool_{};
 	ImGuiInstance imgui_instance_{};
 
 	///// Private methods
 
 	void create_command_buffers();
-	void regenerate_framebuffers();
+	[[nodiscard]] bool detect_dynamic_rendering() const;
 
 	// Friend classes
 	friend VulkanDevice;
@@ -16,7 +16,7 @@ VulkanFence::VulkanFence(VulkanContext *context, bool signaled)
 	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 	fence_info.flags = signaled_ ? VK_FENCE_CREATE_SIGNALED_BIT : 0;
 
-	if (vkCreateFence(context_->device_.logical_device_, &fence_info, nullptr, &handle_) != VK_SUCCESS)
+	if (vkCreateFence(context_->device_.logical_device_, &fence_info, vulkan_allocator(), &handle_) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create fence");
 	}
@@ -37,7 +37,7 @@ VulkanFence::~VulkanFence()
 {
 	if (handle_ != VK_NULL_HANDLE)
 	{
-		vkDestroyFence(context_->device_.logical_device_, handle_, nullptr);
+		vkDestroyFence(context_->device_.logical_device_, handle_, vulkan_allocator());
 		FLOWFORGE_TRACE("Fence destroyed");
 	}
 }
@@ -2,6 +2,8 @@
 
 #include "window.hpp"
 
+#include "allocation_callbacks.hpp"
+
 #include <GL/gl.h>
 
 
@@ -15,6 +17,14 @@ Window::Window(size_t w, size_t h, const std::string& name)
 	window_ = glfwCreateWindow(static_cast<int>(w), static_cast<int>(h), name.c_str(), nullptr, nullptr);
 	glfwSetWindowUserPointer(window_, this);
 	glfwSetFramebufferSizeCallback(window_, framebuffer_resize_callback);
+	glfwSetKeyCallback(window_, key_callback);
+	glfwSetCharCallback(window_, char_callback);
+	glfwSetMouseButtonCallback(window_, mouse_button_callback);
+	glfwSetCursorPosCallback(window_, cursor_position_callback);
+	glfwSetCursorEnterCallback(window_, cursor_enter_callback);
+	glfwSetScrollCallback(window_, scroll_callback);
+	glfwSetWindowFocusCallback(window_, focus_callback);
+	glfwSetWindowRefreshCallback(window_, refresh_callback);
 	
 	if (!glfwVulkanSupported())
 	{
@@ -33,7 +43,7 @@ VkSurfaceKHR Window::create_window_surface(VkInstance instance) const
 {
 	VkSurfaceKHR surface;
 	
-	if (glfwCreateWindowSurface(instance, window_, nullptr, &surface) != VK_SUCCESS)
+	if (glfwCreateWindowSurface(instance, window_, vulkan_allocator(), &surface) != VK_SUCCESS)
 	{
 		throw std::runtime_error("Failed to create window surface! ");
 	}
@@ -46,6 +56,7 @@ void Window::framebuffer_resize_callback(GLFWwindow *window, int width, int heig
 	auto vulkanWindow = reinterpret_cast<Window*>(glfwGetWindowUserPointer(window));
 	
 	vulkanWindow->frame_buffer_resized_ = true;
+	vulkanWindow->event_count_++;
 	vulkanWindow->frame_buffer_width_ = width;
 	vulkanWindow->frame_buffer_height_ = height;
 
@@ -53,4 +64,50 @@ void Window::framebuffer_resize_callback(GLFWwindow *window, int width, int heig
 		vulkanWindow->resize_callback_(vulkanWindow->callback_param_ptr_);
 }
 
+void Window::key_callback(GLFWwindow *window, int, int, int, int)
+{
+	count_event(window);
+}
+
+void Window::char_callback(GLFWwindow *window, unsigned int)
+{
+	count_event(window);
+}
+
+void Window::mouse_button_callback(GLFWwindow *window, int, int, int)
+{
+	count_event(window);
+}
+
+void Window::cursor_position_callback(GLFWwindow *window, double, double)
+{
+	count_event(window);
+}
+
+void Window::cursor_enter_callback(GLFWwindow *window, int)
+{
+	count_event(window);
+}
+
+void Window::scroll_callback(GLFWwindow *window, double, double)
+{
+	count_event(window);
+}
+
+void Window::focus_callback(GLFWwindow *window, int)
+{
+	count_event(window);
+}
+
+void Window::refresh_callback(GLFWwindow *window)
+{
+	// The window was uncovered or damaged, its contents have to be drawn again
+	count_event(window);
+}
+
+void Window::count_event(GLFWwindow *window)
+{
+	reinterpret_cast<Window *>(glfwGetWindowUserPointer(window))->event_count_++;
+}
+
 } // flwfrg
\ No newline at end of file
@@ -29,6 +29,8 @@ public:
 	[[nodiscard]] inline VkExtent2D get_extent() const { return {frame_buffer_width_, frame_buffer_height_}; };
 	[[nodiscard]] inline bool was_window_resized() const { return frame_buffer_resized_; };
 	inline void reset_window_resized_flag() { frame_buffer_resized_ = false; };
+	// Counts input, resize, focus and refresh events, a change means the window has to be redrawn
+	[[nodiscard]] inline uint64_t get_event_count() const { return event_count_; };
 	[[nodiscard]] inline GLFWwindow *get_glfw_window_ptr() const
 	{
 		return window_;
@@ -48,12 +50,24 @@ private:
 
 	uint32_t frame_buffer_width_, frame_buffer_height_;
 	bool frame_buffer_resized_ = false;
+	uint64_t event_count_ = 0;
 
 	std::function<void(void *)> resize_callback_ = nullptr;
 	void *callback_param_ptr_ = nullptr;
 
 	// Frame buffer resize method
 	static void framebuffer_resize_callback(GLFWwindow *window, int width, int height);
+
+	// Installed before ImGui, which chains to them
+	static void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
+	static void char_callback(GLFWwindow *window, unsigned int codepoint);
+	static void mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
+	static void cursor_position_callback(GLFWwindow *window, double x, double y);
+	static void cursor_enter_callback(GLFWwindow *window, int entered);
+	static void scroll_callback(GLFWwindow *window, double x_offset, double y_offset);
+	static void focus_callback(GLFWwindow *window, int focused);
+	static void refresh_callback(GLFWwindow *window);
+	static void count_event(GLFWwindow *window);
 };
 
 }// namespace flwfrg
@@ -0,0 +1,297 @@
+#include "pch.hpp"
+
+#include "renderer/mesh/mesh_asset.hpp"
+#include "renderer/mesh/mesh_optimizer.hpp"
+#include "renderer/mesh/mesh_simplifier.hpp"
+
+#include <charconv>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// FlowForgeMeshCook <source.obj> <output.mesh> welds and optimizes a source mesh, generates its detail levels
+// and writes it as a cooked mesh asset.
+// FlowForgeMeshCook --check optimizes a row major grid and fails unless the vertex cache miss ratio dropped,
+// then simplifies an unwelded grid with a texture seam and fails unless it got detail levels that keep the seam,
+// and finally packs a grid into compact vertices and fails unless they decode back to it.
+
+namespace
+{
+
+using namespace flwfrg;
+
+///// Local helper functions
+
+// OBJ indices are one based, negative ones count back from the last element read so far
+std::optional<size_t> resolve_index(std::string_view token, size_t element_count)
+{
+	int64_t index = 0;
+	const auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), index);
+	if (error != std::errc{} || index == 0)
+		return std::nullopt;
+
+	const int64_t resolved = index > 0 ? index - 1 : static_cast<int64_t>(element_count) + index;
+	if (resolved < 0 || resolved >= static_cast<int64_t>(element_count))
+		return std::nullopt;
+	return static_cast<size_t>(resolved);
+}
+
+// Reads positions, texture coordinates and faces. Polygons are triangulated as fans and every corner becomes
+// its own vertex, welding merges the shared ones afterwards.
+std::optional<MeshData> read_obj(const std::string &path)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+	{
+		FLOWFORGE_ERROR("Failed to open {}", path);
+		return std::nullopt;
+	}
+
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> texture_coordinates;
+	MeshData mesh{};
+
+	std::string line;
+	std::vector<Vertex3d> face;
+	for (size_t line_number = 1; std::getline(file, line); line_number++)
+	{
+		std::istringstream stream(line);
+		std::string type;
+		stream >> type;
+
+		if (type == "v")
+		{
+			glm::vec3 &position = positions.emplace_back(0.0f);
+			stream >> position.x >> position.y >> position.z;
+		} else if (type == "vt")
+		{
+			glm::vec2 &texture_coordinate = texture_coordinates.emplace_back(0.0f);
+			stream >> texture_coordinate.x >> texture_coordinate.y;
+			// OBJ puts the origin at the bottom left, images are loaded top row first
+			texture_coordinate.y = 1.0f - texture_coordinate.y;
+		} else if (type == "f")
+		{
+			face.clear();
+			std::string corner;
+			while (stream >> corner)
+			{
+				// position[/texture_coordinate[/normal]]
+				const std::string_view view{corner};
+				const size_t slash = view.find('/');
+				const std::optional<size_t> position = resolve_index(view.substr(0, slash), positions.size());
+				if (!position)
+				{
+					FLOWFORGE_ERROR("{}:{}: invalid position index '{}'", path, line_number, corner);
+					return std::nullopt;
+				}
+
+				Vertex3d &vertex = face.emplace_back();
+				vertex.position = positions[*position];
+
+				if (slash != std::string_view::npos)
+				{
+					const std::string_view rest = view.substr(slash + 1);
+					const std::string_view texture_token = rest.substr(0, rest.find('/'));
+					if (!texture_token.empty())
+					{
+						const std::optional<size_t> texture_coordinate = resolve_index(texture_token, texture_coordinates.size());
+						if (!texture_coordinate)
+						{
+							FLOWFORGE_ERROR("{}:{}: invalid texture coordinate index '{}'", path, line_number, corner);
+							return std::nullopt;
+						}
+						vertex.texture_coordiante = texture_coordinates[*texture_coordinate];
+					}
+				}
+			}
+
+			const auto first = static_cast<uint32_t>(mesh.vertices.size());
+			mesh.vertices.insert(mesh.vertices.end(), face.begin(), face.end());
+			for (uint32_t i = 2; i < face.size(); i++)
+			{
+				mesh.indices.insert(mesh.indices.end(), {first, first + i - 1, first + i});
+			}
+		}
+	}
+
+	if (mesh.indices.empty())
+	{
+		FLOWFORGE_ERROR("{} has no faces", path);
+		return std::nullopt;
+	}
+	return mesh;
+}
+
+// Quads of a size by size grid, emitted row by row. Rows are longer than the cache,
+// so only the vertices shared with the previous quad are hits.
+// Faceted grids give every quad its own copies of its corners, like an unwelded flat shaded export.
+// Quads from the seam column on have their texture coordinates shifted by one, a second island.
+MeshData make_grid(uint32_t size, bool faceted = false, uint32_t seam_column = std::numeric_limits<uint32_t>::max())
+{
+	MeshData mesh{};
+
+	// Shared vertex of every corner and island
+	std::vector<uint32_t> shared((size + 1) * (size + 1) * 2, std::numeric_limits<uint32_t>::max());
+	const auto vertex = [&](uint32_t x, uint32_t y, uint32_t island) {
+		uint32_t &index = shared[(y * (size + 1) + x) * 2 + island];
+		if (faceted || index == std::numeric_limits<uint32_t>::max())
+		{
+			index = static_cast<uint32_t>(mesh.vertices.size());
+			const glm::vec2 coordinate = glm::vec2(x, y) / static_cast<float>(size);
+			mesh.vertices.push_back({glm::vec3(coordinate.x, 0.0f, coordinate.y), coordinate + glm::vec2(static_cast<float>(island), 0.0f)});
+		}
+		return index;
+	};
+
+	for (uint32_t y = 0; y < size; y++)
+	{
+		for (uint32_t x = 0; x < size; x++)
+		{
+			const uint32_t island = x >= seam_column ? 1 : 0;
+			const uint32_t top_left = vertex(x, y, island);
+			const uint32_t bottom_left = vertex(x, y + 1, island);
+			const uint32_t top_right = vertex(x + 1, y, island);
+			const uint32_t bottom_right = vertex(x + 1, y + 1, island);
+			mesh.indices.insert(mesh.indices.end(), {top_left, bottom_left, top_right, top_right, bottom_left, bottom_right});
+		}
+	}
+	return mesh;
+}
+
+bool cook(const std::string &source_path, const std::string &output_path)
+{
+	std::optional<MeshData> mesh = read_obj(source_path);
+	if (!mesh)
+		return false;
+
+	MeshOptimizer{}.optimize(*mesh);
+
+	// The levels are appended after the full detail indices
+	const auto index_count = static_cast<uint32_t>(mesh->indices.size());
+	std::vector<MeshLod> lods = MeshSimplifier{}.generate_lods(*mesh, 0, index_count);
+
+	const MeshAssetSource source{&*mesh, {}, {std::move(lods)}};
+	const std::string materials[] = {"default"};
+	if (!write_mesh_asset(output_path, {&source, 1}, materials))
+	{
+		FLOWFORGE_ERROR("Failed to write {}", output_path);
+		return false;
+	}
+
+	FLOWFORGE_INFO("Cooked {} into {}", source_path, output_path);
+	return true;
+}
+
+bool check_vertex_cache()
+{
+	MeshData grid = make_grid(64);
+	const size_t triangle_count = grid.triangle_count();
+
+	const MeshOptimizationReport report = MeshOptimizer{}.optimize(grid);
+	if (grid.triangle_count() != triangle_count || report.vertex_count_after != report.vertex_count_before)
+	{
+		FLOWFORGE_ERROR("Optimizing the grid changed its topology");
+		return false;
+	}
+	if (report.after.acmr >= report.before.acmr)
+	{
+		FLOWFORGE_ERROR("Optimizing the grid did not lower its ACMR: {:.3f} -> {:.3f}", report.before.acmr, report.after.acmr);
+		return false;
+	}
+
+	FLOWFORGE_INFO("Grid ACMR {:.3f} -> {:.3f}", report.before.acmr, report.after.acmr);
+	return true;
+}
+
+bool check_detail_levels()
+{
+	MeshData grid = make_grid(32, true, 16);
+	const auto index_count = static_cast<uint32_t>(grid.indices.size());
+
+	const std::vector<MeshLod> lods = MeshSimplifier{}.generate_lods(grid, 0, index_count);
+	if (lods.empty())
+	{
+		FLOWFORGE_ERROR("Simplifying the faceted grid generated no detail levels");
+		return false;
+	}
+
+	// Collapses across the seam would stretch a triangle over both islands
+	for (const MeshLod &lod: lods)
+	{
+		for (uint32_t i = lod.first_index; i < lod.first_index + lod.index_count; i += 3)
+		{
+			const bool island = grid.vertices[grid.indices[i]].texture_coordiante.x > 1.0f;
+			if ((grid.vertices[grid.indices[i + 1]].texture_coordiante.x > 1.0f) != island ||
+				(grid.vertices[grid.indices[i + 2]].texture_coordiante.x > 1.0f) != island)
+			{
+				FLOWFORGE_ERROR("A detail level of the faceted grid crosses its texture seam");
+				return false;
+			}
+		}
+	}
+
+	FLOWFORGE_INFO("Faceted grid: {} detail levels, {} -> {} triangles", lods.size(), index_count / 3, lods.back().index_count / 3);
+	return true;
+}
+
+bool check_compact_vertices()
+{
+	const MeshData grid = make_grid(16);
+	const VertexQuantization quantization = grid.compute_bounds().quantization();
+	const std::vector<CompactVertex3d> compact = grid.compact_vertices();
+
+	// Half a step of the 16 bit encodings, with some slack for the float math
+	const float position_tolerance = quantization.scale / 32767.0f;
+	const float texture_tolerance = 1.0f / 65535.0f;
+	for (size_t i = 0; i < compact.size(); i++)
+	{
+		const CompactVertex3d &vertex = compact[i];
+		const glm::vec3 normalized{glm::unpackSnorm1x16(vertex.position.value[0]), glm::unpackSnorm1x16(vertex.position.value[1]), glm::unpackSnorm1x16(vertex.position.value[2])};
+		const glm::vec2 texture_coordinate{glm::unpackUnorm1x16(vertex.texture_coordinate.value[0]), glm::unpackUnorm1x16(vertex.texture_coordinate.value[1])};
+		const glm::vec3 normal = octahedral_decode({glm::unpackSnorm1x16(vertex.normal.value[0]), glm::unpackSnorm1x16(vertex.normal.value[1])});
+
+		const glm::vec3 position_error = glm::abs(quantization.dequantize(normalized) - grid.vertices[i].position);
+		const glm::vec2 texture_error = glm::abs(texture_coordinate - grid.vertices[i].texture_coordiante);
+		if (glm::max(position_error.x, glm::max(position_error.y, position_error.z)) > position_tolerance ||
+			glm::max(texture_error.x, texture_error.y) > texture_tolerance)
+		{
+			FLOWFORGE_ERROR("Compact vertex {} of the grid does not round trip", i);
+			return false;
+		}
+		// The grid lies in the xz plane, facing up
+		if (glm::dot(normal, glm::vec3(0.0f, 1.0f, 0.0f)) < 0.999f)
+		{
+			FLOWFORGE_ERROR("Compact vertex {} of the grid has a wrong normal", i);
+			return false;
+		}
+	}
+
+	FLOWFORGE_INFO("Compact grid: {} vertices, {} -> {} bytes", compact.size(), grid.vertices.size() * sizeof(Vertex3d), compact.size() * sizeof(CompactVertex3d));
+	return true;
+}
+
+bool run_check()
+{
+	return check_vertex_cache() && check_detail_levels() && check_compact_vertices();
+}
+
+}// namespace
+
+int main(int argc, char **argv)
+{
+	flwfrg::Logger::init();
+
+	if (argc == 2 && std::string_view{argv[1]} == "--check")
+		return run_check() ? 0 : 1;
+
+	if (argc != 3)
+	{
+		FLOWFORGE_ERROR("Usage: {} <source.obj> <output.mesh> | --check", argv[0]);
+		return 1;
+	}
+	return cook(argv[1], argv[2]) ? 0 : 1;
+}